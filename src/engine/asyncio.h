@@ -0,0 +1,64 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_ASYNCIO_H
+#define ENGINE_ASYNCIO_H
+
+#include "kernel.h"
+
+// sequential reader that keeps the next block of a file loaded in the background
+class IAsyncFileReader
+{
+public:
+	virtual ~IAsyncFileReader() {}
+
+	virtual unsigned Read(void *pBuffer, unsigned Size) = 0;
+	virtual unsigned Skip(long Size) = 0;
+	virtual int Seek(long Offset, int Origin) = 0;
+	virtual long Tell() = 0;
+	virtual long Length() = 0;
+};
+
+class IAsyncIO : public IInterface
+{
+	MACRO_INTERFACE("asyncio", 0)
+public:
+	enum
+	{
+		PRIORITY_LOW=0,
+		PRIORITY_NORMAL,
+		PRIORITY_HIGH,
+		NUM_PRIORITIES,
+
+		INVALID_REQUEST=-1,
+	};
+
+	/*
+		Result is 0 on success. pData is owned by the service and is only
+		valid during the callback, which is always called from Update().
+	*/
+	typedef void (*FCompletionCallback)(int RequestID, int Result, const void *pData, unsigned DataSize, void *pUser);
+
+	virtual int ReadFile(const char *pFilename, int StorageType, int Priority, FCompletionCallback pfnCallback, void *pUser) = 0;
+	virtual int WriteFile(const char *pFilename, int StorageType, const void *pData, unsigned DataSize, int Priority, FCompletionCallback pfnCallback, void *pUser) = 0;
+	virtual bool Cancel(int RequestID) = 0;
+	virtual int NumPending() = 0;
+
+	// dispatches finished requests, call this from the main loop
+	virtual void Update() = 0;
+
+	// takes ownership of the file handle
+	virtual IAsyncFileReader *OpenReader(IOHANDLE File, int Priority) = 0;
+	virtual void CloseReader(IAsyncFileReader *pReader) = 0;
+};
+
+class IEngineAsyncIO : public IAsyncIO
+{
+	MACRO_INTERFACE("engineasyncio", 0)
+public:
+	virtual void Init() = 0;
+	virtual void Shutdown() = 0;
+};
+
+extern IEngineAsyncIO *CreateEngineAsyncIO();
+
+#endif
@@ -109,6 +109,11 @@ public:
 	virtual int MapDownloadTotalsize() const = 0;
 
 	// input
+	enum
+	{
+		MAX_INPUTS=200
+	};
+
 	virtual const int *GetInput(int Tick) const = 0;
 
 	// remote console
@@ -174,7 +179,12 @@ public:
 	virtual void OnRender() = 0;
 	virtual void OnUpdate() = 0;
 	virtual void OnStateChange(int NewState, int OldState) = 0;
-	virtual void OnConnected() = 0;
+	// demos need the map right away, a connecting client loads it over several updates
+	virtual void OnConnected(bool LoadMapNow) = 0;
+	// the map is about to be unloaded or replaced
+	virtual void OnMapUnload() = 0;
+	// the frames of a benchmark are summed up and reported once it isn't running anymore
+	virtual void OnBenchmark(bool Running) = 0;
 	virtual void OnMessage(int MsgID, CUnpacker *pUnpacker) = 0;
 	virtual void OnPredict() = 0;
 	virtual void OnActivateEditor() = 0;
@@ -0,0 +1,136 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/tl/threading.h>
+
+#include "backend_null.h"
+
+CGraphicsBackend_Null::CGraphicsBackend_Null()
+{
+	m_ScreenWidth = 0;
+	m_ScreenHeight = 0;
+	m_Completed = 0;
+	m_TextureMemoryUsage = 0;
+	mem_zero(m_aTextureMemory, sizeof(m_aTextureMemory));
+	mem_zero(&m_Stats, sizeof(m_Stats));
+}
+
+int CGraphicsBackend_Null::Init(const char *pName, int *pScreen, int *pWindowWidth, int *pWindowHeight, int *pScreenWidth, int *pScreenHeight, int FsaaSamples, int Flags, int *pDesktopWidth, int *pDesktopHeight)
+{
+	// keep the requested size, the layout of the ui depends on it
+	if(*pWindowWidth <= 0 || *pWindowHeight <= 0)
+	{
+		*pWindowWidth = 1280;
+		*pWindowHeight = 720;
+	}
+	*pScreen = 0;
+	*pScreenWidth = m_ScreenWidth = *pWindowWidth;
+	*pScreenHeight = m_ScreenHeight = *pWindowHeight;
+	*pDesktopWidth = *pWindowWidth;
+	*pDesktopHeight = *pWindowHeight;
+	return 0;
+}
+
+int CGraphicsBackend_Null::Shutdown()
+{
+	int Frames = max((int)m_Stats.m_Swaps, 1);
+	dbg_msg("gfx", "null backend ran %d frames, per frame: %d buffers, %d commands, %d draws, %d primitives, %d texture uploads",
+		(int)m_Stats.m_Swaps, (int)(m_Stats.m_Buffers/Frames), (int)(m_Stats.m_Commands/Frames), (int)(m_Stats.m_RenderCommands/Frames),
+		(int)(m_Stats.m_Primitives/Frames), (int)(m_Stats.m_TextureUploads/Frames));
+	return 0;
+}
+
+bool CGraphicsBackend_Null::GetDesktopResolution(int Index, int *pDesktopWidth, int* pDesktopHeight)
+{
+	*pDesktopWidth = m_ScreenWidth;
+	*pDesktopHeight = m_ScreenHeight;
+	return Index == 0;
+}
+
+void CGraphicsBackend_Null::RunCommand(const CCommandBuffer::CCommand *pBaseCommand)
+{
+	m_Stats.m_Commands++;
+	switch(pBaseCommand->m_Cmd)
+	{
+	case CCommandBuffer::CMD_SIGNAL:
+		static_cast<const CCommandBuffer::CSignalCommand *>(pBaseCommand)->m_pSemaphore->signal();
+		break;
+	case CCommandBuffer::CMD_RUNBUFFER:
+		RunBuffer(static_cast<const CCommandBuffer::CRunBufferCommand *>(pBaseCommand)->m_pOtherBuffer);
+		break;
+	case CCommandBuffer::CMD_TEXTURE_CREATE:
+		{
+			const CCommandBuffer::CTextureCreateCommand *pCommand = static_cast<const CCommandBuffer::CTextureCreateCommand *>(pBaseCommand);
+			m_TextureMemoryUsage -= m_aTextureMemory[pCommand->m_Slot];
+			m_aTextureMemory[pCommand->m_Slot] = pCommand->m_Width*pCommand->m_Height*pCommand->m_PixelSize;
+			m_TextureMemoryUsage += m_aTextureMemory[pCommand->m_Slot];
+			m_Stats.m_TextureUploads++;
+			mem_free(pCommand->m_pData);
+		}
+		break;
+	case CCommandBuffer::CMD_TEXTURE_UPDATE:
+		m_Stats.m_TextureUploads++;
+		mem_free(static_cast<const CCommandBuffer::CTextureUpdateCommand *>(pBaseCommand)->m_pData);
+		break;
+	case CCommandBuffer::CMD_TEXTURE_DESTROY:
+		{
+			int Slot = static_cast<const CCommandBuffer::CTextureDestroyCommand *>(pBaseCommand)->m_Slot;
+			m_TextureMemoryUsage -= m_aTextureMemory[Slot];
+			m_aTextureMemory[Slot] = 0;
+		}
+		break;
+	case CCommandBuffer::CMD_BUFFER_CREATE:
+		mem_free(static_cast<const CCommandBuffer::CBufferCreateCommand *>(pBaseCommand)->m_pVertices);
+		break;
+	case CCommandBuffer::CMD_RENDER:
+		m_Stats.m_RenderCommands++;
+		m_Stats.m_Primitives += static_cast<const CCommandBuffer::CRenderCommand *>(pBaseCommand)->m_PrimCount;
+		break;
+	case CCommandBuffer::CMD_RENDER_BUFFER:
+		{
+			const CCommandBuffer::CRenderBufferCommand *pCommand = static_cast<const CCommandBuffer::CRenderBufferCommand *>(pBaseCommand);
+			m_Stats.m_RenderCommands++;
+			for(unsigned i = 0; i < pCommand->m_NumRanges; i++)
+				m_Stats.m_Primitives += pCommand->m_pRanges[i].m_Count;
+		}
+		break;
+	case CCommandBuffer::CMD_SWAP:
+		m_Stats.m_Swaps++;
+		break;
+	case CCommandBuffer::CMD_VSYNC:
+		*static_cast<const CCommandBuffer::CVSyncCommand *>(pBaseCommand)->m_pRetOk = true;
+		break;
+	case CCommandBuffer::CMD_SCREENSHOT:
+		{
+			// a black image, the one who added the command frees it
+			const CCommandBuffer::CScreenshotCommand *pCommand = static_cast<const CCommandBuffer::CScreenshotCommand *>(pBaseCommand);
+			int w = pCommand->m_W == -1 ? m_ScreenWidth : pCommand->m_W;
+			int h = pCommand->m_H == -1 ? m_ScreenHeight : pCommand->m_H;
+			pCommand->m_pImage->m_Width = w;
+			pCommand->m_pImage->m_Height = h;
+			pCommand->m_pImage->m_Format = CImageInfo::FORMAT_RGB;
+			pCommand->m_pImage->m_pData = mem_alloc(w*h*3, 1);
+			mem_zero(pCommand->m_pImage->m_pData, w*h*3);
+		}
+		break;
+	case CCommandBuffer::CMD_VIDEOMODES:
+		*static_cast<const CCommandBuffer::CVideoModesCommand *>(pBaseCommand)->m_pNumModes = 0;
+		break;
+	}
+}
+
+unsigned CGraphicsBackend_Null::RunBuffer(CCommandBuffer *pBuffer)
+{
+	m_Stats.m_Buffers++;
+	unsigned CommandIndex = 0;
+	while(1)
+	{
+		const CCommandBuffer::CCommand *pCommand = pBuffer->GetCommand(&CommandIndex);
+		if(pCommand == 0x0)
+			break;
+		RunCommand(pCommand);
+	}
+	return ++m_Completed;
+}
+
+IGraphicsBackend *CreateGraphicsBackendNull() { return new CGraphicsBackend_Null; }
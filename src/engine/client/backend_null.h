@@ -0,0 +1,69 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_CLIENT_BACKEND_NULL_H
+#define ENGINE_CLIENT_BACKEND_NULL_H
+
+#include "graphics_threaded.h"
+
+/*
+	Consumes the command buffers right away without a window or a GPU.
+	Nothing is drawn, but the work is counted, so the client can be
+	benchmarked on machines without a display. Everything handed over
+	by the commands is freed like the real backend does.
+*/
+class CGraphicsBackend_Null : public IGraphicsBackend
+{
+public:
+	struct CStats
+	{
+		int64 m_Buffers;
+		int64 m_Commands;
+		int64 m_RenderCommands;
+		int64 m_Primitives;
+		int64 m_TextureUploads;
+		int64 m_Swaps;
+	};
+
+private:
+	int m_ScreenWidth;
+	int m_ScreenHeight;
+	unsigned m_Completed;
+	int m_TextureMemoryUsage;
+	int m_aTextureMemory[CCommandBuffer::MAX_TEXTURES];
+	CStats m_Stats;
+
+	void RunCommand(const CCommandBuffer::CCommand *pBaseCommand);
+
+public:
+	CGraphicsBackend_Null();
+
+	virtual int Init(const char *pName, int *pScreen, int *pWindowWidth, int *pWindowHeight, int *pScreenWidth, int *pScreenHeight, int FsaaSamples, int Flags, int *pDesktopWidth, int *pDesktopHeight);
+	virtual int Shutdown();
+
+	virtual int MemoryUsage() const { return m_TextureMemoryUsage; }
+	virtual int GetTextureArraySize() const { return 1; }
+	virtual bool BuffersSupported() const { return true; }
+
+	virtual int GetNumScreens() const { return 1; }
+
+	virtual void Minimize() {}
+	virtual void Maximize() {}
+	virtual bool Fullscreen(bool State) { return false; }
+	virtual void SetWindowBordered(bool State) {}
+	virtual bool SetWindowScreen(int Index) { return Index == 0; }
+	virtual bool GetDesktopResolution(int Index, int *pDesktopWidth, int* pDesktopHeight);
+	virtual int GetWindowScreen() { return 0; }
+	virtual int WindowActive() { return 1; }
+	virtual int WindowOpen() { return 1; }
+
+	// the buffers are done once they are handed over
+	virtual unsigned RunBuffer(CCommandBuffer *pBuffer);
+	virtual bool IsFenceDone(unsigned Fence) const { return true; }
+	virtual void WaitForFence(unsigned Fence) {}
+	virtual bool IsIdle() const { return true; }
+	virtual void WaitForIdle() {}
+
+	const CStats &Stats() const { return m_Stats; }
+};
+
+#endif
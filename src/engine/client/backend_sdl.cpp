@@ -29,14 +29,15 @@ void CGraphicsBackend_Threaded::ThreadFunc(void *pUser)
 	while(!pThis->m_Shutdown)
 	{
 		pThis->m_Activity.wait();
-		if(pThis->m_pBuffer)
+		while(pThis->m_Completed != pThis->m_Submitted)
 		{
 			#ifdef CONF_PLATFORM_MACOSX
 				CAutoreleasePool AutoreleasePool;
 			#endif
-			pThis->m_pProcessor->RunBuffer(pThis->m_pBuffer);
 			sync_barrier();
-			pThis->m_pBuffer = 0x0;
+			pThis->m_pProcessor->RunBuffer(pThis->m_apQueue[pThis->m_Completed%MAX_QUEUED_BUFFERS]);
+			sync_barrier();
+			pThis->m_Completed++;
 			pThis->m_BufferDone.signal();
 		}
 	}
@@ -44,7 +45,10 @@ void CGraphicsBackend_Threaded::ThreadFunc(void *pUser)
 
 CGraphicsBackend_Threaded::CGraphicsBackend_Threaded()
 {
-	m_pBuffer = 0x0;
+	for(int i = 0; i < MAX_QUEUED_BUFFERS; i++)
+		m_apQueue[i] = 0x0;
+	m_Submitted = 0;
+	m_Completed = 0;
 	m_pProcessor = 0x0;
 	m_pThread = 0x0;
 }
@@ -65,22 +69,36 @@ void CGraphicsBackend_Threaded::StopProcessor()
 	thread_destroy(m_pThread);
 }
 
-void CGraphicsBackend_Threaded::RunBuffer(CCommandBuffer *pBuffer)
+unsigned CGraphicsBackend_Threaded::RunBuffer(CCommandBuffer *pBuffer)
 {
-	WaitForIdle();
-	m_pBuffer = pBuffer;
+	WaitForFence(m_Submitted-MAX_QUEUED_BUFFERS+1);
+	m_apQueue[m_Submitted%MAX_QUEUED_BUFFERS] = pBuffer;
+	sync_barrier();
+	m_Submitted++;
 	m_Activity.signal();
+	return m_Submitted;
+}
+
+bool CGraphicsBackend_Threaded::IsFenceDone(unsigned Fence) const
+{
+	// the counters may wrap around
+	return (int)(m_Completed-Fence) >= 0;
+}
+
+void CGraphicsBackend_Threaded::WaitForFence(unsigned Fence)
+{
+	while(!IsFenceDone(Fence))
+		m_BufferDone.wait();
 }
 
 bool CGraphicsBackend_Threaded::IsIdle() const
 {
-	return m_pBuffer == 0x0;
+	return m_Completed == m_Submitted;
 }
 
 void CGraphicsBackend_Threaded::WaitForIdle()
 {
-	while(m_pBuffer != 0x0)
-		m_BufferDone.wait();
+	WaitForFence(m_Submitted);
 }
 
 
@@ -255,6 +273,14 @@ void CCommandProcessorFragment_OpenGL::Cmd_Init(const CInitCommand *pCommand)
 		dbg_msg("render", "*** warning *** max 3D texture size is too low - using the fallback system");
 	m_TextureArraySize = IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION / min(m_Max3DTexSize, IGraphics::NUMTILES_DIMENSION * IGraphics::NUMTILES_DIMENSION);
 	*pCommand->m_pTextureArraySize = m_TextureArraySize;
+
+	m_pfnGenBuffers = (PFNGLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffers");
+	m_pfnDeleteBuffers = (PFNGLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffers");
+	m_pfnBindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+	m_pfnBufferData = (PFNGLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferData");
+	*pCommand->m_pBuffersSupported = m_pfnGenBuffers && m_pfnDeleteBuffers && m_pfnBindBuffer && m_pfnBufferData;
+	if(!*pCommand->m_pBuffersSupported)
+		dbg_msg("render", "vertex buffers not supported - static map layers are drawn per frame");
 }
 
 void CCommandProcessorFragment_OpenGL::Cmd_Texture_Update(const CCommandBuffer::CTextureUpdateCommand *pCommand)
@@ -466,6 +492,48 @@ void CCommandProcessorFragment_OpenGL::Cmd_Render(const CCommandBuffer::CRenderC
 	};
 }
 
+void CCommandProcessorFragment_OpenGL::Cmd_Buffer_Create(const CCommandBuffer::CBufferCreateCommand *pCommand)
+{
+	m_pfnGenBuffers(1, &m_aBuffers[pCommand->m_Slot]);
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_aBuffers[pCommand->m_Slot]);
+	m_pfnBufferData(GL_ARRAY_BUFFER, sizeof(CCommandBuffer::CVertex)*pCommand->m_NumVertices, pCommand->m_pVertices, GL_STATIC_DRAW);
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, 0);
+	mem_free(pCommand->m_pVertices);
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_Buffer_Destroy(const CCommandBuffer::CBufferDestroyCommand *pCommand)
+{
+	m_pfnDeleteBuffers(1, &m_aBuffers[pCommand->m_Slot]);
+	m_aBuffers[pCommand->m_Slot] = 0;
+}
+
+void CCommandProcessorFragment_OpenGL::Cmd_Render_Buffer(const CCommandBuffer::CRenderBufferCommand *pCommand)
+{
+	SetState(pCommand->m_State);
+
+	// the pointers are offsets into the bound buffer
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, m_aBuffers[pCommand->m_Slot]);
+	glVertexPointer(2, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)0);
+	glTexCoordPointer(3, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)0 + sizeof(float)*2);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	if(pCommand->m_UseColor)
+	{
+		glDisableClientState(GL_COLOR_ARRAY);
+		glColor4f(pCommand->m_Color.r, pCommand->m_Color.g, pCommand->m_Color.b, pCommand->m_Color.a);
+	}
+	else
+	{
+		glColorPointer(4, GL_FLOAT, sizeof(CCommandBuffer::CVertex), (char*)0 + sizeof(float)*5);
+		glEnableClientState(GL_COLOR_ARRAY);
+	}
+
+	for(unsigned i = 0; i < pCommand->m_NumRanges; i++)
+		glDrawArrays(GL_QUADS, pCommand->m_pRanges[i].m_Offset*4, pCommand->m_pRanges[i].m_Count*4);
+
+	m_pfnBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void CCommandProcessorFragment_OpenGL::Cmd_Screenshot(const CCommandBuffer::CScreenshotCommand *pCommand)
 {
 	// fetch image data
@@ -507,6 +575,11 @@ CCommandProcessorFragment_OpenGL::CCommandProcessorFragment_OpenGL()
 {
 	mem_zero(m_aTextures, sizeof(m_aTextures));
 	m_pTextureMemoryUsage = 0;
+	mem_zero(m_aBuffers, sizeof(m_aBuffers));
+	m_pfnGenBuffers = 0;
+	m_pfnDeleteBuffers = 0;
+	m_pfnBindBuffer = 0;
+	m_pfnBufferData = 0;
 }
 
 bool CCommandProcessorFragment_OpenGL::RunCommand(const CCommandBuffer::CCommand * pBaseCommand)
@@ -519,6 +592,9 @@ bool CCommandProcessorFragment_OpenGL::RunCommand(const CCommandBuffer::CCommand
 	case CCommandBuffer::CMD_TEXTURE_UPDATE: Cmd_Texture_Update(static_cast<const CCommandBuffer::CTextureUpdateCommand *>(pBaseCommand)); break;
 	case CCommandBuffer::CMD_CLEAR: Cmd_Clear(static_cast<const CCommandBuffer::CClearCommand *>(pBaseCommand)); break;
 	case CCommandBuffer::CMD_RENDER: Cmd_Render(static_cast<const CCommandBuffer::CRenderCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_BUFFER_CREATE: Cmd_Buffer_Create(static_cast<const CCommandBuffer::CBufferCreateCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_BUFFER_DESTROY: Cmd_Buffer_Destroy(static_cast<const CCommandBuffer::CBufferDestroyCommand *>(pBaseCommand)); break;
+	case CCommandBuffer::CMD_RENDER_BUFFER: Cmd_Render_Buffer(static_cast<const CCommandBuffer::CRenderBufferCommand *>(pBaseCommand)); break;
 	case CCommandBuffer::CMD_SCREENSHOT: Cmd_Screenshot(static_cast<const CCommandBuffer::CScreenshotCommand *>(pBaseCommand)); break;
 	default: return false;
 	}
@@ -787,6 +863,7 @@ int CGraphicsBackend_SDL_OpenGL::Init(const char *pName, int *pScreen, int *pWin
 	CCommandProcessorFragment_OpenGL::CInitCommand CmdOpenGL;
 	CmdOpenGL.m_pTextureMemoryUsage = &m_TextureMemoryUsage;
 	CmdOpenGL.m_pTextureArraySize = &m_TextureArraySize;
+	CmdOpenGL.m_pBuffersSupported = &m_BuffersSupported;
 	CmdBuffer.AddCommand(CmdOpenGL);
 	RunBuffer(&CmdBuffer);
 	WaitForIdle();
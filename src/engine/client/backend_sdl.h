@@ -5,16 +5,6 @@
 #if defined(CONF_PLATFORM_MACOSX)
 	#include <objc/objc-runtime.h>
 
-	class semaphore
-	{
-		SDL_sem *sem;
-	public:
-		semaphore() { sem = SDL_CreateSemaphore(0); }
-		~semaphore() { SDL_DestroySemaphore(sem); }
-		void wait() { SDL_SemWait(sem); }
-		void signal() { SDL_SemPost(sem); }
-	};
-
 	class CAutoreleasePool
 	{
 	private:
@@ -52,7 +42,9 @@ public:
 
 	CGraphicsBackend_Threaded();
 
-	virtual void RunBuffer(CCommandBuffer *pBuffer);
+	virtual unsigned RunBuffer(CCommandBuffer *pBuffer);
+	virtual bool IsFenceDone(unsigned Fence) const;
+	virtual void WaitForFence(unsigned Fence);
 	virtual bool IsIdle() const;
 	virtual void WaitForIdle();
 
@@ -61,8 +53,16 @@ protected:
 	void StopProcessor();
 
 private:
+	enum
+	{
+		MAX_QUEUED_BUFFERS=4,
+	};
+
+	// the buffers are run in order, the fence of a buffer is its number
 	ICommandProcessor *m_pProcessor;
-	CCommandBuffer * volatile m_pBuffer;
+	CCommandBuffer * volatile m_apQueue[MAX_QUEUED_BUFFERS];
+	volatile unsigned m_Submitted;
+	volatile unsigned m_Completed;
 	volatile bool m_Shutdown;
 	semaphore m_Activity;
 	semaphore m_BufferDone;
@@ -107,6 +107,13 @@ class CCommandProcessorFragment_OpenGL
 	int m_Max3DTexSize;
 	int m_TextureArraySize;
 
+	// vertex buffer objects are part of OpenGL 1.5 and have to be loaded
+	PFNGLGENBUFFERSPROC m_pfnGenBuffers;
+	PFNGLDELETEBUFFERSPROC m_pfnDeleteBuffers;
+	PFNGLBINDBUFFERPROC m_pfnBindBuffer;
+	PFNGLBUFFERDATAPROC m_pfnBufferData;
+	GLuint m_aBuffers[CCommandBuffer::MAX_BUFFERS];
+
 public:
 	enum
 	{
@@ -118,6 +125,7 @@ public:
 		CInitCommand() : CCommand(CMD_INIT) {}
 		volatile int *m_pTextureMemoryUsage;
 		int *m_pTextureArraySize;
+		bool *m_pBuffersSupported;
 	};
 
 private:
@@ -133,6 +141,9 @@ private:
 	void Cmd_Texture_Create(const CCommandBuffer::CTextureCreateCommand *pCommand);
 	void Cmd_Clear(const CCommandBuffer::CClearCommand *pCommand);
 	void Cmd_Render(const CCommandBuffer::CRenderCommand *pCommand);
+	void Cmd_Buffer_Create(const CCommandBuffer::CBufferCreateCommand *pCommand);
+	void Cmd_Buffer_Destroy(const CCommandBuffer::CBufferDestroyCommand *pCommand);
+	void Cmd_Render_Buffer(const CCommandBuffer::CRenderBufferCommand *pCommand);
 	void Cmd_Screenshot(const CCommandBuffer::CScreenshotCommand *pCommand);
 
 public:
@@ -197,12 +208,14 @@ class CGraphicsBackend_SDL_OpenGL : public CGraphicsBackend_Threaded
 	volatile int m_TextureMemoryUsage;
 	int m_NumScreens;
 	int m_TextureArraySize;
+	bool m_BuffersSupported;
 public:
 	virtual int Init(const char *pName, int *pScreen, int *pWindowWidth, int *pWindowHeight, int *pScreenWidth, int *pScreenHeight, int FsaaSamples, int Flags, int *pDesktopWidth, int *pDesktopHeight);
 	virtual int Shutdown();
 
 	virtual int MemoryUsage() const;
 	virtual int GetTextureArraySize() const { return m_TextureArraySize; }
+	virtual bool BuffersSupported() const { return m_BuffersSupported; }
 
 	virtual int GetNumScreens() const { return m_NumScreens; }
 
@@ -8,6 +8,7 @@
 #include <base/math.h>
 #include <base/system.h>
 
+#include <engine/asyncio.h>
 #include <engine/client.h>
 #include <engine/config.h>
 #include <engine/console.h>
@@ -252,6 +253,10 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 	m_RenderFrameTimeHigh = 0.0f;
 	m_RenderFrames = 0;
 	m_LastRenderTime = time_get();
+	m_Benchmark = false;
+	m_BenchmarkStep = 0;
+	m_BenchmarkStart = 0;
+	m_BenchmarkStartFrame = 0;
 	m_LastCpuTime = time_get();
 	m_LastAvgCpuFrameTime = 0;
 
@@ -425,7 +430,7 @@ void CClient::SendInput()
 	Msg.AddInt(PingCorrection);
 
 	m_CurrentInput++;
-	m_CurrentInput%=200;
+	m_CurrentInput%=MAX_INPUTS;
 
 	SendMsg(&Msg, MSGFLAG_FLUSH);
 }
@@ -439,7 +444,7 @@ const char *CClient::LatestVersion() const
 const int *CClient::GetInput(int Tick) const
 {
 	int Best = -1;
-	for(int i = 0; i < 200; i++)
+	for(int i = 0; i < MAX_INPUTS; i++)
 	{
 		if(m_aInputs[i].m_Tick <= Tick && (Best == -1 || m_aInputs[Best].m_Tick < m_aInputs[i].m_Tick))
 			Best = i;
@@ -477,7 +482,7 @@ void CClient::OnEnterGame()
 {
 	// reset input
 	int i;
-	for(i = 0; i < 200; i++)
+	for(i = 0; i < MAX_INPUTS; i++)
 		m_aInputs[i].m_Tick = -1;
 	m_CurrentInput = 0;
 
@@ -567,6 +572,9 @@ void CClient::DisconnectWithReason(const char *pReason)
 	str_format(aBuf, sizeof(aBuf), "disconnecting. reason='%s'", pReason?pReason:"unknown");
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "client", aBuf);
 
+	if(m_Benchmark)
+		FinishBenchmark();
+
 	// stop demo playback and recorder
 	m_DemoPlayer.Stop();
 	DemoRecorder_Stop();
@@ -585,6 +593,7 @@ void CClient::DisconnectWithReason(const char *pReason)
 	m_pConsole->DeregisterTempAll();
 	m_NetClient.Disconnect(pReason);
 	SetState(IClient::STATE_OFFLINE);
+	GameClient()->OnMapUnload();
 	m_pMap->Unload();
 
 	// disable all downloads
@@ -806,6 +815,7 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, const SHA
 
 	SetState(IClient::STATE_LOADING);
 
+	GameClient()->OnMapUnload();
 	if(!m_pMap->Load(pFilename))
 	{
 		str_format(aErrorMsg, sizeof(aErrorMsg), "map '%s' not found", pFilename);
@@ -1282,7 +1292,7 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 		}
 		else if((pPacket->m_Flags&NET_CHUNKFLAG_VITAL) != 0 && Msg == NETMSG_CON_READY)
 		{
-			GameClient()->OnConnected();
+			GameClient()->OnConnected(false);
 		}
 		else if(Msg == NETMSG_PING)
 		{
@@ -1347,7 +1357,7 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 
 			// adjust our prediction time
 			int64 Target = 0;
-			for(int k = 0; k < 200; k++)
+			for(int k = 0; k < MAX_INPUTS; k++)
 			{
 				if(m_aInputs[k].m_Tick == InputPredTick)
 				{
@@ -1647,7 +1657,7 @@ void CClient::Update()
 {
 	if(State() == IClient::STATE_DEMOPLAYBACK)
 	{
-		m_DemoPlayer.Update();
+		m_DemoPlayer.Update(m_Benchmark ? m_BenchmarkStep : 0);
 		if(m_DemoPlayer.IsPlaying())
 		{
 			// update timers
@@ -1660,7 +1670,12 @@ void CClient::Update()
 		else
 		{
 			// disconnect on error
+			bool Benchmark = m_Benchmark;
 			Disconnect();
+
+			// there is nothing to look at without a window
+			if(Benchmark && Config()->m_GfxNull)
+				Quit();
 		}
 	}
 	else if(State() == IClient::STATE_ONLINE && m_ReceivedSnapshots >= 3)
@@ -1770,6 +1785,9 @@ void CClient::Update()
 	// update the maser server registry
 	MasterServer()->Update();
 
+	// dispatch finished file requests
+	AsyncIO()->Update();
+
 	// update the server browser
 	m_ServerBrowser.Update(m_ResortServerBrowser);
 	m_ResortServerBrowser = false;
@@ -1836,6 +1854,9 @@ void CClient::InitInterfaces()
 	m_pConfigManager = Kernel()->RequestInterface<IConfigManager>();
 	m_pConfig = m_pConfigManager->Values();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
+	m_pAsyncIO = Kernel()->RequestInterface<IEngineAsyncIO>();
+
+	m_DemoPlayer.SetAsyncIO(m_pAsyncIO);
 
 	//
 	m_ServerBrowser.Init(&m_ContactClient, m_pGameClient->NetVersion());
@@ -1845,7 +1866,7 @@ void CClient::InitInterfaces()
 
 bool CClient::LimitFps()
 {
-	if(Config()->m_GfxVsync || !Config()->m_GfxLimitFps) return false;
+	if(m_Benchmark || Config()->m_GfxVsync || !Config()->m_GfxLimitFps) return false;
 
 	/**
 		If desired frame time is not reached:
@@ -2108,7 +2129,8 @@ void CClient::Run()
 
 			const bool SkipFrame = LimitFps();
 
-			if(!SkipFrame && (!Config()->m_GfxAsyncRender || m_pGraphics->IsIdle()))
+			// with async rendering the update never waits for the backend, frames are only rendered when they can be queued
+			if(!SkipFrame && (!Config()->m_GfxAsyncRender || !m_pGraphics->FrameQueueFull()))
 			{
 				m_RenderFrames++;
 
@@ -2318,7 +2340,7 @@ const char *CClient::DemoPlayer_Play(const char *pFilename, int StorageType)
 		return pError;
 	}
 
-	GameClient()->OnConnected();
+	GameClient()->OnConnected(true);
 
 	// setup buffers
 	mem_zero(m_aDemorecSnapshotData, sizeof(m_aDemorecSnapshotData));
@@ -2351,6 +2373,37 @@ void CClient::Con_Play(IConsole::IResult *pResult, void *pUserData)
 	pSelf->DemoPlayer_Play(pResult->GetString(0), IStorage::TYPE_ALL);
 }
 
+void CClient::Con_Benchmark(IConsole::IResult *pResult, void *pUserData)
+{
+	CClient *pSelf = (CClient *)pUserData;
+	const char *pError = pSelf->DemoPlayer_Play(pResult->GetString(0), IStorage::TYPE_ALL);
+	if(pError)
+	{
+		pSelf->m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "benchmark", pError);
+		return;
+	}
+
+	int Fps = pResult->NumArguments() > 1 ? clamp(pResult->GetInteger(1), 1, 1000) : 60;
+	pSelf->m_Benchmark = true;
+	pSelf->m_BenchmarkStep = time_freq()/Fps;
+	pSelf->m_BenchmarkStart = time_get();
+	pSelf->m_BenchmarkStartFrame = pSelf->m_RenderFrames;
+	pSelf->GameClient()->OnBenchmark(true);
+}
+
+void CClient::FinishBenchmark()
+{
+	m_Benchmark = false;
+
+	int Frames = m_RenderFrames-m_BenchmarkStartFrame;
+	float Seconds = (time_get()-m_BenchmarkStart)/(float)time_freq();
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "%d frames in %.2fs, %.3fms per frame (%.1f fps)", Frames, Seconds,
+		Frames > 0 ? Seconds*1000.0f/Frames : 0.0f, Seconds > 0.0f ? Frames/Seconds : 0.0f);
+	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "benchmark", aBuf);
+	GameClient()->OnBenchmark(false);
+}
+
 void CClient::DemoRecorder_Start(const char *pFilename, bool WithTimestamp)
 {
 	if(State() != IClient::STATE_ONLINE)
@@ -2366,6 +2419,7 @@ void CClient::DemoRecorder_Start(const char *pFilename, bool WithTimestamp)
 		}
 		else
 			str_format(aFilename, sizeof(aFilename), "demos/%s.demo", pFilename);
+		m_DemoRecorder.SetKeyFrameMode(Config()->m_DemoKeyframeInterval, Config()->m_DemoKeyframeDeltas);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameClient()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "client");
 	}
 }
@@ -2531,6 +2585,7 @@ void CClient::RegisterCommands()
 	m_pConsole->Register("rcon", "r[command]", CFGFLAG_CLIENT, Con_Rcon, this, "Send specified command to rcon");
 	m_pConsole->Register("rcon_auth", "s[password]", CFGFLAG_CLIENT, Con_RconAuth, this, "Authenticate to rcon");
 	m_pConsole->Register("play", "r[file]", CFGFLAG_CLIENT|CFGFLAG_STORE, Con_Play, this, "Play the file specified");
+	m_pConsole->Register("benchmark", "s[file] ?i[fps]", CFGFLAG_CLIENT|CFGFLAG_STORE, Con_Benchmark, this, "Play the demo as fast as possible with a fixed time step per frame and print the time spent per frame");
 	m_pConsole->Register("record", "?s[file]", CFGFLAG_CLIENT, Con_Record, this, "Record to the file");
 	m_pConsole->Register("stoprecord", "", CFGFLAG_CLIENT, Con_StopRecord, this, "Stop recording");
 	m_pConsole->Register("add_demomarker", "", CFGFLAG_CLIENT, Con_AddDemoMarker, this, "Add demo timeline marker");
@@ -2608,7 +2663,7 @@ int main(int argc, const char **argv) // ignore_convention
 
 	// create the components
 	int FlagMask = CFGFLAG_CLIENT;
-	IEngine *pEngine = CreateEngine("Teeworlds");
+	IEngine *pEngine = CreateEngine("Teeworlds", 4); // several jobs to decode the assets in parallel on startup
 	IConsole *pConsole = CreateConsole(FlagMask);
 	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_CLIENT, argc, argv); // ignore_convention
 	IConfigManager *pConfigManager = CreateConfigManager();
@@ -2617,6 +2672,7 @@ int main(int argc, const char **argv) // ignore_convention
 	IEngineTextRender *pEngineTextRender = CreateEngineTextRender();
 	IEngineMap *pEngineMap = CreateEngineMap();
 	IEngineMasterServer *pEngineMasterServer = CreateEngineMasterServer();
+	IEngineAsyncIO *pEngineAsyncIO = CreateEngineAsyncIO();
 
 	if(RandInitFailed)
 	{
@@ -2650,11 +2706,15 @@ int main(int argc, const char **argv) // ignore_convention
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(CreateGameClient());
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pStorage);
 
+		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IEngineAsyncIO*>(pEngineAsyncIO)); // register as both
+		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IAsyncIO*>(pEngineAsyncIO));
+
 		if(RegisterFail)
 			return -1;
 	}
 
 	pEngine->Init();
+	pEngineAsyncIO->Init();
 	pConfigManager->Init(FlagMask);
 	pConsole->Init();
 	pEngineMasterServer->Init();
@@ -2734,6 +2794,7 @@ int main(int argc, const char **argv) // ignore_convention
 	delete pKernel;
 	delete pEngine;
 	delete pConsole;
+	delete pEngineAsyncIO;
 	delete pStorage;
 	delete pConfigManager;
 	delete pEngineSound;
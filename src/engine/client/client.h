@@ -66,6 +66,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	IConsole *m_pConsole;
 	IStorage *m_pStorage;
 	IEngineMasterServer *m_pMasterServer;
+	class IEngineAsyncIO *m_pAsyncIO;
 
 	enum
 	{
@@ -95,6 +96,13 @@ class CClient : public IClient, public CDemoPlayer::IListener
 	float m_RenderFrameTimeHigh;
 	int m_RenderFrames;
 
+	// a benchmark plays a demo with a fixed time step per frame and renders as many frames as it can
+	bool m_Benchmark;
+	int64 m_BenchmarkStep;
+	int64 m_BenchmarkStart;
+	int m_BenchmarkStartFrame;
+	void FinishBenchmark();
+
 	NETADDR m_ServerAddress;
 	int m_WindowMustRefocus;
 	int m_SnapCrcErrors;
@@ -150,7 +158,7 @@ class CClient : public IClient, public CDemoPlayer::IListener
 		int m_Tick; // the tick that the input is for
 		int64 m_PredictedTime; // prediction latency when we sent this input
 		int64 m_Time;
-	} m_aInputs[200];
+	} m_aInputs[MAX_INPUTS];
 
 	int m_CurrentInput;
 
@@ -203,6 +211,7 @@ public:
 	CConfig *Config() { return m_pConfig; }
 	IConsole *Console() { return m_pConsole; }
 	IStorage *Storage() { return m_pStorage; }
+	class IEngineAsyncIO *AsyncIO() { return m_pAsyncIO; }
 
 	CClient();
 
@@ -303,6 +312,7 @@ public:
 	static void Con_AddFavorite(IConsole::IResult *pResult, void *pUserData);
 	static void Con_RemoveFavorite(IConsole::IResult *pResult, void *pUserData);
 	static void Con_Play(IConsole::IResult *pResult, void *pUserData);
+	static void Con_Benchmark(IConsole::IResult *pResult, void *pUserData);
 	static void Con_Record(IConsole::IResult *pResult, void *pUserData);
 	static void Con_StopRecord(IConsole::IResult *pResult, void *pUserData);
 	static void Con_AddDemoMarker(IConsole::IResult *pResult, void *pUserData);
@@ -3,6 +3,7 @@
 
 #include <base/detect.h>
 #include <base/math.h>
+#include <base/tl/algorithm.h>
 #include <base/tl/threading.h>
 
 #include <base/system.h>
@@ -34,6 +35,39 @@ static CVideoMode g_aFakeModes[] = {
 	{1920,1440,8,8,8}, {1920,2400,8,8,8}, {2048,1536,8,8,8}
 };
 
+static bool StatesEqual(const CCommandBuffer::CState &a, const CCommandBuffer::CState &b)
+{
+	return a.m_BlendMode == b.m_BlendMode && a.m_WrapModeU == b.m_WrapModeU && a.m_WrapModeV == b.m_WrapModeV &&
+		a.m_Texture == b.m_Texture && a.m_TextureArrayIndex == b.m_TextureArrayIndex && a.m_Dimension == b.m_Dimension &&
+		a.m_ScreenTL.x == b.m_ScreenTL.x && a.m_ScreenTL.y == b.m_ScreenTL.y && a.m_ScreenBR.x == b.m_ScreenBR.x && a.m_ScreenBR.y == b.m_ScreenBR.y &&
+		a.m_ClipEnable == b.m_ClipEnable && (!a.m_ClipEnable ||
+		(a.m_ClipX == b.m_ClipX && a.m_ClipY == b.m_ClipY && a.m_ClipW == b.m_ClipW && a.m_ClipH == b.m_ClipH));
+}
+
+bool CGraphics_Threaded::MergeVertices(int PrimType, int PrimCount, int NumVerts)
+{
+	// nothing else may have been queued since the last render command
+	CCommandBuffer::CRenderCommand *pLast = m_pLastRenderCommand;
+	if(!pLast || m_pCommandBuffer->m_CmdBuffer.DataUsed() != m_LastRenderCommandEnd ||
+		pLast->m_PrimType != (unsigned)PrimType || !StatesEqual(pLast->m_State, m_State))
+		return false;
+
+	// the new vertices have to follow the old ones directly
+	int LastNumVerts = pLast->m_PrimCount * (PrimType == CCommandBuffer::PRIMTYPE_QUADS ? 4 : 2);
+	if((unsigned char *)(pLast->m_pVertices + LastNumVerts) != m_pCommandBuffer->m_DataBuffer.DataPtr() + m_pCommandBuffer->m_DataBuffer.DataUsed())
+		return false;
+
+	CCommandBuffer::CVertex *pVertices = (CCommandBuffer::CVertex *)m_pCommandBuffer->AllocData(sizeof(CCommandBuffer::CVertex)*NumVerts);
+	if(!pVertices)
+		return false;
+
+	mem_copy(pVertices, m_aVertices, sizeof(CCommandBuffer::CVertex)*NumVerts);
+	pLast->m_PrimCount += PrimCount;
+	m_FrameStats.m_MergedDrawCalls++;
+	m_FrameStats.m_Vertices += NumVerts;
+	return true;
+}
+
 void CGraphics_Threaded::FlushVertices()
 {
 	if(m_NumVertices == 0)
@@ -42,6 +76,27 @@ void CGraphics_Threaded::FlushVertices()
 	int NumVerts = m_NumVertices;
 	m_NumVertices = 0;
 
+	if(m_Recording)
+	{
+		// keep the vertices for the buffer instead of drawing them
+		if(m_NumRecordedVertices+NumVerts > m_RecordedVerticesSize)
+		{
+			int NewSize = max(m_RecordedVerticesSize*2, m_NumRecordedVertices+NumVerts);
+			CCommandBuffer::CVertex *pNewVertices = (CCommandBuffer::CVertex *)mem_alloc(sizeof(CCommandBuffer::CVertex)*NewSize, sizeof(void*));
+			if(m_pRecordedVertices)
+			{
+				mem_copy(pNewVertices, m_pRecordedVertices, sizeof(CCommandBuffer::CVertex)*m_NumRecordedVertices);
+				mem_free(m_pRecordedVertices);
+			}
+			m_pRecordedVertices = pNewVertices;
+			m_RecordedVerticesSize = NewSize;
+		}
+		mem_copy(m_pRecordedVertices+m_NumRecordedVertices, m_aVertices, sizeof(CCommandBuffer::CVertex)*NumVerts);
+		m_NumRecordedVertices += NumVerts;
+		m_RecordedDimension = m_State.m_Dimension;
+		return;
+	}
+
 	CCommandBuffer::CRenderCommand Cmd;
 	Cmd.m_State = m_State;
 
@@ -58,6 +113,9 @@ void CGraphics_Threaded::FlushVertices()
 	else
 		return;
 
+	if(MergeVertices(Cmd.m_PrimType, Cmd.m_PrimCount, NumVerts))
+		return;
+
 	Cmd.m_pVertices = (CCommandBuffer::CVertex *)m_pCommandBuffer->AllocData(sizeof(CCommandBuffer::CVertex)*NumVerts);
 	if(Cmd.m_pVertices == 0x0)
 	{
@@ -93,6 +151,20 @@ void CGraphics_Threaded::FlushVertices()
 	}
 
 	mem_copy(Cmd.m_pVertices, m_aVertices, sizeof(CCommandBuffer::CVertex)*NumVerts);
+	m_pLastRenderCommand = (CCommandBuffer::CRenderCommand *)(m_pCommandBuffer->m_CmdBuffer.DataPtr() + m_pCommandBuffer->m_CmdBuffer.DataUsed() - sizeof(Cmd));
+	m_LastRenderCommandEnd = m_pCommandBuffer->m_CmdBuffer.DataUsed();
+	CountDrawCall(Cmd.m_State.m_Texture, NumVerts);
+}
+
+void CGraphics_Threaded::CountDrawCall(int Texture, int NumVertices)
+{
+	m_FrameStats.m_DrawCalls++;
+	m_FrameStats.m_Vertices += NumVertices;
+	if(Texture != m_LastDrawnTexture)
+	{
+		m_FrameStats.m_TextureSwitches++;
+		m_LastDrawnTexture = Texture;
+	}
 }
 
 void CGraphics_Threaded::AddVertices(int Count)
@@ -136,8 +208,12 @@ CGraphics_Threaded::CGraphics_Threaded()
 
 	m_CurrentCommandBuffer = 0;
 	m_pCommandBuffer = 0x0;
-	m_apCommandBuffers[0] = 0x0;
-	m_apCommandBuffers[1] = 0x0;
+	m_NumCommandBuffers = 0;
+	for(int i = 0; i < MAX_CMDBUFFERS; i++)
+	{
+		m_apCommandBuffers[i] = 0x0;
+		m_aCommandBufferFences[i] = 0;
+	}
 
 	m_NumVertices = 0;
 
@@ -149,6 +225,21 @@ CGraphics_Threaded::CGraphics_Threaded()
 
 	m_TextureMemoryUsage = 0;
 
+	m_Recording = false;
+	m_pRecordedVertices = 0;
+	m_NumRecordedVertices = 0;
+	m_RecordedVerticesSize = 0;
+	m_RecordedDimension = 2;
+
+	m_aTextureOffset[0] = m_aTextureOffset[1] = 0.0f;
+	m_aTextureScale[0] = m_aTextureScale[1] = 1.0f;
+	m_BuildingAtlas = false;
+	m_pLastRenderCommand = 0;
+	m_LastRenderCommandEnd = 0;
+	mem_zero(&m_FrameStats, sizeof(m_FrameStats));
+	mem_zero(&m_LastFrameStats, sizeof(m_LastFrameStats));
+	m_LastDrawnTexture = -1;
+
 	m_RenderEnable = true;
 	m_DoScreenshot = false;
 }
@@ -273,9 +364,32 @@ int CGraphics_Threaded::UnloadTexture(CTextureHandle *Index)
 	if(!Index->IsValid())
 		return 0;
 
-	CCommandBuffer::CTextureDestroyCommand Cmd;
-	Cmd.m_Slot = Index->Id();
-	m_pCommandBuffer->AddCommand(Cmd);
+	CTextureInfo *pInfo = &m_aTextureInfos[Index->Id()];
+	if(pInfo->m_AtlasRegion)
+	{
+		// the page goes away with its last region
+		pInfo->m_AtlasRegion = false;
+		if(pInfo->m_AtlasPage >= 0 && --m_aTextureInfos[pInfo->m_AtlasPage].m_NumAtlasRegions == 0)
+		{
+			CTextureHandle Page = CreateTextureHandle(pInfo->m_AtlasPage);
+			UnloadTexture(&Page);
+		}
+		for(int i = 0; i < m_lAtlasImages.size(); i++)
+		{
+			if(m_lAtlasImages[i].m_Slot == Index->Id())
+			{
+				mem_free(m_lAtlasImages[i].m_pData);
+				m_lAtlasImages.remove_index(i);
+				break;
+			}
+		}
+	}
+	else
+	{
+		CCommandBuffer::CTextureDestroyCommand Cmd;
+		Cmd.m_Slot = Index->Id();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
 
 	m_aTextureIndices[Index->Id()] = m_FirstFreeTexture;
 	m_FirstFreeTexture = Index->Id();
@@ -307,6 +421,7 @@ int CGraphics_Threaded::LoadTextureRawSub(CTextureHandle TextureID, int x, int y
 {
 	if(!TextureID.IsValid())
 		return 0;
+	dbg_assert(!m_aTextureInfos[TextureID.Id()].m_AtlasRegion, "textures in an atlas can't be updated");
 
 	CCommandBuffer::CTextureUpdateCommand Cmd;
 	Cmd.m_Slot = TextureID.Id();
@@ -339,6 +454,28 @@ IGraphics::CTextureHandle CGraphics_Threaded::LoadTextureRaw(int Width, int Heig
 	int Tex = m_FirstFreeTexture;
 	m_FirstFreeTexture = m_aTextureIndices[Tex];
 	m_aTextureIndices[Tex] = -1;
+	mem_zero(&m_aTextureInfos[Tex], sizeof(m_aTextureInfos[Tex]));
+
+	if(m_BuildingAtlas && (Flags&TEXLOAD_ATLAS) && !(Flags&(TEXLOAD_ARRAY_256|TEXLOAD_MULTI_DIMENSION)) &&
+		Format == CImageInfo::FORMAT_RGBA && StoreFormat == CImageInfo::FORMAT_RGBA &&
+		Width+2*ATLAS_PADDING <= ATLAS_PAGE_SIZE && Height+2*ATLAS_PADDING <= ATLAS_PAGE_SIZE)
+	{
+		// keep the image until the atlas is built
+		CAtlasImage Image;
+		Image.m_Slot = Tex;
+		Image.m_Width = Width;
+		Image.m_Height = Height;
+		Image.m_X = 0;
+		Image.m_Y = 0;
+		Image.m_PageFlags = Flags&(TEXLOAD_NOMIPMAPS|TEXLOAD_LINEARMIPMAPS);
+		Image.m_pData = (unsigned char *)mem_alloc(Width*Height*4, sizeof(void*));
+		mem_copy(Image.m_pData, pData, Width*Height*4);
+		m_lAtlasImages.add(Image);
+
+		m_aTextureInfos[Tex].m_AtlasRegion = true;
+		m_aTextureInfos[Tex].m_AtlasPage = -1;
+		return CreateTextureHandle(Tex);
+	}
 
 	CCommandBuffer::CTextureCreateCommand Cmd;
 	Cmd.m_Slot = Tex;
@@ -455,12 +592,16 @@ int CGraphics_Threaded::LoadPNG(CImageInfo *pImg, const char *pFilename, int Sto
 
 void CGraphics_Threaded::KickCommandBuffer()
 {
-	m_pBackend->RunBuffer(m_pCommandBuffer);
+	m_FrameStats.m_Commands += m_pCommandBuffer->m_NumCommands;
+	m_FrameStats.m_CommandBuffers++;
+	m_aCommandBufferFences[m_CurrentCommandBuffer] = m_pBackend->RunBuffer(m_pCommandBuffer);
 
-	// swap buffer
-	m_CurrentCommandBuffer ^= 1;
+	// the next buffer might still be queued, only wait for that one
+	m_CurrentCommandBuffer = (m_CurrentCommandBuffer+1)%m_NumCommandBuffers;
+	m_pBackend->WaitForFence(m_aCommandBufferFences[m_CurrentCommandBuffer]);
 	m_pCommandBuffer = m_apCommandBuffers[m_CurrentCommandBuffer];
 	m_pCommandBuffer->Reset();
+	m_pLastRenderCommand = 0;
 }
 
 void CGraphics_Threaded::ScreenshotDirect(const char *pFilename)
@@ -504,10 +645,128 @@ void CGraphics_Threaded::ScreenshotDirect(const char *pFilename)
 void CGraphics_Threaded::TextureSet(CTextureHandle TextureID)
 {
 	dbg_assert(m_Drawing == 0, "called Graphics()->TextureSet within begin");
-	m_State.m_Texture = TextureID.Id();
+	const CTextureInfo *pInfo = TextureID.IsValid() ? &m_aTextureInfos[TextureID.Id()] : 0;
+	if(pInfo && pInfo->m_AtlasRegion)
+	{
+		m_State.m_Texture = pInfo->m_AtlasPage;
+		m_aTextureOffset[0] = pInfo->m_aAtlasOffset[0];
+		m_aTextureOffset[1] = pInfo->m_aAtlasOffset[1];
+		m_aTextureScale[0] = pInfo->m_aAtlasScale[0];
+		m_aTextureScale[1] = pInfo->m_aAtlasScale[1];
+	}
+	else
+	{
+		m_State.m_Texture = TextureID.Id();
+		m_aTextureOffset[0] = m_aTextureOffset[1] = 0.0f;
+		m_aTextureScale[0] = m_aTextureScale[1] = 1.0f;
+	}
 	m_State.m_Dimension = 2;
 }
 
+void CGraphics_Threaded::AtlasBegin()
+{
+	dbg_assert(!m_BuildingAtlas, "called Graphics()->AtlasBegin twice");
+	m_BuildingAtlas = m_pConfig->m_GfxTextureAtlas != 0;
+}
+
+void CGraphics_Threaded::BuildAtlasPage(const array<int> &lImages, int Height, int Flags)
+{
+	if(!lImages.size())
+		return;
+
+	unsigned char *pPage = (unsigned char *)mem_alloc(ATLAS_PAGE_SIZE*Height*4, sizeof(void*));
+	mem_zero(pPage, ATLAS_PAGE_SIZE*Height*4);
+	for(int i = 0; i < lImages.size(); i++)
+	{
+		// copy the image and repeat its edge pixels into the padding
+		const CAtlasImage *pImage = &m_lAtlasImages[lImages[i]];
+		for(int y = 0; y < pImage->m_Height+2*ATLAS_PADDING; y++)
+		{
+			const unsigned char *pSrc = pImage->m_pData + clamp(y-(int)ATLAS_PADDING, 0, pImage->m_Height-1)*pImage->m_Width*4;
+			unsigned char *pDst = pPage + ((pImage->m_Y+y)*ATLAS_PAGE_SIZE + pImage->m_X)*4;
+			for(int x = 0; x < ATLAS_PADDING; x++)
+			{
+				mem_copy(pDst + x*4, pSrc, 4);
+				mem_copy(pDst + (ATLAS_PADDING+pImage->m_Width+x)*4, pSrc + (pImage->m_Width-1)*4, 4);
+			}
+			mem_copy(pDst + ATLAS_PADDING*4, pSrc, pImage->m_Width*4);
+		}
+	}
+
+	CTextureHandle Page = LoadTextureRaw(ATLAS_PAGE_SIZE, Height, CImageInfo::FORMAT_RGBA, pPage, CImageInfo::FORMAT_RGBA, Flags|TEXLOAD_NORESAMPLE);
+	mem_free(pPage);
+	if(m_pConfig->m_Debug)
+		dbg_msg("graphics", "built atlas page %dx%d with %d textures", (int)ATLAS_PAGE_SIZE, Height, lImages.size());
+
+	m_aTextureInfos[Page.Id()].m_NumAtlasRegions += lImages.size();
+	for(int i = 0; i < lImages.size(); i++)
+	{
+		CAtlasImage *pImage = &m_lAtlasImages[lImages[i]];
+		CTextureInfo *pInfo = &m_aTextureInfos[pImage->m_Slot];
+		pInfo->m_AtlasPage = Page.Id();
+		pInfo->m_aAtlasOffset[0] = (pImage->m_X+ATLAS_PADDING) / (float)ATLAS_PAGE_SIZE;
+		pInfo->m_aAtlasOffset[1] = (pImage->m_Y+ATLAS_PADDING) / (float)Height;
+		pInfo->m_aAtlasScale[0] = pImage->m_Width / (float)ATLAS_PAGE_SIZE;
+		pInfo->m_aAtlasScale[1] = pImage->m_Height / (float)Height;
+		mem_free(pImage->m_pData);
+		pImage->m_pData = 0;
+	}
+}
+
+void CGraphics_Threaded::AtlasEnd()
+{
+	if(!m_BuildingAtlas)
+		return;
+	m_BuildingAtlas = false;
+
+	// shelf packing, tallest images first
+	if(m_lAtlasImages.size() > 1)
+		sort(m_lAtlasImages.all());
+
+	// images with different flags go into different pages
+	for(int First = 0; First < m_lAtlasImages.size(); First++)
+	{
+		if(!m_lAtlasImages[First].m_pData)
+			continue;
+
+		const int Flags = m_lAtlasImages[First].m_PageFlags;
+		array<int> lPage;
+		int x = 0, y = 0, ShelfHeight = 0;
+		for(int i = First; i < m_lAtlasImages.size(); i++)
+		{
+			CAtlasImage *pImage = &m_lAtlasImages[i];
+			if(!pImage->m_pData || pImage->m_PageFlags != Flags)
+				continue;
+
+			// keep the regions aligned so they start on whole texels in the first mipmaps
+			int w = (pImage->m_Width+3*ATLAS_PADDING-1)/ATLAS_PADDING*ATLAS_PADDING;
+			int h = (pImage->m_Height+3*ATLAS_PADDING-1)/ATLAS_PADDING*ATLAS_PADDING;
+			if(x+w > ATLAS_PAGE_SIZE)
+			{
+				x = 0;
+				y += ShelfHeight;
+				ShelfHeight = 0;
+			}
+			if(y+h > ATLAS_PAGE_SIZE)
+			{
+				BuildAtlasPage(lPage, y, Flags);
+				lPage.clear();
+				x = 0;
+				y = 0;
+				ShelfHeight = 0;
+			}
+
+			pImage->m_X = x;
+			pImage->m_Y = y;
+			lPage.add(i);
+			x += w;
+			ShelfHeight = max(ShelfHeight, h);
+		}
+		BuildAtlasPage(lPage, y+ShelfHeight, Flags);
+	}
+	m_lAtlasImages.clear();
+}
+
 void CGraphics_Threaded::Clear(float r, float g, float b)
 {
 	CCommandBuffer::CClearCommand Cmd;
@@ -600,6 +859,15 @@ void CGraphics_Threaded::QuadsSetSubset(float TlU, float TlV, float BrU, float B
 
 	m_State.m_TextureArrayIndex = m_TextureArrayIndex;
 
+	if(TextureIndex < 0)
+	{
+		// map into the atlas page
+		TlU = m_aTextureOffset[0] + TlU*m_aTextureScale[0];
+		BrU = m_aTextureOffset[0] + BrU*m_aTextureScale[0];
+		TlV = m_aTextureOffset[1] + TlV*m_aTextureScale[1];
+		BrV = m_aTextureOffset[1] + BrV*m_aTextureScale[1];
+	}
+
 	m_aTexture[0].u = TlU;	m_aTexture[1].u = BrU;
 	m_aTexture[0].v = TlV;	m_aTexture[1].v = TlV;
 
@@ -620,6 +888,15 @@ void CGraphics_Threaded::QuadsSetSubsetFree(
 
 	m_State.m_TextureArrayIndex = m_TextureArrayIndex;
 
+	if(TextureIndex < 0)
+	{
+		// map into the atlas page
+		x0 = m_aTextureOffset[0] + x0*m_aTextureScale[0]; y0 = m_aTextureOffset[1] + y0*m_aTextureScale[1];
+		x1 = m_aTextureOffset[0] + x1*m_aTextureScale[0]; y1 = m_aTextureOffset[1] + y1*m_aTextureScale[1];
+		x2 = m_aTextureOffset[0] + x2*m_aTextureScale[0]; y2 = m_aTextureOffset[1] + y2*m_aTextureScale[1];
+		x3 = m_aTextureOffset[0] + x3*m_aTextureScale[0]; y3 = m_aTextureOffset[1] + y3*m_aTextureScale[1];
+	}
+
 	m_aTexture[0].u = x0; m_aTexture[0].v = y0;
 	m_aTexture[1].u = x1; m_aTexture[1].v = y1;
 	m_aTexture[2].u = x2; m_aTexture[2].v = y2;
@@ -710,6 +987,55 @@ void CGraphics_Threaded::QuadsDrawFreeform(const CFreeformItem *pArray, int Num)
 	AddVertices(4*Num);
 }
 
+void CGraphics_Threaded::QuadsDrawSprites(const CSpriteItem *pArray, int Num)
+{
+	dbg_assert(m_Drawing == DRAWING_QUADS, "called Graphics()->QuadsDrawSprites without begin");
+
+	m_State.m_TextureArrayIndex = m_TextureArrayIndex;
+	m_State.m_Dimension = 2;
+
+	for(int i = 0; i < Num; ++i)
+	{
+		const CSpriteItem *pItem = &pArray[i];
+		CCommandBuffer::CVertex *pVertices = &m_aVertices[m_NumVertices];
+
+		// map into the atlas page
+		float u0 = m_aTextureOffset[0] + pItem->m_U0*m_aTextureScale[0];
+		float u1 = m_aTextureOffset[0] + pItem->m_U1*m_aTextureScale[0];
+		float v0 = m_aTextureOffset[1] + pItem->m_V0*m_aTextureScale[1];
+		float v1 = m_aTextureOffset[1] + pItem->m_V1*m_aTextureScale[1];
+		pVertices[0].m_Tex.u = u0; pVertices[0].m_Tex.v = v0;
+		pVertices[1].m_Tex.u = u1; pVertices[1].m_Tex.v = v0;
+		pVertices[2].m_Tex.u = u1; pVertices[2].m_Tex.v = v1;
+		pVertices[3].m_Tex.u = u0; pVertices[3].m_Tex.v = v1;
+
+		// same corners as QuadsDraw with Rotate4
+		float c = 1.0f, s = 0.0f;
+		if(pItem->m_Rotation != 0)
+		{
+			c = cosf(pItem->m_Rotation);
+			s = sinf(pItem->m_Rotation);
+		}
+		float w = pItem->m_Width/2;
+		float h = pItem->m_Height/2;
+		pVertices[0].m_Pos.x = pItem->m_X - w*c + h*s; pVertices[0].m_Pos.y = pItem->m_Y - w*s - h*c;
+		pVertices[1].m_Pos.x = pItem->m_X + w*c + h*s; pVertices[1].m_Pos.y = pItem->m_Y + w*s - h*c;
+		pVertices[2].m_Pos.x = pItem->m_X + w*c - h*s; pVertices[2].m_Pos.y = pItem->m_Y + w*s + h*c;
+		pVertices[3].m_Pos.x = pItem->m_X - w*c - h*s; pVertices[3].m_Pos.y = pItem->m_Y - w*s + h*c;
+
+		for(int v = 0; v < 4; v++)
+		{
+			pVertices[v].m_Tex.i = 0;
+			pVertices[v].m_Color.r = pItem->m_Color.r;
+			pVertices[v].m_Color.g = pItem->m_Color.g;
+			pVertices[v].m_Color.b = pItem->m_Color.b;
+			pVertices[v].m_Color.a = pItem->m_Color.a;
+		}
+
+		AddVertices(4);
+	}
+}
+
 void CGraphics_Threaded::QuadsText(float x, float y, float Size, const char *pText)
 {
 	float StartX = x;
@@ -739,6 +1065,120 @@ void CGraphics_Threaded::QuadsText(float x, float y, float Size, const char *pTe
 	}
 }
 
+bool CGraphics_Threaded::BuffersSupported()
+{
+	// the tileset fallback system would need a texture switch within a buffer
+	return m_pBackend->BuffersSupported() && m_pBackend->GetTextureArraySize() == 1;
+}
+
+void CGraphics_Threaded::BufferBegin()
+{
+	dbg_assert(m_Drawing == 0 && !m_Recording, "called Graphics()->BufferBegin within begin");
+	dbg_assert(BuffersSupported(), "called Graphics()->BufferBegin without buffer support");
+	m_Recording = true;
+	m_NumRecordedVertices = 0;
+	m_RecordedDimension = 2;
+}
+
+IGraphics::CBufferHandle CGraphics_Threaded::BufferEnd()
+{
+	dbg_assert(m_Recording && m_Drawing == 0, "called Graphics()->BufferEnd without begin");
+	m_Recording = false;
+
+	if(m_NumRecordedVertices == 0 || m_FirstFreeBuffer < 0)
+	{
+		if(m_NumRecordedVertices)
+			dbg_msg("graphics", "out of buffers");
+		return CBufferHandle();
+	}
+
+	// grab buffer
+	int Slot = m_FirstFreeBuffer;
+	m_FirstFreeBuffer = m_aBufferIndices[Slot];
+	m_aBufferIndices[Slot] = -1;
+	m_aBufferDimensions[Slot] = m_RecordedDimension;
+
+	// the vertices are handed over to the command processor
+	CCommandBuffer::CBufferCreateCommand Cmd;
+	Cmd.m_Slot = Slot;
+	Cmd.m_NumVertices = m_NumRecordedVertices;
+	Cmd.m_pVertices = m_pRecordedVertices;
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+
+	m_pRecordedVertices = 0;
+	m_NumRecordedVertices = 0;
+	m_RecordedVerticesSize = 0;
+	return CreateBufferHandle(Slot);
+}
+
+void CGraphics_Threaded::UnloadBuffer(CBufferHandle *pBuffer)
+{
+	if(!pBuffer->IsValid())
+		return;
+
+	CCommandBuffer::CBufferDestroyCommand Cmd;
+	Cmd.m_Slot = pBuffer->Id();
+	if(!m_pCommandBuffer->AddCommand(Cmd))
+	{
+		KickCommandBuffer();
+		m_pCommandBuffer->AddCommand(Cmd);
+	}
+
+	m_aBufferIndices[pBuffer->Id()] = m_FirstFreeBuffer;
+	m_FirstFreeBuffer = pBuffer->Id();
+
+	pBuffer->Invalidate();
+}
+
+void CGraphics_Threaded::RenderBuffer(CBufferHandle Buffer, const int *pOffsets, const int *pCounts, int NumRanges, const vec4 *pColor)
+{
+	dbg_assert(m_Drawing == 0, "called Graphics()->RenderBuffer within begin");
+	if(!Buffer.IsValid() || NumRanges <= 0)
+		return;
+
+	CCommandBuffer::CRenderBufferCommand Cmd;
+	Cmd.m_State = m_State;
+	Cmd.m_State.m_Dimension = m_aBufferDimensions[Buffer.Id()];
+	Cmd.m_State.m_TextureArrayIndex = 0;
+	Cmd.m_Slot = Buffer.Id();
+	Cmd.m_UseColor = pColor != 0;
+	if(pColor)
+	{
+		Cmd.m_Color.r = pColor->r;
+		Cmd.m_Color.g = pColor->g;
+		Cmd.m_Color.b = pColor->b;
+		Cmd.m_Color.a = pColor->a;
+	}
+	Cmd.m_NumRanges = NumRanges;
+
+	Cmd.m_pRanges = (CCommandBuffer::CBufferRange *)m_pCommandBuffer->AllocData(sizeof(CCommandBuffer::CBufferRange)*NumRanges);
+	if(Cmd.m_pRanges == 0x0 || !m_pCommandBuffer->AddCommand(Cmd))
+	{
+		// kick command buffer and try again
+		KickCommandBuffer();
+
+		Cmd.m_pRanges = (CCommandBuffer::CBufferRange *)m_pCommandBuffer->AllocData(sizeof(CCommandBuffer::CBufferRange)*NumRanges);
+		if(Cmd.m_pRanges == 0x0 || !m_pCommandBuffer->AddCommand(Cmd))
+		{
+			dbg_msg("graphics", "failed to allocate memory for buffer render command");
+			return;
+		}
+	}
+
+	int NumVertices = 0;
+	for(int i = 0; i < NumRanges; i++)
+	{
+		Cmd.m_pRanges[i].m_Offset = pOffsets[i];
+		Cmd.m_pRanges[i].m_Count = pCounts[i];
+		NumVertices += pCounts[i];
+	}
+	CountDrawCall(Cmd.m_State.m_Texture, NumVertices);
+}
+
 int CGraphics_Threaded::IssueInit()
 {
 	int Flags = 0;
@@ -801,13 +1241,21 @@ int CGraphics_Threaded::Init()
 	for(int i = 0; i < MAX_TEXTURES-1; i++)
 		m_aTextureIndices[i] = i+1;
 	m_aTextureIndices[MAX_TEXTURES-1] = -1;
+	mem_zero(m_aTextureInfos, sizeof(m_aTextureInfos));
 
-	m_pBackend = CreateGraphicsBackend();
+	// init buffers
+	m_FirstFreeBuffer = 0;
+	for(int i = 0; i < MAX_BUFFERS-1; i++)
+		m_aBufferIndices[i] = i+1;
+	m_aBufferIndices[MAX_BUFFERS-1] = -1;
+
+	m_pBackend = m_pConfig->m_GfxNull ? CreateGraphicsBackendNull() : CreateGraphicsBackend();
 	if(InitWindow() != 0)
 		return -1;
 
 	// create command buffers
-	for(int i = 0; i < NUM_CMDBUFFERS; i++)
+	m_NumCommandBuffers = clamp(m_pConfig->m_GfxCommandBuffers, 2, (int)MAX_CMDBUFFERS);
+	for(int i = 0; i < m_NumCommandBuffers; i++)
 		m_apCommandBuffers[i] = new CCommandBuffer(128*1024, 2*1024*1024);
 	m_pCommandBuffer = m_apCommandBuffers[0];
 
@@ -861,8 +1309,18 @@ void CGraphics_Threaded::Shutdown()
 	m_pBackend = 0x0;
 
 	// delete the command buffers
-	for(int i = 0; i < NUM_CMDBUFFERS; i++)
+	for(int i = 0; i < m_NumCommandBuffers; i++)
 		delete m_apCommandBuffers[i];
+
+	if(m_pRecordedVertices)
+	{
+		mem_free(m_pRecordedVertices);
+		m_pRecordedVertices = 0;
+	}
+
+	for(int i = 0; i < m_lAtlasImages.size(); i++)
+		mem_free(m_lAtlasImages[i].m_pData);
+	m_lAtlasImages.clear();
 }
 
 int CGraphics_Threaded::GetNumScreens() const
@@ -965,6 +1423,10 @@ void CGraphics_Threaded::Swap()
 
 	// kick the command buffer
 	KickCommandBuffer();
+
+	m_LastFrameStats = m_FrameStats;
+	mem_zero(&m_FrameStats, sizeof(m_FrameStats));
+	m_LastDrawnTexture = -1;
 }
 
 bool CGraphics_Threaded::SetVSync(bool State)
@@ -1000,6 +1462,11 @@ void CGraphics_Threaded::WaitForIdle()
 	m_pBackend->WaitForIdle();
 }
 
+bool CGraphics_Threaded::FrameQueueFull() const
+{
+	return !m_pBackend->IsFenceDone(m_aCommandBufferFences[(m_CurrentCommandBuffer+1)%m_NumCommandBuffers]);
+}
+
 int CGraphics_Threaded::GetVideoModes(CVideoMode *pModes, int MaxModes, int Screen)
 {
 	if(m_pConfig->m_GfxDisplayAllModes)
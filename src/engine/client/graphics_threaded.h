@@ -1,5 +1,7 @@
 #pragma once
 
+#include <base/tl/array.h>
+
 #include <engine/graphics.h>
 
 class CCommandBuffer
@@ -47,10 +49,12 @@ class CCommandBuffer
 public:
 	CBuffer m_CmdBuffer;
 	CBuffer m_DataBuffer;
+	unsigned m_NumCommands;
 
 	enum
 	{
 		MAX_TEXTURES=1024*4,
+		MAX_BUFFERS=1024,
 	};
 
 	enum
@@ -74,9 +78,14 @@ public:
 		CMD_TEXTURE_DESTROY,
 		CMD_TEXTURE_UPDATE,
 
+		// buffer commands
+		CMD_BUFFER_CREATE,
+		CMD_BUFFER_DESTROY,
+
 		// rendering
 		CMD_CLEAR,
 		CMD_RENDER,
+		CMD_RENDER_BUFFER,
 
 		// swap
 		CMD_SWAP,
@@ -183,6 +192,23 @@ public:
 		CVertex *m_pVertices; // you should use the command buffer data to allocate vertices for this command
 	};
 
+	struct CBufferRange
+	{
+		int m_Offset; // in quads
+		int m_Count;
+	};
+
+	struct CRenderBufferCommand : public CCommand
+	{
+		CRenderBufferCommand() : CCommand(CMD_RENDER_BUFFER) {}
+		CState m_State;
+		int m_Slot;
+		bool m_UseColor; // draw with m_Color instead of the vertex colors
+		CColor m_Color;
+		unsigned m_NumRanges;
+		CBufferRange *m_pRanges; // allocated in the command buffer data
+	};
+
 	struct CScreenshotCommand : public CCommand
 	{
 		CScreenshotCommand() : CCommand(CMD_SCREENSHOT) {}
@@ -255,10 +281,27 @@ public:
 		int m_Slot;
 	};
 
+	struct CBufferCreateCommand : public CCommand
+	{
+		CBufferCreateCommand() : CCommand(CMD_BUFFER_CREATE) {}
+
+		int m_Slot;
+		int m_NumVertices;
+		CVertex *m_pVertices; // will be freed by the command processor
+	};
+
+	struct CBufferDestroyCommand : public CCommand
+	{
+		CBufferDestroyCommand() : CCommand(CMD_BUFFER_DESTROY) {}
+
+		int m_Slot;
+	};
+
 	//
 	CCommandBuffer(unsigned CmdBufferSize, unsigned DataBufferSize)
 	: m_CmdBuffer(CmdBufferSize), m_DataBuffer(DataBufferSize)
 	{
+		m_NumCommands = 0;
 	}
 
 	void *AllocData(unsigned WantedSize)
@@ -278,6 +321,7 @@ public:
 			return false;
 		mem_copy(pCmd, &Command, sizeof(Command));
 		pCmd->m_Size = sizeof(Command);
+		m_NumCommands++;
 		return true;
 	}
 
@@ -295,6 +339,7 @@ public:
 	{
 		m_CmdBuffer.Reset();
 		m_DataBuffer.Reset();
+		m_NumCommands = 0;
 	}
 };
 
@@ -320,6 +365,7 @@ public:
 
 	virtual int MemoryUsage() const = 0;
 	virtual int GetTextureArraySize() const = 0;
+	virtual bool BuffersSupported() const = 0;
 
 	virtual int GetNumScreens() const = 0;
 
@@ -333,7 +379,10 @@ public:
 	virtual int WindowActive() = 0;
 	virtual int WindowOpen() = 0;
 
-	virtual void RunBuffer(CCommandBuffer *pBuffer) = 0;
+	// queues the buffer and returns its fence, which is passed once the buffer is done
+	virtual unsigned RunBuffer(CCommandBuffer *pBuffer) = 0;
+	virtual bool IsFenceDone(unsigned Fence) const = 0;
+	virtual void WaitForFence(unsigned Fence) = 0;
 	virtual bool IsIdle() const = 0;
 	virtual void WaitForIdle() = 0;
 };
@@ -342,21 +391,52 @@ class CGraphics_Threaded : public IEngineGraphics
 {
 	enum
 	{
-		NUM_CMDBUFFERS = 2,
+		MAX_CMDBUFFERS = 4,
 
 		MAX_VERTICES = 32*1024,
 		MAX_TEXTURES = 1024*4,
+		MAX_BUFFERS = 1024,
 
 		DRAWING_QUADS=1,
-		DRAWING_LINES=2
+		DRAWING_LINES=2,
+
+		ATLAS_PAGE_SIZE=2048,
+		ATLAS_PADDING=8, // keeps the first mipmap levels from bleeding into each other
+	};
+
+	struct CTextureInfo
+	{
+		// textures packed into an atlas page map into a part of it
+		bool m_AtlasRegion;
+		int m_AtlasPage; // texture slot of the page, -1 until the atlas is built
+		float m_aAtlasOffset[2];
+		float m_aAtlasScale[2];
+
+		int m_NumAtlasRegions; // for pages, the regions that still use it
+	};
+
+	struct CAtlasImage
+	{
+		int m_Slot;
+		int m_Width;
+		int m_Height;
+		int m_X;
+		int m_Y;
+		int m_PageFlags;
+		unsigned char *m_pData;
+
+		bool operator<(const CAtlasImage &Other) const { return m_Height > Other.m_Height; }
 	};
 
 	CCommandBuffer::CState m_State;
 	IGraphicsBackend *m_pBackend;
 
-	CCommandBuffer *m_apCommandBuffers[NUM_CMDBUFFERS];
+	// filled in turn, a buffer is reused once the backend passed its fence
+	CCommandBuffer *m_apCommandBuffers[MAX_CMDBUFFERS];
+	unsigned m_aCommandBufferFences[MAX_CMDBUFFERS];
 	CCommandBuffer *m_pCommandBuffer;
 	unsigned m_CurrentCommandBuffer;
+	int m_NumCommandBuffers;
 
 	//
 	class IStorage *m_pStorage;
@@ -382,8 +462,37 @@ class CGraphics_Threaded : public IEngineGraphics
 	int m_aTextureIndices[MAX_TEXTURES];
 	int m_FirstFreeTexture;
 	int m_TextureMemoryUsage;
+	CTextureInfo m_aTextureInfos[MAX_TEXTURES];
+	float m_aTextureOffset[2];
+	float m_aTextureScale[2];
+
+	bool m_BuildingAtlas;
+	array<CAtlasImage> m_lAtlasImages;
+
+	// the last render command, following draws with the same state are appended to it
+	CCommandBuffer::CRenderCommand *m_pLastRenderCommand;
+	unsigned m_LastRenderCommandEnd;
+
+	CFrameStats m_FrameStats;
+	CFrameStats m_LastFrameStats;
+	int m_LastDrawnTexture;
+
+	void CountDrawCall(int Texture, int NumVertices);
+
+	int m_aBufferIndices[MAX_BUFFERS];
+	int m_aBufferDimensions[MAX_BUFFERS];
+	int m_FirstFreeBuffer;
+
+	// quads recorded for a buffer
+	bool m_Recording;
+	CCommandBuffer::CVertex *m_pRecordedVertices;
+	int m_NumRecordedVertices;
+	int m_RecordedVerticesSize;
+	int m_RecordedDimension;
 
 	void FlushVertices();
+	bool MergeVertices(int PrimType, int PrimCount, int NumVerts);
+	void BuildAtlasPage(const array<int> &lImages, int Height, int Flags);
 	void AddVertices(int Count);
 	void Rotate4(const CCommandBuffer::CPoint &rCenter, CCommandBuffer::CVertex *pPoints);
 
@@ -406,6 +515,7 @@ public:
 	virtual void WrapMode(int WrapU, int WrapV);
 
 	virtual int MemoryUsage() const;
+	virtual const CFrameStats &FrameStats() const { return m_LastFrameStats; }
 
 	virtual void MapScreen(float TopLeftX, float TopLeftY, float BottomRightX, float BottomRightY);
 	virtual void GetScreen(float *pTopLeftX, float *pTopLeftY, float *pBottomRightX, float *pBottomRightY);
@@ -420,12 +530,16 @@ public:
 
 	// simple uncompressed RGBA loaders
 	virtual IGraphics::CTextureHandle LoadTexture(const char *pFilename, int StorageType, int StoreFormat, int Flags);
+	virtual IGraphics::CTextureHandle InvalidTexture() const { return m_InvalidTexture; }
 	virtual int LoadPNG(CImageInfo *pImg, const char *pFilename, int StorageType);
 
 	void ScreenshotDirect(const char *pFilename);
 
 	virtual void TextureSet(CTextureHandle TextureID);
 
+	virtual void AtlasBegin();
+	virtual void AtlasEnd();
+
 	virtual void Clear(float r, float g, float b);
 
 	virtual void QuadsBegin();
@@ -445,8 +559,15 @@ public:
 	virtual void QuadsDraw(CQuadItem *pArray, int Num);
 	virtual void QuadsDrawTL(const CQuadItem *pArray, int Num);
 	virtual void QuadsDrawFreeform(const CFreeformItem *pArray, int Num);
+	virtual void QuadsDrawSprites(const CSpriteItem *pArray, int Num);
 	virtual void QuadsText(float x, float y, float Size, const char *pText);
 
+	virtual bool BuffersSupported();
+	virtual void BufferBegin();
+	virtual CBufferHandle BufferEnd();
+	virtual void UnloadBuffer(CBufferHandle *pBuffer);
+	virtual void RenderBuffer(CBufferHandle Buffer, const int *pOffsets, const int *pCounts, int NumRanges, const vec4 *pColor);
+
 	virtual int GetNumScreens() const;
 	virtual void Minimize();
 	virtual void Maximize();
@@ -472,6 +593,8 @@ public:
 	virtual void InsertSignal(semaphore *pSemaphore);
 	virtual bool IsIdle() const;
 	virtual void WaitForIdle();
+	virtual bool FrameQueueFull() const;
 };
 
 extern IGraphicsBackend *CreateGraphicsBackend();
+extern IGraphicsBackend *CreateGraphicsBackendNull();
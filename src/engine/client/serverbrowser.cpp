@@ -1,5 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm> // stable_sort
+
 #include <base/math.h>
 #include <base/system.h>
 
@@ -24,6 +26,23 @@
 
 
 static const char *s_pFilename = "serverlist.json";
+static const char *s_pCacheFilename = "serverlist.dat";
+
+// binary cache of the last complete internet server list
+struct CServerlistCacheHeader
+{
+	enum
+	{
+		VERSION=1,
+	};
+
+	char m_aID[8];
+	int m_Version;
+	int m_InfoSize;
+	int m_NumServers;
+};
+
+static const char s_aCacheID[8] = "TWSLIST";
 
 inline int AddrHash(const NETADDR *pAddr)
 {
@@ -39,6 +58,11 @@ inline int GetNewToken()
 	return random_int();
 }
 
+static bool CompareLatency(const CServerEntry *pEntry1, const CServerEntry *pEntry2)
+{
+	return pEntry1->m_Info.m_Latency < pEntry2->m_Info.m_Latency;
+}
+
 //
 void CServerBrowser::CServerlist::Clear()
 {
@@ -66,7 +90,16 @@ CServerBrowser::CServerBrowser()
 	m_pLastReqServer = 0;
 	m_NumRequests = 0;
 
+	m_RequestWindow = 0;
+	m_NumResponses = 0;
+	m_NumTimeouts = 0;
+	m_NumPeriodResponses = 0;
+	m_NumPeriodTimeouts = 0;
+	m_RequestStatsTime = 0;
+	m_RefreshStartTime = 0;
+
 	m_NeedRefresh = 0;
+	m_CachedServerlist = false;
 	m_RefreshFlags = 0;
 
 	// the token is to keep server refresh separated from each other
@@ -88,11 +121,14 @@ void CServerBrowser::Init(class CNetClient *pNetClient, const char *pNetVersion)
 
 	m_ServerBrowserFavorites.Init(pNetClient, m_pConsole, Kernel()->RequestInterface<IEngine>(), pConfigManager);
 	m_ServerBrowserFilter.Init(Config(), Kernel()->RequestInterface<IFriends>(), pNetVersion);
+
+	LoadServerlistCache();
 }
 
 void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CServerInfo *pInfo)
 {
 	CServerEntry *pEntry = 0;
+	int Type = IServerBrowser::TYPE_INTERNET;
 	switch(SetType)
 	{
 	case SET_MASTER_ADD:
@@ -104,8 +140,9 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 
 			if(!Find(IServerBrowser::TYPE_INTERNET, Addr))
 			{
+				// favorites get requested first
 				pEntry = Add(IServerBrowser::TYPE_INTERNET, Addr);
-				QueueRequest(pEntry);
+				QueueRequest(pEntry, pEntry->m_Info.m_Favorite);
 			}
 		}
 		break;
@@ -123,8 +160,6 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 		break;
 	case SET_TOKEN:
 		{
-			int Type;
-
 			// internet entry
 			if(m_RefreshFlags&IServerBrowser::REFRESHFLAG_INTERNET)
 			{
@@ -132,6 +167,11 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 				pEntry = Find(Type, Addr);
 				if(pEntry && (pEntry->m_InfoState != CServerEntry::STATE_PENDING || Token != pEntry->m_CurrentToken))
 					pEntry = 0;
+				if(pEntry)
+				{
+					m_NumResponses++;
+					m_NumPeriodResponses++;
+				}
 			}
 
 			// lan entry
@@ -144,6 +184,8 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 			// set info
 			if(pEntry)
 			{
+				if(Type == m_ActServerlistType)
+					m_ServerBrowserFilter.RemoveServer(m_aServerlist[Type].m_ppServerlist, m_aServerlist[Type].m_NumServers, pEntry->m_Info.m_ServerIndex);
 				SetInfo(Type, pEntry, *pInfo);
 				if(Type == IServerBrowser::TYPE_LAN)
 					pEntry->m_Info.m_Latency = min(static_cast<int>((time_get()-m_BroadcastTime)*1000/time_freq()), 999);
@@ -154,8 +196,9 @@ void CServerBrowser::Set(const NETADDR &Addr, int SetType, int Token, const CSer
 		}
 	}
 
-	if(pEntry)
-		m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, CServerBrowserFilter::RESORT_FLAG_FORCE);
+	// only (re)insert the changed entry instead of resorting the whole list
+	if(pEntry && Type == m_ActServerlistType)
+		m_ServerBrowserFilter.InsertServer(m_aServerlist[Type].m_ppServerlist, m_aServerlist[Type].m_NumServers, pEntry->m_Info.m_ServerIndex);
 }
 
 void CServerBrowser::Update(bool ForceResort)
@@ -215,13 +258,35 @@ void CServerBrowser::Update(bool ForceResort)
 		if(pEntry->m_RequestTime && pEntry->m_RequestTime+Timeout < Now)
 		{
 			// timeout
+			m_NumTimeouts++;
+			m_NumPeriodTimeouts++;
+			m_pNetClient->PurgeStoredPacket(pEntry->m_TrackID);
 			RemoveRequest(pEntry);
+
+			// try again at the end of the queue
+			if(pEntry->m_NumRetries < REQUEST_RETRIES)
+			{
+				pEntry->m_NumRetries++;
+				pEntry->m_RequestTime = 0;
+				QueueRequest(pEntry);
+			}
+			else if(pEntry->m_Info.m_MaxClients)
+			{
+				// drop outdated info from the cache
+				if(m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
+					m_ServerBrowserFilter.RemoveServer(m_aServerlist[IServerBrowser::TYPE_INTERNET].m_ppServerlist, m_aServerlist[IServerBrowser::TYPE_INTERNET].m_NumServers, pEntry->m_Info.m_ServerIndex);
+				ResetInfo(IServerBrowser::TYPE_INTERNET, pEntry);
+				if(m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
+					m_ServerBrowserFilter.InsertServer(m_aServerlist[IServerBrowser::TYPE_INTERNET].m_ppServerlist, m_aServerlist[IServerBrowser::TYPE_INTERNET].m_NumServers, pEntry->m_Info.m_ServerIndex);
+			}
 		}
 
 		pEntry = pNext;
 	}
 
-	// do timeouts
+	UpdateRequestWindow(Now);
+
+	// do requests
 	pEntry = m_pFirstReqServer;
 	Count = 0;
 	while(1)
@@ -229,8 +294,8 @@ void CServerBrowser::Update(bool ForceResort)
 		if(!pEntry) // no more entries
 			break;
 
-		// no more then 10 concurrent requests
-		if(Count == Config()->m_BrMaxRequests)
+		// limit concurrent requests
+		if(Count >= m_RequestWindow)
 			break;
 
 		if(pEntry->m_RequestTime == 0)
@@ -240,6 +305,20 @@ void CServerBrowser::Update(bool ForceResort)
 		pEntry = pEntry->m_pNextReq;
 	}
 
+	// refresh finished
+	if(m_RefreshStartTime && !m_NeedRefresh && !m_MasterRefreshTime && !m_pFirstReqServer)
+	{
+		if(Config()->m_Debug)
+		{
+			char aBuf[256];
+			str_format(aBuf, sizeof(aBuf), "refresh done servers=%d responses=%d timeouts=%d window=%d time=%dms",
+				m_aServerlist[IServerBrowser::TYPE_INTERNET].m_NumServers, m_NumResponses, m_NumTimeouts, m_RequestWindow,
+				(int)((Now-m_RefreshStartTime)*1000/time_freq()));
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", aBuf);
+		}
+		m_RefreshStartTime = 0;
+	}
+
 	// update favorite
 	const NETADDR *pFavAddr = m_ServerBrowserFavorites.UpdateFavorites();
 	if(pFavAddr)
@@ -314,13 +393,42 @@ void CServerBrowser::Refresh(int RefreshFlags)
 		{
 			m_pNetClient->PurgeStoredPacket(pEntry->m_TrackID);
 		}
-		m_aServerlist[IServerBrowser::TYPE_INTERNET].Clear();
-		if(m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
-			m_ServerBrowserFilter.Clear();
 		m_pFirstReqServer = 0;
 		m_pLastReqServer = 0;
 		m_NumRequests = 0;
 
+		m_RequestWindow = max(1, Config()->m_BrMaxRequests);
+		m_NumResponses = 0;
+		m_NumTimeouts = 0;
+		m_NumPeriodResponses = 0;
+		m_NumPeriodTimeouts = 0;
+		m_RequestStatsTime = time_get();
+		m_RefreshStartTime = m_RequestStatsTime;
+
+		if(m_CachedServerlist)
+		{
+			// keep showing the cached servers and request them again, favorites and lowest ping first
+			CServerlist *pList = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+			CServerEntry **ppQueue = (CServerEntry **)mem_alloc(pList->m_NumServers*sizeof(CServerEntry*), 1);
+			mem_copy(ppQueue, pList->m_ppServerlist, pList->m_NumServers*sizeof(CServerEntry*));
+			std::stable_sort(ppQueue, ppQueue+pList->m_NumServers, CompareLatency);
+			for(int i = 0; i < pList->m_NumServers; i++)
+			{
+				ppQueue[i]->m_CurrentToken = GetNewToken();
+				ppQueue[i]->m_RequestTime = 0;
+				ppQueue[i]->m_NumRetries = 0;
+				QueueRequest(ppQueue[i], ppQueue[i]->m_Info.m_Favorite);
+			}
+			mem_free(ppQueue);
+			m_CachedServerlist = false;
+		}
+		else
+		{
+			m_aServerlist[IServerBrowser::TYPE_INTERNET].Clear();
+			if(m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
+				m_ServerBrowserFilter.Clear();
+		}
+
 		m_NeedRefresh = 1;
 		for(int i = 0; i < m_ServerBrowserFavorites.m_NumFavoriteServers; i++)
 			if(m_ServerBrowserFavorites.m_aFavoriteServers[i].m_State >= CServerBrowserFavorites::FAVSTATE_ADDR)
@@ -428,14 +536,7 @@ CServerEntry *CServerBrowser::Add(int ServerlistType, const NETADDR &Addr)
 	pEntry->m_Addr = Addr;
 	pEntry->m_InfoState = CServerEntry::STATE_INVALID;
 	pEntry->m_CurrentToken = GetNewToken();
-	pEntry->m_Info.m_NetAddr = Addr;
-
-	pEntry->m_Info.m_Latency = 999;
-	net_addr_str(&Addr, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aAddress), true);
-	str_copy(pEntry->m_Info.m_aName, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aName));
-	str_copy(pEntry->m_Info.m_aHostname, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aHostname));
-
-	UpdateFavoriteState(&pEntry->m_Info);
+	ResetInfo(ServerlistType, pEntry);
 
 	// add to the hash list
 	int Hash = AddrHash(&Addr);
@@ -479,19 +580,54 @@ CServerEntry *CServerBrowser::Find(int ServerlistType, const NETADDR &Addr)
 	return (CServerEntry*)0;
 }
 
-void CServerBrowser::QueueRequest(CServerEntry *pEntry)
+void CServerBrowser::QueueRequest(CServerEntry *pEntry, bool Priority)
 {
 	// add it to the list of servers that we should request info from
-	pEntry->m_pPrevReq = m_pLastReqServer;
-	if(m_pLastReqServer)
-		m_pLastReqServer->m_pNextReq = pEntry;
-	else
+	if(Priority)
+	{
+		pEntry->m_pNextReq = m_pFirstReqServer;
+		if(m_pFirstReqServer)
+			m_pFirstReqServer->m_pPrevReq = pEntry;
+		else
+			m_pLastReqServer = pEntry;
 		m_pFirstReqServer = pEntry;
-	m_pLastReqServer = pEntry;
+	}
+	else
+	{
+		pEntry->m_pPrevReq = m_pLastReqServer;
+		if(m_pLastReqServer)
+			m_pLastReqServer->m_pNextReq = pEntry;
+		else
+			m_pFirstReqServer = pEntry;
+		m_pLastReqServer = pEntry;
+	}
 
 	m_NumRequests++;
 }
 
+void CServerBrowser::UpdateRequestWindow(int64 Now)
+{
+	// adjust the number of concurrent requests once per timeout period depending on the loss
+	if(m_RequestStatsTime+time_freq() > Now)
+		return;
+
+	int NumSamples = m_NumPeriodResponses+m_NumPeriodTimeouts;
+	if(NumSamples > 0)
+	{
+		int MinWindow = max(1, Config()->m_BrMaxRequests/4);
+		int MaxWindow = max(1, Config()->m_BrMaxRequests*4);
+		int Loss = m_NumPeriodTimeouts*100/NumSamples;
+		if(Loss <= REQUEST_LOSS_LOW)
+			m_RequestWindow = min(MaxWindow, m_RequestWindow+m_RequestWindow/2+1);
+		else if(Loss >= REQUEST_LOSS_HIGH)
+			m_RequestWindow = max(MinWindow, m_RequestWindow/2);
+	}
+
+	m_NumPeriodResponses = 0;
+	m_NumPeriodTimeouts = 0;
+	m_RequestStatsTime = Now;
+}
+
 void CServerBrowser::RemoveRequest(CServerEntry *pEntry)
 {
 	if(pEntry->m_pPrevReq || pEntry->m_pNextReq || m_pFirstReqServer == pEntry)
@@ -571,7 +707,11 @@ void CServerBrowser::RequestImpl(const NETADDR &Addr, CServerEntry *pEntry)
 
 void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CServerInfo &Info)
 {
+	m_aServerlist[ServerlistType].m_NumPlayers -= pEntry->m_Info.m_NumPlayers;
+	m_aServerlist[ServerlistType].m_NumClients -= pEntry->m_Info.m_NumClients;
+
 	bool Fav = pEntry->m_Info.m_Favorite;
+	int ServerIndex = pEntry->m_Info.m_ServerIndex;
 	pEntry->m_Info = Info;
 	pEntry->m_Info.m_Flags &= FLAG_PASSWORD|FLAG_TIMESCORE;
 	if(str_comp(pEntry->m_Info.m_aGameType, "DM") == 0 || str_comp(pEntry->m_Info.m_aGameType, "TDM") == 0 || str_comp(pEntry->m_Info.m_aGameType, "CTF") == 0 ||
@@ -587,6 +727,7 @@ void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CSe
 		str_comp(pEntry->m_Info.m_aMap, "lms1") == 0)
 		pEntry->m_Info.m_Flags |= FLAG_PUREMAP;
 	pEntry->m_Info.m_Favorite = Fav;
+	pEntry->m_Info.m_ServerIndex = ServerIndex;
 	pEntry->m_Info.m_NetAddr = pEntry->m_Addr;
 
 	m_aServerlist[ServerlistType].m_NumPlayers += pEntry->m_Info.m_NumPlayers;
@@ -595,6 +736,24 @@ void CServerBrowser::SetInfo(int ServerlistType, CServerEntry *pEntry, const CSe
 	pEntry->m_InfoState = CServerEntry::STATE_READY;
 }
 
+void CServerBrowser::ResetInfo(int ServerlistType, CServerEntry *pEntry)
+{
+	m_aServerlist[ServerlistType].m_NumPlayers -= pEntry->m_Info.m_NumPlayers;
+	m_aServerlist[ServerlistType].m_NumClients -= pEntry->m_Info.m_NumClients;
+
+	int ServerIndex = pEntry->m_Info.m_ServerIndex;
+	mem_zero(&pEntry->m_Info, sizeof(pEntry->m_Info));
+	pEntry->m_Info.m_ServerIndex = ServerIndex;
+	pEntry->m_Info.m_NetAddr = pEntry->m_Addr;
+
+	pEntry->m_Info.m_Latency = 999;
+	net_addr_str(&pEntry->m_Addr, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aAddress), true);
+	str_copy(pEntry->m_Info.m_aName, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aName));
+	str_copy(pEntry->m_Info.m_aHostname, pEntry->m_Info.m_aAddress, sizeof(pEntry->m_Info.m_aHostname));
+
+	UpdateFavoriteState(&pEntry->m_Info);
+}
+
 void CServerBrowser::LoadServerlist()
 {
 	// read file data into buffer
@@ -649,4 +808,94 @@ void CServerBrowser::SaveServerlist()
 		Writer.WriteStrValue(m_aServerlist[IServerBrowser::TYPE_INTERNET].m_ppServerlist[i]->m_Info.m_aAddress);
 	Writer.EndArray();
 	Writer.EndObject();
+
+	SaveServerlistCache();
+}
+
+void CServerBrowser::LoadServerlistCache()
+{
+	IOHANDLE File = Storage()->OpenFile(s_pCacheFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+
+	// check the header, the cache is only valid for the same build layout
+	CServerlistCacheHeader Header;
+	int FileSize = (int)io_length(File);
+	if(io_read(File, &Header, sizeof(Header)) != sizeof(Header) || mem_comp(Header.m_aID, s_aCacheID, sizeof(s_aCacheID)) != 0 ||
+		Header.m_Version != CServerlistCacheHeader::VERSION || Header.m_InfoSize != (int)sizeof(CServerInfo) ||
+		Header.m_NumServers <= 0 || Header.m_NumServers > (FileSize-(int)sizeof(Header))/(int)sizeof(CServerInfo))
+	{
+		io_close(File);
+		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client_srvbrowse", "ignoring outdated server list cache");
+		return;
+	}
+
+	// read all entries at once
+	CServerInfo *pInfos = (CServerInfo *)mem_alloc(Header.m_NumServers*sizeof(CServerInfo), 1);
+	bool Valid = io_read(File, pInfos, Header.m_NumServers*sizeof(CServerInfo)) == Header.m_NumServers*sizeof(CServerInfo);
+	io_close(File);
+
+	for(int i = 0; Valid && i < Header.m_NumServers; i++)
+	{
+		if(Find(IServerBrowser::TYPE_INTERNET, pInfos[i].m_NetAddr))
+			continue;
+
+		// terminate strings in case the file is corrupted
+		pInfos[i].m_aGameType[sizeof(pInfos[i].m_aGameType)-1] = 0;
+		pInfos[i].m_aName[sizeof(pInfos[i].m_aName)-1] = 0;
+		pInfos[i].m_aHostname[sizeof(pInfos[i].m_aHostname)-1] = 0;
+		pInfos[i].m_aMap[sizeof(pInfos[i].m_aMap)-1] = 0;
+		pInfos[i].m_aVersion[sizeof(pInfos[i].m_aVersion)-1] = 0;
+		pInfos[i].m_aAddress[sizeof(pInfos[i].m_aAddress)-1] = 0;
+		pInfos[i].m_NumClients = clamp(pInfos[i].m_NumClients, 0, (int)MAX_CLIENTS);
+		for(int c = 0; c < pInfos[i].m_NumClients; c++)
+		{
+			pInfos[i].m_aClients[c].m_aName[sizeof(pInfos[i].m_aClients[c].m_aName)-1] = 0;
+			pInfos[i].m_aClients[c].m_aClan[sizeof(pInfos[i].m_aClients[c].m_aClan)-1] = 0;
+		}
+
+		CServerEntry *pEntry = Add(IServerBrowser::TYPE_INTERNET, pInfos[i].m_NetAddr);
+		SetInfo(IServerBrowser::TYPE_INTERNET, pEntry, pInfos[i]);
+	}
+	mem_free(pInfos);
+
+	m_CachedServerlist = m_aServerlist[IServerBrowser::TYPE_INTERNET].m_NumServers > 0;
+	if(m_CachedServerlist && m_ActServerlistType == IServerBrowser::TYPE_INTERNET)
+		m_ServerBrowserFilter.Sort(m_aServerlist[m_ActServerlistType].m_ppServerlist, m_aServerlist[m_ActServerlistType].m_NumServers, CServerBrowserFilter::RESORT_FLAG_FORCE);
+
+	if(Config()->m_Debug)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "loaded %d servers from the cache", m_aServerlist[IServerBrowser::TYPE_INTERNET].m_NumServers);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client_srvbrowse", aBuf);
+	}
+}
+
+void CServerBrowser::SaveServerlistCache()
+{
+	// only store complete results
+	if(m_pFirstReqServer || m_CachedServerlist)
+		return;
+
+	const CServerlist *pList = &m_aServerlist[IServerBrowser::TYPE_INTERNET];
+	CServerlistCacheHeader Header;
+	mem_copy(Header.m_aID, s_aCacheID, sizeof(Header.m_aID));
+	Header.m_Version = CServerlistCacheHeader::VERSION;
+	Header.m_InfoSize = sizeof(CServerInfo);
+	Header.m_NumServers = 0;
+	for(int i = 0; i < pList->m_NumServers; ++i)
+		if(pList->m_ppServerlist[i]->m_InfoState == CServerEntry::STATE_READY)
+			Header.m_NumServers++;
+	if(Header.m_NumServers == 0)
+		return;
+
+	IOHANDLE File = Storage()->OpenFile(s_pCacheFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+
+	io_write(File, &Header, sizeof(Header));
+	for(int i = 0; i < pList->m_NumServers; ++i)
+		if(pList->m_ppServerlist[i]->m_InfoState == CServerEntry::STATE_READY)
+			io_write(File, &pList->m_ppServerlist[i]->m_Info, sizeof(CServerInfo));
+	io_close(File);
 }
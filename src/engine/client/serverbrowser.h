@@ -16,6 +16,10 @@ public:
 		SET_MASTER_ADD=1,
 		SET_FAV_ADD,
 		SET_TOKEN,
+
+		REQUEST_RETRIES=1,
+		REQUEST_LOSS_LOW=20, // percent
+		REQUEST_LOSS_HIGH=40,
 	};
 		
 	CServerBrowser();
@@ -56,6 +60,8 @@ public:
 	
 	void LoadServerlist();
 	void SaveServerlist();
+	void LoadServerlistCache();
+	void SaveServerlistCache();
 
 private:
 	class CNetClient *m_pNetClient;
@@ -93,7 +99,17 @@ private:
 	CServerEntry *m_pLastReqServer;
 	int m_NumRequests;
 
+	// adaptive number of concurrent requests
+	int m_RequestWindow;
+	int m_NumResponses;
+	int m_NumTimeouts;
+	int m_NumPeriodResponses;
+	int m_NumPeriodTimeouts;
+	int64 m_RequestStatsTime;
+	int64 m_RefreshStartTime;
+
 	int m_NeedRefresh;
+	bool m_CachedServerlist; // internet list was loaded from the cache and not refreshed yet
 
 	// the token is to keep server refresh separated from each other
 	int m_CurrentLanToken;
@@ -104,10 +120,12 @@ private:
 
 	CServerEntry *Add(int ServerlistType, const NETADDR &Addr);
 	CServerEntry *Find(int ServerlistType, const NETADDR &Addr);
-	void QueueRequest(CServerEntry *pEntry);
+	void QueueRequest(CServerEntry *pEntry, bool Priority = false);
+	void UpdateRequestWindow(int64 Now);
 	void RemoveRequest(CServerEntry *pEntry);
 	void RequestImpl(const NETADDR &Addr, CServerEntry *pEntry);
 	void SetInfo(int ServerlistType, CServerEntry *pEntry, const CServerInfo &Info);
+	void ResetInfo(int ServerlistType, CServerEntry *pEntry);
 };
 
 #endif
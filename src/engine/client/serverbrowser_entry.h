@@ -15,6 +15,7 @@ public:
 
 	NETADDR m_Addr;
 	int64 m_RequestTime;
+	int m_NumRetries;
 	int m_InfoState;
 	int m_CurrentToken;	// the token is to keep server refresh separated from each other
 	int m_TrackID;
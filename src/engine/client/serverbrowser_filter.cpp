@@ -14,7 +14,7 @@
 
 class SortWrap
 {
-	typedef bool (CServerBrowserFilter::CServerFilter::*SortFunc)(int, int) const;
+	typedef CServerBrowserFilter::CServerFilter::SortFunc SortFunc;
 	SortFunc m_pfnSort;
 	CServerBrowserFilter::CServerFilter *m_pThis;
 public:
@@ -95,130 +95,141 @@ void CServerBrowserFilter::CServerFilter::Filter()
 	// filter the servers
 	for(int i = 0; i < NumServers; i++)
 	{
-		int Filtered = 0;
-
-		int RelevantClientCount = (m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumPlayers : m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients;
-		if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_BOTS)
+		if(FilterEntry(i))
 		{
-			RelevantClientCount -= m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumBotPlayers;
-			if(!(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS))
-				RelevantClientCount -= m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumBotSpectators;
+			m_pSortedServerlist[m_NumSortedServers++] = i;
+			m_NumSortedPlayers += GetRelevantClientCount(i);
 		}
+	}
+}
 
-		if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_EMPTY && RelevantClientCount == 0)
-			Filtered = 1;
-		else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FULL && ((m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS && m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumPlayers == m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_MaxPlayers) ||
-				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients == m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_MaxClients))
-			Filtered = 1;
-		else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_PW && m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Flags&IServerBrowser::FLAG_PASSWORD)
-			Filtered = 1;
-		else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FAVORITE && !m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Favorite)
-			Filtered = 1;
-		else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_PURE && !(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Flags&IServerBrowser::FLAG_PURE))
-			Filtered = 1;
-		else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_PURE_MAP &&  !(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Flags&IServerBrowser::FLAG_PUREMAP))
-			Filtered = 1;
-		else if(m_FilterInfo.m_Ping < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Latency)
-			Filtered = 1;
-		else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_COMPAT_VERSION && str_comp_num(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aVersion, m_pServerBrowserFilter->m_aNetVersion, 3) != 0)
-			Filtered = 1;
-		else if(m_FilterInfo.m_aAddress[0] && !str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aAddress, m_FilterInfo.m_aAddress))
-			Filtered = 1;
-		else if(m_FilterInfo.IsLevelFiltered(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_ServerLevel))
-			Filtered = 1;
-		else
+int CServerBrowserFilter::CServerFilter::GetRelevantClientCount(int Index) const
+{
+	const CServerEntry *pEntry = m_pServerBrowserFilter->m_ppServerlist[Index];
+	int RelevantClientCount = (m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? pEntry->m_Info.m_NumPlayers : pEntry->m_Info.m_NumClients;
+	if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_BOTS)
+	{
+		RelevantClientCount -= pEntry->m_Info.m_NumBotPlayers;
+		if(!(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS))
+			RelevantClientCount -= pEntry->m_Info.m_NumBotSpectators;
+	}
+	return RelevantClientCount;
+}
+
+bool CServerBrowserFilter::CServerFilter::FilterEntry(int i)
+{
+	int Filtered = 0;
+	int RelevantClientCount = GetRelevantClientCount(i);
+
+	if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_EMPTY && RelevantClientCount == 0)
+		Filtered = 1;
+	else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FULL && ((m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS && m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumPlayers == m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_MaxPlayers) ||
+			m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients == m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_MaxClients))
+		Filtered = 1;
+	else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_PW && m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Flags&IServerBrowser::FLAG_PASSWORD)
+		Filtered = 1;
+	else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FAVORITE && !m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Favorite)
+		Filtered = 1;
+	else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_PURE && !(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Flags&IServerBrowser::FLAG_PURE))
+		Filtered = 1;
+	else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_PURE_MAP &&  !(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Flags&IServerBrowser::FLAG_PUREMAP))
+		Filtered = 1;
+	else if(m_FilterInfo.m_Ping < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_Latency)
+		Filtered = 1;
+	else if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_COMPAT_VERSION && str_comp_num(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aVersion, m_pServerBrowserFilter->m_aNetVersion, 3) != 0)
+		Filtered = 1;
+	else if(m_FilterInfo.m_aAddress[0] && !str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aAddress, m_FilterInfo.m_aAddress))
+		Filtered = 1;
+	else if(m_FilterInfo.IsLevelFiltered(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_ServerLevel))
+		Filtered = 1;
+	else
+	{
+		if(m_FilterInfo.m_aGametype[0][0])
 		{
-			if(m_FilterInfo.m_aGametype[0][0])
+			Filtered = 1;
+			for(int Index = 0; Index < CServerFilterInfo::MAX_GAMETYPES; ++Index)
 			{
-				Filtered = 1;
-				for(int Index = 0; Index < CServerFilterInfo::MAX_GAMETYPES; ++Index)
+				if(!m_FilterInfo.m_aGametype[Index][0])
+					break;
+				if(!str_comp_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aGameType, m_FilterInfo.m_aGametype[Index]))
 				{
-					if(!m_FilterInfo.m_aGametype[Index][0])
-						break;
-					if(!str_comp_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aGameType, m_FilterInfo.m_aGametype[Index]))
-					{
-						Filtered = 0;
-						break;
-					}
+					Filtered = 0;
+					break;
 				}
 			}
+		}
 
-			if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_COUNTRY)
+		if(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_COUNTRY)
+		{
+			Filtered = 1;
+			// match against player country
+			for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
 			{
-				Filtered = 1;
-				// match against player country
-				for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
+				if(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_Country == m_FilterInfo.m_Country)
 				{
-					if(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_Country == m_FilterInfo.m_Country)
-					{
-						Filtered = 0;
-						break;
-					}
+					Filtered = 0;
+					break;
 				}
 			}
+		}
 
-			if(!Filtered && Config()->m_BrFilterString[0] != 0)
-			{
-				int MatchFound = 0;
-
-				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit = 0;
-
-				// match against server name
-				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aName, Config()->m_BrFilterString))
-				{
-					MatchFound = 1;
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_SERVERNAME;
-				}
+		if(!Filtered && Config()->m_BrFilterString[0] != 0)
+		{
+			int MatchFound = 0;
 
-				// match against players
-				for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
-				{
-					if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aName, Config()->m_BrFilterString) ||
-						str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aClan, Config()->m_BrFilterString))
-					{
-						MatchFound = 1;
-						m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_PLAYER;
-						break;
-					}
-				}
+			m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit = 0;
 
-				// match against map
-				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aMap, Config()->m_BrFilterString))
-				{
-					MatchFound = 1;
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_MAPNAME;
-				}
+			// match against server name
+			if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aName, Config()->m_BrFilterString))
+			{
+				MatchFound = 1;
+				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_SERVERNAME;
+			}
 
-				// match against game type
-				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aGameType, Config()->m_BrFilterString))
+			// match against players
+			for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
+			{
+				if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aName, Config()->m_BrFilterString) ||
+					str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aClan, Config()->m_BrFilterString))
 				{
 					MatchFound = 1;
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_GAMETYPE;
+					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_PLAYER;
+					break;
 				}
-
-				if(!MatchFound)
-					Filtered = 1;
 			}
-		}
 
-		if(Filtered == 0)
-		{
-			// check for friend
-			m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState = CContactInfo::CONTACT_NO;
-			for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
+			// match against map
+			if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aMap, Config()->m_BrFilterString))
 			{
-				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_FriendState = m_pServerBrowserFilter->m_pFriends->GetFriendState(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aName,
-					m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aClan);
-				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState = max(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState, m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_FriendState);
+				MatchFound = 1;
+				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_MAPNAME;
 			}
 
-			if(!(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FRIENDS) || m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState != CContactInfo::CONTACT_NO)
+			// match against game type
+			if(str_find_nocase(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aGameType, Config()->m_BrFilterString))
 			{
-				m_pSortedServerlist[m_NumSortedServers++] = i;
-				m_NumSortedPlayers += RelevantClientCount;
+				MatchFound = 1;
+				m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_QuickSearchHit |= IServerBrowser::QUICK_GAMETYPE;
 			}
+
+			if(!MatchFound)
+				Filtered = 1;
 		}
 	}
+
+	if(Filtered)
+		return false;
+
+	// check for friend
+	m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState = CContactInfo::CONTACT_NO;
+	for(int p = 0; p < m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_NumClients; p++)
+	{
+		m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_FriendState = m_pServerBrowserFilter->m_pFriends->GetFriendState(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aName,
+			m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_aClan);
+		m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState = max(m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState, m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_aClients[p].m_FriendState);
+	}
+
+	return !(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_FRIENDS) || m_pServerBrowserFilter->m_ppServerlist[i]->m_Info.m_FriendState != CContactInfo::CONTACT_NO;
 }
 
 int CServerBrowserFilter::CServerFilter::GetSortHash() const
@@ -239,38 +250,78 @@ int CServerBrowserFilter::CServerFilter::GetSortHash() const
 	return i;
 }
 
-void CServerBrowserFilter::CServerFilter::Sort()
+CServerBrowserFilter::CServerFilter::SortFunc CServerBrowserFilter::CServerFilter::GetSortFunc() const
 {
-	// create filtered list
-	Filter();
-
-	// sort
 	switch(Config()->m_BrSort)
 	{
-	case IServerBrowser::SORT_NAME:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortCompareName));
-		break;
 	case IServerBrowser::SORT_PING:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortComparePing));
-		break;
+		return &CServerBrowserFilter::CServerFilter::SortComparePing;
 	case IServerBrowser::SORT_MAP:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortCompareMap));
-		break;
+		return &CServerBrowserFilter::CServerFilter::SortCompareMap;
 	case IServerBrowser::SORT_NUMPLAYERS:
 		if(!(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_BOTS))
-			std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this,
-						(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumClients));
+			return (m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumClients;
 		else
-			std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this,
-						(m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumRealPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumRealClients));
-		break;
+			return (m_FilterInfo.m_SortHash&IServerBrowser::FILTER_SPECTATORS) ? &CServerBrowserFilter::CServerFilter::SortCompareNumRealPlayers : &CServerBrowserFilter::CServerFilter::SortCompareNumRealClients;
 	case IServerBrowser::SORT_GAMETYPE:
-		std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, &CServerBrowserFilter::CServerFilter::SortCompareGametype));
+		return &CServerBrowserFilter::CServerFilter::SortCompareGametype;
+	default:
+		return &CServerBrowserFilter::CServerFilter::SortCompareName;
 	}
+}
+
+void CServerBrowserFilter::CServerFilter::Sort()
+{
+	// create filtered list
+	Filter();
+
+	// sort
+	std::stable_sort(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, SortWrap(this, GetSortFunc()));
 
 	m_FilterInfo.m_SortHash = GetSortHash();
 }
 
+void CServerBrowserFilter::CServerFilter::RemoveEntry(int Index)
+{
+	for(int i = 0; i < m_NumSortedServers; i++)
+	{
+		if(m_pSortedServerlist[i] == Index)
+		{
+			m_NumSortedPlayers -= GetRelevantClientCount(Index);
+			mem_move(&m_pSortedServerlist[i], &m_pSortedServerlist[i+1], (m_NumSortedServers-i-1)*sizeof(int));
+			m_NumSortedServers--;
+			return;
+		}
+	}
+}
+
+void CServerBrowserFilter::CServerFilter::InsertEntry(int Index)
+{
+	if(!FilterEntry(Index))
+		return;
+
+	// grow the sorted list
+	if(m_NumSortedServers == m_SortedServersCapacity)
+	{
+		int NewCapacity = max(1000, m_SortedServersCapacity+m_SortedServersCapacity/2);
+		int *pNewList = (int *)mem_alloc(NewCapacity*sizeof(int), 1);
+		if(m_pSortedServerlist)
+		{
+			mem_copy(pNewList, m_pSortedServerlist, m_NumSortedServers*sizeof(int));
+			mem_free(m_pSortedServerlist);
+		}
+		m_pSortedServerlist = pNewList;
+		m_SortedServersCapacity = NewCapacity;
+	}
+
+	// binary search the position, equal entries keep their order like with the stable sort
+	int Pos = std::upper_bound(m_pSortedServerlist, m_pSortedServerlist+m_NumSortedServers, Index, SortWrap(this, GetSortFunc())) - m_pSortedServerlist;
+	mem_move(&m_pSortedServerlist[Pos+1], &m_pSortedServerlist[Pos], (m_NumSortedServers-Pos)*sizeof(int));
+	m_pSortedServerlist[Pos] = Index;
+	m_NumSortedServers++;
+	m_NumSortedPlayers += GetRelevantClientCount(Index);
+}
+
 bool CServerBrowserFilter::CServerFilter::SortCompareName(int Index1, int Index2) const
 {
 	CServerEntry *a = m_pServerBrowserFilter->m_ppServerlist[Index1];
@@ -352,6 +403,33 @@ void CServerBrowserFilter::Clear()
 	}
 }
 
+void CServerBrowserFilter::RemoveServer(CServerEntry **ppServerlist, int NumServers, int Index)
+{
+	m_ppServerlist = ppServerlist;
+	m_NumServers = NumServers;
+	for(int i = 0; i < m_lFilters.size(); i++)
+	{
+		// outdated filters get resorted completely anyway
+		CServerFilter *pFilter = &m_lFilters[i];
+		if(pFilter->m_FilterInfo.m_SortHash == pFilter->GetSortHash())
+			pFilter->RemoveEntry(Index);
+	}
+}
+
+void CServerBrowserFilter::InsertServer(CServerEntry **ppServerlist, int NumServers, int Index)
+{
+	m_ppServerlist = ppServerlist;
+	m_NumServers = NumServers;
+	for(int i = 0; i < m_lFilters.size(); i++)
+	{
+		CServerFilter *pFilter = &m_lFilters[i];
+		if(pFilter->m_FilterInfo.m_SortHash != pFilter->GetSortHash())
+			pFilter->Sort();
+		else
+			pFilter->InsertEntry(Index);
+	}
+}
+
 void CServerBrowserFilter::Sort(CServerEntry **ppServerlist, int NumServers, int ResortFlags)
 {
 	m_ppServerlist = ppServerlist;
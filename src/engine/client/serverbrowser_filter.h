@@ -33,10 +33,19 @@ public:
 		~CServerFilter();
 		CServerFilter& operator=(const CServerFilter& Other);
 
+		typedef bool (CServerFilter::*SortFunc)(int, int) const;
+
 		void Filter();
+		bool FilterEntry(int Index);
+		int GetRelevantClientCount(int Index) const;
 		int GetSortHash() const;
+		SortFunc GetSortFunc() const;
 		void Sort();
 
+		// incremental updates of the sorted list
+		void RemoveEntry(int Index);
+		void InsertEntry(int Index);
+
 		// sorting criterions
 		bool SortCompareName(int Index1, int Index2) const;
 		bool SortCompareMap(int Index1, int Index2) const;
@@ -54,6 +63,10 @@ public:
 	void Clear();
 	void Sort(class CServerEntry **ppServerlist, int NumServers, int ResortFlags);
 
+	// incremental updates: remove a server before its info changes and insert it again afterwards
+	void RemoveServer(class CServerEntry **ppServerlist, int NumServers, int Index);
+	void InsertServer(class CServerEntry **ppServerlist, int NumServers, int Index);
+
 	// filter
 	int AddFilter(const class CServerFilterInfo *pFilterInfo);
 	void GetFilter(int Index, class CServerFilterInfo *pFilterInfo) const;
@@ -2,11 +2,15 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/math.h>
 #include <base/system.h>
+#include <base/tl/array.h>
+#include <base/tl/threading.h>
 
+#include <engine/engine.h>
 #include <engine/graphics.h>
 #include <engine/storage.h>
 
 #include <engine/shared/config.h>
+#include <engine/shared/soundmix.h>
 
 #include "SDL.h"
 
@@ -23,17 +27,46 @@ enum
 	NUM_SAMPLES = 512,
 	NUM_VOICES = 64,
 	NUM_CHANNELS = 16,
+	MAX_COMMANDS = 256,
+	DECODE_CHUNK_FRAMES = 4096,
 };
 
+/*
+	Samples are decoded by a job when they are played the first time. The
+	mixer starts playing them as soon as the first frames are decoded and
+	only touches the data below m_DecodedFrames. Samples that weren't
+	played for the longest time are unloaded when the decoded ones exceed
+	snd_cache_size.
+*/
 struct CSample
 {
+	enum
+	{
+		STATE_FREE=0,
+		STATE_UNLOADED,
+		STATE_LOADING,
+		STATE_READY,
+		STATE_FAILED,
+	};
+
+	char m_aFilename[IO_MAX_PATH_LENGTH];
+	volatile int m_State;
+
 	short *m_pData;
 	int m_NumFrames;
 	int m_Rate;
 	int m_Channels;
+	volatile int m_DecodedFrames;
 	int m_LoopStart;
 	int m_LoopEnd;
 	int m_PausedAt;
+
+	// used by the game thread to find samples to unload
+	int64 m_LastUse;
+	unsigned m_LastPlayCommand;
+
+	// voices of the mixer that use the sample, only changed by the mixer
+	volatile int m_MixerRefs;
 };
 
 struct CChannel
@@ -41,26 +74,65 @@ struct CChannel
 	int m_Vol; // 0 - 255
 };
 
+// only touched by the mixer
 struct CVoice
 {
 	CSample *m_pSample;
 	CChannel *m_pChannel;
+	int m_Generation;
 	int m_Tick;
 	int m_Vol; // 0 - 255
 	int m_Flags;
 	int m_X, m_Y;
 };
 
+// the game thread's view of a voice, it is free once the mixer finished its generation
+struct CVoiceState
+{
+	CSample *m_pSample;
+	int m_Generation;
+};
+
+// sent from the game thread to the mixer
+struct CVoiceCommand
+{
+	enum
+	{
+		PLAY=0,
+		STOP,
+		STOP_ALL,
+	};
+
+	int m_Type;
+	int m_Voice;
+	int m_Generation;
+	CSample *m_pSample;
+	CChannel *m_pChannel;
+	int m_Flags;
+	int m_X, m_Y;
+};
+
 static CSample m_aSamples[NUM_SAMPLES] = {{0}};
 static CVoice m_aVoices[NUM_VOICES] = {{0}};
+static CVoiceState m_aVoiceStates[NUM_VOICES] = {{0}};
+static volatile int m_aVoiceDone[NUM_VOICES] = {0};
 static CChannel m_aChannels[NUM_CHANNELS];
 
+// single producer, single consumer ring, so the game thread never waits for the mixer
+static CVoiceCommand m_aCommands[MAX_COMMANDS];
+static volatile unsigned m_CommandWrite = 0;
+static volatile unsigned m_CommandRead = 0;
+
 static LOCK m_SoundLock = 0;
 
-static int m_CenterX = 0;
-static int m_CenterY = 0;
+static LOCK m_DecodeLock = 0;
+static array<int> m_lDecodeRequests;
+static CJob m_DecodeJob;
+
+static volatile int m_CenterX = 0;
+static volatile int m_CenterY = 0;
 
-static float m_MaxDistance = 1500.0f;
+static volatile float m_MaxDistance = 1500.0f;
 
 static int m_MixingRate = 48000;
 static volatile int m_SoundVolume = 100;
@@ -71,123 +143,171 @@ static unsigned m_MaxFrames = 0;
 
 static IOHANDLE s_File;
 
-// TODO: there should be a faster way todo this
-static short Int2Short(int i)
+static bool PushCommand(const CVoiceCommand *pCommand)
 {
-	if(i > 0x7fff)
-		return 0x7fff;
-	else if(i < -0x7fff)
-		return -0x7fff;
-	return i;
+	if(m_CommandWrite-m_CommandRead == MAX_COMMANDS)
+		return false;
+	m_aCommands[m_CommandWrite%MAX_COMMANDS] = *pCommand;
+	sync_barrier();
+	m_CommandWrite++;
+	return true;
 }
 
-static void Mix(short *pFinalOut, unsigned Frames)
+static void PushCommandWait(const CVoiceCommand *pCommand)
 {
-	int MasterVol;
-	mem_zero(m_pMixBuffer, m_MaxFrames*2*sizeof(int));
-	Frames = min(Frames, m_MaxFrames);
+	// only happens when the mixer is stalled, stopping must not get lost
+	while(!PushCommand(pCommand))
+		thread_yield();
+}
 
-	// aquire lock while we are mixing
-	lock_wait(m_SoundLock);
+static void ReleaseVoice(CVoice *v)
+{
+	CSample *pSample = v->m_pSample;
+	v->m_pSample = 0;
+	// the game thread might free the data right after this
+	sync_barrier();
+	pSample->m_MixerRefs--;
+}
 
-	MasterVol = m_SoundVolume;
+static void StopVoice(CVoice *v)
+{
+	if(v->m_Flags&ISound::FLAG_LOOP)
+		v->m_pSample->m_PausedAt = v->m_Tick;
+	else
+		v->m_pSample->m_PausedAt = 0;
+	ReleaseVoice(v);
+}
 
-	for(unsigned i = 0; i < NUM_VOICES; i++)
+static void ProcessCommands()
+{
+	while(m_CommandRead != m_CommandWrite)
 	{
-		if(m_aVoices[i].m_pSample)
+		sync_barrier();
+		const CVoiceCommand *pCommand = &m_aCommands[m_CommandRead%MAX_COMMANDS];
+		if(pCommand->m_Type == CVoiceCommand::PLAY)
+		{
+			CVoice *v = &m_aVoices[pCommand->m_Voice];
+			if(v->m_pSample)
+				ReleaseVoice(v);
+			v->m_pSample = pCommand->m_pSample;
+			v->m_pSample->m_MixerRefs++;
+			v->m_pChannel = pCommand->m_pChannel;
+			v->m_Generation = pCommand->m_Generation;
+			if(pCommand->m_Flags&ISound::FLAG_LOOP)
+				v->m_Tick = v->m_pSample->m_PausedAt;
+			else
+				v->m_Tick = 0;
+			v->m_Vol = 255;
+			v->m_Flags = pCommand->m_Flags;
+			v->m_X = pCommand->m_X;
+			v->m_Y = pCommand->m_Y;
+		}
+		else if(pCommand->m_Type == CVoiceCommand::STOP)
 		{
-			// mix voice
-			CVoice *v = &m_aVoices[i];
-			int *pOut = m_pMixBuffer;
+			CVoice *v = &m_aVoices[pCommand->m_Voice];
+			if(v->m_pSample && v->m_Generation == pCommand->m_Generation)
+				StopVoice(v);
+		}
+		else if(pCommand->m_Type == CVoiceCommand::STOP_ALL)
+		{
+			for(int i = 0; i < NUM_VOICES; i++)
+			{
+				if(m_aVoices[i].m_pSample)
+					StopVoice(&m_aVoices[i]);
+			}
+		}
+		sync_barrier();
+		m_CommandRead++;
+	}
+}
 
-			int Step = v->m_pSample->m_Channels; // setup input sources
-			short *pInL = &v->m_pSample->m_pData[v->m_Tick*Step];
-			short *pInR = &v->m_pSample->m_pData[v->m_Tick*Step+1];
+static void Mix(short *pFinalOut, unsigned Frames)
+{
+	Frames = min(Frames, m_MaxFrames);
+	mem_zero(m_pMixBuffer, Frames*2*sizeof(int));
 
-			unsigned End = v->m_pSample->m_NumFrames-v->m_Tick;
+	ProcessCommands();
 
-			int Rvol = v->m_pChannel->m_Vol;
-			int Lvol = v->m_pChannel->m_Vol;
+	int CenterX = m_CenterX;
+	int CenterY = m_CenterY;
+	float MaxDistance = m_MaxDistance;
 
-			// make sure that we don't go outside the sound data
-			if(Frames < End)
-				End = Frames;
+	for(unsigned i = 0; i < NUM_VOICES; i++)
+	{
+		CVoice *v = &m_aVoices[i];
+		if(!v->m_pSample)
+			continue;
 
-			// check if we have a mono sound
-			if(v->m_pSample->m_Channels == 1)
-				pInR = pInL;
+		int Rvol = v->m_pChannel->m_Vol;
+		int Lvol = v->m_pChannel->m_Vol;
 
-			// volume calculation
-			if(v->m_Flags&ISound::FLAG_POS)
+		// volume calculation, once per buffer
+		if(v->m_Flags&ISound::FLAG_POS)
+		{
+			int dx = v->m_X - CenterX;
+			int dy = v->m_Y - CenterY;
+			float Dist = sqrtf((float)dx*dx+dy*dy);
+			if(Dist >= 0.0f && Dist < MaxDistance)
 			{
-				int dx = v->m_X - m_CenterX;
-				int dy = v->m_Y - m_CenterY;
-				float Dist = sqrtf((float)dx*dx+dy*dy);
-				if(Dist >= 0.0f && Dist < m_MaxDistance)
-				{
-					// linear falloff
-					float Falloff = 1.0f - Dist/m_MaxDistance;
+				// linear falloff
+				float Falloff = 1.0f - Dist/MaxDistance;
 
-					// amplitude after falloff
-					float FalloffAmp = v->m_pChannel->m_Vol * Falloff;
+				// amplitude after falloff
+				float FalloffAmp = v->m_pChannel->m_Vol * Falloff;
 
-					// distribute volume to the channels depending on x difference
-					float Lpan = 0.5f - dx/m_MaxDistance/2.0f;
-					float Rpan = 1.0f - Lpan;
+				// distribute volume to the channels depending on x difference
+				float Lpan = 0.5f - dx/MaxDistance/2.0f;
+				float Rpan = 1.0f - Lpan;
 
-					// apply square root to preserve sound power after panning
-					float LampFactor = sqrt(Lpan);
-					float RampFactor = sqrt(Rpan);
-
-					// volume of the channels
-					Lvol = FalloffAmp*LampFactor;
-					Rvol = FalloffAmp*RampFactor;
-				}
-				else
-				{
-					Lvol = 0;
-					Rvol = 0;
-				}
+				// apply square root to preserve sound power after panning
+				Lvol = (int)(FalloffAmp*sqrtf(Lpan));
+				Rvol = (int)(FalloffAmp*sqrtf(Rpan));
 			}
-
-			// process all frames
-			for(unsigned s = 0; s < End; s++)
+			else
 			{
-				*pOut++ += (*pInL)*Lvol;
-				*pOut++ += (*pInR)*Rvol;
-				pInL += Step;
-				pInR += Step;
-				v->m_Tick++;
+				Lvol = 0;
+				Rvol = 0;
 			}
+		}
+
+		// process all frames, looping sounds wrap around within the buffer
+		CSample *pSample = v->m_pSample;
+		if(pSample->m_State == CSample::STATE_FAILED)
+		{
+			ReleaseVoice(v);
+			m_aVoiceDone[i] = v->m_Generation;
+			continue;
+		}
+
+		// wait for the decoder if the sample isn't decoded that far yet
+		int Decoded = pSample->m_DecodedFrames;
+		sync_barrier();
+		unsigned Done = 0;
+		while(Done < Frames && v->m_Tick < Decoded)
+		{
+			unsigned Num = min(Frames-Done, (unsigned)(Decoded-v->m_Tick));
+			if(Lvol || Rvol)
+				SoundMixVoice(m_pMixBuffer+Done*2, pSample->m_pData+v->m_Tick*pSample->m_Channels, pSample->m_Channels, Num, Lvol, Rvol);
+			Done += Num;
+			v->m_Tick += Num;
 
 			// free voice if not used any more
-			if(v->m_Tick == v->m_pSample->m_NumFrames)
+			if(v->m_Tick == pSample->m_NumFrames)
 			{
 				if(v->m_Flags&ISound::FLAG_LOOP)
 					v->m_Tick = 0;
 				else
-					v->m_pSample = 0;
+				{
+					ReleaseVoice(v);
+					m_aVoiceDone[i] = v->m_Generation;
+					break;
+				}
 			}
 		}
 	}
 
-
-	// release the lock
-	lock_unlock(m_SoundLock);
-
-	{
-		// clamp accumulated values
-		// TODO: this seams slow
-		for(unsigned i = 0; i < Frames; i++)
-		{
-			int j = i<<1;
-			int vl = ((m_pMixBuffer[j]*MasterVol)/101)>>8;
-			int vr = ((m_pMixBuffer[j+1]*MasterVol)/101)>>8;
-
-			pFinalOut[j] = Int2Short(vl);
-			pFinalOut[j+1] = Int2Short(vr);
-		}
-	}
+	// clamp accumulated values
+	SoundMixOutput(pFinalOut, m_pMixBuffer, Frames, m_SoundVolume);
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
 	swap_endian(pFinalOut, sizeof(short), Frames * 2);
@@ -200,6 +320,12 @@ static void SdlCallback(void *pUnused, Uint8 *pStream, int Len)
 	Mix((short *)pStream, Len/2/2);
 }
 
+static bool VoiceActive(int VoiceID)
+{
+	const CVoiceState *pState = &m_aVoiceStates[VoiceID];
+	return pState->m_pSample && m_aVoiceDone[VoiceID] != pState->m_Generation;
+}
+
 
 int CSound::Init()
 {
@@ -210,10 +336,12 @@ int CSound::Init()
 	m_pConfig = Kernel()->RequestInterface<IConfigManager>()->Values();
 	m_pGraphics = Kernel()->RequestInterface<IEngineGraphics>();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
+	m_pEngine = Kernel()->RequestInterface<IEngine>();
 
 	SDL_AudioSpec Format;
 
 	m_SoundLock = lock_create();
+	m_DecodeLock = lock_create();
 
 	if(!m_pConfig->m_SndInit)
 		return 0;
@@ -261,20 +389,75 @@ int CSound::Update()
 	if(!m_pGraphics->WindowActive() && m_pConfig->m_SndNonactiveMute)
 		WantedVolume = 0;
 
-	if(WantedVolume != m_SoundVolume)
+	// read by the mixer on the next buffer
+	m_SoundVolume = WantedVolume;
+
+	if(m_SoundEnabled)
 	{
-		lock_wait(m_SoundLock);
-		m_SoundVolume = WantedVolume;
-		lock_unlock(m_SoundLock);
+		// the job might have finished right before the last request was added
+		lock_wait(m_DecodeLock);
+		bool Pending = m_lDecodeRequests.size() != 0;
+		lock_unlock(m_DecodeLock);
+		if(Pending)
+			StartDecodeJob();
+
+		UpdateCache();
 	}
 
 	return 0;
 }
 
+void CSound::UpdateCache()
+{
+	int64 Budget = (int64)m_pConfig->m_SndCacheSize*1024*1024;
+	int64 Used = 0;
+	for(int i = 0; i < NUM_SAMPLES; i++)
+	{
+		if(m_aSamples[i].m_State == CSample::STATE_READY)
+			Used += m_aSamples[i].m_NumFrames*m_aSamples[i].m_Channels*sizeof(short);
+	}
+
+	while(Used > Budget)
+	{
+		// unload the sample that was played the longest time ago, if the mixer is done with it
+		int Oldest = -1;
+		for(int i = 0; i < NUM_SAMPLES; i++)
+		{
+			CSample *pSample = &m_aSamples[i];
+			if(pSample->m_State != CSample::STATE_READY || (int)(m_CommandRead-pSample->m_LastPlayCommand) <= 0)
+				continue;
+			sync_barrier();
+			if(pSample->m_MixerRefs == 0 && (Oldest < 0 || pSample->m_LastUse < m_aSamples[Oldest].m_LastUse))
+				Oldest = i;
+		}
+		if(Oldest < 0)
+			break;
+
+		CSample *pSample = &m_aSamples[Oldest];
+		Used -= pSample->m_NumFrames*pSample->m_Channels*sizeof(short);
+		pSample->m_State = CSample::STATE_UNLOADED;
+		pSample->m_DecodedFrames = 0;
+		mem_free(pSample->m_pData);
+		pSample->m_pData = 0;
+		if(m_pConfig->m_Debug)
+			dbg_msg("sound/wv", "unloaded %s", pSample->m_aFilename);
+	}
+}
+
 int CSound::Shutdown()
 {
 	SDL_CloseAudio();
 	SDL_QuitSubSystem(SDL_INIT_AUDIO);
+
+	// the job uses the samples
+	if(m_DecodeLock)
+	{
+		lock_wait(m_DecodeLock);
+		m_lDecodeRequests.clear();
+		lock_unlock(m_DecodeLock);
+		m_pEngine->WaitJob(&m_DecodeJob);
+		lock_destroy(m_DecodeLock);
+	}
 	lock_destroy(m_SoundLock);
 	if(m_pMixBuffer)
 	{
@@ -289,51 +472,13 @@ int CSound::AllocID()
 	// TODO: linear search, get rid of it
 	for(unsigned SampleID = 0; SampleID < NUM_SAMPLES; SampleID++)
 	{
-		if(m_aSamples[SampleID].m_pData == 0x0)
+		if(m_aSamples[SampleID].m_State == CSample::STATE_FREE)
 			return SampleID;
 	}
 
 	return -1;
 }
 
-void CSound::RateConvert(int SampleID)
-{
-	CSample *pSample = &m_aSamples[SampleID];
-	int NumFrames = 0;
-	short *pNewData = 0;
-
-	// make sure that we need to convert this sound
-	if(!pSample->m_pData || pSample->m_Rate == m_MixingRate)
-		return;
-
-	// allocate new data
-	NumFrames = (int)((pSample->m_NumFrames/(float)pSample->m_Rate)*m_MixingRate);
-	pNewData = (short *)mem_alloc(NumFrames*pSample->m_Channels*sizeof(short), 1);
-
-	for(int i = 0; i < NumFrames; i++)
-	{
-		// resample TODO: this should be done better, like linear at least
-		float a = i/(float)NumFrames;
-		int f = (int)(a*pSample->m_NumFrames);
-		if(f >= pSample->m_NumFrames)
-			f = pSample->m_NumFrames-1;
-
-		// set new data
-		if(pSample->m_Channels == 1)
-			pNewData[i] = pSample->m_pData[f];
-		else if(pSample->m_Channels == 2)
-		{
-			pNewData[i*2] = pSample->m_pData[f*2];
-			pNewData[i*2+1] = pSample->m_pData[f*2+1];
-		}
-	}
-
-	// free old data and apply new
-	mem_free(pSample->m_pData);
-	pSample->m_pData = pNewData;
-	pSample->m_NumFrames = NumFrames;
-}
-
 static int ReadDataOld(void *pBuffer, int Size)
 {
 	return io_read(s_File, pBuffer, Size);
@@ -371,42 +516,66 @@ static int PushBackByte(void *pId, int Char)
 }
 #endif
 
-ISound::CSampleHandle CSound::LoadWV(const char *pFilename)
+void CSound::StartDecodeJob()
 {
-	CSample *pSample;
-	int SampleID = -1;
-	char aError[100];
-	WavpackContext *pContext;
-
-	// don't waste memory on sound when we are stress testing
-	if(m_pConfig->m_DbgStress)
-		return CSampleHandle();
-
-	// no need to load sound when we are running with no sound
-	if(!m_SoundEnabled)
-		return CSampleHandle();
+	if(m_DecodeJob.Status() == CJob::STATE_DONE)
+		m_pEngine->AddJob(&m_DecodeJob, DecodeThread, this);
+}
 
-	if(!m_pStorage)
-		return CSampleHandle();
+void CSound::RequestDecode(int SampleID)
+{
+	m_aSamples[SampleID].m_State = CSample::STATE_LOADING;
+	lock_wait(m_DecodeLock);
+	m_lDecodeRequests.add(SampleID);
+	lock_unlock(m_DecodeLock);
+	StartDecodeJob();
+}
 
-	lock_wait(m_SoundLock);
-	s_File = m_pStorage->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
-	if(!s_File)
+int CSound::DecodeThread(void *pUser)
+{
+	CSound *pThis = (CSound *)pUser;
+	while(1)
 	{
-		dbg_msg("sound/wv", "failed to open file. filename='%s'", pFilename);
-		lock_unlock(m_SoundLock);
-		return CSampleHandle();
+		lock_wait(m_DecodeLock);
+		if(!m_lDecodeRequests.size())
+		{
+			lock_unlock(m_DecodeLock);
+			break;
+		}
+		int SampleID = m_lDecodeRequests[0];
+		m_lDecodeRequests.remove_index(0);
+		lock_unlock(m_DecodeLock);
+
+		// the wavpack decoder has only one context, so this is the only place that decodes
+		pThis->DecodeSample(SampleID);
 	}
+	return 0;
+}
 
-	SampleID = AllocID();
-	if(SampleID < 0)
+static void DecodeFailed(CSample *pSample)
+{
+	if(s_File)
 	{
 		io_close(s_File);
 		s_File = 0;
-		lock_unlock(m_SoundLock);
-		return CSampleHandle();
 	}
-	pSample = &m_aSamples[SampleID];
+	pSample->m_State = CSample::STATE_FAILED;
+}
+
+void CSound::DecodeSample(int SampleID)
+{
+	CSample *pSample = &m_aSamples[SampleID];
+	int64 StartTime = time_get();
+	char aError[100];
+	WavpackContext *pContext;
+
+	s_File = m_pStorage->OpenFile(pSample->m_aFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!s_File)
+	{
+		dbg_msg("sound/wv", "failed to open file. filename='%s'", pSample->m_aFilename);
+		DecodeFailed(pSample);
+		return;
+	}
 
 #if defined(CONF_WAVPACK_OPEN_FILE_INPUT_EX)
 	WavpackStreamReader Callback = {0};
@@ -419,75 +588,137 @@ ISound::CSampleHandle CSound::LoadWV(const char *pFilename)
 #else
 	pContext = WavpackOpenFileInput(ReadDataOld, aError);
 #endif
-	if (pContext)
+	if(!pContext)
 	{
-		int m_aSamples = WavpackGetNumSamples(pContext);
-		int BitsPerSample = WavpackGetBitsPerSample(pContext);
-		unsigned int SampleRate = WavpackGetSampleRate(pContext);
-		int m_aChannels = WavpackGetNumChannels(pContext);
-		int *pData;
-		int *pSrc;
-		short *pDst;
-		int i;
-
-		pSample->m_Channels = m_aChannels;
-		pSample->m_Rate = SampleRate;
-
-		if(pSample->m_Channels > 2)
-		{
-			dbg_msg("sound/wv", "file is not mono or stereo. filename='%s'", pFilename);
-			io_close(s_File);
-			s_File = 0;
-			lock_unlock(m_SoundLock);
-			return CSampleHandle();
-		}
+		dbg_msg("sound/wv", "failed to open %s: %s", pSample->m_aFilename, aError);
+		DecodeFailed(pSample);
+		return;
+	}
 
-		/*
-		if(snd->rate != 44100)
-		{
-			dbg_msg("sound/wv", "file is %d Hz, not 44100 Hz. filename='%s'", snd->rate, filename);
-			return -1;
-		}*/
+	int NumSrcFrames = WavpackGetNumSamples(pContext);
+	int BitsPerSample = WavpackGetBitsPerSample(pContext);
+	int SampleRate = WavpackGetSampleRate(pContext);
+	int Channels = WavpackGetNumChannels(pContext);
+
+	if(Channels < 1 || Channels > 2)
+	{
+		dbg_msg("sound/wv", "file is not mono or stereo. filename='%s'", pSample->m_aFilename);
+		DecodeFailed(pSample);
+		return;
+	}
 
-		if(BitsPerSample != 16)
+	if(BitsPerSample != 16)
+	{
+		dbg_msg("sound/wv", "bps is %d, not 16, filname='%s'", BitsPerSample, pSample->m_aFilename);
+		DecodeFailed(pSample);
+		return;
+	}
+
+	// the sample is resampled to the mixing rate while decoding
+	int NumFrames = NumSrcFrames;
+	if(SampleRate != m_MixingRate)
+		NumFrames = (int)((NumSrcFrames/(float)SampleRate)*m_MixingRate);
+	if(NumFrames <= 0)
+	{
+		dbg_msg("sound/wv", "file is empty. filename='%s'", pSample->m_aFilename);
+		DecodeFailed(pSample);
+		return;
+	}
+
+	short *pData = (short *)mem_alloc(NumFrames*Channels*sizeof(short), 1);
+	pSample->m_pData = pData;
+	pSample->m_NumFrames = NumFrames;
+	pSample->m_Rate = SampleRate;
+	pSample->m_Channels = Channels;
+
+	// decode in chunks, so the mixer can start before long samples are done
+	int *pChunk = (int *)mem_alloc(DECODE_CHUNK_FRAMES*Channels*sizeof(int), 1);
+	int ChunkStart = 0;
+	int Frame = 0;
+	while(Frame < NumFrames)
+	{
+		int Num = WavpackUnpackSamples(pContext, pChunk, DECODE_CHUNK_FRAMES);
+		if(Num <= 0)
+			break;
+
+		for(; Frame < NumFrames; Frame++)
 		{
-			dbg_msg("sound/wv", "bps is %d, not 16, filname='%s'", BitsPerSample, pFilename);
-			io_close(s_File);
-			s_File = 0;
-			lock_unlock(m_SoundLock);
-			return CSampleHandle();
+			// resample TODO: this should be done better, like linear at least
+			int f = Frame;
+			if(NumFrames != NumSrcFrames)
+				f = min((int)(Frame/(float)NumFrames*NumSrcFrames), NumSrcFrames-1);
+			if(f >= ChunkStart+Num)
+				break;
+			for(int c = 0; c < Channels; c++)
+				pData[Frame*Channels+c] = (short)pChunk[(f-ChunkStart)*Channels+c];
 		}
+		ChunkStart += Num;
 
-		pData = (int *)mem_alloc(4*m_aSamples*m_aChannels, 1);
-		WavpackUnpackSamples(pContext, pData, m_aSamples); // TODO: check return value
-		pSrc = pData;
+		sync_barrier();
+		pSample->m_DecodedFrames = Frame;
+	}
+	mem_free(pChunk);
+	io_close(s_File);
+	s_File = 0;
 
-		pSample->m_pData = (short *)mem_alloc(2*m_aSamples*m_aChannels, 1);
-		pDst = pSample->m_pData;
+	// play silence where the file is cut off
+	if(Frame < NumFrames)
+		mem_zero(pData+Frame*Channels, (NumFrames-Frame)*Channels*sizeof(short));
 
-		for (i = 0; i < m_aSamples*m_aChannels; i++)
-			*pDst++ = (short)*pSrc++;
+	sync_barrier();
+	pSample->m_DecodedFrames = NumFrames;
+	pSample->m_State = CSample::STATE_READY;
 
-		mem_free(pData);
+	if(m_pConfig->m_Debug)
+		dbg_msg("sound/wv", "decoded %s in %.2fms", pSample->m_aFilename, (time_get()-StartTime)*1000.0f/time_freq());
+}
 
-		pSample->m_NumFrames = m_aSamples;
-		pSample->m_LoopStart = -1;
-		pSample->m_LoopEnd = -1;
-		pSample->m_PausedAt = 0;
-	}
-	else
+ISound::CSampleHandle CSound::LoadWV(const char *pFilename)
+{
+	// don't waste memory on sound when we are stress testing
+	if(m_pConfig->m_DbgStress)
+		return CSampleHandle();
+
+	// no need to load sound when we are running with no sound
+	if(!m_SoundEnabled)
+		return CSampleHandle();
+
+	if(!m_pStorage)
+		return CSampleHandle();
+
+	// the sample is decoded when it is played
+	IOHANDLE File = m_pStorage->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
 	{
-		dbg_msg("sound/wv", "failed to open %s: %s", pFilename, aError);
+		dbg_msg("sound/wv", "failed to open file. filename='%s'", pFilename);
+		return CSampleHandle();
 	}
+	io_close(File);
 
-	io_close(s_File);
-	s_File = NULL;
+	lock_wait(m_SoundLock);
+	int SampleID = AllocID();
+	if(SampleID < 0)
+	{
+		lock_unlock(m_SoundLock);
+		return CSampleHandle();
+	}
+	CSample *pSample = &m_aSamples[SampleID];
+	str_copy(pSample->m_aFilename, pFilename, sizeof(pSample->m_aFilename));
+	pSample->m_pData = 0;
+	pSample->m_DecodedFrames = 0;
+	pSample->m_LoopStart = -1;
+	pSample->m_LoopEnd = -1;
+	pSample->m_PausedAt = 0;
+	pSample->m_LastUse = 0;
+	pSample->m_LastPlayCommand = m_CommandWrite-1;
+	pSample->m_MixerRefs = 0;
+	sync_barrier();
+	pSample->m_State = CSample::STATE_UNLOADED;
+	lock_unlock(m_SoundLock);
 
 	if(m_pConfig->m_Debug)
-		dbg_msg("sound/wv", "loaded %s", pFilename);
+		dbg_msg("sound/wv", "registered %s", pFilename);
 
-	RateConvert(SampleID);
-	lock_unlock(m_SoundLock);
 	return CreateSampleHandle(SampleID);
 }
 
@@ -509,22 +740,25 @@ void CSound::SetChannelVolume(int ChannelID, float Vol)
 
 int CSound::Play(int ChannelID, CSampleHandle SampleID, int Flags, float x, float y)
 {
-	if(!SampleID.IsValid())
+	if(!SampleID.IsValid() || !m_SoundEnabled)
 		return -1;
 
-	int VoiceID = -1;
-	int i;
+	CSample *pSample = &m_aSamples[SampleID.Id()];
+	if(pSample->m_State == CSample::STATE_FAILED)
+		return -1;
+	if(pSample->m_State == CSample::STATE_UNLOADED)
+		RequestDecode(SampleID.Id());
+	pSample->m_LastUse = time_get();
 
-	lock_wait(m_SoundLock);
+	int VoiceID = -1;
 
 	// search for voice
-	for(i = 0; i < NUM_VOICES; i++)
+	for(int i = 0; i < NUM_VOICES; i++)
 	{
 		int id = (m_NextVoice + i) % NUM_VOICES;
-		if(!m_aVoices[id].m_pSample)
+		if(!VoiceActive(id))
 		{
 			VoiceID = id;
-			m_NextVoice = id+1;
 			break;
 		}
 	}
@@ -532,19 +766,26 @@ int CSound::Play(int ChannelID, CSampleHandle SampleID, int Flags, float x, floa
 	// voice found, use it
 	if(VoiceID != -1)
 	{
-		m_aVoices[VoiceID].m_pSample = &m_aSamples[SampleID.Id()];
-		m_aVoices[VoiceID].m_pChannel = &m_aChannels[ChannelID];
-		if(Flags & FLAG_LOOP)
-			m_aVoices[VoiceID].m_Tick = m_aSamples[SampleID.Id()].m_PausedAt;
-		else
-			m_aVoices[VoiceID].m_Tick = 0;
-		m_aVoices[VoiceID].m_Vol = 255;
-		m_aVoices[VoiceID].m_Flags = Flags;
-		m_aVoices[VoiceID].m_X = (int)x;
-		m_aVoices[VoiceID].m_Y = (int)y;
+		CVoiceState *pState = &m_aVoiceStates[VoiceID];
+		CVoiceCommand Command;
+		Command.m_Type = CVoiceCommand::PLAY;
+		Command.m_Voice = VoiceID;
+		Command.m_Generation = pState->m_Generation+1;
+		Command.m_pSample = pSample;
+		Command.m_pChannel = &m_aChannels[ChannelID];
+		Command.m_Flags = Flags;
+		Command.m_X = (int)x;
+		Command.m_Y = (int)y;
+		unsigned CommandIndex = m_CommandWrite;
+		if(!PushCommand(&Command))
+			return -1;
+		pSample->m_LastPlayCommand = CommandIndex;
+
+		pState->m_pSample = Command.m_pSample;
+		pState->m_Generation = Command.m_Generation;
+		m_NextVoice = VoiceID+1;
 	}
 
-	lock_unlock(m_SoundLock);
 	return VoiceID;
 }
 
@@ -561,54 +802,44 @@ int CSound::Play(int ChannelID, CSampleHandle SampleID, int Flags)
 void CSound::Stop(CSampleHandle SampleID)
 {
 	// TODO: a nice fade out
-	lock_wait(m_SoundLock);
+	if(!m_SoundEnabled)
+		return;
 	CSample *pSample = &m_aSamples[SampleID.Id()];
 	for(int i = 0; i < NUM_VOICES; i++)
 	{
-		if(m_aVoices[i].m_pSample == pSample)
+		if(m_aVoiceStates[i].m_pSample == pSample && VoiceActive(i))
 		{
-			if(m_aVoices[i].m_Flags & FLAG_LOOP)
-				m_aVoices[i].m_pSample->m_PausedAt = m_aVoices[i].m_Tick;
-			else
-				m_aVoices[i].m_pSample->m_PausedAt = 0;
-			m_aVoices[i].m_pSample = 0;
+			CVoiceCommand Command;
+			Command.m_Type = CVoiceCommand::STOP;
+			Command.m_Voice = i;
+			Command.m_Generation = m_aVoiceStates[i].m_Generation;
+			PushCommandWait(&Command);
+			m_aVoiceStates[i].m_pSample = 0;
 		}
 	}
-	lock_unlock(m_SoundLock);
 }
 
 void CSound::StopAll()
 {
 	// TODO: a nice fade out
-	lock_wait(m_SoundLock);
+	if(!m_SoundEnabled)
+		return;
+	CVoiceCommand Command;
+	Command.m_Type = CVoiceCommand::STOP_ALL;
+	PushCommandWait(&Command);
 	for(int i = 0; i < NUM_VOICES; i++)
-	{
-		if(m_aVoices[i].m_pSample)
-		{
-			if(m_aVoices[i].m_Flags & FLAG_LOOP)
-				m_aVoices[i].m_pSample->m_PausedAt = m_aVoices[i].m_Tick;
-			else
-				m_aVoices[i].m_pSample->m_PausedAt = 0;
-		}
-		m_aVoices[i].m_pSample = 0;
-	}
-	lock_unlock(m_SoundLock);
+		m_aVoiceStates[i].m_pSample = 0;
 }
 
 bool CSound::IsPlaying(CSampleHandle SampleID)
 {
-	bool Ret = false;
-	lock_wait(m_SoundLock);
 	CSample *pSample = &m_aSamples[SampleID.Id()];
 	for(int i = 0; i < NUM_VOICES; i++)
 	{
-		if(m_aVoices[i].m_pSample == pSample)
-		{
-			Ret = true;
-		}
+		if(m_aVoiceStates[i].m_pSample == pSample && VoiceActive(i))
+			return true;
 	}
-	lock_unlock(m_SoundLock);
-	return Ret;
+	return false;
 }
 
 IEngineSound *CreateEngineSound() { return new CSound; }
@@ -13,6 +13,7 @@ public:
 	CConfig *m_pConfig;
 	IEngineGraphics *m_pGraphics;
 	IStorage *m_pStorage;
+	class IEngine *m_pEngine;
 
 	virtual int Init();
 
@@ -20,7 +21,11 @@ public:
 	int Shutdown();
 	int AllocID();
 
-	static void RateConvert(int SampleID);
+	static int DecodeThread(void *pUser);
+	void StartDecodeJob();
+	void RequestDecode(int SampleID);
+	void DecodeSample(int SampleID);
+	void UpdateCache();
 
 	virtual bool IsSoundEnabled() { return m_SoundEnabled != 0; }
 
@@ -2,8 +2,11 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
 #include <base/math.h>
+#include <base/tl/array.h>
+#include <engine/engine.h>
 #include <engine/graphics.h>
 #include <engine/textrender.h>
+#include <engine/shared/jobs.h>
 
 #ifdef CONF_FAMILY_WINDOWS
 	#include <windows.h>
@@ -13,19 +16,40 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
-// TODO: Refactor: clean this up
 enum
 {
-	MAX_CHARACTERS = 64,
+	ATLAS_SIZE = 1024,
+	MAX_ATLAS_PAGES = 8,
+	MAX_ATLAS_SHELVES = 256,
+	MAX_GLYPHS = 16*1024,
+	MAX_GLYPH_SIZE = 256,
+	GLYPH_HASH_SIZE = 4096,
+	PREWARM_MAX_FONT_SIZE = 36,
 };
 
 
 static int aFontSizes[] = {8,9,10,11,12,13,14,15,16,17,18,19,20,36,64};
 #define NUM_FONT_SIZES (sizeof(aFontSizes)/sizeof(int))
 
+class CFont;
+
 struct CFontChar
 {
+	enum
+	{
+		STATE_NEW=0,
+		STATE_QUEUED,
+		STATE_READY,
+		STATE_FAILED,
+	};
+
+	CFont *m_pFont;
+	int m_SizeIndex;
 	int m_ID;
+	int m_NextHash;
+	int m_State;
+	bool m_HasMetrics;
+	int m_Page;
 
 	// these values are scaled to the pFont size
 	// width * font_size == real_size
@@ -42,21 +66,9 @@ struct CFontChar
 struct CFontSizeData
 {
 	int m_FontSize;
-	FT_Face *m_pFace;
-
-	IGraphics::CTextureHandle m_aTextures[2];
-	int m_TextureWidth;
-	int m_TextureHeight;
-
-	int m_NumXChars;
-	int m_NumYChars;
 
-	int m_CharMaxWidth;
-	int m_CharMaxHeight;
-
-	CFontChar m_aCharacters[MAX_CHARACTERS*MAX_CHARACTERS];
-
-	int m_CurrentCharacter;
+	// changes whenever characters of this size move or get replaced
+	int m_Generation;
 };
 
 class CFont
@@ -64,6 +76,8 @@ class CFont
 public:
 	char m_aFilename[IO_MAX_PATH_LENGTH];
 	FT_Face m_FtFace;
+	FT_Face m_WorkerFace; // only used by the glyph job
+	bool m_WorkerFaceFailed;
 	CFontSizeData m_aSizes[NUM_FONT_SIZES];
 };
 
@@ -71,11 +85,14 @@ struct CQuadChar
 {
 	float m_aUvs[4];
 	IGraphics::CQuadItem m_QuadItem;
+	int m_Page;
+	int m_Glyph;
 };
 
 class CTextRender : public IEngineTextRender
 {
 	IGraphics *m_pGraphics;
+	IEngine *m_pEngine;
 	IGraphics *Graphics() { return m_pGraphics; }
 
 	int WordLength(const char *pText)
@@ -119,9 +136,7 @@ class CTextRender : public IEngineTextRender
 		return NUM_FONT_SIZES-1;
 	}
 
-
-
-	void Grow(unsigned char *pIn, unsigned char *pOut, int w, int h)
+	static void Grow(unsigned char *pIn, unsigned char *pOut, int w, int h)
 	{
 		for(int y = 0; y < h; y++)
 			for(int x = 0; x < w; x++)
@@ -145,38 +160,7 @@ class CTextRender : public IEngineTextRender
 			}
 	}
 
-	void InitTexture(CFontSizeData *pSizeData, int CharWidth, int CharHeight, int Xchars, int Ychars)
-	{
-		static int FontMemoryUsage = 0;
-		int Width = CharWidth*Xchars;
-		int Height = CharHeight*Ychars;
-		void *pMem = mem_alloc(Width*Height, 1);
-		mem_zero(pMem, Width*Height);
-
-		for(int i = 0; i < 2; i++)
-		{
-			if(pSizeData->m_aTextures[i].IsValid())
-			{
-				Graphics()->UnloadTexture(&(pSizeData->m_aTextures[i]));
-				FontMemoryUsage -= pSizeData->m_TextureWidth*pSizeData->m_TextureHeight;
-			}
-
-			pSizeData->m_aTextures[i] = Graphics()->LoadTextureRaw(Width, Height, CImageInfo::FORMAT_ALPHA, pMem, CImageInfo::FORMAT_ALPHA, IGraphics::TEXLOAD_NOMIPMAPS);
-			FontMemoryUsage += Width*Height;
-		}
-
-		pSizeData->m_NumXChars = Xchars;
-		pSizeData->m_NumYChars = Ychars;
-		pSizeData->m_TextureWidth = Width;
-		pSizeData->m_TextureHeight = Height;
-		pSizeData->m_CurrentCharacter = 0;
-
-		dbg_msg("pFont", "memory usage: %d", FontMemoryUsage);
-
-		mem_free(pMem);
-	}
-
-	int AdjustOutlineThicknessToFontSize(int OutlineThickness, int FontSize)
+	static int AdjustOutlineThicknessToFontSize(int OutlineThickness, int FontSize)
 	{
 		if(FontSize > 36)
 			OutlineThickness *= 4;
@@ -185,492 +169,655 @@ class CTextRender : public IEngineTextRender
 		return OutlineThickness;
 	}
 
-	void IncreaseTextureSize(CFontSizeData *pSizeData)
+	CFontSizeData *GetSize(CFont *pFont, int Pixelsize)
 	{
-		if(pSizeData->m_TextureWidth < pSizeData->m_TextureHeight)
-			pSizeData->m_NumXChars <<= 1;
-		else
-			pSizeData->m_NumYChars <<= 1;
-		InitTexture(pSizeData, pSizeData->m_CharMaxWidth, pSizeData->m_CharMaxHeight, pSizeData->m_NumXChars, pSizeData->m_NumYChars);
+		int Index = GetFontSizeIndex(Pixelsize);
+		if(pFont->m_aSizes[Index].m_FontSize != aFontSizes[Index])
+			pFont->m_aSizes[Index].m_FontSize = aFontSizes[Index];
+		return &pFont->m_aSizes[Index];
 	}
 
-
-	// TODO: Refactor: move this into a pFont class
-	void InitIndex(CFont *pFont, int Index)
+	/*
+		Glyphs of all fonts and sizes are shelf packed into a few texture
+		pages, each with a second texture for the outlines. Glyphs are
+		rasterized by a job, the text is laid out with their advance in the
+		meantime and they show up once the job is done. When all pages are
+		full, the least recently used one is cleared.
+	*/
+	struct CAtlasShelf
 	{
-		CFontSizeData *pSizeData = &pFont->m_aSizes[Index];
+		int m_Y;
+		int m_Height;
+		int m_X;
+	};
 
-		pSizeData->m_FontSize = aFontSizes[Index];
-		FT_Set_Pixel_Sizes(pFont->m_FtFace, 0, pSizeData->m_FontSize);
+	struct CAtlasPage
+	{
+		IGraphics::CTextureHandle m_aTextures[2];
+		CAtlasShelf m_aShelves[MAX_ATLAS_SHELVES];
+		int m_NumShelves;
+		int m_UsedHeight;
+	};
 
-		int OutlineThickness = AdjustOutlineThicknessToFontSize(1, pSizeData->m_FontSize);
+	struct CGlyphRequest
+	{
+		CFont *m_pFont;
+		int m_SizeIndex;
+		int m_FontSize;
+		int m_Chr;
+		int m_Glyph;
+	};
+
+	struct CGlyphResult
+	{
+		// the slot might hold another character by the time the result arrives
+		CFont *m_pFont;
+		int m_SizeIndex;
+		int m_Chr;
+		int m_Glyph;
+		bool m_Failed;
+		int m_Width;
+		int m_Height;
+		int m_Left;
+		int m_Top;
+		int m_Advance;
+		unsigned char *m_pData; // glyph followed by the outline
+	};
+
+	CFontChar m_aGlyphs[MAX_GLYPHS];
+	int m_aGlyphHash[GLYPH_HASH_SIZE];
+	int m_FirstFreeGlyph;
+	CAtlasPage m_aAtlasPages[MAX_ATLAS_PAGES];
+	int m_NumAtlasPages;
+
+	FT_Library m_WorkerLibrary;
+	CJob m_GlyphJob;
+	LOCK m_GlyphLock;
+	array<CGlyphRequest> m_lGlyphRequests;
+	array<CGlyphResult> m_lGlyphResults;
+	int m_NumQueuedGlyphs;
+
+	static unsigned GlyphHash(const CFont *pFont, int SizeIndex, int Chr)
+	{
+		// there is rarely more than one font
+		return ((unsigned)Chr*NUM_FONT_SIZES + SizeIndex) % GLYPH_HASH_SIZE;
+	}
 
+	int FindGlyph(CFont *pFont, int SizeIndex, int Chr)
+	{
+		for(int i = m_aGlyphHash[GlyphHash(pFont, SizeIndex, Chr)]; i >= 0; i = m_aGlyphs[i].m_NextHash)
 		{
-			unsigned GlyphIndex;
-			int MaxH = 0;
-			int MaxW = 0;
-
-			int Charcode = FT_Get_First_Char(pFont->m_FtFace, &GlyphIndex);
-			while(GlyphIndex != 0)
-			{
-				// do stuff
-				FT_Load_Glyph(pFont->m_FtFace, GlyphIndex, FT_LOAD_DEFAULT);
-
-				if(pFont->m_FtFace->glyph->metrics.width > MaxW) MaxW = pFont->m_FtFace->glyph->metrics.width; // ignore_convention
-				if(pFont->m_FtFace->glyph->metrics.height > MaxH) MaxH = pFont->m_FtFace->glyph->metrics.height; // ignore_convention
-				Charcode = FT_Get_Next_Char(pFont->m_FtFace, Charcode, &GlyphIndex);
-			}
-
-			MaxW = (MaxW>>6)+2+OutlineThickness*2;
-			MaxH = (MaxH>>6)+2+OutlineThickness*2;
-
-			for(pSizeData->m_CharMaxWidth = 1; pSizeData->m_CharMaxWidth < MaxW; pSizeData->m_CharMaxWidth <<= 1);
-			for(pSizeData->m_CharMaxHeight = 1; pSizeData->m_CharMaxHeight < MaxH; pSizeData->m_CharMaxHeight <<= 1);
+			if(m_aGlyphs[i].m_ID == Chr && m_aGlyphs[i].m_SizeIndex == SizeIndex && m_aGlyphs[i].m_pFont == pFont)
+				return i;
 		}
-
-		//dbg_msg("pFont", "init size %d, texture size %d %d", pFont->sizes[index].font_size, w, h);
-		//FT_New_Face(m_FTLibrary, "data/fonts/vera.ttf", 0, &pFont->ft_face);
-		InitTexture(pSizeData, pSizeData->m_CharMaxWidth, pSizeData->m_CharMaxHeight, 8, 8);
+		return -1;
 	}
 
-	CFontSizeData *GetSize(CFont *pFont, int Pixelsize)
+	int NewGlyph(CFont *pFont, int SizeIndex, int Chr)
 	{
-		int Index = GetFontSizeIndex(Pixelsize);
-		if(pFont->m_aSizes[Index].m_FontSize != aFontSizes[Index])
-			InitIndex(pFont, Index);
-		return &pFont->m_aSizes[Index];
-	}
+		if(m_FirstFreeGlyph < 0 && !EvictAtlasPage())
+			return -1;
 
+		int Index = m_FirstFreeGlyph;
+		CFontChar *pChr = &m_aGlyphs[Index];
+		m_FirstFreeGlyph = pChr->m_NextHash;
+		mem_zero(pChr, sizeof(*pChr));
+		pChr->m_pFont = pFont;
+		pChr->m_SizeIndex = SizeIndex;
+		pChr->m_ID = Chr;
+		pChr->m_State = CFontChar::STATE_NEW;
+		pChr->m_Page = -1;
+
+		unsigned Hash = GlyphHash(pFont, SizeIndex, Chr);
+		pChr->m_NextHash = m_aGlyphHash[Hash];
+		m_aGlyphHash[Hash] = Index;
+		return Index;
+	}
 
-	void UploadGlyph(CFontSizeData *pSizeData, int Texnum, int SlotID, int Chr, const void *pData)
+	void FreeGlyph(int Index)
 	{
-		int x = (SlotID%pSizeData->m_NumXChars) * (pSizeData->m_TextureWidth/pSizeData->m_NumXChars);
-		int y = (SlotID/pSizeData->m_NumXChars) * (pSizeData->m_TextureHeight/pSizeData->m_NumYChars);
-
-		Graphics()->LoadTextureRawSub(pSizeData->m_aTextures[Texnum], x, y,
-			pSizeData->m_TextureWidth/pSizeData->m_NumXChars,
-			pSizeData->m_TextureHeight/pSizeData->m_NumYChars,
-			CImageInfo::FORMAT_ALPHA, pData);
-		/*
-		glBindTexture(GL_TEXTURE_2D, pSizeData->m_aTextures[Texnum]);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y,
-			pSizeData->m_TextureWidth/pSizeData->m_NumXChars,
-			pSizeData->m_TextureHeight/pSizeData->m_NumYChars,
-			m_FontTextureFormat, GL_UNSIGNED_BYTE, pData);*/
+		CFontChar *pChr = &m_aGlyphs[Index];
+		int *pNext = &m_aGlyphHash[GlyphHash(pChr->m_pFont, pChr->m_SizeIndex, pChr->m_ID)];
+		while(*pNext != Index)
+			pNext = &m_aGlyphs[*pNext].m_NextHash;
+		*pNext = pChr->m_NextHash;
+
+		pChr->m_pFont->m_aSizes[pChr->m_SizeIndex].m_Generation++;
+		pChr->m_pFont = 0;
+		pChr->m_NextHash = m_FirstFreeGlyph;
+		m_FirstFreeGlyph = Index;
 	}
 
-	// 32k of data used for rendering glyphs
-	unsigned char ms_aGlyphData[(1024/8) * (1024/8)];
-	unsigned char ms_aGlyphDataOutlined[(1024/8) * (1024/8)];
-
-	int GetSlot(CFontSizeData *pSizeData)
+	bool EvictAtlasPage()
 	{
-		int CharCount = pSizeData->m_NumXChars*pSizeData->m_NumYChars;
-		if(pSizeData->m_CurrentCharacter < CharCount)
+		// clear the page that was used the longest time ago
+		int64 aLastUse[MAX_ATLAS_PAGES] = {0};
+		for(int i = 0; i < MAX_GLYPHS; i++)
 		{
-			int i = pSizeData->m_CurrentCharacter;
-			pSizeData->m_CurrentCharacter++;
-			return i;
+			if(m_aGlyphs[i].m_pFont && m_aGlyphs[i].m_Page >= 0)
+				aLastUse[m_aGlyphs[i].m_Page] = max(aLastUse[m_aGlyphs[i].m_Page], m_aGlyphs[i].m_TouchTime);
 		}
-
-		// kick out the oldest
-		// TODO: remove this linear search
+		int Page = -1;
+		for(int i = 0; i < m_NumAtlasPages; i++)
 		{
-			int Oldest = 0;
-			for(int i = 1; i < CharCount; i++)
-			{
-				if(pSizeData->m_aCharacters[i].m_TouchTime < pSizeData->m_aCharacters[Oldest].m_TouchTime)
-					Oldest = i;
-			}
-
-			if(time_get()-pSizeData->m_aCharacters[Oldest].m_TouchTime < time_freq() &&
-				(pSizeData->m_NumXChars < MAX_CHARACTERS || pSizeData->m_NumYChars < MAX_CHARACTERS))
-			{
-				IncreaseTextureSize(pSizeData);
-				return GetSlot(pSizeData);
-			}
+			if(Page < 0 || aLastUse[i] < aLastUse[Page])
+				Page = i;
+		}
+		if(Page < 0)
+			return false;
 
-			return Oldest;
+		for(int i = 0; i < MAX_GLYPHS; i++)
+		{
+			if(m_aGlyphs[i].m_pFont && m_aGlyphs[i].m_Page == Page)
+				FreeGlyph(i);
 		}
+		m_aAtlasPages[Page].m_NumShelves = 0;
+		m_aAtlasPages[Page].m_UsedHeight = 0;
+		return true;
 	}
 
-	int RenderGlyph(CFont *pFont, CFontSizeData *pSizeData, int Chr)
+	bool AllocInPage(CAtlasPage *pPage, int Width, int Height, int *pX, int *pY)
 	{
-		FT_Bitmap *pBitmap;
-		int SlotID = 0;
-		int SlotW = pSizeData->m_TextureWidth / pSizeData->m_NumXChars;
-		int SlotH = pSizeData->m_TextureHeight / pSizeData->m_NumYChars;
-		int SlotSize = SlotW*SlotH;
-		int x = 1;
-		int y = 1;
-		unsigned int px, py;
-
-		FT_Set_Pixel_Sizes(pFont->m_FtFace, 0, pSizeData->m_FontSize);
+		// take the lowest shelf that fits without wasting too much
+		CAtlasShelf *pBest = 0;
+		for(int i = 0; i < pPage->m_NumShelves; i++)
+		{
+			CAtlasShelf *pShelf = &pPage->m_aShelves[i];
+			if(pShelf->m_Height >= Height && pShelf->m_Height <= Height+Height/4+2 && pShelf->m_X+Width <= ATLAS_SIZE &&
+				(!pBest || pShelf->m_Height < pBest->m_Height))
+				pBest = pShelf;
+		}
 
-		if(FT_Load_Char(pFont->m_FtFace, Chr, FT_LOAD_RENDER|FT_LOAD_NO_BITMAP))
+		if(!pBest)
 		{
-			dbg_msg("pFont", "error loading glyph %d", Chr);
-			return -1;
+			int ShelfHeight = (Height+3)&~3;
+			if(pPage->m_NumShelves == MAX_ATLAS_SHELVES || pPage->m_UsedHeight+ShelfHeight > ATLAS_SIZE)
+				return false;
+			pBest = &pPage->m_aShelves[pPage->m_NumShelves++];
+			pBest->m_Y = pPage->m_UsedHeight;
+			pBest->m_Height = ShelfHeight;
+			pBest->m_X = 0;
+			pPage->m_UsedHeight += ShelfHeight;
 		}
 
-		pBitmap = &pFont->m_FtFace->glyph->bitmap; // ignore_convention
+		*pX = pBest->m_X;
+		*pY = pBest->m_Y;
+		pBest->m_X += Width;
+		return true;
+	}
 
-		// fetch slot
-		SlotID = GetSlot(pSizeData);
-		if(SlotID < 0)
-			return -1;
+	int AllocAtlas(int Width, int Height, int *pX, int *pY)
+	{
+		for(int i = 0; i < m_NumAtlasPages; i++)
+		{
+			if(AllocInPage(&m_aAtlasPages[i], Width, Height, pX, pY))
+				return i;
+		}
 
-		// adjust spacing
-		int OutlineThickness = AdjustOutlineThicknessToFontSize(1, pSizeData->m_FontSize);
-		x += OutlineThickness;
-		y += OutlineThickness;
+		if(m_NumAtlasPages < MAX_ATLAS_PAGES)
+		{
+			CAtlasPage *pPage = &m_aAtlasPages[m_NumAtlasPages];
+			void *pMem = mem_alloc(ATLAS_SIZE*ATLAS_SIZE, 1);
+			mem_zero(pMem, ATLAS_SIZE*ATLAS_SIZE);
+			for(int i = 0; i < 2; i++)
+				pPage->m_aTextures[i] = Graphics()->LoadTextureRaw(ATLAS_SIZE, ATLAS_SIZE, CImageInfo::FORMAT_ALPHA, pMem, CImageInfo::FORMAT_ALPHA, IGraphics::TEXLOAD_NOMIPMAPS);
+			mem_free(pMem);
+			pPage->m_NumShelves = 0;
+			pPage->m_UsedHeight = 0;
+			dbg_msg("textrender", "created glyph page %d", m_NumAtlasPages);
+			if(AllocInPage(pPage, Width, Height, pX, pY))
+				return m_NumAtlasPages++;
+			m_NumAtlasPages++;
+		}
+		else if(EvictAtlasPage())
+			return AllocAtlas(Width, Height, pX, pY);
 
-		// prepare glyph data
-		mem_zero(ms_aGlyphData, SlotSize);
+		return -1;
+	}
 
+	// renders the glyph with its outline, can be called from the glyph job
+	static bool RasterizeGlyph(FT_Face Face, int FontSize, int Chr, CGlyphResult *pResult)
+	{
+		pResult->m_Failed = true;
+		pResult->m_pData = 0;
+
+		FT_Set_Pixel_Sizes(Face, 0, FontSize);
+		if(FT_Load_Char(Face, Chr, FT_LOAD_RENDER|FT_LOAD_NO_BITMAP))
+			return false;
+
+		FT_Bitmap *pBitmap = &Face->glyph->bitmap; // ignore_convention
+		int OutlineThickness = AdjustOutlineThicknessToFontSize(1, FontSize);
+		int Width = pBitmap->width + OutlineThickness*2 + 2; // ignore_convention
+		int Height = pBitmap->rows + OutlineThickness*2 + 2; // ignore_convention
+		if(Width > MAX_GLYPH_SIZE || Height > MAX_GLYPH_SIZE)
+			return false;
+
+		unsigned char *pData = (unsigned char *)mem_alloc(Width*Height*2, 1);
+		unsigned char *pGlyph = pData;
+		unsigned char *pOutline = pData + Width*Height;
+		mem_zero(pData, Width*Height*2);
+
+		int x = 1+OutlineThickness;
+		int y = 1+OutlineThickness;
 		if(pBitmap->pixel_mode == FT_PIXEL_MODE_GRAY) // ignore_convention
 		{
-			for(py = 0; py < pBitmap->rows; py++) // ignore_convention
-				for(px = 0; px < pBitmap->width; px++) // ignore_convention
-					ms_aGlyphData[(py+y)*SlotW+px+x] = pBitmap->buffer[py*pBitmap->pitch+px]; // ignore_convention
+			for(unsigned py = 0; py < pBitmap->rows; py++) // ignore_convention
+				for(unsigned px = 0; px < pBitmap->width; px++) // ignore_convention
+					pGlyph[(py+y)*Width+px+x] = pBitmap->buffer[py*pBitmap->pitch+px]; // ignore_convention
 		}
 		else if(pBitmap->pixel_mode == FT_PIXEL_MODE_MONO) // ignore_convention
 		{
-			for(py = 0; py < pBitmap->rows; py++) // ignore_convention
-				for(px = 0; px < pBitmap->width; px++) // ignore_convention
+			for(unsigned py = 0; py < pBitmap->rows; py++) // ignore_convention
+				for(unsigned px = 0; px < pBitmap->width; px++) // ignore_convention
 				{
 					if(pBitmap->buffer[py*pBitmap->pitch+px/8]&(1<<(7-(px%8)))) // ignore_convention
-						ms_aGlyphData[(py+y)*SlotW+px+x] = 255;
+						pGlyph[(py+y)*Width+px+x] = 255;
 				}
 		}
 
-		/*for(py = 0; py < SlotW; py++)
-			for(px = 0; px < SlotH; px++)
-				ms_aGlyphData[py*SlotW+px] = 255;*/
-
-		// upload the glyph
-		UploadGlyph(pSizeData, 0, SlotID, Chr, ms_aGlyphData);
-
 		if(OutlineThickness == 1)
-		{
-			Grow(ms_aGlyphData, ms_aGlyphDataOutlined, SlotW, SlotH);
-			UploadGlyph(pSizeData, 1, SlotID, Chr, ms_aGlyphDataOutlined);
-		}
+			Grow(pGlyph, pOutline, Width, Height);
 		else
 		{
+			unsigned char *pTemp = (unsigned char *)mem_alloc(Width*Height, 1);
+			mem_copy(pOutline, pGlyph, Width*Height);
 			for(int i = OutlineThickness; i > 0; i-=2)
 			{
-				Grow(ms_aGlyphData, ms_aGlyphDataOutlined, SlotW, SlotH);
-				Grow(ms_aGlyphDataOutlined, ms_aGlyphData, SlotW, SlotH);
+				Grow(pOutline, pTemp, Width, Height);
+				Grow(pTemp, pOutline, Width, Height);
 			}
-			UploadGlyph(pSizeData, 1, SlotID, Chr, ms_aGlyphData);
-		}
-
-		// set char info
-		{
-			CFontChar *pFontchr = &pSizeData->m_aCharacters[SlotID];
-			float Scale = 1.0f/pSizeData->m_FontSize;
-			float Uscale = 1.0f/pSizeData->m_TextureWidth;
-			float Vscale = 1.0f/pSizeData->m_TextureHeight;
-			int Height = pBitmap->rows + OutlineThickness*2 + 2; // ignore_convention
-			int Width = pBitmap->width + OutlineThickness*2 + 2; // ignore_convention
-
-			pFontchr->m_ID = Chr;
-			pFontchr->m_Height = Height * Scale;
-			pFontchr->m_Width = Width * Scale;
-			pFontchr->m_OffsetX = (pFont->m_FtFace->glyph->bitmap_left-2) * Scale; // ignore_convention
-			pFontchr->m_OffsetY = (pSizeData->m_FontSize - pFont->m_FtFace->glyph->bitmap_top) * Scale; // ignore_convention
-			pFontchr->m_AdvanceX = (pFont->m_FtFace->glyph->advance.x>>6) * Scale; // ignore_convention
-
-			pFontchr->m_aUvs[0] = (SlotID%pSizeData->m_NumXChars) / (float)(pSizeData->m_NumXChars);
-			pFontchr->m_aUvs[1] = (SlotID/pSizeData->m_NumXChars) / (float)(pSizeData->m_NumYChars);
-			pFontchr->m_aUvs[2] = pFontchr->m_aUvs[0] + Width*Uscale;
-			pFontchr->m_aUvs[3] = pFontchr->m_aUvs[1] + Height*Vscale;
+			mem_free(pTemp);
 		}
 
-		return SlotID;
+		pResult->m_Failed = false;
+		pResult->m_Width = Width;
+		pResult->m_Height = Height;
+		pResult->m_Left = Face->glyph->bitmap_left; // ignore_convention
+		pResult->m_Top = Face->glyph->bitmap_top; // ignore_convention
+		pResult->m_Advance = Face->glyph->advance.x>>6; // ignore_convention
+		pResult->m_pData = pData;
+		return true;
 	}
 
-	CFontChar *GetChar(CFont *pFont, CFontSizeData *pSizeData, int Chr)
+	static int GlyphJob(void *pUser)
 	{
-		CFontChar *pFontchr = NULL;
-
-		// search for the character
-		// TODO: remove this linear search
-		int i;
-		for(i = 0; i < pSizeData->m_CurrentCharacter; i++)
+		CTextRender *pThis = (CTextRender *)pUser;
+		while(1)
 		{
-			if(pSizeData->m_aCharacters[i].m_ID == Chr)
+			lock_wait(pThis->m_GlyphLock);
+			if(!pThis->m_lGlyphRequests.size())
 			{
-				pFontchr = &pSizeData->m_aCharacters[i];
+				lock_unlock(pThis->m_GlyphLock);
 				break;
 			}
-		}
+			CGlyphRequest Request = pThis->m_lGlyphRequests[pThis->m_lGlyphRequests.size()-1];
+			pThis->m_lGlyphRequests.remove_index_fast(pThis->m_lGlyphRequests.size()-1);
+			lock_unlock(pThis->m_GlyphLock);
+
+			CFont *pFont = Request.m_pFont;
+			if(!pFont->m_WorkerFace && !pFont->m_WorkerFaceFailed)
+				pFont->m_WorkerFaceFailed = FT_New_Face(pThis->m_WorkerLibrary, pFont->m_aFilename, 0, &pFont->m_WorkerFace) != 0;
+
+			CGlyphResult Result;
+			Result.m_pFont = pFont;
+			Result.m_SizeIndex = Request.m_SizeIndex;
+			Result.m_Chr = Request.m_Chr;
+			Result.m_Glyph = Request.m_Glyph;
+			if(pFont->m_WorkerFace)
+				RasterizeGlyph(pFont->m_WorkerFace, Request.m_FontSize, Request.m_Chr, &Result);
+			else
+			{
+				Result.m_Failed = true;
+				Result.m_pData = 0;
+			}
 
-		// check if we need to render the character
-		if(!pFontchr)
-		{
-			int Index = RenderGlyph(pFont, pSizeData, Chr);
-			if(Index >= 0)
-				pFontchr = &pSizeData->m_aCharacters[Index];
+			lock_wait(pThis->m_GlyphLock);
+			pThis->m_lGlyphResults.add(Result);
+			lock_unlock(pThis->m_GlyphLock);
 		}
-
-		// touch the character
-		// TODO: don't call time_get here
-		if(pFontchr)
-			pFontchr->m_TouchTime = time_get();
-
-		return pFontchr;
+		return 0;
 	}
 
-	// must only be called from the rendering function as the pFont must be set to the correct size
-	void RenderSetup(CFont *pFont, int size)
+	void StartGlyphJob()
 	{
-		FT_Set_Pixel_Sizes(pFont->m_FtFace, 0, size);
+		if(m_GlyphJob.Status() == CJob::STATE_DONE)
+			m_pEngine->AddJob(&m_GlyphJob, GlyphJob, this);
 	}
 
-	float Kerning(CFont *pFont, int Left, int Right)
+	void ApplyGlyph(int Index, const CGlyphResult *pResult)
 	{
-		FT_Vector Kerning = {0,0};
-		FT_Get_Kerning(pFont->m_FtFace, Left, Right, FT_KERNING_DEFAULT, &Kerning);
-		return (Kerning.x>>6);
-	}
+		CFontChar *pChr = &m_aGlyphs[Index];
+		CFontSizeData *pSizeData = &pChr->m_pFont->m_aSizes[pChr->m_SizeIndex];
+		pSizeData->m_Generation++;
 
+		int x, y;
+		int Page = pResult->m_Failed ? -1 : AllocAtlas(pResult->m_Width, pResult->m_Height, &x, &y);
+		if(Page < 0)
+		{
+			if(!pResult->m_Failed)
+				dbg_msg("textrender", "no space for glyph %d", pChr->m_ID);
+			else
+				dbg_msg("textrender", "error loading glyph %d", pChr->m_ID);
+			pChr->m_State = CFontChar::STATE_FAILED;
+			return;
+		}
 
-public:
-	CTextRender()
-	{
-		m_pGraphics = 0;
+		// upload the glyph
+		const int Size = pResult->m_Width*pResult->m_Height;
+		Graphics()->LoadTextureRawSub(m_aAtlasPages[Page].m_aTextures[0], x, y, pResult->m_Width, pResult->m_Height, CImageInfo::FORMAT_ALPHA, pResult->m_pData);
+		Graphics()->LoadTextureRawSub(m_aAtlasPages[Page].m_aTextures[1], x, y, pResult->m_Width, pResult->m_Height, CImageInfo::FORMAT_ALPHA, pResult->m_pData+Size);
 
-		m_TextR = 1.0f;
-		m_TextG = 1.0f;
-		m_TextB = 1.0f;
-		m_TextA = 1.0f;
-		m_TextOutlineR = 0.0f;
-		m_TextOutlineG = 0.0f;
-		m_TextOutlineB = 0.0f;
-		m_TextOutlineA = 0.3f;
+		// set char info
+		float Scale = 1.0f/pSizeData->m_FontSize;
+		pChr->m_State = CFontChar::STATE_READY;
+		pChr->m_HasMetrics = true;
+		pChr->m_Page = Page;
+		pChr->m_Height = pResult->m_Height * Scale;
+		pChr->m_Width = pResult->m_Width * Scale;
+		pChr->m_OffsetX = (pResult->m_Left-2) * Scale;
+		pChr->m_OffsetY = (pSizeData->m_FontSize - pResult->m_Top) * Scale;
+		pChr->m_AdvanceX = pResult->m_Advance * Scale;
+		pChr->m_aUvs[0] = x / (float)ATLAS_SIZE;
+		pChr->m_aUvs[1] = y / (float)ATLAS_SIZE;
+		pChr->m_aUvs[2] = (x+pResult->m_Width) / (float)ATLAS_SIZE;
+		pChr->m_aUvs[3] = (y+pResult->m_Height) / (float)ATLAS_SIZE;
+	}
 
-		m_pDefaultFont = 0;
+	void ProcessGlyphResults()
+	{
+		if(!m_NumQueuedGlyphs)
+			return;
 
-		// GL_LUMINANCE can be good for debugging
-		//m_FontTextureFormat = GL_ALPHA;
+		lock_wait(m_GlyphLock);
+		for(int i = 0; i < m_lGlyphResults.size(); i++)
+		{
+			const CGlyphResult *pResult = &m_lGlyphResults[i];
+			const CFontChar *pChr = &m_aGlyphs[pResult->m_Glyph];
+			// glyphs that were needed right away are rendered already, their slot might even be reused
+			if(pChr->m_State == CFontChar::STATE_QUEUED && pChr->m_pFont == pResult->m_pFont &&
+				pChr->m_SizeIndex == pResult->m_SizeIndex && pChr->m_ID == pResult->m_Chr)
+				ApplyGlyph(pResult->m_Glyph, pResult);
+			if(pResult->m_pData)
+				mem_free(pResult->m_pData);
+		}
+		m_NumQueuedGlyphs -= m_lGlyphResults.size();
+		m_lGlyphResults.set_size(0);
+		bool Pending = m_lGlyphRequests.size() != 0;
+		lock_unlock(m_GlyphLock);
+
+		// the job might have finished right before the last request was added
+		if(Pending)
+			StartGlyphJob();
 	}
 
-	virtual void Init()
+	void QueueGlyph(int Index)
 	{
-		m_pGraphics = Kernel()->RequestInterface<IGraphics>();
-		FT_Init_FreeType(&m_FTLibrary);
-	}
+		CFontChar *pChr = &m_aGlyphs[Index];
+		pChr->m_State = CFontChar::STATE_QUEUED;
+		if(!m_pEngine)
+		{
+			RenderGlyphNow(Index);
+			return;
+		}
 
+		CGlyphRequest Request;
+		Request.m_pFont = pChr->m_pFont;
+		Request.m_SizeIndex = pChr->m_SizeIndex;
+		Request.m_FontSize = pChr->m_pFont->m_aSizes[pChr->m_SizeIndex].m_FontSize;
+		Request.m_Chr = pChr->m_ID;
+		Request.m_Glyph = Index;
+		lock_wait(m_GlyphLock);
+		m_lGlyphRequests.add(Request);
+		lock_unlock(m_GlyphLock);
+		m_NumQueuedGlyphs++;
+		StartGlyphJob();
+	}
 
-	virtual int LoadFont(const char *pFilename)
+	void RenderGlyphNow(int Index)
 	{
-		CFont *pFont = (CFont *)mem_alloc(sizeof(CFont), 1);
+		CFontChar *pChr = &m_aGlyphs[Index];
+		CGlyphResult Result;
+		Result.m_pFont = pChr->m_pFont;
+		Result.m_SizeIndex = pChr->m_SizeIndex;
+		Result.m_Chr = pChr->m_ID;
+		Result.m_Glyph = Index;
+		RasterizeGlyph(pChr->m_pFont->m_FtFace, pChr->m_pFont->m_aSizes[pChr->m_SizeIndex].m_FontSize, pChr->m_ID, &Result);
+		ApplyGlyph(Index, &Result);
+		if(Result.m_pData)
+			mem_free(Result.m_pData);
+	}
 
-		mem_zero(pFont, sizeof(*pFont));
-		str_copy(pFont->m_aFilename, pFilename, sizeof(pFont->m_aFilename));
+	bool LoadMetrics(CFont *pFont, CFontSizeData *pSizeData, CFontChar *pChr)
+	{
+		// the advance is enough to lay out the text before the glyph is rendered
+		FT_Set_Pixel_Sizes(pFont->m_FtFace, 0, pSizeData->m_FontSize);
+		if(FT_Load_Char(pFont->m_FtFace, pChr->m_ID, FT_LOAD_NO_BITMAP))
+			return false;
+		pChr->m_AdvanceX = (pFont->m_FtFace->glyph->advance.x>>6) / (float)pSizeData->m_FontSize; // ignore_convention
+		pChr->m_HasMetrics = true;
+		return true;
+	}
 
-		if(FT_New_Face(m_FTLibrary, pFont->m_aFilename, 0, &pFont->m_FtFace))
+	// returns 0 if the character can't be rendered, otherwise it might still be a placeholder
+	CFontChar *GetChar(CFont *pFont, CFontSizeData *pSizeData, int Chr, bool Wait=false)
+	{
+		int SizeIndex = pSizeData - pFont->m_aSizes;
+		int Index = FindGlyph(pFont, SizeIndex, Chr);
+		if(Index < 0)
 		{
-			mem_free(pFont);
-			return -1;
+			Index = NewGlyph(pFont, SizeIndex, Chr);
+			if(Index < 0)
+				return 0;
 		}
 
-		for(unsigned i = 0; i < NUM_FONT_SIZES; i++)
-			pFont->m_aSizes[i].m_FontSize = -1;
+		CFontChar *pFontchr = &m_aGlyphs[Index];
+		if(pFontchr->m_State == CFontChar::STATE_FAILED)
+			return 0;
+		if(!pFontchr->m_HasMetrics && !LoadMetrics(pFont, pSizeData, pFontchr))
+		{
+			dbg_msg("textrender", "error loading glyph %d", Chr);
+			pFontchr->m_State = CFontChar::STATE_FAILED;
+			return 0;
+		}
 
-		dbg_msg("textrender", "loaded pFont from '%s'", pFilename);
-		m_pDefaultFont = pFont;
+		if(Wait && pFontchr->m_State != CFontChar::STATE_READY)
+			RenderGlyphNow(Index);
+		else if(pFontchr->m_State == CFontChar::STATE_NEW)
+			QueueGlyph(Index);
+		if(pFontchr->m_State == CFontChar::STATE_FAILED)
+			return 0;
 
-		return 0;
+		// touch the character
+		// TODO: don't call time_get here
+		pFontchr->m_TouchTime = time_get();
+		return pFontchr;
 	}
 
-
-	virtual void SetCursor(CTextCursor *pCursor, float x, float y, float FontSize, int Flags)
+	void PrewarmGlyphs(CFont *pFont)
 	{
-		mem_zero(pCursor, sizeof(*pCursor));
-		pCursor->m_FontSize = FontSize;
-		pCursor->m_StartX = x;
-		pCursor->m_StartY = y;
-		pCursor->m_X = x;
-		pCursor->m_Y = y;
-		pCursor->m_LineCount = 1;
-		pCursor->m_LineWidth = -1.0f;
-		pCursor->m_Flags = Flags;
-		pCursor->m_GlyphCount = 0;
-		pCursor->m_CharCount = 0;
+		// the printable ascii characters of the common sizes
+		for(unsigned s = 0; s < NUM_FONT_SIZES && aFontSizes[s] <= PREWARM_MAX_FONT_SIZE; s++)
+		{
+			GetSize(pFont, aFontSizes[s]);
+			for(int c = 32; c < 127; c++)
+			{
+				int Index = FindGlyph(pFont, s, c);
+				if(Index < 0)
+					Index = NewGlyph(pFont, s, c);
+				if(Index >= 0 && m_aGlyphs[Index].m_State == CFontChar::STATE_NEW)
+					QueueGlyph(Index);
+			}
+		}
 	}
 
-
-	virtual void Text(void *pFontSetV, float x, float y, float Size, const char *pText, float LineWidth, bool MultiLine)
+	// draws the glyphs with the glyph (0) or outline (1) textures of their pages
+	void RenderQuads(const CQuadChar *pQuads, int Num, int Texture, const vec4 &Color, float OffsetX, float OffsetY)
 	{
-		CTextCursor Cursor;
-		SetCursor(&Cursor, x, y, Size, TEXTFLAG_RENDER);
-		if(!MultiLine)
-			Cursor.m_Flags |= TEXTFLAG_STOP_AT_END;
-		Cursor.m_LineWidth = LineWidth;
-		TextEx(&Cursor, pText, -1);
-	}
+		int Page = -1;
+		for(int i = 0; i < Num; i++)
+		{
+			if(pQuads[i].m_Page != Page)
+			{
+				if(Page >= 0)
+					Graphics()->QuadsEnd();
+				Page = pQuads[i].m_Page;
+				Graphics()->TextureSet(m_aAtlasPages[Page].m_aTextures[Texture]);
+				Graphics()->QuadsBegin();
+				Graphics()->SetColor(Color.r, Color.g, Color.b, Color.a);
+			}
 
-	virtual float TextWidth(void *pFontSetV, float Size, const char *pText, int StrLength, float LineWidth)
-	{
-		CTextCursor Cursor;
-		SetCursor(&Cursor, 0, 0, Size, 0);
-		Cursor.m_LineWidth = LineWidth;
-		TextEx(&Cursor, pText, StrLength);
-		return Cursor.m_X;
+			Graphics()->QuadsSetSubset(pQuads[i].m_aUvs[0], pQuads[i].m_aUvs[1], pQuads[i].m_aUvs[2], pQuads[i].m_aUvs[3]);
+			IGraphics::CQuadItem QuadItem = pQuads[i].m_QuadItem;
+			QuadItem.m_X += OffsetX;
+			QuadItem.m_Y += OffsetY;
+			Graphics()->QuadsDrawTL(&QuadItem, 1);
+		}
+		if(Page >= 0)
+			Graphics()->QuadsEnd();
 	}
 
-	virtual int TextLineCount(void *pFontSetV, float Size, const char *pText, float LineWidth)
+	// must only be called from the rendering function as the pFont must be set to the correct size
+	void RenderSetup(CFont *pFont, int size)
 	{
-		CTextCursor Cursor;
-		SetCursor(&Cursor, 0, 0, Size, 0);
-		Cursor.m_LineWidth = LineWidth;
-		TextEx(&Cursor, pText, -1);
-		return Cursor.m_LineCount;
+		FT_Set_Pixel_Sizes(pFont->m_FtFace, 0, size);
 	}
 
-	virtual void TextColor(float r, float g, float b, float a)
+	float Kerning(CFont *pFont, int Left, int Right)
 	{
-		m_TextR = r;
-		m_TextG = g;
-		m_TextB = b;
-		m_TextA = a;
+		FT_Vector Kerning = {0,0};
+		FT_Get_Kerning(pFont->m_FtFace, Left, Right, FT_KERNING_DEFAULT, &Kerning);
+		return (Kerning.x>>6);
 	}
 
-	virtual void TextOutlineColor(float r, float g, float b, float a)
+
+	/*
+		Laid out strings are kept in a cache, so text that doesn't change
+		skips the utf-8 decoding, the glyph lookups, the kerning and the
+		line wrapping. A layout only depends on the cursor through the
+		flags, line width and line limits as long as the text starts at the
+		beginning of a line, so the glyphs are stored relative to the cursor
+		and moving text still hits. Layouts are dropped when the glyphs of
+		their font size move in the texture.
+	*/
+	enum
 	{
-		m_TextOutlineR = r;
-		m_TextOutlineG = g;
-		m_TextOutlineB = b;
-		m_TextOutlineA = a;
-	}
+		LAYOUT_HASH_SIZE=1024,
+		MAX_LAYOUTS=1024,
+		MAX_LAYOUT_GLYPHS=64*1024,
+		MAX_LAYOUT_TEXT_LENGTH=1024,
+	};
 
-	virtual void TextShadowed(CTextCursor *pCursor, const char *pText, int Length, vec2 ShadowOffset,
-							  vec4 ShadowColor, vec4 TextColor_)
+	struct CLayoutContext
+	{
+		CFont *m_pFont;
+		CFontSizeData *m_pSizeData;
+		int m_ActualSize;
+		float m_Size;
+		float m_FakeToScreenX;
+		float m_FakeToScreenY;
+	};
+
+	// followed by the glyphs and the text
+	struct CLayout
 	{
+		CLayout *m_pPrev;
+		CLayout *m_pNext;
+		CLayout *m_pNextHash;
+
+		// key
+		unsigned m_Hash;
+		CFontSizeData *m_pSizeData;
+		int m_ActualSize;
+		float m_FakeToScreenX;
+		float m_FakeToScreenY;
+		float m_LineWidth;
+		int m_Flags;
+		int m_MaxLines;
+		int m_StartLineCount;
+		int m_Length;
+		int m_Generation;
+
+		// result
+		float m_EndX;
+		float m_EndY;
+		bool m_GotNewLine;
+		int m_LineCount;
+		int m_GlyphCount;
+		int m_CharCount;
+		int m_NumGlyphs;
+
+		CQuadChar *Glyphs() { return (CQuadChar *)(this+1); }
+		char *Text() { return (char *)(Glyphs()+m_NumGlyphs); }
+	};
+
+	CLayout *m_apLayoutHash[LAYOUT_HASH_SIZE];
+	CLayout *m_pFirstLayout;
+	CLayout *m_pLastLayout;
+	int m_NumLayouts;
+	int m_NumLayoutGlyphs;
+	int m_LayoutHits;
+	int m_LayoutMisses;
+	array<CQuadChar> m_lLayoutGlyphs;
+
+	bool PrepareLayout(const CTextCursor *pCursor, CLayoutContext *pContext, float *pCursorX, float *pCursorY)
+	{
+		ProcessGlyphResults();
+
 		float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
-		float FakeToScreenX, FakeToScreenY;
 
 		// to correct coords, convert to screen coords, round, and convert back
 		Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
 
-		FakeToScreenX = (Graphics()->ScreenWidth()/(ScreenX1-ScreenX0));
-		FakeToScreenY = (Graphics()->ScreenHeight()/(ScreenY1-ScreenY0));
-		ShadowOffset.x /= FakeToScreenX;
-		ShadowOffset.y /= FakeToScreenY;
-
-		CQuadChar aTextQuads[1024];
-		int TextQuadCount = 0;
-		IGraphics::CTextureHandle FontTexture;
-
-		TextDeferredRenderEx(pCursor, pText, Length, aTextQuads, sizeof(aTextQuads)/sizeof(aTextQuads[0]),
-				&TextQuadCount, &FontTexture);
+		pContext->m_FakeToScreenX = (Graphics()->ScreenWidth()/(ScreenX1-ScreenX0));
+		pContext->m_FakeToScreenY = (Graphics()->ScreenHeight()/(ScreenY1-ScreenY0));
+		*pCursorX = (int)(pCursor->m_X * pContext->m_FakeToScreenX) / pContext->m_FakeToScreenX;
+		*pCursorY = (int)(pCursor->m_Y * pContext->m_FakeToScreenY) / pContext->m_FakeToScreenY;
 
-		Graphics()->TextureSet(FontTexture);
-
-		Graphics()->QuadsBegin();
+		// same with size
+		pContext->m_ActualSize = (int)(pCursor->m_FontSize * pContext->m_FakeToScreenY);
+		pContext->m_Size = pContext->m_ActualSize / pContext->m_FakeToScreenY;
 
-		// shadow pass
-		Graphics()->SetColor(ShadowColor.r, ShadowColor.g, ShadowColor.b, ShadowColor.a);
+		// fetch pFont data
+		pContext->m_pFont = pCursor->m_pFont ? pCursor->m_pFont : m_pDefaultFont;
+		if(!pContext->m_pFont)
+			return false;
 
-		for(int i = 0; i < TextQuadCount; i++)
-		{
-			const CQuadChar& q = aTextQuads[i];
-			Graphics()->QuadsSetSubset(q.m_aUvs[0], q.m_aUvs[1], q.m_aUvs[2], q.m_aUvs[3]);
+		pContext->m_pSizeData = GetSize(pContext->m_pFont, pContext->m_ActualSize);
+		RenderSetup(pContext->m_pFont, pContext->m_ActualSize);
+		return true;
+	}
 
-			IGraphics::CQuadItem QuadItem = q.m_QuadItem;
-			QuadItem.m_X += ShadowOffset.x;
-			QuadItem.m_Y += ShadowOffset.y;
-			Graphics()->QuadsDrawTL(&QuadItem, 1);
-		}
+	// glyphs are only collected if plGlyphs is set, relative to CursorX and CursorY
+	bool LayoutText(const CLayoutContext *pContext, CTextCursor *pCursor, float CursorX, float CursorY, const char *pText, int Length, array<CQuadChar> *plGlyphs)
+	{
+		CFontSizeData *pSizeData = pContext->m_pSizeData;
+		const float Size = pContext->m_Size;
+		const float FakeToScreenX = pContext->m_FakeToScreenX;
+		const float FakeToScreenY = pContext->m_FakeToScreenY;
+		const float Scale = 1.0f/pSizeData->m_FontSize;
 
-		// text pass
-		Graphics()->SetColor(TextColor_.r, TextColor_.g, TextColor_.b, TextColor_.a);
+		int GotNewLine = 0;
+		const char *pCurrent = pText;
+		const char *pEnd = pCurrent+Length;
+		float DrawX = CursorX;
+		float DrawY = CursorY;
+		int LineCount = pCursor->m_LineCount;
 
-		for(int i = 0; i < TextQuadCount; i++)
-		{
-			const CQuadChar& q = aTextQuads[i];
-			Graphics()->QuadsSetSubset(q.m_aUvs[0], q.m_aUvs[1], q.m_aUvs[2], q.m_aUvs[3]);
-			Graphics()->QuadsDrawTL(&q.m_QuadItem, 1);
-		}
-
-		Graphics()->QuadsEnd();
-	}
-
-	virtual void TextDeferredRenderEx(CTextCursor *pCursor, const char *pText, int Length,
-									  CQuadChar* aQuadChar, int QuadCharMaxCount, int* pQuadCharCount,
-									  IGraphics::CTextureHandle* pFontTexture)
-	{
-		CFont *pFont = pCursor->m_pFont;
-		CFontSizeData *pSizeData = NULL;
-
-		float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
-		float FakeToScreenX, FakeToScreenY;
-		int ActualX, ActualY;
-
-		int ActualSize;
-		int GotNewLine = 0;
-		float DrawX = 0.0f, DrawY = 0.0f;
-		int LineCount = 0;
-		float CursorX, CursorY;
-
-		float Size = pCursor->m_FontSize;
-
-		// to correct coords, convert to screen coords, round, and convert back
-		Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
-
-		FakeToScreenX = (Graphics()->ScreenWidth()/(ScreenX1-ScreenX0));
-		FakeToScreenY = (Graphics()->ScreenHeight()/(ScreenY1-ScreenY0));
-		ActualX = (int)(pCursor->m_X * FakeToScreenX);
-		ActualY = (int)(pCursor->m_Y * FakeToScreenY);
-
-		CursorX = ActualX / FakeToScreenX;
-		CursorY = ActualY / FakeToScreenY;
-
-		// same with size
-		ActualSize = (int)(Size * FakeToScreenY);
-		Size = ActualSize / FakeToScreenY;
-
-		// fetch pFont data
-		if(!pFont)
-			pFont = m_pDefaultFont;
-
-		if(!pFont)
-			return;
-
-		pSizeData = GetSize(pFont, ActualSize);
-		RenderSetup(pFont, ActualSize);
-		*pFontTexture = pSizeData->m_aTextures[0];
-
-		float Scale = 1.0f/pSizeData->m_FontSize;
-
-		// set length
-		if(Length < 0)
-			Length = str_length(pText);
-
-
-		const char *pCurrent = (char *)pText;
-		const char *pEnd = pCurrent+Length;
-		DrawX = CursorX;
-		DrawY = CursorY;
-		LineCount = pCursor->m_LineCount;
-
-		while(pCurrent < pEnd && (pCursor->m_MaxLines < 1 || LineCount <= pCursor->m_MaxLines))
+		while(pCurrent < pEnd && (pCursor->m_MaxLines < 1 || LineCount <= pCursor->m_MaxLines))
 		{
 			int NewLine = 0;
 			const char *pBatchEnd = pEnd;
 			if(pCursor->m_LineWidth > 0 && !(pCursor->m_Flags&TEXTFLAG_STOP_AT_END))
 			{
-				int Wlen = min(WordLength((char *)pCurrent), (int)(pEnd-pCurrent));
+				int Wlen = min(WordLength(pCurrent), (int)(pEnd-pCurrent));
+				const float WordX = (int)(DrawX * FakeToScreenX) / FakeToScreenX;
+				const float WordY = (int)(DrawY * FakeToScreenY) / FakeToScreenY;
 				CTextCursor Compare = *pCursor;
 				Compare.m_X = DrawX;
 				Compare.m_Y = DrawY;
 				Compare.m_Flags &= ~TEXTFLAG_RENDER;
 				Compare.m_LineWidth = -1;
-				TextDeferredRenderEx(&Compare, pCurrent, Wlen, aQuadChar, QuadCharMaxCount, pQuadCharCount,
-									 pFontTexture);
+				LayoutText(pContext, &Compare, WordX, WordY, pCurrent, Wlen, 0);
 
 				if(Compare.m_X-DrawX > pCursor->m_LineWidth)
 				{
@@ -682,8 +829,7 @@ public:
 					Cutter.m_Flags &= ~TEXTFLAG_RENDER;
 					Cutter.m_Flags |= TEXTFLAG_STOP_AT_END;
 
-					TextDeferredRenderEx(&Cutter, (const char *)pCurrent, Wlen, aQuadChar, QuadCharMaxCount,
-										 pQuadCharCount, pFontTexture);
+					LayoutText(pContext, &Cutter, WordX, WordY, pCurrent, Wlen, 0);
 					Wlen = Cutter.m_GlyphCount;
 					NewLine = 1;
 
@@ -712,6 +858,7 @@ public:
 				{
 					DrawX = pCursor->m_StartX;
 					DrawY += Size;
+					GotNewLine = 1;
 					DrawX = (int)(DrawX * FakeToScreenX) / FakeToScreenX; // realign
 					DrawY = (int)(DrawY * FakeToScreenY) / FakeToScreenY;
 					++LineCount;
@@ -720,10 +867,10 @@ public:
 					continue;
 				}
 
-				CFontChar *pChr = GetChar(pFont, pSizeData, Character);
+				CFontChar *pChr = GetChar(pContext->m_pFont, pSizeData, Character);
 				if(pChr)
 				{
-					float Advance = pChr->m_AdvanceX + Kerning(pFont, Character, NextCharacter)*Scale;
+					float Advance = pChr->m_AdvanceX + Kerning(pContext->m_pFont, Character, NextCharacter)*Scale;
 					if(pCursor->m_Flags&TEXTFLAG_STOP_AT_END && DrawX+Advance*Size-pCursor->m_StartX > pCursor->m_LineWidth)
 					{
 						// we hit the end of the line, no more to render or count
@@ -731,19 +878,16 @@ public:
 						break;
 					}
 
-					if(pCursor->m_Flags&TEXTFLAG_RENDER)
+					// placeholders only take up their space until the glyph is rendered
+					if(plGlyphs && pChr->m_State == CFontChar::STATE_READY)
 					{
-						dbg_assert(*pQuadCharCount < QuadCharMaxCount, "aQuadChar size is too small");
-
-						CQuadChar QuadChar;
-						memmove(QuadChar.m_aUvs, pChr->m_aUvs, sizeof(pChr->m_aUvs));
-
-						IGraphics::CQuadItem QuadItem(DrawX+pChr->m_OffsetX*Size,
-													  DrawY+pChr->m_OffsetY*Size,
-													  pChr->m_Width*Size,
-													  pChr->m_Height*Size);
-						QuadChar.m_QuadItem = QuadItem;
-						aQuadChar[(*pQuadCharCount)++] = QuadChar;
+						CQuadChar Glyph;
+						Glyph.m_Page = pChr->m_Page;
+						Glyph.m_Glyph = pChr - m_aGlyphs;
+						mem_copy(Glyph.m_aUvs, pChr->m_aUvs, sizeof(pChr->m_aUvs));
+						Glyph.m_QuadItem = IGraphics::CQuadItem(DrawX+pChr->m_OffsetX*Size-CursorX,
+							DrawY+pChr->m_OffsetY*Size-CursorY, pChr->m_Width*Size, pChr->m_Height*Size);
+						plGlyphs->add(Glyph);
 					}
 
 					DrawX += Advance*Size;
@@ -767,194 +911,402 @@ public:
 
 		if(GotNewLine)
 			pCursor->m_Y = DrawY;
+		return GotNewLine;
 	}
 
-	virtual void TextEx(CTextCursor *pCursor, const char *pText, int Length)
+	static unsigned LayoutHash(const char *pText, int Length)
 	{
-		CFont *pFont = pCursor->m_pFont;
-		CFontSizeData *pSizeData = NULL;
+		unsigned Hash = 5381;
+		for(int i = 0; i < Length; i++)
+			Hash = ((Hash << 5) + Hash) + (unsigned char)pText[i];
+		return Hash;
+	}
 
-		//dbg_msg("textrender", "rendering text '%s'", text);
+	void RemoveLayout(CLayout *pLayout)
+	{
+		CLayout **ppLayout = &m_apLayoutHash[pLayout->m_Hash%LAYOUT_HASH_SIZE];
+		while(*ppLayout != pLayout)
+			ppLayout = &(*ppLayout)->m_pNextHash;
+		*ppLayout = pLayout->m_pNextHash;
 
-		float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
-		float FakeToScreenX, FakeToScreenY;
-		int ActualX, ActualY;
+		if(pLayout->m_pPrev)
+			pLayout->m_pPrev->m_pNext = pLayout->m_pNext;
+		else
+			m_pFirstLayout = pLayout->m_pNext;
+		if(pLayout->m_pNext)
+			pLayout->m_pNext->m_pPrev = pLayout->m_pPrev;
+		else
+			m_pLastLayout = pLayout->m_pPrev;
 
-		int ActualSize;
-		int i;
-		int GotNewLine = 0;
-		float DrawX = 0.0f, DrawY = 0.0f;
-		int LineCount = 0;
-		float CursorX, CursorY;
+		m_NumLayouts--;
+		m_NumLayoutGlyphs -= pLayout->m_NumGlyphs;
+		mem_free(pLayout);
+	}
 
-		float Size = pCursor->m_FontSize;
+	void AddLayout(CLayout *pLayout)
+	{
+		// drop the least recently used layouts to stay in the budget
+		while(m_pLastLayout && (m_NumLayouts >= MAX_LAYOUTS || m_NumLayoutGlyphs+pLayout->m_NumGlyphs > MAX_LAYOUT_GLYPHS))
+			RemoveLayout(m_pLastLayout);
+
+		pLayout->m_pNextHash = m_apLayoutHash[pLayout->m_Hash%LAYOUT_HASH_SIZE];
+		m_apLayoutHash[pLayout->m_Hash%LAYOUT_HASH_SIZE] = pLayout;
+		pLayout->m_pPrev = 0;
+		pLayout->m_pNext = m_pFirstLayout;
+		if(m_pFirstLayout)
+			m_pFirstLayout->m_pPrev = pLayout;
+		else
+			m_pLastLayout = pLayout;
+		m_pFirstLayout = pLayout;
 
-		// to correct coords, convert to screen coords, round, and convert back
-		Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
+		m_NumLayouts++;
+		m_NumLayoutGlyphs += pLayout->m_NumGlyphs;
+	}
 
-		FakeToScreenX = (Graphics()->ScreenWidth()/(ScreenX1-ScreenX0));
-		FakeToScreenY = (Graphics()->ScreenHeight()/(ScreenY1-ScreenY0));
-		ActualX = (int)(pCursor->m_X * FakeToScreenX);
-		ActualY = (int)(pCursor->m_Y * FakeToScreenY);
+	CLayout *FindLayout(const CLayoutContext *pContext, const CTextCursor *pCursor, unsigned Hash, const char *pText, int Length)
+	{
+		for(CLayout *pLayout = m_apLayoutHash[Hash%LAYOUT_HASH_SIZE]; pLayout; pLayout = pLayout->m_pNextHash)
+		{
+			if(pLayout->m_Hash == Hash && pLayout->m_Length == Length && pLayout->m_pSizeData == pContext->m_pSizeData &&
+				pLayout->m_ActualSize == pContext->m_ActualSize && pLayout->m_FakeToScreenX == pContext->m_FakeToScreenX &&
+				pLayout->m_FakeToScreenY == pContext->m_FakeToScreenY && pLayout->m_LineWidth == pCursor->m_LineWidth &&
+				pLayout->m_Flags == (pCursor->m_Flags&~TEXTFLAG_RENDER) && pLayout->m_MaxLines == pCursor->m_MaxLines &&
+				pLayout->m_StartLineCount == pCursor->m_LineCount && mem_comp(pLayout->Text(), pText, Length) == 0)
+				return pLayout;
+		}
+		return 0;
+	}
 
-		CursorX = ActualX / FakeToScreenX;
-		CursorY = ActualY / FakeToScreenY;
+	// lays out the text and moves the cursor, returns the glyphs relative to CursorX and CursorY
+	int Layout(const CLayoutContext *pContext, CTextCursor *pCursor, float CursorX, float CursorY, const char *pText, int Length, const CQuadChar **ppGlyphs)
+	{
+		CFontSizeData *pSizeData = pContext->m_pSizeData;
 
-		// same with size
-		ActualSize = (int)(Size * FakeToScreenY);
-		Size = ActualSize / FakeToScreenY;
+		// text that doesn't start a line depends on where the line started
+		if(pCursor->m_X != pCursor->m_StartX || Length > MAX_LAYOUT_TEXT_LENGTH)
+		{
+			m_lLayoutGlyphs.set_size(0);
+			LayoutText(pContext, pCursor, CursorX, CursorY, pText, Length, pCursor->m_Flags&TEXTFLAG_RENDER ? &m_lLayoutGlyphs : 0);
+			*ppGlyphs = m_lLayoutGlyphs.base_ptr();
+			return m_lLayoutGlyphs.size();
+		}
 
-		// fetch pFont data
-		if(!pFont)
-			pFont = m_pDefaultFont;
+		unsigned Hash = LayoutHash(pText, Length);
+		CLayout *pLayout = FindLayout(pContext, pCursor, Hash, pText, Length);
+		if(pLayout && pLayout->m_Generation == pSizeData->m_Generation)
+		{
+			m_LayoutHits++;
 
-		if(!pFont)
-			return;
+			// move it to the front
+			if(pLayout->m_pPrev)
+			{
+				pLayout->m_pPrev->m_pNext = pLayout->m_pNext;
+				if(pLayout->m_pNext)
+					pLayout->m_pNext->m_pPrev = pLayout->m_pPrev;
+				else
+					m_pLastLayout = pLayout->m_pPrev;
+				pLayout->m_pPrev = 0;
+				pLayout->m_pNext = m_pFirstLayout;
+				m_pFirstLayout->m_pPrev = pLayout;
+				m_pFirstLayout = pLayout;
+			}
 
-		pSizeData = GetSize(pFont, ActualSize);
-		RenderSetup(pFont, ActualSize);
+			// keep the glyphs from being replaced
+			int64 Now = time_get();
+			for(int i = 0; i < pLayout->m_NumGlyphs; i++)
+				m_aGlyphs[pLayout->Glyphs()[i].m_Glyph].m_TouchTime = Now;
+		}
+		else
+		{
+			m_LayoutMisses++;
+			if(pLayout)
+				RemoveLayout(pLayout);
 
-		float Scale = 1.0f/pSizeData->m_FontSize;
+			CTextCursor Cursor;
+			bool GotNewLine = false;
+			for(int Try = 0; Try < 2; Try++)
+			{
+				// glyphs rendered on the way can move the ones before, lay it out again then
+				int Generation = pSizeData->m_Generation;
+				Cursor = *pCursor;
+				Cursor.m_GlyphCount = 0;
+				Cursor.m_CharCount = 0;
+				m_lLayoutGlyphs.set_size(0);
+				GotNewLine = LayoutText(pContext, &Cursor, CursorX, CursorY, pText, Length, &m_lLayoutGlyphs);
+				if(Generation == pSizeData->m_Generation)
+					break;
+			}
 
-		// set length
-		if(Length < 0)
-			Length = str_length(pText);
+			int NumGlyphs = m_lLayoutGlyphs.size();
+			pLayout = (CLayout *)mem_alloc(sizeof(CLayout) + NumGlyphs*sizeof(CQuadChar) + Length, sizeof(void*));
+			pLayout->m_Hash = Hash;
+			pLayout->m_pSizeData = pSizeData;
+			pLayout->m_ActualSize = pContext->m_ActualSize;
+			pLayout->m_FakeToScreenX = pContext->m_FakeToScreenX;
+			pLayout->m_FakeToScreenY = pContext->m_FakeToScreenY;
+			pLayout->m_LineWidth = pCursor->m_LineWidth;
+			pLayout->m_Flags = pCursor->m_Flags&~TEXTFLAG_RENDER;
+			pLayout->m_MaxLines = pCursor->m_MaxLines;
+			pLayout->m_StartLineCount = pCursor->m_LineCount;
+			pLayout->m_Length = Length;
+			pLayout->m_Generation = pSizeData->m_Generation;
+			pLayout->m_EndX = Cursor.m_X - CursorX;
+			pLayout->m_EndY = Cursor.m_Y - CursorY;
+			pLayout->m_GotNewLine = GotNewLine;
+			pLayout->m_LineCount = Cursor.m_LineCount;
+			pLayout->m_GlyphCount = Cursor.m_GlyphCount;
+			pLayout->m_CharCount = Cursor.m_CharCount;
+			pLayout->m_NumGlyphs = NumGlyphs;
+			mem_copy(pLayout->Glyphs(), m_lLayoutGlyphs.base_ptr(), NumGlyphs*sizeof(CQuadChar));
+			mem_copy(pLayout->Text(), pText, Length);
+			AddLayout(pLayout);
+		}
 
-		// if we don't want to render, we can just skip the first outline pass
-		i = 1;
-		if(pCursor->m_Flags&TEXTFLAG_RENDER)
-			i = 0;
+		pCursor->m_X = CursorX + pLayout->m_EndX;
+		if(pLayout->m_GotNewLine)
+			pCursor->m_Y = CursorY + pLayout->m_EndY;
+		pCursor->m_LineCount = pLayout->m_LineCount;
+		pCursor->m_GlyphCount += pLayout->m_GlyphCount;
+		pCursor->m_CharCount += pLayout->m_CharCount;
+		*ppGlyphs = pLayout->Glyphs();
+		return pLayout->m_NumGlyphs;
+	}
 
-		for(;i < 2; i++)
+public:
+	CTextRender()
+	{
+		m_pGraphics = 0;
+
+		m_TextR = 1.0f;
+		m_TextG = 1.0f;
+		m_TextB = 1.0f;
+		m_TextA = 1.0f;
+		m_TextOutlineR = 0.0f;
+		m_TextOutlineG = 0.0f;
+		m_TextOutlineB = 0.0f;
+		m_TextOutlineA = 0.3f;
+
+		m_pDefaultFont = 0;
+
+		mem_zero(m_apLayoutHash, sizeof(m_apLayoutHash));
+		m_pFirstLayout = 0;
+		m_pLastLayout = 0;
+		m_NumLayouts = 0;
+		m_NumLayoutGlyphs = 0;
+		m_LayoutHits = 0;
+		m_LayoutMisses = 0;
+
+		for(int i = 0; i < MAX_GLYPHS; i++)
 		{
-			const char *pCurrent = (char *)pText;
-			const char *pEnd = pCurrent+Length;
-			DrawX = CursorX;
-			DrawY = CursorY;
-			LineCount = pCursor->m_LineCount;
+			m_aGlyphs[i].m_pFont = 0;
+			m_aGlyphs[i].m_NextHash = i+1 < MAX_GLYPHS ? i+1 : -1;
+		}
+		for(int i = 0; i < GLYPH_HASH_SIZE; i++)
+			m_aGlyphHash[i] = -1;
+		m_FirstFreeGlyph = 0;
+		m_NumAtlasPages = 0;
 
-			if(pCursor->m_Flags&TEXTFLAG_RENDER)
-			{
-				// TODO: Make this better
-				if (i == 0)
-					Graphics()->TextureSet(pSizeData->m_aTextures[1]);
-				else
-					Graphics()->TextureSet(pSizeData->m_aTextures[0]);
+		m_pEngine = 0;
+		m_GlyphLock = lock_create();
+		m_NumQueuedGlyphs = 0;
 
-				Graphics()->QuadsBegin();
-				if (i == 0)
-					Graphics()->SetColor(m_TextOutlineR, m_TextOutlineG, m_TextOutlineB, m_TextOutlineA*m_TextA);
-				else
-					Graphics()->SetColor(m_TextR, m_TextG, m_TextB, m_TextA);
-			}
+		// GL_LUMINANCE can be good for debugging
+		//m_FontTextureFormat = GL_ALPHA;
+	}
 
-			while(pCurrent < pEnd && (pCursor->m_MaxLines < 1 || LineCount <= pCursor->m_MaxLines))
-			{
-				int NewLine = 0;
-				const char *pBatchEnd = pEnd;
-				if(pCursor->m_LineWidth > 0 && !(pCursor->m_Flags&TEXTFLAG_STOP_AT_END))
-				{
-					int Wlen = min(WordLength((char *)pCurrent), (int)(pEnd-pCurrent));
-					CTextCursor Compare = *pCursor;
-					Compare.m_X = DrawX;
-					Compare.m_Y = DrawY;
-					Compare.m_Flags &= ~TEXTFLAG_RENDER;
-					Compare.m_LineWidth = -1;
-					TextEx(&Compare, pCurrent, Wlen);
-
-					if(Compare.m_X-DrawX > pCursor->m_LineWidth)
-					{
-						// word can't be fitted in one line, cut it
-						CTextCursor Cutter = *pCursor;
-						Cutter.m_GlyphCount = 0;
-						Cutter.m_X = DrawX;
-						Cutter.m_Y = DrawY;
-						Cutter.m_Flags &= ~TEXTFLAG_RENDER;
-						Cutter.m_Flags |= TEXTFLAG_STOP_AT_END;
-
-						TextEx(&Cutter, (const char *)pCurrent, Wlen);
-						Wlen = Cutter.m_GlyphCount;
-						NewLine = 1;
-
-						if(Wlen <= 3) // if we can't place 3 chars of the word on this line, take the next
-							Wlen = 0;
-					}
-					else if(Compare.m_X-pCursor->m_StartX > pCursor->m_LineWidth)
-					{
-						NewLine = 1;
-						Wlen = 0;
-					}
+	~CTextRender()
+	{
+		// the job uses this object
+		if(m_pEngine)
+			m_pEngine->WaitJob(&m_GlyphJob);
+		for(int i = 0; i < m_lGlyphResults.size(); i++)
+		{
+			if(m_lGlyphResults[i].m_pData)
+				mem_free(m_lGlyphResults[i].m_pData);
+		}
+		lock_destroy(m_GlyphLock);
 
-					pBatchEnd = pCurrent + Wlen;
-				}
+		while(m_pLastLayout)
+			RemoveLayout(m_pLastLayout);
+	}
 
-				const char *pTmp = pCurrent;
-				int NextCharacter = str_utf8_decode(&pTmp);
-				while(pCurrent < pBatchEnd)
-				{
-					pCursor->m_CharCount += pTmp-pCurrent;
-					int Character = NextCharacter;
-					pCurrent = pTmp;
-					NextCharacter = str_utf8_decode(&pTmp);
+	virtual void Init()
+	{
+		m_pGraphics = Kernel()->RequestInterface<IGraphics>();
+		m_pEngine = Kernel()->RequestInterface<IEngine>();
+		FT_Init_FreeType(&m_FTLibrary);
+		FT_Init_FreeType(&m_WorkerLibrary);
+	}
 
-					if(Character == '\n')
-					{
-						DrawX = pCursor->m_StartX;
-						DrawY += Size;
-						GotNewLine = 1;
-						DrawX = (int)(DrawX * FakeToScreenX) / FakeToScreenX; // realign
-						DrawY = (int)(DrawY * FakeToScreenY) / FakeToScreenY;
-						++LineCount;
-						if(pCursor->m_MaxLines > 0 && LineCount > pCursor->m_MaxLines)
-							break;
-						continue;
-					}
 
-					CFontChar *pChr = GetChar(pFont, pSizeData, Character);
-					if(pChr)
-					{
-						float Advance = pChr->m_AdvanceX + Kerning(pFont, Character, NextCharacter)*Scale;
-						if(pCursor->m_Flags&TEXTFLAG_STOP_AT_END && DrawX+Advance*Size-pCursor->m_StartX > pCursor->m_LineWidth)
-						{
-							// we hit the end of the line, no more to render or count
-							pCurrent = pEnd;
-							break;
-						}
+	virtual int LoadFont(const char *pFilename)
+	{
+		CFont *pFont = (CFont *)mem_alloc(sizeof(CFont), 1);
 
-						if(pCursor->m_Flags&TEXTFLAG_RENDER)
-						{
-							Graphics()->QuadsSetSubset(pChr->m_aUvs[0], pChr->m_aUvs[1], pChr->m_aUvs[2], pChr->m_aUvs[3]);
-							IGraphics::CQuadItem QuadItem(DrawX+pChr->m_OffsetX*Size, DrawY+pChr->m_OffsetY*Size, pChr->m_Width*Size, pChr->m_Height*Size);
-							Graphics()->QuadsDrawTL(&QuadItem, 1);
-						}
+		mem_zero(pFont, sizeof(*pFont));
+		str_copy(pFont->m_aFilename, pFilename, sizeof(pFont->m_aFilename));
 
-						DrawX += Advance*Size;
-						pCursor->m_GlyphCount++;
-					}
-				}
+		if(FT_New_Face(m_FTLibrary, pFont->m_aFilename, 0, &pFont->m_FtFace))
+		{
+			mem_free(pFont);
+			return -1;
+		}
 
-				if(NewLine)
-				{
-					DrawX = pCursor->m_StartX;
-					DrawY += Size;
-					GotNewLine = 1;
-					DrawX = (int)(DrawX * FakeToScreenX) / FakeToScreenX; // realign
-					DrawY = (int)(DrawY * FakeToScreenY) / FakeToScreenY;
-					++LineCount;
-				}
-			}
+		for(unsigned i = 0; i < NUM_FONT_SIZES; i++)
+			pFont->m_aSizes[i].m_FontSize = -1;
+
+		dbg_msg("textrender", "loaded pFont from '%s'", pFilename);
+		m_pDefaultFont = pFont;
+		PrewarmGlyphs(pFont);
+
+		return 0;
+	}
+
+
+	virtual void SetCursor(CTextCursor *pCursor, float x, float y, float FontSize, int Flags)
+	{
+		mem_zero(pCursor, sizeof(*pCursor));
+		pCursor->m_FontSize = FontSize;
+		pCursor->m_StartX = x;
+		pCursor->m_StartY = y;
+		pCursor->m_X = x;
+		pCursor->m_Y = y;
+		pCursor->m_LineCount = 1;
+		pCursor->m_LineWidth = -1.0f;
+		pCursor->m_Flags = Flags;
+		pCursor->m_GlyphCount = 0;
+		pCursor->m_CharCount = 0;
+	}
+
+
+	virtual void Text(void *pFontSetV, float x, float y, float Size, const char *pText, float LineWidth, bool MultiLine)
+	{
+		CTextCursor Cursor;
+		SetCursor(&Cursor, x, y, Size, TEXTFLAG_RENDER);
+		if(!MultiLine)
+			Cursor.m_Flags |= TEXTFLAG_STOP_AT_END;
+		Cursor.m_LineWidth = LineWidth;
+		TextEx(&Cursor, pText, -1);
+	}
+
+	virtual float TextWidth(void *pFontSetV, float Size, const char *pText, int StrLength, float LineWidth)
+	{
+		CTextCursor Cursor;
+		SetCursor(&Cursor, 0, 0, Size, 0);
+		Cursor.m_LineWidth = LineWidth;
+		TextEx(&Cursor, pText, StrLength);
+		return Cursor.m_X;
+	}
+
+	virtual int TextLineCount(void *pFontSetV, float Size, const char *pText, float LineWidth)
+	{
+		CTextCursor Cursor;
+		SetCursor(&Cursor, 0, 0, Size, 0);
+		Cursor.m_LineWidth = LineWidth;
+		TextEx(&Cursor, pText, -1);
+		return Cursor.m_LineCount;
+	}
+
+	virtual void TextColor(float r, float g, float b, float a)
+	{
+		m_TextR = r;
+		m_TextG = g;
+		m_TextB = b;
+		m_TextA = a;
+	}
+
+	virtual void TextOutlineColor(float r, float g, float b, float a)
+	{
+		m_TextOutlineR = r;
+		m_TextOutlineG = g;
+		m_TextOutlineB = b;
+		m_TextOutlineA = a;
+	}
+
+	virtual void TextShadowed(CTextCursor *pCursor, const char *pText, int Length, vec2 ShadowOffset,
+							  vec4 ShadowColor, vec4 TextColor_)
+	{
+		float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
+		float FakeToScreenX, FakeToScreenY;
 
-			if(pCursor->m_Flags&TEXTFLAG_RENDER)
-				Graphics()->QuadsEnd();
+		// to correct coords, convert to screen coords, round, and convert back
+		Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
+
+		FakeToScreenX = (Graphics()->ScreenWidth()/(ScreenX1-ScreenX0));
+		FakeToScreenY = (Graphics()->ScreenHeight()/(ScreenY1-ScreenY0));
+		ShadowOffset.x /= FakeToScreenX;
+		ShadowOffset.y /= FakeToScreenY;
+
+		CQuadChar aTextQuads[1024];
+		int TextQuadCount = 0;
+		IGraphics::CTextureHandle FontTexture;
+
+		TextDeferredRenderEx(pCursor, pText, Length, aTextQuads, sizeof(aTextQuads)/sizeof(aTextQuads[0]),
+				&TextQuadCount, &FontTexture);
+
+		// shadow pass
+		RenderQuads(aTextQuads, TextQuadCount, 0, ShadowColor, ShadowOffset.x, ShadowOffset.y);
+
+		// text pass
+		RenderQuads(aTextQuads, TextQuadCount, 0, TextColor_, 0.0f, 0.0f);
+	}
+
+	virtual void TextDeferredRenderEx(CTextCursor *pCursor, const char *pText, int Length,
+									  CQuadChar* aQuadChar, int QuadCharMaxCount, int* pQuadCharCount,
+									  IGraphics::CTextureHandle* pFontTexture)
+	{
+		CLayoutContext Context;
+		float CursorX, CursorY;
+		if(!PrepareLayout(pCursor, &Context, &CursorX, &CursorY))
+			return;
+
+		if(Length < 0)
+			Length = str_length(pText);
+
+		const CQuadChar *pGlyphs;
+		int NumGlyphs = Layout(&Context, pCursor, CursorX, CursorY, pText, Length, &pGlyphs);
+		if(!(pCursor->m_Flags&TEXTFLAG_RENDER))
+			return;
+
+		// the glyphs can be spread over several pages, this is the first one
+		if(NumGlyphs)
+			*pFontTexture = m_aAtlasPages[pGlyphs[0].m_Page].m_aTextures[0];
+
+		for(int i = 0; i < NumGlyphs; i++)
+		{
+			dbg_assert(*pQuadCharCount < QuadCharMaxCount, "aQuadChar size is too small");
+			CQuadChar *pQuadChar = &aQuadChar[(*pQuadCharCount)++];
+			*pQuadChar = pGlyphs[i];
+			pQuadChar->m_QuadItem.m_X += CursorX;
+			pQuadChar->m_QuadItem.m_Y += CursorY;
 		}
+	}
 
-		pCursor->m_X = DrawX;
-		pCursor->m_LineCount = LineCount;
+	virtual void TextEx(CTextCursor *pCursor, const char *pText, int Length)
+	{
+		//dbg_msg("textrender", "rendering text '%s'", text);
 
-		if(GotNewLine)
-			pCursor->m_Y = DrawY;
+		CLayoutContext Context;
+		float CursorX, CursorY;
+		if(!PrepareLayout(pCursor, &Context, &CursorX, &CursorY))
+			return;
+
+		if(Length < 0)
+			Length = str_length(pText);
+
+		const CQuadChar *pGlyphs;
+		int NumGlyphs = Layout(&Context, pCursor, CursorX, CursorY, pText, Length, &pGlyphs);
+		if(!(pCursor->m_Flags&TEXTFLAG_RENDER))
+			return;
+
+		// outline pass first, then the text
+		RenderQuads(pGlyphs, NumGlyphs, 1, vec4(m_TextOutlineR, m_TextOutlineG, m_TextOutlineB, m_TextOutlineA*m_TextA), CursorX, CursorY);
+		RenderQuads(pGlyphs, NumGlyphs, 0, vec4(m_TextR, m_TextG, m_TextB, m_TextA), CursorX, CursorY);
 	}
 
+	virtual int LayoutCacheHits() const { return m_LayoutHits; }
+	virtual int LayoutCacheMisses() const { return m_LayoutMisses; }
+
 	float TextGetLineBaseY(const CTextCursor *pCursor)
 	{
 		CFont *pFont = pCursor->m_pFont;
@@ -983,7 +1335,7 @@ public:
 
 		pSizeData = GetSize(pFont, ActualSize);
 		RenderSetup(pFont, ActualSize);
-		CFontChar *pChr = GetChar(pFont, pSizeData, ' ');
+		CFontChar *pChr = GetChar(pFont, pSizeData, ' ', true);
 		return CursorY + pChr->m_OffsetY*Size + pChr->m_Height*Size;
 	}
 
@@ -62,6 +62,7 @@ public:
 		TEXLOAD_NOMIPMAPS - Prevents the texture from generating mipmaps
 		TEXLOAD_ARRAY_256 - Texture will be loaded as 3D texture with 16*16 subtiles
 		TEXLOAD_MULTI_DIMENSION - Texture will be loaded as 2D and 3D texture
+		TEXLOAD_ATLAS - Texture may share an atlas page with others, see AtlasBegin
 	*/
 	enum
 	{
@@ -70,6 +71,7 @@ public:
 		TEXLOAD_ARRAY_256 = 4,
 		TEXLOAD_MULTI_DIMENSION = 8,
 		TEXLOAD_LINEARMIPMAPS = 16,
+		TEXLOAD_ATLAS = 32,
 
 		NUMTILES_DIMENSION = 16,			// number of tiles in each dimension within a texture
 	};
@@ -95,6 +97,20 @@ public:
 		void Invalidate() { m_Id = -1; }
 	};
 
+	class CBufferHandle
+	{
+		friend class IGraphics;
+		int m_Id;
+	public:
+		CBufferHandle()
+		: m_Id(-1)
+		{}
+
+		bool IsValid() const { return Id() >= 0; }
+		int Id() const { return m_Id; }
+		void Invalidate() { m_Id = -1; }
+	};
+
 	int ScreenWidth() const { return m_ScreenWidth; }
 	int ScreenHeight() const { return m_ScreenHeight; }
 	float ScreenAspect() const { return (float)ScreenWidth()/(float)ScreenHeight(); }
@@ -119,15 +135,36 @@ public:
 	virtual void WrapMode(int WrapU, int WrapV) = 0;
 	virtual int MemoryUsage() const = 0;
 
+	// work queued for the backend in the last complete frame
+	struct CFrameStats
+	{
+		int m_DrawCalls;
+		int m_MergedDrawCalls; // draws appended to the previous draw call
+		int m_Vertices;
+		int m_TextureSwitches;
+		int m_Commands;
+		int m_CommandBuffers;
+	};
+	virtual const CFrameStats &FrameStats() const = 0;
+
 	virtual int LoadPNG(CImageInfo *pImg, const char *pFilename, int StorageType) = 0;
 
 	virtual int UnloadTexture(CTextureHandle *Index) = 0;
 	virtual CTextureHandle LoadTextureRaw(int Width, int Height, int Format, const void *pData, int StoreFormat, int Flags) = 0;
 	virtual int LoadTextureRawSub(CTextureHandle TextureID, int x, int y, int Width, int Height, int Format, const void *pData) = 0;
 	virtual CTextureHandle LoadTexture(const char *pFilename, int StorageType, int StoreFormat, int Flags) = 0;
+	// the placeholder that is drawn for images that failed to load
+	virtual CTextureHandle InvalidTexture() const = 0;
 	virtual void TextureSet(CTextureHandle Texture) = 0;
 	void TextureClear() { TextureSet(CTextureHandle()); }
 
+	// RGBA textures loaded with TEXLOAD_ATLAS between AtlasBegin and AtlasEnd
+	// are packed into shared pages, so draws with them can be merged. they
+	// can't be used with texture coordinates outside of 0..1 and the handles
+	// can only be drawn with after AtlasEnd.
+	virtual void AtlasBegin() = 0;
+	virtual void AtlasEnd() = 0;
+
 	struct CLineItem
 	{
 		float m_X0, m_Y0, m_X1, m_Y1;
@@ -161,6 +198,17 @@ public:
 			: m_X0(x0), m_Y0(y0), m_X1(x1), m_Y1(y1), m_X2(x2), m_Y2(y2), m_X3(x3), m_Y3(y3) {}
 	};
 	virtual void QuadsDrawFreeform(const CFreeformItem *pArray, int Num) = 0;
+
+	// centered and rotated quads with their own texture coordinates and
+	// color, so many different sprites can be drawn without state changes
+	struct CSpriteItem
+	{
+		float m_X, m_Y, m_Width, m_Height;
+		float m_Rotation;
+		float m_U0, m_V0, m_U1, m_V1;
+		vec4 m_Color;
+	};
+	virtual void QuadsDrawSprites(const CSpriteItem *pArray, int Num) = 0;
 	virtual void QuadsText(float x, float y, float Size, const char *pText) = 0;
 
 	struct CColorVertex
@@ -174,6 +222,16 @@ public:
 	virtual void SetColor(float r, float g, float b, float a) = 0;
 	virtual void SetColor4(vec4 TopLeft, vec4 TopRight, vec4 BottomLeft, vec4 BottomRight) = 0;
 
+	// static quads that are kept on the gpu. quads drawn between BufferBegin
+	// and BufferEnd are recorded into the buffer instead of being rendered,
+	// the buffer is then drawn in ranges of quads. pColor replaces the
+	// recorded vertex colors.
+	virtual bool BuffersSupported() = 0;
+	virtual void BufferBegin() = 0;
+	virtual CBufferHandle BufferEnd() = 0;
+	virtual void UnloadBuffer(CBufferHandle *pBuffer) = 0;
+	virtual void RenderBuffer(CBufferHandle Buffer, const int *pOffsets, const int *pCounts, int NumRanges, const vec4 *pColor) = 0;
+
 	virtual void ReadBackbuffer(unsigned char **ppPixels, int x, int y, int w, int h) = 0;
 	virtual void TakeScreenshot(const char *pFilename) = 0;
 	virtual int GetVideoModes(CVideoMode *pModes, int MaxModes, int Screen) = 0;
@@ -186,6 +244,8 @@ public:
 	virtual void InsertSignal(class semaphore *pSemaphore) = 0;
 	virtual bool IsIdle() const = 0;
 	virtual void WaitForIdle() = 0;
+	// true while the next swap would have to wait for the backend
+	virtual bool FrameQueueFull() const = 0;
 
 protected:
 	inline CTextureHandle CreateTextureHandle(int Index)
@@ -194,6 +254,13 @@ protected:
 		Tex.m_Id = Index;
 		return Tex;
 	}
+
+	inline CBufferHandle CreateBufferHandle(int Index)
+	{
+		CBufferHandle Buffer;
+		Buffer.m_Id = Index;
+		return Buffer;
+	}
 };
 
 class IEngineGraphics : public IGraphics
@@ -68,6 +68,7 @@ public:
 
 	virtual void DemoRecorder_HandleAutoStart() = 0;
 	virtual bool DemoRecorder_IsRecording() = 0;
+	virtual void DemoRecorder_SaveReplay(const char *pName) = 0;
 };
 
 class IGameServer : public IInterface
@@ -4,6 +4,7 @@
 #include <base/math.h>
 #include <base/system.h>
 
+#include <engine/asyncio.h>
 #include <engine/config.h>
 #include <engine/console.h>
 #include <engine/engine.h>
@@ -268,7 +269,7 @@ void CServer::CClient::Reset()
 	m_MapChunk = 0;
 }
 
-CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
+CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta), m_ReplayRecorder(&m_SnapshotDelta)
 {
 	m_TickSpeed = SERVER_TICK_SPEED;
 
@@ -279,6 +280,7 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 
 	m_pCurrentMapData = 0;
 	m_CurrentMapSize = 0;
+	m_LastReplaySave = 0;
 
 	m_NumMapEntries = 0;
 	m_pFirstMapEntry = 0;
@@ -512,7 +514,10 @@ int CServer::SendMsg(CMsgPacker *pMsg, int Flags, int ClientID)
 
 	// write message to demo recorder
 	if(!(Flags&MSGFLAG_NORECORD))
+	{
 		m_DemoRecorder.RecordMessage(pMsg->Data(), pMsg->Size());
+		m_ReplayRecorder.RecordMessage(pMsg->Data(), pMsg->Size());
+	}
 
 	if(!(Flags&MSGFLAG_NOSEND))
 	{
@@ -538,7 +543,7 @@ void CServer::DoSnapshot()
 	GameServer()->OnPreSnap();
 
 	// create snapshot for demo recording
-	if(m_DemoRecorder.IsRecording())
+	if(m_DemoRecorder.IsRecording() || m_ReplayRecorder.IsRecording())
 	{
 		char aData[CSnapshot::MAX_SIZE];
 		int SnapshotSize;
@@ -550,6 +555,7 @@ void CServer::DoSnapshot()
 
 		// write snapshot
 		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
+		m_ReplayRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
 	}
 
 	// create snapshots for all clients
@@ -1267,6 +1273,7 @@ int CServer::LoadMap(const char *pMapName)
 
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
+	m_ReplayRecorder.Stop();
 
 	// reinit snapshot ids
 	m_IDPool.TimeoutIDs();
@@ -1294,6 +1301,8 @@ int CServer::LoadMap(const char *pMapName)
 		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
 		io_close(File);
 	}
+
+	ReplayRecorder_Start();
 	return 1;
 }
 
@@ -1309,6 +1318,7 @@ void CServer::InitInterfaces(CConfig *pConfig, IConsole *pConsole, IGameServer *
 	m_pGameServer = pGameServer;
 	m_pMap = pMap;
 	m_pStorage = pStorage;
+	m_pAsyncIO = Kernel()->RequestInterface<IEngineAsyncIO>();
 }
 
 int CServer::Run()
@@ -1467,6 +1477,9 @@ int CServer::Run()
 
 			PumpNetwork();
 
+			// dispatch finished file requests
+			AsyncIO()->Update();
+
 			// wait for incoming data
 			m_NetServer.Wait(clamp(int((TickStartTime(m_CurrentGameTick+1)-time_get())*1000/time_freq()), 1, 1000/SERVER_TICK_SPEED/2));
 		}
@@ -1476,6 +1489,8 @@ int CServer::Run()
 	m_Econ.Shutdown();
 
 	GameServer()->OnShutdown();
+	m_DemoRecorder.Stop();
+	m_ReplayRecorder.Stop();
 	m_pMap->Unload();
 
 	if(m_pCurrentMapData)
@@ -1588,6 +1603,7 @@ void CServer::DemoRecorder_HandleAutoStart()
 		char aDate[20];
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", "auto/autorecord", aDate);
+		m_DemoRecorder.SetKeyFrameMode(Config()->m_DemoKeyframeInterval, Config()->m_DemoKeyframeDeltas);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "server");
 		if(Config()->m_SvAutoDemoMax)
 		{
@@ -1600,7 +1616,55 @@ void CServer::DemoRecorder_HandleAutoStart()
 
 bool CServer::DemoRecorder_IsRecording()
 {
-	return m_DemoRecorder.IsRecording();
+	return m_DemoRecorder.IsRecording() || m_ReplayRecorder.IsRecording();
+}
+
+void CServer::DemoRecorder_SaveReplay(const char *pName)
+{
+	if(!m_ReplayRecorder.IsRecording())
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "the replay buffer is disabled, set sv_replay_buffer to enable it");
+		return;
+	}
+
+	// every replay holds up to the whole buffer, so don't let frequent triggers like kick votes flood the disk
+	int64 Now = time_get();
+	if(m_LastReplaySave && Now < m_LastReplaySave+time_freq()*Config()->m_SvReplayInterval)
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "not saving the replay, the last one was saved less than sv_replay_interval seconds ago");
+		return;
+	}
+
+	// the player infos and the game info are part of the keyframe snapshot every replay starts with
+	char aFileDesc[64];
+	char aFilename[128];
+	char aDate[20];
+	str_timestamp(aDate, sizeof(aDate));
+	if(pName[0])
+		str_format(aFileDesc, sizeof(aFileDesc), "replay_%s", pName);
+	else
+		str_copy(aFileDesc, "replay", sizeof(aFileDesc));
+	str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", aFileDesc, aDate);
+	if(m_ReplayRecorder.SaveReplay(Storage(), aFilename) != 0)
+		return;
+	m_LastReplaySave = Now;
+
+	if(Config()->m_SvReplayMax)
+	{
+		// clean up saved replays
+		CFileCollection Replays;
+		Replays.Init(Storage(), "demos", aFileDesc, ".demo", Config()->m_SvReplayMax);
+	}
+}
+
+void CServer::ReplayRecorder_Start()
+{
+	m_ReplayRecorder.Stop();
+	if(Config()->m_SvReplayBuffer)
+	{
+		m_ReplayRecorder.SetKeyFrameMode(Config()->m_DemoKeyframeInterval, Config()->m_DemoKeyframeDeltas);
+		m_ReplayRecorder.StartReplay(Storage(), m_pConsole, GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapSha256, m_CurrentMapCrc, "server", Config()->m_SvReplayBuffer*1024*1024);
+	}
 }
 
 void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
@@ -1615,6 +1679,7 @@ void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/demo_%s.demo", aDate);
 	}
+	pServer->m_DemoRecorder.SetKeyFrameMode(pServer->Config()->m_DemoKeyframeInterval, pServer->Config()->m_DemoKeyframeDeltas);
 	pServer->m_DemoRecorder.Start(pServer->Storage(), pServer->Console(), aFilename, pServer->GameServer()->NetVersion(), pServer->m_aCurrentMap, pServer->m_CurrentMapSha256, pServer->m_CurrentMapCrc, "server");
 }
 
@@ -1623,6 +1688,11 @@ void CServer::ConStopRecord(IConsole::IResult *pResult, void *pUser)
 	((CServer *)pUser)->m_DemoRecorder.Stop();
 }
 
+void CServer::ConSaveReplay(IConsole::IResult *pResult, void *pUser)
+{
+	((CServer *)pUser)->DemoRecorder_SaveReplay(pResult->NumArguments() ? pResult->GetString(0) : "");
+}
+
 void CServer::ConMapReload(IConsole::IResult *pResult, void *pUser)
 {
 	((CServer *)pUser)->m_MapReload = true;
@@ -1729,6 +1799,15 @@ void CServer::ConchainConsoleOutputLevelUpdate(IConsole::IResult *pResult, void
 	}
 }
 
+void CServer::ConchainReplayBufferUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	CServer *pSelf = (CServer *)pUserData;
+	int OldSize = pSelf->Config()->m_SvReplayBuffer;
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments() && pSelf->Config()->m_SvReplayBuffer != OldSize && pSelf->m_pCurrentMapData)
+		pSelf->ReplayRecorder_Start();
+}
+
 void CServer::ConchainRconPasswordSet(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -1758,6 +1837,7 @@ void CServer::RegisterCommands()
 
 	Console()->Register("record", "?s[file]", CFGFLAG_SERVER|CFGFLAG_STORE, ConRecord, this, "Record to a file");
 	Console()->Register("stoprecord", "", CFGFLAG_SERVER, ConStopRecord, this, "Stop recording");
+	Console()->Register("save_replay", "?s[name]", CFGFLAG_SERVER, ConSaveReplay, this, "Save the replay buffer to a demo");
 
 	Console()->Register("reload", "", CFGFLAG_SERVER, ConMapReload, this, "Reload the map");
 
@@ -1772,6 +1852,7 @@ void CServer::RegisterCommands()
 	Console()->Chain("console_output_level", ConchainConsoleOutputLevelUpdate, this);
 	Console()->Chain("sv_rcon_password", ConchainRconPasswordSet, this);
 	Console()->Chain("sv_map", ConchainMapUpdate, this);
+	Console()->Chain("sv_replay_buffer", ConchainReplayBufferUpdate, this);
 
 	// register console commands in sub parts
 	m_ServerBan.InitServerBan(Console(), Storage(), this);
@@ -1838,13 +1919,14 @@ int main(int argc, const char **argv) // ignore_convention
 
 	// create the components
 	int FlagMask = CFGFLAG_SERVER|CFGFLAG_ECON;
-	IEngine *pEngine = CreateEngine("Teeworlds_Server");
+	IEngine *pEngine = CreateEngine("Teeworlds_Server", 1);
 	IEngineMap *pEngineMap = CreateEngineMap();
 	IGameServer *pGameServer = CreateGameServer();
 	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER|CFGFLAG_ECON);
 	IEngineMasterServer *pEngineMasterServer = CreateEngineMasterServer();
 	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_SERVER, argc, argv); // ignore_convention
 	IConfigManager *pConfigManager = CreateConfigManager();
+	IEngineAsyncIO *pEngineAsyncIO = CreateEngineAsyncIO();
 
 	pServer->InitRegister(&pServer->m_NetServer, pEngineMasterServer, pConfigManager->Values(), pConsole);
 
@@ -1861,12 +1943,15 @@ int main(int argc, const char **argv) // ignore_convention
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(pConfigManager);
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IEngineMasterServer*>(pEngineMasterServer)); // register as both
 		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IMasterServer*>(pEngineMasterServer));
+		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IEngineAsyncIO*>(pEngineAsyncIO)); // register as both
+		RegisterFail = RegisterFail || !pKernel->RegisterInterface(static_cast<IAsyncIO*>(pEngineAsyncIO));
 
 		if(RegisterFail)
 			return -1;
 	}
 
 	pEngine->Init();
+	pEngineAsyncIO->Init();
 	pConfigManager->Init(FlagMask);
 	pConsole->Init();
 	pEngineMasterServer->Init();
@@ -1905,6 +1990,7 @@ int main(int argc, const char **argv) // ignore_convention
 	delete pGameServer;
 	delete pConsole;
 	delete pEngineMasterServer;
+	delete pEngineAsyncIO;
 	delete pStorage;
 	delete pConfigManager;
 
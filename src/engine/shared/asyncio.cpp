@@ -0,0 +1,635 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <engine/asyncio.h>
+#include <engine/storage.h>
+
+class CAsyncIO : public IEngineAsyncIO
+{
+	enum
+	{
+		NUM_THREADS=2,
+		READER_BLOCK_SIZE=64*1024,
+
+		REQUEST_READ=0,
+		REQUEST_WRITE,
+		REQUEST_BLOCK,
+
+		STATE_IDLE=0,
+		STATE_QUEUED,
+		STATE_RUNNING,
+		STATE_DONE,
+	};
+
+	struct CRequest
+	{
+		int m_ID;
+		int m_Type;
+		int m_Priority;
+		int m_State;
+		bool m_Canceled;
+
+		char m_aFilename[IO_MAX_PATH_LENGTH];
+		int m_StorageType;
+		void *m_pData;
+		unsigned m_DataSize;
+		int m_Result;
+
+		FCompletionCallback m_pfnCallback;
+		void *m_pUser;
+
+		// block reads issued by a file reader
+		IOHANDLE m_File;
+		long m_Offset;
+		semaphore *m_pDone;
+		bool m_Waiting;
+
+		CRequest *m_pNext;
+	};
+
+	class CFileReader : public IAsyncFileReader
+	{
+	public:
+		struct CBlock
+		{
+			CRequest m_Request;
+			unsigned char m_aData[READER_BLOCK_SIZE];
+		};
+
+		CAsyncIO *m_pAsyncIO;
+		IOHANDLE m_File;
+		int m_Priority;
+		long m_Pos;
+		long m_Length;
+
+		// the front block holds the data at the current position, the back block is the read-ahead
+		CBlock m_aBlocks[2];
+		int m_Front;
+
+		// signalled when a block the reader waits for is finished by a worker
+		semaphore m_BlockDone;
+
+		CFileReader(CAsyncIO *pAsyncIO, IOHANDLE File, int Priority);
+
+		bool FetchBlock();
+
+		unsigned Read(void *pBuffer, unsigned Size);
+		unsigned Skip(long Size);
+		int Seek(long Offset, int Origin);
+		long Tell() { return m_Pos; }
+		long Length() { return m_Length; }
+	};
+
+	IStorage *m_pStorage;
+
+	int m_NumThreads;
+	void *m_apThreads[NUM_THREADS];
+	volatile bool m_Shutdown;
+
+	// signalled once per queued request and once per thread on shutdown
+	semaphore m_Queued;
+
+	LOCK m_Lock;
+	CRequest *m_apFirstQueued[NUM_PRIORITIES];
+	CRequest *m_apLastQueued[NUM_PRIORITIES];
+	CRequest *m_apRunning[NUM_THREADS];
+	CRequest *m_pFirstDone;
+	CRequest *m_pLastDone;
+	int m_NumPending;
+	int m_NextID;
+
+	struct CThreadData
+	{
+		CAsyncIO *m_pAsyncIO;
+		int m_Index;
+	};
+	CThreadData m_aThreadData[NUM_THREADS];
+
+	static void WorkerThread(void *pUser);
+	static void Process(CRequest *pRequest, IStorage *pStorage);
+
+	// requires the lock to be held, starts the workers with the first request
+	void StartThreads();
+	void Enqueue(CRequest *pRequest);
+	bool Unqueue(CRequest *pRequest);
+
+	// makes sure no worker touches the block anymore, reading it on this thread if it is still queued
+	void WaitBlock(CRequest *pRequest);
+
+	CRequest *NewRequest(int Type, const char *pFilename, int StorageType, int Priority, FCompletionCallback pfnCallback, void *pUser);
+	void FreeRequest(CRequest *pRequest);
+
+public:
+	CAsyncIO();
+	~CAsyncIO();
+
+	void Init();
+	void Shutdown();
+
+	int ReadFile(const char *pFilename, int StorageType, int Priority, FCompletionCallback pfnCallback, void *pUser);
+	int WriteFile(const char *pFilename, int StorageType, const void *pData, unsigned DataSize, int Priority, FCompletionCallback pfnCallback, void *pUser);
+	bool Cancel(int RequestID);
+	int NumPending();
+	void Update();
+
+	IAsyncFileReader *OpenReader(IOHANDLE File, int Priority);
+	void CloseReader(IAsyncFileReader *pReader);
+};
+
+CAsyncIO::CAsyncIO()
+{
+	m_pStorage = 0;
+	m_NumThreads = 0;
+	m_Shutdown = false;
+	m_Lock = lock_create();
+	for(int i = 0; i < NUM_PRIORITIES; i++)
+	{
+		m_apFirstQueued[i] = 0;
+		m_apLastQueued[i] = 0;
+	}
+	for(int i = 0; i < NUM_THREADS; i++)
+		m_apRunning[i] = 0;
+	m_pFirstDone = 0;
+	m_pLastDone = 0;
+	m_NumPending = 0;
+	m_NextID = 0;
+}
+
+CAsyncIO::~CAsyncIO()
+{
+	Shutdown();
+	lock_destroy(m_Lock);
+}
+
+void CAsyncIO::Init()
+{
+	m_pStorage = Kernel()->RequestInterface<IStorage>();
+	m_Shutdown = false;
+}
+
+void CAsyncIO::StartThreads()
+{
+	m_NumThreads = NUM_THREADS;
+	for(int i = 0; i < m_NumThreads; i++)
+	{
+		m_aThreadData[i].m_pAsyncIO = this;
+		m_aThreadData[i].m_Index = i;
+		m_apThreads[i] = thread_init(WorkerThread, &m_aThreadData[i]);
+	}
+}
+
+void CAsyncIO::Shutdown()
+{
+	lock_wait(m_Lock);
+	m_Shutdown = true;
+	int NumThreads = m_NumThreads;
+	m_NumThreads = 0;
+	lock_unlock(m_Lock);
+
+	for(int i = 0; i < NumThreads; i++)
+		m_Queued.signal();
+	for(int i = 0; i < NumThreads; i++)
+	{
+		thread_wait(m_apThreads[i]);
+		thread_destroy(m_apThreads[i]);
+	}
+
+	// drop everything that did not finish, readers own their block requests
+	lock_wait(m_Lock);
+	for(int i = 0; i < NUM_PRIORITIES; i++)
+	{
+		CRequest *pRequest = m_apFirstQueued[i];
+		while(pRequest)
+		{
+			CRequest *pNext = pRequest->m_pNext;
+			if(pRequest->m_Type == REQUEST_BLOCK)
+				pRequest->m_State = STATE_IDLE;
+			else
+				FreeRequest(pRequest);
+			pRequest = pNext;
+		}
+		m_apFirstQueued[i] = 0;
+		m_apLastQueued[i] = 0;
+	}
+	while(m_pFirstDone)
+	{
+		CRequest *pNext = m_pFirstDone->m_pNext;
+		FreeRequest(m_pFirstDone);
+		m_pFirstDone = pNext;
+	}
+	m_pLastDone = 0;
+	m_NumPending = 0;
+	lock_unlock(m_Lock);
+}
+
+void CAsyncIO::WorkerThread(void *pUser)
+{
+	CThreadData *pData = (CThreadData *)pUser;
+	CAsyncIO *pSelf = pData->m_pAsyncIO;
+
+	while(1)
+	{
+		pSelf->m_Queued.wait();
+		if(pSelf->m_Shutdown)
+			break;
+
+		CRequest *pRequest = 0;
+
+		// fetch the request with the highest priority
+		lock_wait(pSelf->m_Lock);
+		for(int p = NUM_PRIORITIES-1; p >= 0 && !pRequest; p--)
+		{
+			if(pSelf->m_apFirstQueued[p])
+			{
+				pRequest = pSelf->m_apFirstQueued[p];
+				pSelf->m_apFirstQueued[p] = pRequest->m_pNext;
+				if(!pSelf->m_apFirstQueued[p])
+					pSelf->m_apLastQueued[p] = 0;
+				pRequest->m_pNext = 0;
+				pRequest->m_State = STATE_RUNNING;
+				pSelf->m_apRunning[pData->m_Index] = pRequest;
+			}
+		}
+		lock_unlock(pSelf->m_Lock);
+
+		// the request was canceled or taken over by a reader
+		if(!pRequest)
+			continue;
+
+		Process(pRequest, pSelf->m_pStorage);
+
+		lock_wait(pSelf->m_Lock);
+		pSelf->m_apRunning[pData->m_Index] = 0;
+		pRequest->m_State = STATE_DONE;
+		if(pRequest->m_Type != REQUEST_BLOCK)
+		{
+			// hand it over to the main thread
+			if(pSelf->m_pLastDone)
+				pSelf->m_pLastDone->m_pNext = pRequest;
+			else
+				pSelf->m_pFirstDone = pRequest;
+			pSelf->m_pLastDone = pRequest;
+		}
+		else if(pRequest->m_Waiting)
+		{
+			pRequest->m_Waiting = false;
+			pRequest->m_pDone->signal();
+		}
+		lock_unlock(pSelf->m_Lock);
+	}
+}
+
+void CAsyncIO::Process(CRequest *pRequest, IStorage *pStorage)
+{
+	if(pRequest->m_Type == REQUEST_READ)
+	{
+		IOHANDLE File = pStorage->OpenFile(pRequest->m_aFilename, IOFLAG_READ, pRequest->m_StorageType);
+		if(File)
+		{
+			io_read_all(File, &pRequest->m_pData, &pRequest->m_DataSize);
+			io_close(File);
+			pRequest->m_Result = pRequest->m_pData ? 0 : -1;
+		}
+		else
+			pRequest->m_Result = -1;
+	}
+	else if(pRequest->m_Type == REQUEST_WRITE)
+	{
+		IOHANDLE File = pStorage->OpenFile(pRequest->m_aFilename, IOFLAG_WRITE, pRequest->m_StorageType);
+		if(File)
+		{
+			pRequest->m_Result = io_write(File, pRequest->m_pData, pRequest->m_DataSize) == pRequest->m_DataSize ? 0 : -1;
+			io_close(File);
+		}
+		else
+			pRequest->m_Result = -1;
+
+		// the callback only gets the result for writes
+		mem_free(pRequest->m_pData);
+		pRequest->m_pData = 0;
+	}
+	else if(pRequest->m_Type == REQUEST_BLOCK)
+	{
+		pRequest->m_DataSize = 0;
+		if(io_seek(pRequest->m_File, pRequest->m_Offset, IOSEEK_START) == 0)
+			pRequest->m_DataSize = io_read(pRequest->m_File, pRequest->m_pData, READER_BLOCK_SIZE);
+		pRequest->m_Result = 0;
+	}
+}
+
+void CAsyncIO::Enqueue(CRequest *pRequest)
+{
+	int Priority = pRequest->m_Priority;
+	pRequest->m_pNext = 0;
+	pRequest->m_State = STATE_QUEUED;
+	if(m_apLastQueued[Priority])
+		m_apLastQueued[Priority]->m_pNext = pRequest;
+	else
+		m_apFirstQueued[Priority] = pRequest;
+	m_apLastQueued[Priority] = pRequest;
+
+	if(m_Shutdown)
+		return;
+	if(!m_NumThreads)
+		StartThreads();
+	m_Queued.signal();
+}
+
+bool CAsyncIO::Unqueue(CRequest *pRequest)
+{
+	int Priority = pRequest->m_Priority;
+	CRequest *pPrev = 0;
+	for(CRequest *pCur = m_apFirstQueued[Priority]; pCur; pPrev = pCur, pCur = pCur->m_pNext)
+	{
+		if(pCur != pRequest)
+			continue;
+
+		if(pPrev)
+			pPrev->m_pNext = pCur->m_pNext;
+		else
+			m_apFirstQueued[Priority] = pCur->m_pNext;
+		if(m_apLastQueued[Priority] == pCur)
+			m_apLastQueued[Priority] = pPrev;
+		pCur->m_pNext = 0;
+		return true;
+	}
+	return false;
+}
+
+void CAsyncIO::WaitBlock(CRequest *pRequest)
+{
+	lock_wait(m_Lock);
+	if(pRequest->m_State == STATE_QUEUED)
+	{
+		// not picked up yet, do it ourselves instead of waiting for a worker
+		Unqueue(pRequest);
+		pRequest->m_State = STATE_RUNNING;
+		lock_unlock(m_Lock);
+		Process(pRequest, m_pStorage);
+		pRequest->m_State = STATE_DONE;
+		return;
+	}
+
+	if(pRequest->m_State == STATE_RUNNING)
+	{
+		pRequest->m_Waiting = true;
+		lock_unlock(m_Lock);
+		pRequest->m_pDone->wait();
+
+		// the worker signals under the lock, let it finish before the reader can go away
+		lock_wait(m_Lock);
+	}
+	lock_unlock(m_Lock);
+}
+
+CAsyncIO::CRequest *CAsyncIO::NewRequest(int Type, const char *pFilename, int StorageType, int Priority, FCompletionCallback pfnCallback, void *pUser)
+{
+	CRequest *pRequest = new CRequest;
+	mem_zero(pRequest, sizeof(CRequest));
+	pRequest->m_Type = Type;
+	pRequest->m_Priority = clamp(Priority, (int)PRIORITY_LOW, (int)PRIORITY_HIGH);
+	if(pFilename)
+		str_copy(pRequest->m_aFilename, pFilename, sizeof(pRequest->m_aFilename));
+	pRequest->m_StorageType = StorageType;
+	pRequest->m_pfnCallback = pfnCallback;
+	pRequest->m_pUser = pUser;
+	pRequest->m_Result = -1;
+	return pRequest;
+}
+
+void CAsyncIO::FreeRequest(CRequest *pRequest)
+{
+	mem_free(pRequest->m_pData);
+	delete pRequest;
+}
+
+int CAsyncIO::ReadFile(const char *pFilename, int StorageType, int Priority, FCompletionCallback pfnCallback, void *pUser)
+{
+	CRequest *pRequest = NewRequest(REQUEST_READ, pFilename, StorageType, Priority, pfnCallback, pUser);
+
+	lock_wait(m_Lock);
+	pRequest->m_ID = m_NextID;
+	m_NextID = (m_NextID+1)&0x7fffffff;
+	Enqueue(pRequest);
+	m_NumPending++;
+	lock_unlock(m_Lock);
+	return pRequest->m_ID;
+}
+
+int CAsyncIO::WriteFile(const char *pFilename, int StorageType, const void *pData, unsigned DataSize, int Priority, FCompletionCallback pfnCallback, void *pUser)
+{
+	CRequest *pRequest = NewRequest(REQUEST_WRITE, pFilename, StorageType, Priority, pfnCallback, pUser);
+	pRequest->m_pData = mem_alloc(max(DataSize, 1u), 1);
+	mem_copy(pRequest->m_pData, pData, DataSize);
+	pRequest->m_DataSize = DataSize;
+
+	lock_wait(m_Lock);
+	pRequest->m_ID = m_NextID;
+	m_NextID = (m_NextID+1)&0x7fffffff;
+	Enqueue(pRequest);
+	m_NumPending++;
+	lock_unlock(m_Lock);
+	return pRequest->m_ID;
+}
+
+bool CAsyncIO::Cancel(int RequestID)
+{
+	bool Found = false;
+	lock_wait(m_Lock);
+
+	// still queued: drop it right away
+	for(int p = 0; p < NUM_PRIORITIES && !Found; p++)
+	{
+		for(CRequest *pRequest = m_apFirstQueued[p]; pRequest; pRequest = pRequest->m_pNext)
+		{
+			if(pRequest->m_Type != REQUEST_BLOCK && pRequest->m_ID == RequestID)
+			{
+				Unqueue(pRequest);
+				FreeRequest(pRequest);
+				m_NumPending--;
+				Found = true;
+				break;
+			}
+		}
+	}
+
+	// running or finished: suppress the callback
+	for(int i = 0; i < NUM_THREADS && !Found; i++)
+	{
+		if(m_apRunning[i] && m_apRunning[i]->m_Type != REQUEST_BLOCK && m_apRunning[i]->m_ID == RequestID)
+		{
+			m_apRunning[i]->m_Canceled = true;
+			Found = true;
+		}
+	}
+	for(CRequest *pRequest = m_pFirstDone; pRequest && !Found; pRequest = pRequest->m_pNext)
+	{
+		if(pRequest->m_ID == RequestID)
+		{
+			pRequest->m_Canceled = true;
+			Found = true;
+		}
+	}
+
+	lock_unlock(m_Lock);
+	return Found;
+}
+
+int CAsyncIO::NumPending()
+{
+	lock_wait(m_Lock);
+	int NumPending = m_NumPending;
+	lock_unlock(m_Lock);
+	return NumPending;
+}
+
+void CAsyncIO::Update()
+{
+	lock_wait(m_Lock);
+	CRequest *pRequest = m_pFirstDone;
+	m_pFirstDone = 0;
+	m_pLastDone = 0;
+	lock_unlock(m_Lock);
+
+	while(pRequest)
+	{
+		CRequest *pNext = pRequest->m_pNext;
+
+		// read the flag under the lock, a cancel could have come in since we took the list
+		lock_wait(m_Lock);
+		bool Canceled = pRequest->m_Canceled;
+		m_NumPending--;
+		lock_unlock(m_Lock);
+
+		if(!Canceled && pRequest->m_pfnCallback)
+			pRequest->m_pfnCallback(pRequest->m_ID, pRequest->m_Result, pRequest->m_pData, pRequest->m_DataSize, pRequest->m_pUser);
+		FreeRequest(pRequest);
+		pRequest = pNext;
+	}
+}
+
+IAsyncFileReader *CAsyncIO::OpenReader(IOHANDLE File, int Priority)
+{
+	if(!File)
+		return 0;
+	return new CFileReader(this, File, clamp(Priority, (int)PRIORITY_LOW, (int)PRIORITY_HIGH));
+}
+
+void CAsyncIO::CloseReader(IAsyncFileReader *pReader)
+{
+	if(!pReader)
+		return;
+
+	CFileReader *pFileReader = static_cast<CFileReader *>(pReader);
+	for(int i = 0; i < 2; i++)
+		WaitBlock(&pFileReader->m_aBlocks[i].m_Request);
+	io_close(pFileReader->m_File);
+	delete pFileReader;
+}
+
+CAsyncIO::CFileReader::CFileReader(CAsyncIO *pAsyncIO, IOHANDLE File, int Priority)
+{
+	m_pAsyncIO = pAsyncIO;
+	m_File = File;
+	m_Priority = Priority;
+	m_Pos = io_tell(File);
+	m_Length = io_length(File);
+	m_Front = 0;
+
+	for(int i = 0; i < 2; i++)
+	{
+		CRequest *pRequest = &m_aBlocks[i].m_Request;
+		mem_zero(pRequest, sizeof(CRequest));
+		pRequest->m_Type = REQUEST_BLOCK;
+		pRequest->m_Priority = Priority;
+		pRequest->m_State = STATE_IDLE;
+		pRequest->m_File = File;
+		pRequest->m_Offset = -1;
+		pRequest->m_pData = m_aBlocks[i].m_aData;
+		pRequest->m_pDone = &m_BlockDone;
+	}
+}
+
+bool CAsyncIO::CFileReader::FetchBlock()
+{
+	long Offset = m_Pos - m_Pos%READER_BLOCK_SIZE;
+	CRequest *pFront = &m_aBlocks[m_Front].m_Request;
+	CRequest *pBack = &m_aBlocks[m_Front^1].m_Request;
+
+	if(pFront->m_State != STATE_DONE || pFront->m_Offset != Offset)
+	{
+		// the read-ahead shares the file handle, it has to be out of the way before we touch it
+		m_pAsyncIO->WaitBlock(pBack);
+		if(pBack->m_State == STATE_DONE && pBack->m_Offset == Offset)
+		{
+			m_Front ^= 1;
+			pFront = &m_aBlocks[m_Front].m_Request;
+			pBack = &m_aBlocks[m_Front^1].m_Request;
+		}
+		else
+		{
+			// random access, load it directly
+			pFront->m_Offset = Offset;
+			Process(pFront, m_pAsyncIO->m_pStorage);
+			pFront->m_State = STATE_DONE;
+		}
+
+		// queue the next block
+		if(pFront->m_DataSize == READER_BLOCK_SIZE && !m_pAsyncIO->m_Shutdown)
+		{
+			pBack->m_Offset = Offset+READER_BLOCK_SIZE;
+			lock_wait(m_pAsyncIO->m_Lock);
+			m_pAsyncIO->Enqueue(pBack);
+			lock_unlock(m_pAsyncIO->m_Lock);
+		}
+		else
+			pBack->m_State = STATE_IDLE;
+	}
+
+	return m_Pos < pFront->m_Offset+(long)pFront->m_DataSize;
+}
+
+unsigned CAsyncIO::CFileReader::Read(void *pBuffer, unsigned Size)
+{
+	unsigned char *pDest = (unsigned char *)pBuffer;
+	unsigned Total = 0;
+	while(Total < Size && FetchBlock())
+	{
+		CRequest *pFront = &m_aBlocks[m_Front].m_Request;
+		unsigned Start = m_Pos-pFront->m_Offset;
+		unsigned Bytes = min(Size-Total, pFront->m_DataSize-Start);
+		mem_copy(pDest+Total, m_aBlocks[m_Front].m_aData+Start, Bytes);
+		Total += Bytes;
+		m_Pos += Bytes;
+	}
+	return Total;
+}
+
+unsigned CAsyncIO::CFileReader::Skip(long Size)
+{
+	m_Pos += Size;
+	return Size;
+}
+
+int CAsyncIO::CFileReader::Seek(long Offset, int Origin)
+{
+	long NewPos;
+	if(Origin == IOSEEK_START)
+		NewPos = Offset;
+	else if(Origin == IOSEEK_CUR)
+		NewPos = m_Pos+Offset;
+	else if(Origin == IOSEEK_END)
+		NewPos = m_Length+Offset;
+	else
+		return -1;
+
+	if(NewPos < 0)
+		return -1;
+	m_Pos = NewPos;
+	return 0;
+}
+
+IEngineAsyncIO *CreateEngineAsyncIO() { return new CAsyncIO; }
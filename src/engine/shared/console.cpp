@@ -288,6 +288,38 @@ void CConsole::Print(int Level, const char *pFrom, const char *pStr, bool Highli
 	}
 }
 
+const char *CConsole::FindLineEnd(const char *pStr, const char **ppNextPart)
+{
+	const char *pEnd = pStr;
+	int InString = 0;
+	*ppNextPart = 0;
+
+	while(*pEnd)
+	{
+		if(*pEnd == '"')
+			InString ^= 1;
+		else if(*pEnd == '\\') // escape sequences
+		{
+			if(pEnd[1] == '"')
+				pEnd++;
+		}
+		else if(!InString)
+		{
+			if(*pEnd == ';') // command separator
+			{
+				*ppNextPart = pEnd+1;
+				break;
+			}
+			else if(*pEnd == '#') // comment, no need to do anything more
+				break;
+		}
+
+		pEnd++;
+	}
+
+	return pEnd;
+}
+
 bool CConsole::LineIsValid(const char *pStr)
 {
 	if(!pStr || *pStr == 0)
@@ -296,32 +328,8 @@ bool CConsole::LineIsValid(const char *pStr)
 	do
 	{
 		CResult Result;
-		const char *pEnd = pStr;
-		const char *pNextPart = 0;
-		int InString = 0;
-
-		while(*pEnd)
-		{
-			if(*pEnd == '"')
-				InString ^= 1;
-			else if(*pEnd == '\\') // escape sequences
-			{
-				if(pEnd[1] == '"')
-					pEnd++;
-			}
-			else if(!InString)
-			{
-				if(*pEnd == ';') // command separator
-				{
-					pNextPart = pEnd+1;
-					break;
-				}
-				else if(*pEnd == '#') // comment, no need to do anything more
-					break;
-			}
-
-			pEnd++;
-		}
+		const char *pNextPart;
+		const char *pEnd = FindLineEnd(pStr, &pNextPart);
 
 		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
 			return false;
@@ -337,37 +345,60 @@ bool CConsole::LineIsValid(const char *pStr)
 	return true;
 }
 
-void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
+void CConsole::ExecuteCommand(int Stroke, CCommand *pCommand, CResult *pResult, bool ParseError)
 {
-	while(pStr && *pStr)
+	if(pCommand)
 	{
-		CResult Result;
-		const char *pEnd = pStr;
-		const char *pNextPart = 0;
-		int InString = 0;
-
-		while(*pEnd)
+		if(pCommand->GetAccessLevel() >= m_AccessLevel)
 		{
-			if(*pEnd == '"')
-				InString ^= 1;
-			else if(*pEnd == '\\') // escape sequences
+			int IsStrokeCommand = 0;
+			if(pResult->m_pCommand[0] == '+')
 			{
-				if(pEnd[1] == '"')
-					pEnd++;
+				// insert the stroke direction token
+				pResult->InsertArgument(m_paStrokeStr[Stroke]);
+				IsStrokeCommand = 1;
 			}
-			else if(!InString)
+
+			if(Stroke || IsStrokeCommand)
 			{
-				if(*pEnd == ';') // command separator
+				if(ParseError)
 				{
-					pNextPart = pEnd+1;
-					break;
+					char aBuf[256];
+					str_format(aBuf, sizeof(aBuf), "Invalid arguments... Usage: %s %s", pCommand->m_pName, pCommand->m_pParams);
+					Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
 				}
-				else if(*pEnd == '#') // comment, no need to do anything more
-					break;
+				else if(m_StoreCommands && pCommand->m_Flags&CFGFLAG_STORE)
+				{
+					m_ExecutionQueue.AddEntry();
+					m_ExecutionQueue.m_pLast->m_pCommand = pCommand;
+					m_ExecutionQueue.m_pLast->m_Result = *pResult;
+				}
+				else
+					pCommand->m_pfnCallback(pResult, pCommand->m_pUserData);
 			}
-
-			pEnd++;
 		}
+		else if(Stroke)
+		{
+			char aBuf[256];
+			str_format(aBuf, sizeof(aBuf), "Access for command %s denied.", pResult->m_pCommand);
+			Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
+		}
+	}
+	else if(Stroke)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "No such command: %s.", pResult->m_pCommand);
+		Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
+	}
+}
+
+void CConsole::ExecuteLineStrokedUncached(int Stroke, const char *pStr)
+{
+	while(pStr && *pStr)
+	{
+		CResult Result;
+		const char *pNextPart;
+		const char *pEnd = FindLineEnd(pStr, &pNextPart);
 
 		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
 			return;
@@ -376,53 +407,143 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 			return;
 
 		CCommand *pCommand = FindCommand(Result.m_pCommand, m_FlagMask);
+		bool ParseError = pCommand && ParseArgs(&Result, pCommand->m_pParams);
+		ExecuteCommand(Stroke, pCommand, &Result, ParseError);
 
-		if(pCommand)
-		{
-			if(pCommand->GetAccessLevel() >= m_AccessLevel)
-			{
-				int IsStrokeCommand = 0;
-				if(Result.m_pCommand[0] == '+')
-				{
-					// insert the stroke direction token
-					Result.AddArgument(m_paStrokeStr[Stroke]);
-					IsStrokeCommand = 1;
-				}
+		pStr = pNextPart;
+	}
+}
 
-				if(Stroke || IsStrokeCommand)
-				{
-					if(ParseArgs(&Result, pCommand->m_pParams))
-					{
-						char aBuf[256];
-						str_format(aBuf, sizeof(aBuf), "Invalid arguments... Usage: %s %s", pCommand->m_pName, pCommand->m_pParams);
-						Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
-					}
-					else if(m_StoreCommands && pCommand->m_Flags&CFGFLAG_STORE)
-					{
-						m_ExecutionQueue.AddEntry();
-						m_ExecutionQueue.m_pLast->m_pCommand = pCommand;
-						m_ExecutionQueue.m_pLast->m_Result = Result;
-					}
-					else
-						pCommand->m_pfnCallback(&Result, pCommand->m_pUserData);
-				}
-			}
-			else if(Stroke)
-			{
-				char aBuf[256];
-				str_format(aBuf, sizeof(aBuf), "Access for command %s denied.", Result.m_pCommand);
-				Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
-			}
-		}
-		else if(Stroke)
+bool CConsole::CompileLine(const char *pStr, CCompiledLine *pLine)
+{
+	int LineLength = str_length(pStr);
+	if(LineLength >= CONSOLE_MAX_STR_LENGTH)
+		return false;
+
+	int DataSize = 0;
+	int NumCommands = 0;
+	for(const char *pPart = pStr; pPart && *pPart;)
+	{
+		CResult Result;
+		const char *pNextPart;
+		const char *pEnd = FindLineEnd(pPart, &pNextPart);
+
+		if(ParseStart(&Result, pPart, (pEnd-pPart) + 1) != 0 || !*Result.m_pCommand)
+			break;
+
+		CCommand *pCommand = FindCommand(Result.m_pCommand, m_FlagMask);
+		bool ParseError = pCommand && ParseArgs(&Result, pCommand->m_pParams);
+
+		// only the used part of the string storage is kept
+		int StringSize = Result.m_pCommand-Result.m_aStringStorage + str_length(Result.m_pCommand) + 1;
+		for(int i = 0; i < Result.NumArguments(); i++)
+			StringSize = max(StringSize, (int)(Result.m_apArgs[i]-Result.m_aStringStorage) + str_length(Result.m_apArgs[i]) + 1);
+		int RecordSize = sizeof(CCompiledCommand) + Result.NumArguments()*sizeof(int) + StringSize;
+		RecordSize = (RecordSize+sizeof(void*)-1) & ~(int)(sizeof(void*)-1);
+		if(DataSize+RecordSize > COMPILE_BUFFER_SIZE)
+			return false;
+
+		CCompiledCommand *pCompiled = (CCompiledCommand *)(m_aCompileBuffer+DataSize);
+		pCompiled->m_pCommand = pCommand;
+		pCompiled->m_LineOffset = pPart-pStr;
+		pCompiled->m_ParseError = ParseError;
+		pCompiled->m_CommandOffset = Result.m_pCommand-Result.m_aStringStorage;
+		pCompiled->m_NumArgs = Result.NumArguments();
+		pCompiled->m_StringSize = StringSize;
+		int *pArgOffsets = (int *)(pCompiled+1);
+		for(int i = 0; i < Result.NumArguments(); i++)
+			pArgOffsets[i] = Result.m_apArgs[i]-Result.m_aStringStorage;
+		mem_copy(pArgOffsets+Result.NumArguments(), Result.m_aStringStorage, StringSize);
+
+		DataSize += RecordSize;
+		NumCommands++;
+		pPart = pNextPart;
+	}
+
+	// the line and the commands share one allocation
+	int LineSize = (LineLength+1+sizeof(void*)-1) & ~(int)(sizeof(void*)-1);
+	pLine->m_pLine = (char *)mem_alloc(LineSize+DataSize, sizeof(void*));
+	mem_copy(pLine->m_pLine, pStr, LineLength+1);
+	pLine->m_pData = (unsigned char *)pLine->m_pLine+LineSize;
+	mem_copy(pLine->m_pData, m_aCompileBuffer, DataSize);
+	pLine->m_FlagMask = m_FlagMask;
+	pLine->m_Generation = m_Generation;
+	pLine->m_NumCommands = NumCommands;
+	pLine->m_InUse = 0;
+	return true;
+}
+
+void CConsole::ExecuteCompiledLine(int Stroke, CCompiledLine *pLine)
+{
+	pLine->m_InUse++;
+	const unsigned char *pData = pLine->m_pData;
+	for(int c = 0; c < pLine->m_NumCommands; c++)
+	{
+		const CCompiledCommand *pCompiled = (const CCompiledCommand *)pData;
+		if(pLine->m_Generation != m_Generation)
 		{
-			char aBuf[256];
-			str_format(aBuf, sizeof(aBuf), "No such command: %s.", Result.m_pCommand);
-			Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
+			// a command changed the registered commands, go on without the cache
+			ExecuteLineStrokedUncached(Stroke, pLine->m_pLine+pCompiled->m_LineOffset);
+			break;
 		}
 
-		pStr = pNextPart;
+		const int *pArgOffsets = (const int *)(pCompiled+1);
+		CResult Result;
+		mem_copy(Result.m_aStringStorage, pArgOffsets+pCompiled->m_NumArgs, pCompiled->m_StringSize);
+		Result.m_pCommand = Result.m_aStringStorage+pCompiled->m_CommandOffset;
+		for(int i = 0; i < pCompiled->m_NumArgs; i++)
+			Result.AddArgument(Result.m_aStringStorage+pArgOffsets[i]);
+		ExecuteCommand(Stroke, pCompiled->m_pCommand, &Result, pCompiled->m_ParseError);
+
+		int RecordSize = sizeof(CCompiledCommand) + pCompiled->m_NumArgs*sizeof(int) + pCompiled->m_StringSize;
+		pData += (RecordSize+sizeof(void*)-1) & ~(int)(sizeof(void*)-1);
+	}
+	pLine->m_InUse--;
+}
+
+void CConsole::FreeCompiledLine(CCompiledLine *pLine)
+{
+	if(pLine->m_pLine)
+		mem_free(pLine->m_pLine);
+	pLine->m_pLine = 0;
+	pLine->m_pData = 0;
+	pLine->m_NumCommands = 0;
+}
+
+void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
+{
+	if(!pStr || !*pStr)
+		return;
+
+	// the lines of a config file run once, they would only evict the binds and votes
+	if(m_pFirstExec)
+	{
+		ExecuteLineStrokedUncached(Stroke, pStr);
+		return;
+	}
+
+	CCompiledLine *pLine = &m_aLineCache[(str_quickhash(pStr)+m_FlagMask)%LINE_CACHE_SIZE];
+	if(pLine->m_pLine && pLine->m_Generation == m_Generation && pLine->m_FlagMask == m_FlagMask && str_comp(pLine->m_pLine, pStr) == 0)
+	{
+		ExecuteCompiledLine(Stroke, pLine);
+		return;
+	}
+
+	// the slot is still executing further up the stack, compile into a temporary line
+	CCompiledLine TempLine;
+	if(pLine->m_InUse)
+		pLine = &TempLine;
+	else
+		FreeCompiledLine(pLine);
+
+	if(!CompileLine(pStr, pLine))
+	{
+		ExecuteLineStrokedUncached(Stroke, pStr);
+		return;
 	}
+	ExecuteCompiledLine(Stroke, pLine);
+	if(pLine == &TempLine)
+		FreeCompiledLine(pLine);
 }
 
 void CConsole::PossibleCommands(const char *pStr, int FlagMask, bool Temp, FPossibleCallback pfnCallback, void *pUser)
@@ -446,9 +567,47 @@ void CConsole::PossibleMaps(const char *pStr, FPossibleCallback pfnCallback, voi
 	}
 }
 
+unsigned CConsole::CommandHash(const char *pName)
+{
+	// commands are matched case insensitive
+	unsigned Hash = 5381;
+	for(; *pName; pName++)
+	{
+		char c = *pName;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = ((Hash << 5) + Hash) + c;
+	}
+	return Hash%COMMAND_HASH_SIZE;
+}
+
+void CConsole::AddCommandHash(CCommand *pCommand)
+{
+	// keep the order of the command list for commands with the same name
+	CCommand **ppLink = &m_apCommandHash[CommandHash(pCommand->m_pName)];
+	while(*ppLink && str_comp(pCommand->m_pName, (*ppLink)->m_pName) > 0)
+		ppLink = &(*ppLink)->m_pNextHash;
+	pCommand->m_pNextHash = *ppLink;
+	*ppLink = pCommand;
+	m_Generation++;
+}
+
+void CConsole::RemoveCommandHash(CCommand *pCommand)
+{
+	for(CCommand **ppLink = &m_apCommandHash[CommandHash(pCommand->m_pName)]; *ppLink; ppLink = &(*ppLink)->m_pNextHash)
+	{
+		if(*ppLink == pCommand)
+		{
+			*ppLink = pCommand->m_pNextHash;
+			break;
+		}
+	}
+	m_Generation++;
+}
+
 CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask)
 		{
@@ -753,6 +912,9 @@ CConsole::CConsole(int FlagMask)
 	m_pLastMapEntry = 0;
 	m_ExecutionQueue.Reset();
 	m_pFirstCommand = 0;
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
+	mem_zero(m_aLineCache, sizeof(m_aLineCache));
+	m_Generation = 0;
 	m_pFirstExec = 0;
 	mem_zero(m_aPrintCB, sizeof(m_aPrintCB));
 	m_NumPrintCB = 0;
@@ -773,6 +935,9 @@ CConsole::CConsole(int FlagMask)
 
 CConsole::~CConsole()
 {
+	for(int i = 0; i < LINE_CACHE_SIZE; i++)
+		FreeCompiledLine(&m_aLineCache[i]);
+
 	CCommand *pCommand = m_pFirstCommand;
 	while(pCommand)
 	{
@@ -862,6 +1027,8 @@ void CConsole::AddCommandSorted(CCommand *pCommand)
 			}
 		}
 	}
+
+	AddCommandHash(pCommand);
 }
 
 void CConsole::Register(const char *pName, const char *pParams,
@@ -886,6 +1053,8 @@ void CConsole::Register(const char *pName, const char *pParams,
 
 	if(DoAdd)
 		AddCommandSorted(pCommand);
+	else
+		m_Generation++; // the parameters might have changed
 }
 
 void CConsole::RegisterTemp(const char *pName, const char *pParams,	int Flags, const char *pHelp)
@@ -949,6 +1118,7 @@ void CConsole::DeregisterTemp(const char *pName)
 	// add to recycle list
 	if(pRemoved)
 	{
+		RemoveCommandHash(pRemoved);
 		pRemoved->m_pNext = m_pRecycleList;
 		m_pRecycleList = pRemoved;
 	}
@@ -970,6 +1140,11 @@ void CConsole::DeregisterTempAll()
 		}
 	}
 
+	// rebuild the hash index from what is left
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
+	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+		AddCommandHash(pCommand);
+
 	m_TempCommands.Reset();
 	m_pRecycleList = 0;
 }
@@ -1074,7 +1249,7 @@ void CConsole::StoreCommands(bool Store)
 
 const IConsole::CCommandInfo *CConsole::GetCommandInfo(const char *pName, int FlagMask, bool Temp)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && pCommand->m_Temp == Temp)
 		{
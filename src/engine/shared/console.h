@@ -14,6 +14,7 @@ class CConsole : public IConsole
 	public:
 		CCommand(bool BasicAccess) : CCommandInfo(BasicAccess) {};
 		CCommand *m_pNext;
+		CCommand *m_pNextHash;
 		int m_Flags;
 		bool m_Temp;
 		FCommandCallback m_pfnCallback;
@@ -115,6 +116,17 @@ class CConsole : public IConsole
 			m_apArgs[m_NumArgs++] = pArg;
 		}
 
+		// drops the last argument if there is no room left
+		void InsertArgument(const char *pArg)
+		{
+			if(m_NumArgs == MAX_PARTS)
+				m_NumArgs--;
+			for(unsigned i = m_NumArgs; i > 0; i--)
+				m_apArgs[i] = m_apArgs[i-1];
+			m_apArgs[0] = pArg;
+			m_NumArgs++;
+		}
+
 		virtual const char *GetString(unsigned Index);
 		virtual int GetInteger(unsigned Index);
 		virtual float GetFloat(unsigned Index);
@@ -122,6 +134,55 @@ class CConsole : public IConsole
 
 	int ParseStart(CResult *pResult, const char *pString, int Length);
 	int ParseArgs(CResult *pResult, const char *pFormat);
+	static const char *FindLineEnd(const char *pStr, const char **ppNextPart);
+	void ExecuteCommand(int Stroke, CCommand *pCommand, CResult *pResult, bool ParseError);
+
+	/*
+		Lines are split into their commands and arguments once and kept
+		in a small direct mapped cache, so binds and repeatedly executed
+		lines skip the tokenizing and the command lookups. Registering or
+		removing commands invalidates all compiled lines.
+	*/
+	enum
+	{
+		COMMAND_HASH_SIZE=1024,
+		LINE_CACHE_SIZE=512,
+		COMPILE_BUFFER_SIZE=16*1024,
+	};
+
+	// followed by the argument offsets and the string storage
+	struct CCompiledCommand
+	{
+		CCommand *m_pCommand;
+		int m_LineOffset;
+		int m_ParseError;
+		int m_CommandOffset;
+		int m_NumArgs;
+		int m_StringSize;
+	};
+
+	struct CCompiledLine
+	{
+		char *m_pLine;
+		unsigned char *m_pData;
+		int m_FlagMask;
+		int m_Generation;
+		int m_NumCommands;
+		int m_InUse;
+	};
+
+	CCommand *m_apCommandHash[COMMAND_HASH_SIZE];
+	CCompiledLine m_aLineCache[LINE_CACHE_SIZE];
+	int m_Generation;
+	unsigned char m_aCompileBuffer[COMPILE_BUFFER_SIZE];
+
+	static unsigned CommandHash(const char *pName);
+	void AddCommandHash(CCommand *pCommand);
+	void RemoveCommandHash(CCommand *pCommand);
+	bool CompileLine(const char *pStr, CCompiledLine *pLine);
+	void ExecuteCompiledLine(int Stroke, CCompiledLine *pLine);
+	void FreeCompiledLine(CCompiledLine *pLine);
+	void ExecuteLineStrokedUncached(int Stroke, const char *pStr);
 
 	/*
 	This function will set pFormat to the next parameter (i,s,r,v,?) it contains and
@@ -3,6 +3,7 @@
 #include <base/math.h>
 #include <base/system.h>
 
+#include <engine/asyncio.h>
 #include <engine/console.h>
 #include <engine/storage.h>
 
@@ -15,27 +16,75 @@
 
 static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
 static const unsigned char gs_ActVersion = 4;
+static const unsigned char gs_KeyFrameDeltaVersion = 5; // deltas are against the last keyframe
 static const int gs_LengthOffset = 152;
 static const int gs_NumMarkersOffset = 176;
+static const unsigned char gs_aIndexMarker[8] = {'T', 'W', 'I', 'N', 'D', 'E', 'X', 0};
+static const unsigned char gs_aIndexFooterMarker[4] = {'T', 'W', 'I', 'X'};
+static const int gs_IndexVersion = 1;
+
+/*
+	Tickmarker
+		7	= Always set
+		6	= Keyframe flag
+		0-5	= Delta tick
+
+	Normal
+		7 = Not set
+		5-6	= Type
+		0-4	= Size
+
+	Seek index (appended at the end by the recorder)
+		CHUNKTYPE_INDEX chunk whose data is a compressed empty stub,
+		followed by the raw index: marker, version, first tick, last tick,
+		keyframe count, keyframes (tick, file position), timeline marker
+		count, timeline markers. The last 8 bytes of the file hold the
+		position of the raw index and the footer marker.
+*/
+
+enum
+{
+	CHUNKTYPEFLAG_TICKMARKER = 0x80,
+	CHUNKTICKFLAG_KEYFRAME = 0x40, // only when tickmarker is set
+
+	CHUNKMASK_TICK = 0x3f,
+	CHUNKMASK_TYPE = 0x60,
+	CHUNKMASK_SIZE = 0x1f,
+
+	CHUNKTYPE_INDEX = 0, // ignored by players that don't know it
+	CHUNKTYPE_SNAPSHOT = 1,
+	CHUNKTYPE_MESSAGE = 2,
+	CHUNKTYPE_DELTA = 3,
+
+	CHUNKFLAG_BIGSIZE = 0x10
+};
 
 CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_File = 0;
+	m_WriterFile = 0;
+	m_MapFile = 0;
+	m_pReplayData = 0;
 	m_LastTickMarker = -1;
 	m_pSnapshotDelta = pSnapshotDelta;
 	m_Huffman.Init();
+	m_QueueLock = lock_create();
+	m_pWriterThread = 0;
+	m_StopWriter = false;
+	m_WaitingForSpace = false;
+	m_KeyFrameInterval = DEFAULT_KEYFRAME_INTERVAL;
+	m_DeltaAgainstKeyFrame = false;
+	m_WaitForWriter = false;
 }
 
-// Record
-int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType)
+CDemoRecorder::~CDemoRecorder()
 {
-	CDemoHeader Header;
-	if(m_File)
-		return -1;
-
-	m_pConsole = pConsole;
+	lock_destroy(m_QueueLock);
+}
 
-	// open mapfile
+// Record
+IOHANDLE CDemoRecorder::OpenMapFile(class IStorage *pStorage, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc)
+{
 	char aMapFilename[128];
 	// try the normal maps folder
 	str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", pMap);
@@ -67,8 +116,38 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 		char aBuf[256];
 		str_format(aBuf, sizeof(aBuf), "Unable to open mapfile '%s'", pMap);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
-		return -1;
 	}
+	return MapFile;
+}
+
+void CDemoRecorder::InitHeader(CDemoHeader *pHeader, const char *pNetVersion, const char *pMap, unsigned MapSize, unsigned Crc, const char *pType)
+{
+	mem_zero(pHeader, sizeof(*pHeader));
+	mem_copy(pHeader->m_aMarker, gs_aHeaderMarker, sizeof(pHeader->m_aMarker));
+	pHeader->m_Version = m_DeltaAgainstKeyFrame ? gs_KeyFrameDeltaVersion : gs_ActVersion;
+	str_copy(pHeader->m_aNetversion, pNetVersion, sizeof(pHeader->m_aNetversion));
+	str_copy(pHeader->m_aMapName, pMap, sizeof(pHeader->m_aMapName));
+	uint_to_bytes_be(pHeader->m_aMapSize, MapSize);
+	uint_to_bytes_be(pHeader->m_aMapCrc, Crc);
+	str_copy(pHeader->m_aType, pType, sizeof(pHeader->m_aType));
+	// Header.m_Length - add this on stop
+	str_timestamp(pHeader->m_aTimestamp, sizeof(pHeader->m_aTimestamp));
+	// Header.m_aNumTimelineMarkers - add this on stop
+	// Header.m_aTimelineMarkers - add this on stop
+}
+
+int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType)
+{
+	CDemoHeader Header;
+	if(IsRecording())
+		return -1;
+
+	m_pConsole = pConsole;
+
+	// open mapfile
+	IOHANDLE MapFile = OpenMapFile(pStorage, pMap, Sha256, Crc);
+	if(!MapFile)
+		return -1;
 
 	IOHANDLE DemoFile = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 	if(!DemoFile)
@@ -82,76 +161,190 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	}
 
 	// write header
-	mem_zero(&Header, sizeof(Header));
-	mem_copy(Header.m_aMarker, gs_aHeaderMarker, sizeof(Header.m_aMarker));
-	Header.m_Version = gs_ActVersion;
-	str_copy(Header.m_aNetversion, pNetVersion, sizeof(Header.m_aNetversion));
-	str_copy(Header.m_aMapName, pMap, sizeof(Header.m_aMapName));
-	unsigned MapSize = io_length(MapFile);
-	uint_to_bytes_be(Header.m_aMapSize, MapSize);
-	uint_to_bytes_be(Header.m_aMapCrc, Crc);
-	str_copy(Header.m_aType, pType, sizeof(Header.m_aType));
-	// Header.m_Length - add this on stop
-	str_timestamp(Header.m_aTimestamp, sizeof(Header.m_aTimestamp));
-	// Header.m_aNumTimelineMarkers - add this on stop
-	// Header.m_aTimelineMarkers - add this on stop
+	InitHeader(&Header, pNetVersion, pMap, io_length(MapFile), Crc, pType);
 	io_write(DemoFile, &Header, sizeof(Header));
 
-	// write map data
-	unsigned char aChunk[1024*64];
-	while(1)
-	{
-		int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
-		if(Bytes <= 0)
-			break;
-		io_write(DemoFile, &aChunk, Bytes);
-	}
-	io_close(MapFile);
-
 	m_LastKeyFrame = -1;
+	m_LastSnapshotSize = -1;
 	m_LastTickMarker = -1;
+	m_WriterLastTickMarker = -1;
 	m_FirstTick = -1;
 	m_NumTimelineMarkers = 0;
+	m_NumDroppedSnapshots = 0;
+	m_NumWriteErrors = 0;
+	m_WriteBufferSize = 0;
+	m_lKeyFrames.clear();
+	m_Queue.Init();
 
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "Recording to '%s'", pFilename);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 	m_File = DemoFile;
 
+	// the writer thread copies the map data first
+	m_WriterFile = DemoFile;
+	m_MapFile = MapFile;
+	m_StopWriter = false;
+	m_pWriterThread = thread_init(WriterThread, this);
+
 	return 0;
 }
 
-/*
-	Tickmarker
-		7	= Always set
-		6	= Keyframe flag
-		0-5	= Delta tick
+int CDemoRecorder::StartReplay(class IStorage *pStorage, class IConsole *pConsole, const char *pNetVersion, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc, const char *pType, int BufferSize)
+{
+	if(IsRecording() || BufferSize <= 0)
+		return -1;
 
-	Normal
-		7 = Not set
-		5-6	= Type
-		0-4	= Size
-*/
+	m_pConsole = pConsole;
 
-enum
+	// kept open to copy the map into every saved replay
+	IOHANDLE MapFile = OpenMapFile(pStorage, pMap, Sha256, Crc);
+	if(!MapFile)
+		return -1;
+	InitHeader(&m_ReplayHeader, pNetVersion, pMap, io_length(MapFile), Crc, pType);
+
+	m_LastKeyFrame = -1;
+	m_LastSnapshotSize = -1;
+	m_LastTickMarker = -1;
+	m_WriterLastTickMarker = -1;
+	m_FirstTick = -1;
+	m_NumTimelineMarkers = 0;
+	m_NumDroppedSnapshots = 0;
+	m_NumWriteErrors = 0;
+	m_WriteBufferSize = 0;
+	m_lKeyFrames.clear();
+	m_lReplaySegments.clear();
+	m_Queue.Init();
+
+	m_pReplayData = (unsigned char *)mem_alloc(BufferSize, 1);
+	m_ReplaySize = BufferSize;
+	m_ReplayStart = 0;
+	m_ReplayEnd = 0;
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "Recording the last %d KiB into the replay buffer", BufferSize/1024);
+	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
+
+	m_WriterFile = 0;
+	m_MapFile = MapFile;
+	m_StopWriter = false;
+	m_pWriterThread = thread_init(WriterThread, this);
+
+	return 0;
+}
+
+int CDemoRecorder::SaveReplay(class IStorage *pStorage, const char *pFilename)
 {
-	CHUNKTYPEFLAG_TICKMARKER = 0x80,
-	CHUNKTICKFLAG_KEYFRAME = 0x40, // only when tickmarker is set
+	if(!IsReplay())
+		return -1;
 
-	CHUNKMASK_TICK = 0x3f,
-	CHUNKMASK_TYPE = 0x60,
-	CHUNKMASK_SIZE = 0x1f,
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "Unable to open '%s' for saving the replay", pFilename);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
+		return -1;
+	}
 
-	CHUNKTYPE_SNAPSHOT = 1,
-	CHUNKTYPE_MESSAGE = 2,
-	CHUNKTYPE_DELTA = 3,
+	// the writer thread adds the rest once it got everything recorded so far
+	CDemoHeader Header = m_ReplayHeader;
+	str_timestamp(Header.m_aTimestamp, sizeof(Header.m_aTimestamp));
+	io_write(File, &Header, sizeof(Header));
+	Enqueue(QUEUEITEM_SAVE_REPLAY, m_LastTickMarker, &File, sizeof(File), true);
 
-	CHUNKFLAG_BIGSIZE = 0x10
-};
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "Saving replay to '%s'", pFilename);
+	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
+	return 0;
+}
+
+void CDemoRecorder::WriterThread(void *pUser)
+{
+	CDemoRecorder *pSelf = (CDemoRecorder *)pUser;
+
+	// write map data
+	if(pSelf->m_WriterFile)
+	{
+		pSelf->WriteMapData();
+		io_close(pSelf->m_MapFile);
+		pSelf->m_MapFile = 0;
+	}
+
+	while(1)
+	{
+		pSelf->m_QueueActivity.wait();
+
+		// only stop once everything queued before Stop() is written
+		CQueueItem Item;
+		bool GotItem = false;
+		lock_wait(pSelf->m_QueueLock);
+		bool Stop = pSelf->m_StopWriter;
+		CQueueItem *pItem = pSelf->m_Queue.First();
+		if(pItem)
+		{
+			Item = *pItem;
+			mem_copy(pSelf->m_aItemData, pItem+1, Item.m_Size);
+			pSelf->m_Queue.PopFirst();
+			GotItem = true;
+			if(pSelf->m_WaitingForSpace)
+			{
+				pSelf->m_WaitingForSpace = false;
+				pSelf->m_QueueSpace.signal();
+			}
+		}
+		lock_unlock(pSelf->m_QueueLock);
+
+		if(GotItem)
+		{
+			if(Item.m_Type == QUEUEITEM_SNAPSHOT)
+				pSelf->ProcessSnapshot(Item.m_Tick, pSelf->m_aItemData, Item.m_Size);
+			else if(Item.m_Type == QUEUEITEM_SAVE_REPLAY)
+				pSelf->WriteReplay(*(IOHANDLE *)pSelf->m_aItemData);
+			else
+				pSelf->Write(CHUNKTYPE_MESSAGE, pSelf->m_aItemData, Item.m_Size);
+		}
+		else if(Stop)
+			break;
+	}
+
+	pSelf->FlushWriteBuffer();
+}
+
+bool CDemoRecorder::Enqueue(int Type, int Tick, const void *pData, int Size, bool Wait)
+{
+	if(Size < 0 || Size > CSnapshot::MAX_SIZE)
+		return false;
+
+	while(1)
+	{
+		lock_wait(m_QueueLock);
+		CQueueItem *pItem = m_Queue.Allocate(sizeof(CQueueItem)+Size);
+		if(pItem)
+		{
+			pItem->m_Type = Type;
+			pItem->m_Tick = Tick;
+			pItem->m_Size = Size;
+			mem_copy(pItem+1, pData, Size);
+		}
+		else if(Wait)
+			m_WaitingForSpace = true;
+		lock_unlock(m_QueueLock);
+
+		if(pItem)
+		{
+			m_QueueActivity.signal();
+			return true;
+		}
+		if(!Wait)
+			return false;
+		m_QueueSpace.wait();
+	}
+}
 
 void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 {
-	if(m_LastTickMarker == -1 || Tick-m_LastTickMarker > 63 || Keyframe)
+	if(m_WriterLastTickMarker == -1 || Tick-m_WriterLastTickMarker > 63 || Keyframe)
 	{
 		unsigned char aChunk[5];
 		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER;
@@ -160,52 +353,149 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 		if(Keyframe)
 			aChunk[0] |= CHUNKTICKFLAG_KEYFRAME;
 
-		io_write(m_File, aChunk, sizeof(aChunk));
+		WriteData(aChunk, sizeof(aChunk));
 	}
 	else
 	{
 		unsigned char aChunk[1];
-		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_LastTickMarker);
-		io_write(m_File, aChunk, sizeof(aChunk));
+		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_WriterLastTickMarker);
+		WriteData(aChunk, sizeof(aChunk));
 	}
 
-	m_LastTickMarker = Tick;
-	if(m_FirstTick < 0)
-		m_FirstTick = Tick;
+	m_WriterLastTickMarker = Tick;
 }
 
-void CDemoRecorder::Write(int Type, const void *pData, int Size)
+void CDemoRecorder::WriteData(const void *pData, int Size)
 {
-	if(!m_File)
+	if(!m_WriterFile)
+	{
+		WriteReplayData(pData, Size);
 		return;
+	}
 
-	char aBuffer[64*1024];
-	char aBuffer2[64*1024];
-
-	/* pad the data with 0 so we get an alignment of 4,
-	else the compression won't work and miss some bytes */
-	mem_copy(aBuffer2, pData, Size);
-	while(Size&3)
-		aBuffer2[Size++] = 0;
-	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer, sizeof(aBuffer)); // buffer2 -> buffer
-	if(Size < 0)
+	m_WriterFilePos += Size;
+	if(m_WriteBufferSize+Size > WRITE_BUFFER_SIZE)
+		FlushWriteBuffer();
+	if(Size > WRITE_BUFFER_SIZE)
 	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", "error during intpack compression");
+		io_write(m_WriterFile, pData, Size);
 		return;
 	}
-	Size = m_Huffman.Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
-	if(Size < 0)
+	mem_copy(m_aWriteBuffer+m_WriteBufferSize, pData, Size);
+	m_WriteBufferSize += Size;
+}
+
+void CDemoRecorder::FlushWriteBuffer()
+{
+	if(m_WriteBufferSize)
+		io_write(m_WriterFile, m_aWriteBuffer, m_WriteBufferSize);
+	m_WriteBufferSize = 0;
+}
+
+void CDemoRecorder::WriteMapData()
+{
+	io_seek(m_MapFile, 0, IOSEEK_START);
+	while(1)
 	{
-		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", "error during network compression");
+		int Bytes = io_read(m_MapFile, m_aWriteBuffer, sizeof(m_aWriteBuffer));
+		if(Bytes <= 0)
+			break;
+		io_write(m_WriterFile, m_aWriteBuffer, Bytes);
+	}
+	m_WriterFilePos = io_tell(m_WriterFile);
+}
+
+void CDemoRecorder::WriteReplayData(const void *pData, int Size)
+{
+	// nothing to add to before the first keyframe
+	if(m_lReplaySegments.size() == 0)
 		return;
+
+	// drop the oldest segments to make room
+	while(m_ReplayEnd+Size-m_ReplayStart > m_ReplaySize)
+	{
+		if(m_lReplaySegments.size() == 1)
+		{
+			// a single segment doesn't fit, start over at the next keyframe
+			m_lReplaySegments.clear();
+			m_ReplayStart = m_ReplayEnd;
+			return;
+		}
+		m_lReplaySegments.remove_index(0);
+		m_ReplayStart = m_lReplaySegments[0].m_Start;
+	}
+
+	int Offset = m_ReplayEnd%m_ReplaySize;
+	int FirstPart = min(Size, m_ReplaySize-Offset);
+	mem_copy(m_pReplayData+Offset, pData, FirstPart);
+	if(FirstPart < Size)
+		mem_copy(m_pReplayData, (const unsigned char *)pData+FirstPart, Size-FirstPart);
+	m_ReplayEnd += Size;
+}
+
+void CDemoRecorder::WriteReplay(IOHANDLE File)
+{
+	// write to the file until the replay is complete
+	m_WriterFile = File;
+	m_WriteBufferSize = 0;
+	WriteMapData();
+
+	for(int i = 0; i < m_lReplaySegments.size(); i++)
+	{
+		CIndexEntry Entry;
+		Entry.m_Tick = m_lReplaySegments[i].m_Tick;
+		Entry.m_Filepos = m_WriterFilePos;
+		m_lKeyFrames.add(Entry);
+
+		int64 End = i+1 < m_lReplaySegments.size() ? m_lReplaySegments[i+1].m_Start : m_ReplayEnd;
+		for(int64 Pos = m_lReplaySegments[i].m_Start; Pos < End;)
+		{
+			int Offset = Pos%m_ReplaySize;
+			int Size = (int)min(End-Pos, (int64)(m_ReplaySize-Offset));
+			WriteData(m_pReplayData+Offset, Size);
+			Pos += Size;
+		}
 	}
+	WriteIndex();
+	FlushWriteBuffer();
 
+	if(m_lKeyFrames.size())
+	{
+		io_seek(File, gs_LengthOffset, IOSEEK_START);
+		unsigned char aLength[4];
+		uint_to_bytes_be(aLength, (m_WriterLastTickMarker-m_lKeyFrames[0].m_Tick)/SERVER_TICK_SPEED);
+		io_write(File, aLength, sizeof(aLength));
+	}
+	io_close(File);
+
+	m_lKeyFrames.clear();
+	m_WriterFile = 0;
+}
+
+int CDemoRecorder::Compress(const void *pData, int Size)
+{
+	char *pBuffer = m_aCompressBuffer[0];
+	char *pBuffer2 = m_aCompressBuffer[1];
+
+	/* pad the data with 0 so we get an alignment of 4,
+	else the compression won't work and miss some bytes */
+	mem_copy(pBuffer2, pData, Size);
+	while(Size&3)
+		pBuffer2[Size++] = 0;
+	Size = CVariableInt::Compress(pBuffer2, Size, pBuffer, CSnapshot::MAX_SIZE); // buffer2 -> buffer
+	if(Size < 0)
+		return -1;
+	return m_Huffman.Compress(pBuffer, Size, pBuffer2, CSnapshot::MAX_SIZE); // buffer -> buffer2
+}
+
+void CDemoRecorder::WriteChunkHeader(int Type, int Size)
+{
 	unsigned char aChunk[3];
 	aChunk[0] = ((Type&0x3)<<5);
 	if(Size < 30)
 	{
 		aChunk[0] |= Size;
-		io_write(m_File, aChunk, 1);
+		WriteData(aChunk, 1);
 	}
 	else
 	{
@@ -213,35 +503,133 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 		{
 			aChunk[0] |= 30;
 			aChunk[1] = Size&0xff;
-			io_write(m_File, aChunk, 2);
+			WriteData(aChunk, 2);
 		}
 		else
 		{
 			aChunk[0] |= 31;
 			aChunk[1] = Size&0xff;
 			aChunk[2] = Size>>8;
-			io_write(m_File, aChunk, 3);
+			WriteData(aChunk, 3);
 		}
 	}
+}
+
+void CDemoRecorder::Write(int Type, const void *pData, int Size)
+{
+	Size = Compress(pData, Size);
+	if(Size < 0)
+	{
+		m_NumWriteErrors++;
+		return;
+	}
 
-	io_write(m_File, aBuffer2, Size);
+	WriteChunkHeader(Type, Size);
+	WriteData(m_aCompressBuffer[1], Size);
 }
 
-void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+void CDemoRecorder::WriteIndex()
 {
-	char aTmpData[CSnapshot::MAX_SIZE];
+	if(m_lKeyFrames.size() == 0)
+		return;
+
+	// the stub decompresses fine, so older players skip the chunk without errors
+	int Zero = 0;
+	int StubSize = Compress(&Zero, sizeof(Zero));
+	if(StubSize < 0)
+		return;
+
+	// keep the chunk within the 16 bit chunk size by thinning out the keyframes of very long demos
+	int Step = m_lKeyFrames.size()/MAX_INDEX_KEYFRAMES + 1;
+	int NumKeyFrames = (m_lKeyFrames.size()+Step-1)/Step;
+
+	unsigned char *pData = (unsigned char *)m_aTmpData;
+	mem_copy(pData, m_aCompressBuffer[1], StubSize);
+	int Size = StubSize;
+	mem_copy(pData+Size, gs_aIndexMarker, sizeof(gs_aIndexMarker));
+	Size += sizeof(gs_aIndexMarker);
+	uint_to_bytes_be(pData+Size, gs_IndexVersion); Size += 4;
+	uint_to_bytes_be(pData+Size, m_lKeyFrames[0].m_Tick); Size += 4;
+	uint_to_bytes_be(pData+Size, m_WriterLastTickMarker); Size += 4;
+	uint_to_bytes_be(pData+Size, NumKeyFrames); Size += 4;
+	for(int i = 0; i < m_lKeyFrames.size(); i += Step)
+	{
+		uint_to_bytes_be(pData+Size, m_lKeyFrames[i].m_Tick); Size += 4;
+		uint_to_bytes_be(pData+Size, m_lKeyFrames[i].m_Filepos); Size += 4;
+	}
+	uint_to_bytes_be(pData+Size, m_NumTimelineMarkers); Size += 4;
+	for(int i = 0; i < m_NumTimelineMarkers; i++)
+	{
+		uint_to_bytes_be(pData+Size, m_aTimelineMarkers[i]); Size += 4;
+	}
+
+	// the header size depends on the chunk size, which includes the footer
+	int ChunkSize = Size+8;
+	int HeaderSize = ChunkSize < 30 ? 1 : ChunkSize < 256 ? 2 : 3;
+	uint_to_bytes_be(pData+Size, m_WriterFilePos+HeaderSize+StubSize); Size += 4;
+	mem_copy(pData+Size, gs_aIndexFooterMarker, sizeof(gs_aIndexFooterMarker));
+	Size += sizeof(gs_aIndexFooterMarker);
+
+	WriteChunkHeader(CHUNKTYPE_INDEX, Size);
+	WriteData(pData, Size);
+	FlushWriteBuffer();
+}
 
-	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
+void CDemoRecorder::ProcessSnapshot(int Tick, const void *pData, int Size)
+{
+	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) >= m_KeyFrameInterval)
 	{
+		if(IsReplay())
+		{
+			// replays are cut at keyframes
+			CReplaySegment Segment;
+			Segment.m_Tick = Tick;
+			Segment.m_Start = m_ReplayEnd;
+			if(m_lReplaySegments.size() == 0)
+				m_ReplayStart = m_ReplayEnd;
+			m_lReplaySegments.add(Segment);
+		}
+		else
+		{
+			// remember the position for the seek index
+			CIndexEntry Entry;
+			Entry.m_Tick = Tick;
+			Entry.m_Filepos = m_WriterFilePos;
+			m_lKeyFrames.add(Entry);
+		}
+
 		// write full tickmarker
 		WriteTickMarker(Tick, 1);
 
 		// write snapshot
-		int SnapSize = ((CSnapshot*)pData)->Serialize(aTmpData);
-		Write(CHUNKTYPE_SNAPSHOT, aTmpData, SnapSize);
+		int SnapSize = ((CSnapshot*)pData)->Serialize(m_aTmpData);
+		Write(CHUNKTYPE_SNAPSHOT, m_aTmpData, SnapSize);
 
 		m_LastKeyFrame = Tick;
 		mem_copy(m_aLastSnapshotData, pData, Size);
+		m_LastSnapshotSize = Size;
+		if(m_DeltaAgainstKeyFrame)
+			mem_copy(m_aKeyFrameSnapshotData, pData, Size);
+	}
+	else if(m_DeltaAgainstKeyFrame)
+	{
+		// write tickmarker
+		WriteTickMarker(Tick, 0);
+
+		// the player repeats the previous snapshot for ticks without one
+		if(Size == m_LastSnapshotSize && mem_comp(m_aLastSnapshotData, pData, Size) == 0)
+			return;
+
+		// an empty delta brings back the keyframe
+		int DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aKeyFrameSnapshotData, (CSnapshot*)pData, m_aTmpData);
+		if(!DeltaSize)
+		{
+			DeltaSize = 3*sizeof(int);
+			mem_zero(m_aTmpData, DeltaSize);
+		}
+		Write(CHUNKTYPE_DELTA, m_aTmpData, DeltaSize);
+		mem_copy(m_aLastSnapshotData, pData, Size);
+		m_LastSnapshotSize = Size;
 	}
 	else
 	{
@@ -249,26 +637,75 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 		WriteTickMarker(Tick, 0);
 
 		// create delta
-		int DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aTmpData);
+		int DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, m_aTmpData);
 		if(DeltaSize)
 		{
 			// record delta
-			Write(CHUNKTYPE_DELTA, aTmpData, DeltaSize);
+			Write(CHUNKTYPE_DELTA, m_aTmpData, DeltaSize);
 			mem_copy(m_aLastSnapshotData, pData, Size);
+			m_LastSnapshotSize = Size;
 		}
 	}
 }
 
+void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+{
+	if(!IsRecording())
+		return;
+
+	if(!Enqueue(QUEUEITEM_SNAPSHOT, Tick, pData, Size, m_WaitForWriter))
+	{
+		m_NumDroppedSnapshots++;
+		return;
+	}
+
+	m_LastTickMarker = Tick;
+	if(m_FirstTick < 0)
+		m_FirstTick = Tick;
+}
+
 void CDemoRecorder::RecordMessage(const void *pData, int Size)
 {
-	Write(CHUNKTYPE_MESSAGE, pData, Size);
+	if(!IsRecording())
+		return;
+
+	Enqueue(QUEUEITEM_MESSAGE, m_LastTickMarker, pData, Size, true);
 }
 
 int CDemoRecorder::Stop()
 {
-	if(!m_File)
+	if(!IsRecording())
 		return -1;
 
+	// let the writer finish everything that is queued
+	lock_wait(m_QueueLock);
+	m_StopWriter = true;
+	lock_unlock(m_QueueLock);
+	m_QueueActivity.signal();
+	thread_wait(m_pWriterThread);
+	thread_destroy(m_pWriterThread);
+	m_pWriterThread = 0;
+
+	if(m_NumDroppedSnapshots || m_NumWriteErrors)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "dropped %d snapshots because the writer could not keep up, %d compression errors", m_NumDroppedSnapshots, m_NumWriteErrors);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", aBuf);
+	}
+
+	if(IsReplay())
+	{
+		io_close(m_MapFile);
+		m_MapFile = 0;
+		mem_free(m_pReplayData);
+		m_pReplayData = 0;
+		m_lReplaySegments.clear();
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped the replay buffer");
+		return 0;
+	}
+
+	WriteIndex();
+
 	// add the demo length to the header
 	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
 	unsigned char aLength[4];
@@ -289,14 +726,22 @@ int CDemoRecorder::Stop()
 
 	io_close(m_File);
 	m_File = 0;
+	m_WriterFile = 0;
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped recording");
 
 	return 0;
 }
 
+void CDemoRecorder::SetKeyFrameMode(int Interval, bool DeltaAgainstKeyFrame)
+{
+	m_KeyFrameInterval = max(Interval, 1);
+	m_DeltaAgainstKeyFrame = DeltaAgainstKeyFrame;
+}
+
 void CDemoRecorder::AddDemoMarker()
 {
-	if(m_LastTickMarker < 0 || m_NumTimelineMarkers >= MAX_TIMELINE_MARKERS)
+	// replays are cut from the buffer, markers before the cut would be off
+	if(m_LastTickMarker < 0 || m_NumTimelineMarkers >= MAX_TIMELINE_MARKERS || IsReplay())
 		return;
 
 	// not more than 1 marker in a second
@@ -317,12 +762,19 @@ void CDemoRecorder::AddDemoMarker()
 CDemoPlayer::CDemoPlayer(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_Huffman.Init();
+	m_pListener = 0;
+	m_pAsyncIO = 0;
+	m_pReader = 0;
 	m_File = 0;
 	m_aErrorMsg[0] = 0;
 	m_pKeyFrames = 0;
 
 	m_pSnapshotDelta = pSnapshotDelta;
 	m_LastSnapshotDataSize = -1;
+	m_KeyFrameSnapshotDataSize = -1;
+	m_DeltaAgainstKeyFrame = false;
+	m_SkipDeltasBefore = -1;
+	m_SkippedDeltaPos = -1;
 }
 
 void CDemoPlayer::SetListener(IListener *pListener)
@@ -330,6 +782,35 @@ void CDemoPlayer::SetListener(IListener *pListener)
 	m_pListener = pListener;
 }
 
+unsigned CDemoPlayer::ReadData(void *pBuffer, unsigned Size)
+{
+	if(m_pReader)
+		return m_pReader->Read(pBuffer, Size);
+	return io_read(m_File, pBuffer, Size);
+}
+
+void CDemoPlayer::SkipData(int Size)
+{
+	if(m_pReader)
+		m_pReader->Skip(Size);
+	else
+		io_skip(m_File, Size);
+}
+
+void CDemoPlayer::SeekData(long Offset)
+{
+	if(m_pReader)
+		m_pReader->Seek(Offset, IOSEEK_START);
+	else
+		io_seek(m_File, Offset, IOSEEK_START);
+}
+
+long CDemoPlayer::TellData()
+{
+	if(m_pReader)
+		return m_pReader->Tell();
+	return io_tell(m_File);
+}
 
 int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 {
@@ -338,7 +819,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 	*pSize = 0;
 	*pType = 0;
 
-	if(io_read(m_File, &Chunk, sizeof(Chunk)) != sizeof(Chunk))
+	if(ReadData(&Chunk, sizeof(Chunk)) != sizeof(Chunk))
 		return -1;
 
 	if(Chunk&CHUNKTYPEFLAG_TICKMARKER)
@@ -350,7 +831,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		if(Tickdelta == 0)
 		{
 			unsigned char aTickData[4];
-			if(io_read(m_File, aTickData, sizeof(aTickData)) != sizeof(aTickData))
+			if(ReadData(aTickData, sizeof(aTickData)) != sizeof(aTickData))
 				return -1;
 			*pTick = bytes_be_to_uint(aTickData);
 		}
@@ -368,14 +849,14 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		if(*pSize == 30)
 		{
 			unsigned char aSizeData[1];
-			if(io_read(m_File, aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
+			if(ReadData(aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
 				return -1;
 			*pSize = aSizeData[0];
 		}
 		else if(*pSize == 31)
 		{
 			unsigned char aSizeData[2];
-			if(io_read(m_File, aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
+			if(ReadData(aSizeData, sizeof(aSizeData)) != sizeof(aSizeData))
 				return -1;
 			*pSize = (aSizeData[1]<<8) | aSizeData[0];
 		}
@@ -384,6 +865,75 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 	return 0;
 }
 
+bool CDemoPlayer::ReadIndex()
+{
+	long DataStart = io_tell(m_File);
+	long FileLength = io_length(m_File);
+	bool Found = false;
+
+	unsigned char aFooter[8];
+	if(FileLength-DataStart >= (long)sizeof(aFooter) && io_seek(m_File, FileLength-sizeof(aFooter), IOSEEK_START) == 0 &&
+		io_read(m_File, aFooter, sizeof(aFooter)) == sizeof(aFooter) &&
+		mem_comp(aFooter+4, gs_aIndexFooterMarker, sizeof(gs_aIndexFooterMarker)) == 0)
+	{
+		long IndexStart = bytes_be_to_uint(aFooter);
+		int IndexSize = (int)(FileLength-sizeof(aFooter)-IndexStart);
+		const int MinSize = sizeof(gs_aIndexMarker)+5*4;
+		if(IndexStart > DataStart && IndexSize >= MinSize && IndexSize <= CSnapshot::MAX_SIZE &&
+			io_seek(m_File, IndexStart, IOSEEK_START) == 0)
+		{
+			unsigned char *pIndex = (unsigned char *)mem_alloc(IndexSize, 1);
+			if(io_read(m_File, pIndex, IndexSize) == (unsigned)IndexSize &&
+				mem_comp(pIndex, gs_aIndexMarker, sizeof(gs_aIndexMarker)) == 0 &&
+				bytes_be_to_uint(pIndex+8) == (unsigned)gs_IndexVersion)
+			{
+				int FirstTick = bytes_be_to_uint(pIndex+12);
+				int LastTick = bytes_be_to_uint(pIndex+16);
+				int NumKeyFrames = bytes_be_to_uint(pIndex+20);
+				int Pos = 24;
+				if(NumKeyFrames > 0 && NumKeyFrames <= (IndexSize-Pos-4)/8)
+				{
+					// reject anything that doesn't point into the chunk data in order
+					Found = true;
+					m_pKeyFrames = (CKeyFrame*)mem_alloc(NumKeyFrames*sizeof(CKeyFrame), 1);
+					for(int i = 0; i < NumKeyFrames; i++, Pos += 8)
+					{
+						m_pKeyFrames[i].m_Tick = bytes_be_to_uint(pIndex+Pos);
+						m_pKeyFrames[i].m_Filepos = bytes_be_to_uint(pIndex+Pos+4);
+						if(m_pKeyFrames[i].m_Filepos < DataStart || m_pKeyFrames[i].m_Filepos >= IndexStart ||
+							(i > 0 && (m_pKeyFrames[i].m_Filepos <= m_pKeyFrames[i-1].m_Filepos || m_pKeyFrames[i].m_Tick < m_pKeyFrames[i-1].m_Tick)))
+							Found = false;
+					}
+
+					int NumMarkers = bytes_be_to_uint(pIndex+Pos);
+					Pos += 4;
+					if(NumMarkers < 0 || NumMarkers > MAX_TIMELINE_MARKERS || Pos+NumMarkers*4 > IndexSize)
+						Found = false;
+
+					if(Found)
+					{
+						m_Info.m_SeekablePoints = NumKeyFrames;
+						m_Info.m_Info.m_FirstTick = FirstTick;
+						m_Info.m_Info.m_LastTick = LastTick;
+						m_Info.m_Info.m_NumTimelineMarkers = NumMarkers;
+						for(int i = 0; i < NumMarkers; i++, Pos += 4)
+							m_Info.m_Info.m_aTimelineMarkers[i] = bytes_be_to_uint(pIndex+Pos);
+					}
+					else
+					{
+						mem_free(m_pKeyFrames);
+						m_pKeyFrames = 0;
+					}
+				}
+			}
+			mem_free(pIndex);
+		}
+	}
+
+	io_seek(m_File, DataStart, IOSEEK_START);
+	return Found;
+}
+
 void CDemoPlayer::ScanFile()
 {
 	CHeap Heap;
@@ -391,12 +941,12 @@ void CDemoPlayer::ScanFile()
 	CKeyFrameSearch *pCurrentKey = 0;
 	int ChunkTick = 0;
 
-	long StartPos = io_tell(m_File);
+	long StartPos = TellData();
 	m_Info.m_SeekablePoints = 0;
 
 	while(1)
 	{
-		long CurrentPos = io_tell(m_File);
+		long CurrentPos = TellData();
 
 		int ChunkSize, ChunkType;
 		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
@@ -425,7 +975,7 @@ void CDemoPlayer::ScanFile()
 			m_Info.m_Info.m_LastTick = ChunkTick;
 		}
 		else if(ChunkSize)
-			io_skip(m_File, ChunkSize);
+			SkipData(ChunkSize);
 	}
 
 	// copy all the frames to an array instead for fast access
@@ -435,15 +985,47 @@ void CDemoPlayer::ScanFile()
 		m_pKeyFrames[i] = pCurrentKey->m_Frame;
 
 	// destroy the temporary heap and seek back to the start
-	io_seek(m_File, StartPos, IOSEEK_START);
+	SeekData(StartPos);
+}
+
+const char *CDemoPlayer::ReadChunkData(int ChunkSize, int *pDataSize)
+{
+	if(ReadData(m_aCompressedData, ChunkSize) != (unsigned)ChunkSize)
+		return "error reading chunk";
+
+	int DataSize = m_Huffman.Decompress(m_aCompressedData, ChunkSize, m_aDecompressed, sizeof(m_aDecompressed));
+	if(DataSize < 0)
+		return "error during network decompression";
+
+	DataSize = CVariableInt::Decompress(m_aDecompressed, DataSize, m_aChunkData, sizeof(m_aChunkData));
+	if(DataSize < 0)
+		return "error during intpack decompression";
+
+	*pDataSize = DataSize;
+	return 0;
+}
+
+void CDemoPlayer::ApplySkippedDelta()
+{
+	// the skipped delta is the latest snapshot, decode it for ticks that repeat it
+	long Pos = TellData();
+	SeekData(m_SkippedDeltaPos);
+	int DataSize;
+	if(!ReadChunkData(m_SkippedDeltaSize, &DataSize) && m_KeyFrameSnapshotDataSize != -1)
+	{
+		DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aKeyFrameSnapshotData, (CSnapshot*)m_aNewSnap, m_aChunkData, DataSize);
+		if(DataSize >= 0)
+		{
+			m_LastSnapshotDataSize = DataSize;
+			mem_copy(m_aLastSnapshotData, m_aNewSnap, DataSize);
+		}
+	}
+	SeekData(Pos);
+	m_SkippedDeltaPos = -1;
 }
 
 void CDemoPlayer::DoTick()
 {
-	static char aCompressedData[CSnapshot::MAX_SIZE];
-	static char aDecompressed[CSnapshot::MAX_SIZE];
-	static char aData[CSnapshot::MAX_SIZE];
-	static char aNewSnap[CSnapshot::MAX_SIZE];
 	bool GotSnapshot = false;
 
 	// update ticks
@@ -469,30 +1051,28 @@ void CDemoPlayer::DoTick()
 			break;
 		}
 
+		// while seeking, deltas against the keyframe are only needed for the last ticks
+		if(ChunkType == CHUNKTYPE_DELTA && m_DeltaAgainstKeyFrame && m_Info.m_Info.m_CurrentTick < m_SkipDeltasBefore)
+		{
+			GotSnapshot = true;
+			m_SkippedDeltaPos = TellData();
+			m_SkippedDeltaSize = ChunkSize;
+			SkipData(ChunkSize);
+			continue;
+		}
+
+		// if there were no snapshots in this tick, decode the skipped one before the chunk buffers are reused
+		if(ChunkType != CHUNKTYPE_DELTA && ChunkType != CHUNKTYPE_SNAPSHOT && !GotSnapshot && m_SkippedDeltaPos != -1 && m_Info.m_Info.m_CurrentTick >= m_SkipDeltasBefore)
+			ApplySkippedDelta();
+
 		// read the chunk
 		if(ChunkSize)
 		{
-			if(io_read(m_File, aCompressedData, ChunkSize) != (unsigned)ChunkSize)
+			const char *pError = ReadChunkData(ChunkSize, &DataSize);
+			if(pError)
 			{
 				// stop on error or eof
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading chunk");
-				Stop();
-				break;
-			}
-
-			DataSize = m_Huffman.Decompress(aCompressedData, ChunkSize, aDecompressed, sizeof(aDecompressed));
-			if(DataSize < 0)
-			{
-				// stop on error or eof
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during network decompression");
-				Stop();
-				break;
-			}
-
-			DataSize = CVariableInt::Decompress(aDecompressed, DataSize, aData, sizeof(aData));
-			if(DataSize < 0)
-			{
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during intpack decompression");
+				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", pError);
 				Stop();
 				break;
 			}
@@ -502,19 +1082,21 @@ void CDemoPlayer::DoTick()
 		{
 			// process delta snapshot
 			GotSnapshot = true;
+			m_SkippedDeltaPos = -1;
 
 			// only unpack the delta if we have a valid snapshot
-			if(m_LastSnapshotDataSize == -1)
+			if((m_DeltaAgainstKeyFrame ? m_KeyFrameSnapshotDataSize : m_LastSnapshotDataSize) == -1)
 				continue;
 
-			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)aNewSnap, aData, DataSize);
+			const void *pDeltaBase = m_DeltaAgainstKeyFrame ? m_aKeyFrameSnapshotData : m_aLastSnapshotData;
+			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)pDeltaBase, (CSnapshot*)m_aNewSnap, m_aChunkData, DataSize);
 			if(DataSize >= 0)
 			{
 				if(m_pListener)
-					m_pListener->OnDemoPlayerSnapshot(aNewSnap, DataSize);
+					m_pListener->OnDemoPlayerSnapshot(m_aNewSnap, DataSize);
 
 				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewSnap, DataSize);
+				mem_copy(m_aLastSnapshotData, m_aNewSnap, DataSize);
 			}
 			else
 			{
@@ -528,18 +1110,24 @@ void CDemoPlayer::DoTick()
 			// process full snapshot
 			CSnapshotBuilder Builder;
 			GotSnapshot = true;
+			m_SkippedDeltaPos = -1;
 
-			if(Builder.UnserializeSnap(aData, DataSize))
-				DataSize = Builder.Finish(aNewSnap);
+			if(Builder.UnserializeSnap(m_aChunkData, DataSize))
+				DataSize = Builder.Finish(m_aNewSnap);
 			else
 				DataSize = -1;
 
 			if(DataSize >= 0)
 			{
 				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewSnap, DataSize);
+				mem_copy(m_aLastSnapshotData, m_aNewSnap, DataSize);
+				if(m_DeltaAgainstKeyFrame)
+				{
+					m_KeyFrameSnapshotDataSize = DataSize;
+					mem_copy(m_aKeyFrameSnapshotData, m_aNewSnap, DataSize);
+				}
 				if(m_pListener)
-					m_pListener->OnDemoPlayerSnapshot(aNewSnap, DataSize);
+					m_pListener->OnDemoPlayerSnapshot(m_aNewSnap, DataSize);
 			}
 			else
 			{
@@ -566,7 +1154,7 @@ void CDemoPlayer::DoTick()
 			else if(ChunkType == CHUNKTYPE_MESSAGE)
 			{
 				if(m_pListener)
-					m_pListener->OnDemoPlayerMessage(aData, DataSize);
+					m_pListener->OnDemoPlayerMessage(m_aChunkData, DataSize);
 			}
 		}
 	}
@@ -607,6 +1195,9 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 	m_Info.m_Info.m_Speed = 1;
 
 	m_LastSnapshotDataSize = -1;
+	m_KeyFrameSnapshotDataSize = -1;
+	m_SkipDeltasBefore = -1;
+	m_SkippedDeltaPos = -1;
 
 	// read the header
 	io_read(m_File, &m_Info.m_Header, sizeof(m_Info.m_Header));
@@ -619,7 +1210,7 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		return m_aErrorMsg;
 	}
 
-	if(m_Info.m_Header.m_Version != gs_ActVersion)
+	if(m_Info.m_Header.m_Version != gs_ActVersion && m_Info.m_Header.m_Version != gs_KeyFrameDeltaVersion)
 	{
 		str_format(m_aErrorMsg, sizeof(m_aErrorMsg), "demo version %d is not supported", m_Info.m_Header.m_Version);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", m_aErrorMsg);
@@ -627,6 +1218,7 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		m_File = 0;
 		return m_aErrorMsg;
 	}
+	m_DeltaAgainstKeyFrame = m_Info.m_Header.m_Version == gs_KeyFrameDeltaVersion;
 
 	if(str_comp(m_Info.m_Header.m_aNetversion, pNetversion) != 0)
 	{
@@ -668,8 +1260,11 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 
 		// save map
 		MapFile = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
-		io_write(MapFile, pMapData, MapSize);
-		io_close(MapFile);
+		if(MapFile)
+		{
+			io_write(MapFile, pMapData, MapSize);
+			io_close(MapFile);
+		}
 
 		// free data
 		mem_free(pMapData);
@@ -682,8 +1277,16 @@ const char *CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole
 		m_Info.m_Info.m_aTimelineMarkers[i] = bytes_be_to_uint(m_Info.m_Header.m_aTimelineMarkers[i]);
 	}
 
-	// scan the file for interesting points
-	ScanFile();
+	// use the seek index if the recorder left one
+	bool HasIndex = ReadIndex();
+
+	// the rest of the file is read sequentially, let the async i/o service keep the next block ready
+	if(m_pAsyncIO)
+		m_pReader = m_pAsyncIO->OpenReader(m_File, IAsyncIO::PRIORITY_HIGH);
+
+	// older demos have to be scanned for interesting points
+	if(!HasIndex)
+		ScanFile();
 
 	// ready for playback
 	return 0;
@@ -715,26 +1318,38 @@ int CDemoPlayer::SetPos(float Percent)
 	// -5 because we have to have a current tick and previous tick when we do the playback
 	int WantedTick = m_Info.m_Info.m_FirstTick + (int)((m_Info.m_Info.m_LastTick-m_Info.m_Info.m_FirstTick)*Percent) - 5;
 
-	int Keyframe = clamp((int)(m_Info.m_SeekablePoints*Percent), 0, m_Info.m_SeekablePoints-1);
-
-	// get correct key frame
-	if(m_pKeyFrames[Keyframe].m_Tick < WantedTick)
-		while(Keyframe < m_Info.m_SeekablePoints-1 && m_pKeyFrames[Keyframe].m_Tick < WantedTick)
-			Keyframe++;
+	if(m_Info.m_SeekablePoints <= 0)
+		return -1;
 
-	while(Keyframe && m_pKeyFrames[Keyframe].m_Tick > WantedTick)
-		Keyframe--;
+	// find the last keyframe at or before the wanted tick
+	int Keyframe = 0;
+	int Low = 0;
+	int High = m_Info.m_SeekablePoints-1;
+	while(Low <= High)
+	{
+		int Mid = (Low+High)/2;
+		if(m_pKeyFrames[Mid].m_Tick <= WantedTick)
+		{
+			Keyframe = Mid;
+			Low = Mid+1;
+		}
+		else
+			High = Mid-1;
+	}
 
 	// seek to the correct keyframe
-	io_seek(m_File, m_pKeyFrames[Keyframe].m_Filepos, IOSEEK_START);
+	SeekData(m_pKeyFrames[Keyframe].m_Filepos);
 
 	m_Info.m_NextTick = -1;
 	m_Info.m_Info.m_CurrentTick = -1;
 	m_Info.m_PreviousTick = -1;
 
 	// playback everything until we hit our tick
+	m_SkipDeltasBefore = WantedTick;
+	m_SkippedDeltaPos = -1;
 	while(m_Info.m_PreviousTick < WantedTick)
 		DoTick();
+	m_SkipDeltasBefore = -1;
 
 	Play();
 
@@ -746,10 +1361,10 @@ void CDemoPlayer::SetSpeed(float Speed)
 	m_Info.m_Info.m_Speed = Speed;
 }
 
-int CDemoPlayer::Update()
+int CDemoPlayer::Update(int64 TimeStep)
 {
 	int64 Now = time_get();
-	int64 Deltatime = Now-m_Info.m_LastUpdate;
+	int64 Deltatime = TimeStep > 0 ? TimeStep : Now-m_Info.m_LastUpdate;
 	m_Info.m_LastUpdate = Now;
 
 	if(!IsPlaying() || m_Info.m_Info.m_Paused)
@@ -799,7 +1414,14 @@ int CDemoPlayer::Stop()
 		return -1;
 
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "Stopped playback");
-	io_close(m_File);
+	if(m_pReader)
+	{
+		// the reader owns the file handle
+		m_pAsyncIO->CloseReader(m_pReader);
+		m_pReader = 0;
+	}
+	else
+		io_close(m_File);
 	m_File = 0;
 	mem_free(m_pKeyFrames);
 	m_pKeyFrames = 0;
@@ -836,7 +1458,8 @@ bool CDemoPlayer::GetDemoInfo(class IStorage *pStorage, const char *pFilename, i
 		return false;
 
 	io_read(File, pDemoHeader, sizeof(CDemoHeader));
-	bool Valid = mem_comp(pDemoHeader->m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) == 0 && pDemoHeader->m_Version == gs_ActVersion;
+	bool Valid = mem_comp(pDemoHeader->m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) == 0 &&
+		(pDemoHeader->m_Version == gs_ActVersion || pDemoHeader->m_Version == gs_KeyFrameDeltaVersion);
 	io_close(File);
 	return Valid;
 }
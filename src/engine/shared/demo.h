@@ -3,38 +3,156 @@
 #ifndef ENGINE_SHARED_DEMO_H
 #define ENGINE_SHARED_DEMO_H
 
+#include <base/tl/array.h>
+#include <base/tl/threading.h>
+
 #include <engine/demo.h>
 #include <engine/shared/protocol.h>
 
 #include "huffman.h"
+#include "ringbuffer.h"
 #include "snapshot.h"
 
 class CDemoRecorder : public IDemoRecorder
 {
+	enum
+	{
+		QUEUE_SIZE=1024*1024,
+		WRITE_BUFFER_SIZE=64*1024,
+
+		QUEUEITEM_SNAPSHOT=0,
+		QUEUEITEM_MESSAGE,
+		QUEUEITEM_SAVE_REPLAY,
+
+		MAX_INDEX_KEYFRAMES=8000,
+		DEFAULT_KEYFRAME_INTERVAL=SERVER_TICK_SPEED*5,
+	};
+
+	struct CQueueItem
+	{
+		int m_Type;
+		int m_Tick;
+		int m_Size;
+	};
+
+	struct CIndexEntry
+	{
+		int m_Tick;
+		int m_Filepos;
+	};
+
+	struct CReplaySegment
+	{
+		int m_Tick;
+		int64 m_Start;
+	};
+
 	class IConsole *m_pConsole;
-	CHuffman m_Huffman;
 	IOHANDLE m_File;
 	int m_LastTickMarker;
-	int m_LastKeyFrame;
 	int m_FirstTick;
-	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
-	class CSnapshotDelta *m_pSnapshotDelta;
 	int m_NumTimelineMarkers;
 	int m_aTimelineMarkers[MAX_TIMELINE_MARKERS];
+	int m_NumDroppedSnapshots;
+	int m_KeyFrameInterval;
+	bool m_DeltaAgainstKeyFrame;
+	bool m_WaitForWriter;
+
+	/*
+		Snapshots and messages are copied into the queue and compressed
+		and written by the writer thread. When the queue is full,
+		snapshots are dropped (playback repeats the previous one) while
+		messages wait for space, as they can't be recovered.
+	*/
+	LOCK m_QueueLock;
+	TStaticRingBuffer<CQueueItem, QUEUE_SIZE> m_Queue;
+	void *m_pWriterThread;
+	bool m_StopWriter;
+	bool m_WaitingForSpace;
+	semaphore m_QueueActivity; // signalled once per queued item and on stop
+	semaphore m_QueueSpace; // signalled when an item is taken while Enqueue waits
+
+	// owned by the writer thread while recording
+	CHuffman m_Huffman;
+	IOHANDLE m_WriterFile;
+	IOHANDLE m_MapFile;
+	int m_WriterLastTickMarker;
+	int m_LastKeyFrame;
+	int m_NumWriteErrors;
+	int m_WriterFilePos;
+	array<CIndexEntry> m_lKeyFrames;
+	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
+	int m_LastSnapshotSize;
+	unsigned char m_aKeyFrameSnapshotData[CSnapshot::MAX_SIZE];
+	class CSnapshotDelta *m_pSnapshotDelta;
+	char m_aItemData[CSnapshot::MAX_SIZE];
+	char m_aTmpData[CSnapshot::MAX_SIZE];
+	char m_aCompressBuffer[2][CSnapshot::MAX_SIZE];
+	unsigned char m_aWriteBuffer[WRITE_BUFFER_SIZE];
+	int m_WriteBufferSize;
+
+	/*
+		Replay mode keeps the compressed chunks in memory instead of
+		writing them. The buffer is split into segments that start at a
+		keyframe, and the oldest segments are dropped to make room, so a
+		saved replay always starts with a keyframe.
+	*/
+	CDemoHeader m_ReplayHeader;
+	unsigned char *m_pReplayData;
+	int m_ReplaySize;
+	int64 m_ReplayStart;
+	int64 m_ReplayEnd;
+	array<CReplaySegment> m_lReplaySegments;
+
+	static void WriterThread(void *pUser);
+	bool Enqueue(int Type, int Tick, const void *pData, int Size, bool Wait);
 
+	IOHANDLE OpenMapFile(class IStorage *pStorage, const char *pMap, SHA256_DIGEST Sha256, unsigned Crc);
+	void InitHeader(CDemoHeader *pHeader, const char *pNetVersion, const char *pMap, unsigned MapSize, unsigned Crc, const char *pType);
+	void WriteMapData();
+	void WriteReplayData(const void *pData, int Size);
+	void WriteReplay(IOHANDLE File);
+
+	void ProcessSnapshot(int Tick, const void *pData, int Size);
 	void WriteTickMarker(int Tick, int Keyframe);
+	int Compress(const void *pData, int Size);
+	void WriteChunkHeader(int Type, int Size);
 	void Write(int Type, const void *pData, int Size);
+	void WriteData(const void *pData, int Size);
+	void FlushWriteBuffer();
+	void WriteIndex();
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
+	~CDemoRecorder();
 
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, SHA256_DIGEST MapSha256, unsigned MapCrc, const char *pType);
 	int Stop();
 	void AddDemoMarker();
 
+	/*
+		Records into a ring buffer of BufferSize bytes instead of a
+		file. SaveReplay() writes what the buffer holds to a demo,
+		the file is written by the writer thread.
+	*/
+	int StartReplay(class IStorage *pStorage, class IConsole *pConsole, const char *pNetversion, const char *pMap, SHA256_DIGEST MapSha256, unsigned MapCrc, const char *pType, int BufferSize);
+	int SaveReplay(class IStorage *pStorage, const char *pFilename);
+
+	/*
+		Takes effect on the next Start(). Denser keyframes make seeking
+		cheaper at the cost of file size. Deltas against the keyframe
+		instead of the previous snapshot are a bit larger, but let the
+		player skip straight to a tick and limit a corrupted chunk to
+		its own tick. Such demos can't be played by older clients.
+	*/
+	void SetKeyFrameMode(int Interval, bool DeltaAgainstKeyFrame);
+	// for offline conversions, wait for the writer instead of dropping snapshots
+	void SetWaitForWriter(bool Wait) { m_WaitForWriter = Wait; }
+
 	void RecordSnapshot(int Tick, const void *pData, int Size);
 	void RecordMessage(const void *pData, int Size);
 
-	bool IsRecording() const { return m_File != 0; }
+	bool IsRecording() const { return m_File != 0 || m_pReplayData != 0; }
+	bool IsReplay() const { return m_pReplayData != 0; }
 
 	int Length() const { return (m_LastTickMarker - m_FirstTick)/SERVER_TICK_SPEED; }
 };
@@ -86,6 +204,8 @@ private:
 	};
 
 	class IConsole *m_pConsole;
+	class IAsyncIO *m_pAsyncIO;
+	class IAsyncFileReader *m_pReader;
 	CHuffman m_Huffman;
 	IOHANDLE m_File;
 	char m_aFilename[256];
@@ -96,18 +216,36 @@ private:
 	int m_DemoType;
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	int m_LastSnapshotDataSize;
+	unsigned char m_aKeyFrameSnapshotData[CSnapshot::MAX_SIZE];
+	int m_KeyFrameSnapshotDataSize;
+	bool m_DeltaAgainstKeyFrame;
+	int m_SkipDeltasBefore;
+	long m_SkippedDeltaPos;
+	int m_SkippedDeltaSize;
 	class CSnapshotDelta *m_pSnapshotDelta;
+	char m_aCompressedData[CSnapshot::MAX_SIZE];
+	char m_aDecompressed[CSnapshot::MAX_SIZE];
+	char m_aChunkData[CSnapshot::MAX_SIZE];
+	char m_aNewSnap[CSnapshot::MAX_SIZE];
+
+	unsigned ReadData(void *pBuffer, unsigned Size);
+	void SkipData(int Size);
+	void SeekData(long Offset);
+	long TellData();
 
 	int ReadChunkHeader(int *pType, int *pSize, int *pTick);
+	const char *ReadChunkData(int ChunkSize, int *pDataSize);
+	void ApplySkippedDelta();
 	void DoTick();
+	bool ReadIndex();
 	void ScanFile();
-	int NextFrame();
 
 public:
 
 	CDemoPlayer(class CSnapshotDelta *m_pSnapshotDelta);
 
 	void SetListener(IListener *pListner);
+	void SetAsyncIO(class IAsyncIO *pAsyncIO) { m_pAsyncIO = pAsyncIO; }
 
 	const char *Load(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, int StorageType, const char *pNetversion);
 	int Play();
@@ -121,9 +259,13 @@ public:
 	bool GetDemoInfo(class IStorage *pStorage, const char *pFilename, int StorageType, CDemoHeader *pDemoHeader) const;
 	int GetDemoType() const;
 
-	int Update();
+	// advances playback by the time since the last update, or by a fixed time step if one is given
+	int Update(int64 TimeStep = 0);
+	// advances playback by one tick regardless of the playback time
+	int NextFrame();
 
 	const CPlaybackInfo *Info() const { return &m_Info; }
+	bool DeltaAgainstKeyFrame() const { return m_DeltaAgainstKeyFrame; }
 	int IsPlaying() const { return m_File != 0; }
 };
 
@@ -0,0 +1,198 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include <engine/storage.h>
+
+#include "demoinfocache.h"
+
+struct CDemoInfoCacheHeader
+{
+	char m_aID[8];
+	int m_Version;
+	int m_EntrySize;
+	int m_NumEntries;
+};
+
+static const char s_aCacheID[8] = "TWDINFO";
+
+static void DateToBytes(unsigned char *pBytes, int64 Date)
+{
+	uint_to_bytes_be(pBytes, (unsigned)(Date>>32));
+	uint_to_bytes_be(pBytes+4, (unsigned)Date);
+}
+
+static int64 BytesToDate(const unsigned char *pBytes)
+{
+	return ((int64)bytes_be_to_uint(pBytes)<<32) | bytes_be_to_uint(pBytes+4);
+}
+
+CDemoInfoCache::CDemoInfoCache()
+{
+	Clear();
+}
+
+void CDemoInfoCache::Clear()
+{
+	m_lEntries.clear();
+	for(int i = 0; i < HASH_SIZE; i++)
+		m_aHashTable[i] = -1;
+	m_Changed = false;
+	m_Scan = 0;
+}
+
+unsigned CDemoInfoCache::Hash(const char *pPath, int StorageType)
+{
+	return (str_quickhash(pPath)+StorageType)%HASH_SIZE;
+}
+
+CDemoInfoCache::CEntry *CDemoInfoCache::Find(const char *pPath, int StorageType)
+{
+	for(int i = m_aHashTable[Hash(pPath, StorageType)]; i >= 0; i = m_lEntries[i].m_NextInHash)
+	{
+		if(m_lEntries[i].m_Data.m_StorageType == StorageType && str_comp(m_lEntries[i].m_Data.m_aPath, pPath) == 0)
+			return &m_lEntries[i];
+	}
+	return 0;
+}
+
+void CDemoInfoCache::AddEntry(const CEntry *pEntry)
+{
+	unsigned Key = Hash(pEntry->m_Data.m_aPath, pEntry->m_Data.m_StorageType);
+	int Index = m_lEntries.add(*pEntry);
+	m_lEntries[Index].m_NextInHash = m_aHashTable[Key];
+	m_aHashTable[Key] = Index;
+}
+
+bool CDemoInfoCache::Load(IStorage *pStorage, const char *pFilename)
+{
+	Clear();
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	// the entries are stored raw, so only accept caches with the same layout
+	CDemoInfoCacheHeader Header;
+	int FileSize = (int)io_length(File);
+	if(io_read(File, &Header, sizeof(Header)) != sizeof(Header) || mem_comp(Header.m_aID, s_aCacheID, sizeof(s_aCacheID)) != 0 ||
+		Header.m_Version != VERSION || Header.m_EntrySize != (int)sizeof(CEntryData) ||
+		Header.m_NumEntries < 0 || Header.m_NumEntries > (FileSize-(int)sizeof(Header))/(int)sizeof(CEntryData))
+	{
+		io_close(File);
+		return false;
+	}
+
+	CEntryData *pData = (CEntryData *)mem_alloc(max(Header.m_NumEntries, 1)*sizeof(CEntryData), 1);
+	bool Valid = io_read(File, pData, Header.m_NumEntries*sizeof(CEntryData)) == Header.m_NumEntries*sizeof(CEntryData);
+	io_close(File);
+
+	for(int i = 0; Valid && i < Header.m_NumEntries; i++)
+	{
+		pData[i].m_aPath[sizeof(pData[i].m_aPath)-1] = 0;
+		CDemoHeader *pHeader = &pData[i].m_Header;
+		pHeader->m_aNetversion[sizeof(pHeader->m_aNetversion)-1] = 0;
+		pHeader->m_aMapName[sizeof(pHeader->m_aMapName)-1] = 0;
+		pHeader->m_aType[sizeof(pHeader->m_aType)-1] = 0;
+		pHeader->m_aTimestamp[sizeof(pHeader->m_aTimestamp)-1] = 0;
+		if(Find(pData[i].m_aPath, pData[i].m_StorageType))
+			continue;
+
+		CEntry Entry;
+		Entry.m_Data = pData[i];
+		Entry.m_Date = BytesToDate(pData[i].m_aDate);
+		Entry.m_Scan = m_Scan;
+		AddEntry(&Entry);
+	}
+	mem_free(pData);
+
+	if(!Valid)
+		Clear();
+	return Valid;
+}
+
+bool CDemoInfoCache::Save(IStorage *pStorage, const char *pFilename)
+{
+	// a failed save is retried with the next change, not right away
+	m_Changed = false;
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	CDemoInfoCacheHeader Header;
+	mem_zero(&Header, sizeof(Header));
+	mem_copy(Header.m_aID, s_aCacheID, sizeof(s_aCacheID));
+	Header.m_Version = VERSION;
+	Header.m_EntrySize = sizeof(CEntryData);
+	Header.m_NumEntries = m_lEntries.size();
+	io_write(File, &Header, sizeof(Header));
+	for(int i = 0; i < m_lEntries.size(); i++)
+		io_write(File, &m_lEntries[i].m_Data, sizeof(CEntryData));
+	io_close(File);
+	return true;
+}
+
+void CDemoInfoCache::BeginScan()
+{
+	m_Scan++;
+}
+
+void CDemoInfoCache::EndScan(const char *pFolder)
+{
+	// rebuild the table without the demos that are gone from the folder
+	array<CEntry> lEntries = m_lEntries;
+	m_lEntries.clear();
+	for(int i = 0; i < HASH_SIZE; i++)
+		m_aHashTable[i] = -1;
+
+	int FolderLength = str_length(pFolder);
+	for(int i = 0; i < lEntries.size(); i++)
+	{
+		const char *pPath = lEntries[i].m_Data.m_aPath;
+		bool InFolder = str_comp_num(pPath, pFolder, FolderLength) == 0 && pPath[FolderLength] == '/' && !str_find(pPath+FolderLength+1, "/");
+		if(InFolder && lEntries[i].m_Scan != m_Scan)
+			m_Changed = true;
+		else
+			AddEntry(&lEntries[i]);
+	}
+}
+
+bool CDemoInfoCache::Get(const char *pPath, int StorageType, time_t Date, CDemoHeader *pHeader, bool *pValid)
+{
+	CEntry *pEntry = Find(pPath, StorageType);
+	if(!pEntry)
+		return false;
+	pEntry->m_Scan = m_Scan;
+	if(pEntry->m_Date != (int64)Date)
+		return false;
+
+	*pHeader = pEntry->m_Data.m_Header;
+	*pValid = pEntry->m_Data.m_Valid != 0;
+	return true;
+}
+
+void CDemoInfoCache::Set(const char *pPath, int StorageType, time_t Date, const CDemoHeader *pHeader, bool Valid)
+{
+	if(str_length(pPath) >= MAX_PATH_LENGTH)
+		return;
+
+	CEntry *pEntry = Find(pPath, StorageType);
+	if(!pEntry)
+	{
+		CEntry Entry;
+		mem_zero(&Entry.m_Data, sizeof(Entry.m_Data));
+		str_copy(Entry.m_Data.m_aPath, pPath, sizeof(Entry.m_Data.m_aPath));
+		Entry.m_Data.m_StorageType = StorageType;
+		AddEntry(&Entry);
+		pEntry = &m_lEntries[m_lEntries.size()-1];
+	}
+
+	pEntry->m_Scan = m_Scan;
+	pEntry->m_Date = Date;
+	DateToBytes(pEntry->m_Data.m_aDate, Date);
+	pEntry->m_Data.m_Valid = Valid;
+	if(Valid)
+		pEntry->m_Data.m_Header = *pHeader;
+	else
+		mem_zero(&pEntry->m_Data.m_Header, sizeof(pEntry->m_Data.m_Header));
+	m_Changed = true;
+}
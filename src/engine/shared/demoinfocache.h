@@ -0,0 +1,72 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_DEMOINFOCACHE_H
+#define ENGINE_SHARED_DEMOINFOCACHE_H
+
+#include <base/system.h>
+#include <base/tl/array.h>
+
+#include <engine/demo.h>
+
+/*
+	Keeps the headers of demos that were already read, so listing a demo
+	folder doesn't have to open every file again. Entries are keyed by
+	path and storage type and are only used while the modification date
+	of the file stays the same. The header includes the timeline markers.
+*/
+class CDemoInfoCache
+{
+	enum
+	{
+		VERSION=1,
+		MAX_PATH_LENGTH=256,
+		HASH_SIZE=1024,
+	};
+
+	// stored as is in the cache file
+	struct CEntryData
+	{
+		char m_aPath[MAX_PATH_LENGTH];
+		int m_StorageType;
+		int m_Valid;
+		unsigned char m_aDate[8];
+		CDemoHeader m_Header;
+	};
+
+	struct CEntry
+	{
+		CEntryData m_Data;
+		int64 m_Date;
+		int m_NextInHash;
+		int m_Scan;
+	};
+
+	array<CEntry> m_lEntries;
+	int m_aHashTable[HASH_SIZE];
+	bool m_Changed;
+	int m_Scan;
+
+	static unsigned Hash(const char *pPath, int StorageType);
+	CEntry *Find(const char *pPath, int StorageType);
+	void AddEntry(const CEntry *pEntry);
+
+public:
+	CDemoInfoCache();
+
+	void Clear();
+	bool Load(class IStorage *pStorage, const char *pFilename);
+	bool Save(class IStorage *pStorage, const char *pFilename);
+
+	// entries of demos in the folder that were not looked up since BeginScan() are dropped by EndScan()
+	void BeginScan();
+	void EndScan(const char *pFolder);
+
+	// returns false if the demo isn't cached or changed since
+	bool Get(const char *pPath, int StorageType, time_t Date, CDemoHeader *pHeader, bool *pValid);
+	void Set(const char *pPath, int StorageType, time_t Date, const CDemoHeader *pHeader, bool Valid);
+
+	int Num() const { return m_lEntries.size(); }
+	bool Changed() const { return m_Changed; }
+};
+
+#endif
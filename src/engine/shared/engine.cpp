@@ -48,7 +48,7 @@ public:
 		}
 	}
 
-	CEngine(const char *pAppname)
+	CEngine(const char *pAppname, int NumJobThreads)
 	{
 		srand(time_get());
 		dbg_logger_stdout();
@@ -64,8 +64,7 @@ public:
 		dbg_msg("engine", "unknown endian");
 	#endif
 
-		
-		m_JobPool.Init(1);
+		m_JobPool.Init(NumJobThreads);
 
 		m_DataLogSent = 0;
 		m_DataLogRecv = 0;
@@ -167,6 +166,11 @@ public:
 			dbg_msg("engine", "job added");
 		m_JobPool.Add(pJob, pfnFunc, pData);
 	}
+
+	void WaitJob(CJob *pJob)
+	{
+		m_JobPool.Wait(pJob);
+	}
 };
 
-IEngine *CreateEngine(const char *pAppname) { return new CEngine(pAppname); }
+IEngine *CreateEngine(const char *pAppname, int NumJobThreads) { return new CEngine(pAppname, NumJobThreads); }
@@ -1,6 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
+#include <base/tl/threading.h>
 #include "jobs.h"
 
 CJobPool::CJobPool()
@@ -50,7 +51,16 @@ void CJobPool::WorkerThread(void *pUser)
 		{
 			pJob->m_Status = CJob::STATE_RUNNING;
 			pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
+
+			// under the lock, so a waiter either sees the job done or gets signalled
+			lock_wait(pPool->m_Lock);
 			pJob->m_Status = CJob::STATE_DONE;
+			if(pJob->m_pDone)
+			{
+				pJob->m_pDone->signal();
+				pJob->m_pDone = 0;
+			}
+			lock_unlock(pPool->m_Lock);
 		}
 		else
 			thread_sleep(10);
@@ -69,13 +79,16 @@ int CJobPool::Init(int NumThreads)
 
 int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
 {
-	mem_zero(pJob, sizeof(CJob));
 	pJob->m_pfnFunc = pfnFunc;
 	pJob->m_pFuncData = pData;
+	pJob->m_pNext = 0;
+	pJob->m_Result = 0;
+	pJob->m_pDone = 0;
 
 	lock_wait(m_Lock);
 
 	// add job to queue
+	pJob->m_Status = CJob::STATE_PENDING;
 	pJob->m_pPrev = m_pLastJob;
 	if(m_pLastJob)
 		m_pLastJob->m_pNext = pJob;
@@ -87,3 +100,21 @@ int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
 	return 0;
 }
 
+void CJobPool::Wait(CJob *pJob)
+{
+	semaphore Done;
+	lock_wait(m_Lock);
+	if(pJob->m_Status == CJob::STATE_DONE)
+	{
+		lock_unlock(m_Lock);
+		return;
+	}
+	pJob->m_pDone = &Done;
+	lock_unlock(m_Lock);
+	Done.wait();
+
+	// the worker signals under the lock, let it finish before the semaphore goes away
+	lock_wait(m_Lock);
+	lock_unlock(m_Lock);
+}
+
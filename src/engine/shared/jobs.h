@@ -5,6 +5,7 @@
 typedef int (*JOBFUNC)(void *pData);
 
 class CJobPool;
+class semaphore;
 
 class CJob
 {
@@ -18,11 +19,15 @@ class CJob
 
 	JOBFUNC m_pfnFunc;
 	void *m_pFuncData;
+
+	// set by the thread waiting for the job
+	semaphore *m_pDone;
 public:
 	CJob()
 	{
 		m_Status = STATE_DONE;
 		m_pFuncData = 0;
+		m_pDone = 0;
 	}
 
 	enum
@@ -58,5 +63,8 @@ public:
 
 	int Init(int NumThreads);
 	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData);
+
+	// blocks until the job is done, only one thread may wait for a job
+	void Wait(CJob *pJob);
 };
 #endif
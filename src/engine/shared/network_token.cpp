@@ -171,19 +171,28 @@ void CNetTokenCache::SendPacketConnless(const NETADDR *pAddr, const void *pData,
 	}
 	else
 	{
-		FetchToken(pAddr);
-
-		// store the packet for future sending
+		// store the packet for future sending, packets to the same address share one token request
+		int64 Now = time_get();
+		int64 LastTokenRequest = 0;
 		CConnlessPacketInfo **ppInfo = &m_pConnlessPacketList;
 		while(*ppInfo)
+		{
+			if(!LastTokenRequest && net_addr_comp(&(*ppInfo)->m_Addr, pAddr) == 0)
+				LastTokenRequest = (*ppInfo)->m_LastTokenRequest;
 			ppInfo = &(*ppInfo)->m_pNext;
+		}
+		if(!LastTokenRequest)
+		{
+			FetchToken(pAddr);
+			LastTokenRequest = Now;
+		}
+
 		*ppInfo = new CConnlessPacketInfo();
 		mem_copy((*ppInfo)->m_aData, pData, DataSize);
 		(*ppInfo)->m_Addr = *pAddr;
 		(*ppInfo)->m_DataSize = DataSize;
-		int64 Now = time_get();
 		(*ppInfo)->m_Expiry = Now + time_freq() * NET_TOKENCACHE_PACKETEXPIRY;
-		(*ppInfo)->m_LastTokenRequest = Now;
+		(*ppInfo)->m_LastTokenRequest = LastTokenRequest;
 		(*ppInfo)->m_pNext = 0;
 		if(pCallbackData)
 		{
@@ -312,8 +321,13 @@ void CNetTokenCache::Update()
 	{
 		if(pEntry->m_LastTokenRequest + 2*time_freq() <= Now)
 		{
+			// one request covers all packets waiting for this address
+			for(CConnlessPacketInfo *pOther = pEntry; pOther; pOther = pOther->m_pNext)
+			{
+				if(net_addr_comp(&pOther->m_Addr, &pEntry->m_Addr) == 0)
+					pOther->m_LastTokenRequest = Now;
+			}
 			FetchToken(&pEntry->m_Addr);
-			pEntry->m_LastTokenRequest = Now;
 		}
 		pEntry = pEntry->m_pNext;
 	}
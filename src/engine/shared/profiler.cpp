@@ -0,0 +1,221 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include "jsonwriter.h"
+#include "profiler.h"
+
+CProfiler::CProfiler()
+{
+	m_NumScopes = 0;
+	m_NumCounters = 0;
+	mem_zero(m_aFrameHistory, sizeof(m_aFrameHistory));
+	m_HistoryPos = 0;
+	m_NumFrames = 0;
+	m_FrameStart = 0;
+	m_Enabled = false;
+	m_TotalFrames = 0;
+	m_TotalFrameTime = 0;
+	m_pTrace = 0;
+	m_TraceStart = 0;
+	m_TraceFrames = 0;
+}
+
+CProfiler::~CProfiler()
+{
+	StopTrace();
+}
+
+int CProfiler::AddScope(const char *pName, const char *pCategory)
+{
+	dbg_assert(m_NumScopes < MAX_SCOPES, "too many profiler scopes");
+	CScope *pScope = &m_aScopes[m_NumScopes];
+	str_copy(pScope->m_aName, pName, sizeof(pScope->m_aName));
+	str_copy(pScope->m_aCategory, pCategory, sizeof(pScope->m_aCategory));
+	pScope->m_Time = 0;
+	mem_zero(pScope->m_aHistory, sizeof(pScope->m_aHistory));
+	pScope->m_TotalTime = 0;
+	pScope->m_TotalMax = 0;
+	return m_NumScopes++;
+}
+
+int CProfiler::AddCounter(const char *pName)
+{
+	dbg_assert(m_NumCounters < MAX_COUNTERS, "too many profiler counters");
+	CCounter *pCounter = &m_aCounters[m_NumCounters];
+	str_copy(pCounter->m_aName, pName, sizeof(pCounter->m_aName));
+	pCounter->m_Value = 0;
+	mem_zero(pCounter->m_aHistory, sizeof(pCounter->m_aHistory));
+	pCounter->m_Total = 0;
+	return m_NumCounters++;
+}
+
+void CProfiler::SetEnabled(bool Enabled)
+{
+	if(Enabled == m_Enabled)
+		return;
+
+	// the history would have a gap otherwise
+	m_Enabled = Enabled;
+	m_NumFrames = 0;
+	m_FrameStart = 0;
+}
+
+void CProfiler::AddTime(int Scope, int64 Start, int64 End)
+{
+	m_aScopes[Scope].m_Time += End-Start;
+	if(m_pTrace)
+		WriteTraceEvent(m_aScopes[Scope].m_aName, m_aScopes[Scope].m_aCategory, Start, End);
+}
+
+void CProfiler::NextFrame()
+{
+	if(!Active())
+		return;
+
+	int64 Now = time_get();
+	if(m_FrameStart)
+	{
+		m_aFrameHistory[m_HistoryPos] = Now-m_FrameStart;
+		for(int i = 0; i < m_NumScopes; i++)
+		{
+			CScope *pScope = &m_aScopes[i];
+			pScope->m_aHistory[m_HistoryPos] = pScope->m_Time;
+			pScope->m_TotalTime += pScope->m_Time;
+			pScope->m_TotalMax = max(pScope->m_TotalMax, pScope->m_Time);
+		}
+		for(int i = 0; i < m_NumCounters; i++)
+		{
+			m_aCounters[i].m_aHistory[m_HistoryPos] = m_aCounters[i].m_Value;
+			m_aCounters[i].m_Total += m_aCounters[i].m_Value;
+		}
+		m_TotalFrames++;
+		m_TotalFrameTime += Now-m_FrameStart;
+		m_HistoryPos = (m_HistoryPos+1)%HISTORY_SIZE;
+		m_NumFrames = min(m_NumFrames+1, (int)HISTORY_SIZE);
+
+		if(m_pTrace)
+		{
+			WriteTraceEvent("frame", "frame", m_FrameStart, Now);
+			WriteTraceCounters(Now);
+			if(--m_TraceFrames <= 0)
+				StopTrace();
+		}
+	}
+
+	for(int i = 0; i < m_NumScopes; i++)
+		m_aScopes[i].m_Time = 0;
+	m_FrameStart = Now;
+}
+
+void CProfiler::StartTrace(IOHANDLE File, int Frames)
+{
+	StopTrace();
+
+	m_pTrace = new CJsonWriter(File);
+	m_pTrace->BeginObject();
+	m_pTrace->WriteAttribute("displayTimeUnit");
+	m_pTrace->WriteStrValue("ms");
+	m_pTrace->WriteAttribute("traceEvents");
+	m_pTrace->BeginArray();
+	m_TraceStart = time_get();
+	m_TraceFrames = Frames;
+
+	// the current frame is incomplete
+	m_FrameStart = 0;
+}
+
+void CProfiler::StopTrace()
+{
+	if(!m_pTrace)
+		return;
+
+	m_pTrace->EndArray();
+	m_pTrace->EndObject();
+	delete m_pTrace;
+	m_pTrace = 0;
+	m_TraceFrames = 0;
+}
+
+int CProfiler::TraceTime(int64 Time) const
+{
+	// microseconds since the start of the trace
+	return (int)((Time-m_TraceStart)*1000000/time_freq());
+}
+
+void CProfiler::WriteTraceEvent(const char *pName, const char *pCategory, int64 Start, int64 End)
+{
+	m_pTrace->BeginObject();
+	m_pTrace->WriteAttribute("name");
+	m_pTrace->WriteStrValue(pName);
+	m_pTrace->WriteAttribute("cat");
+	m_pTrace->WriteStrValue(pCategory);
+	m_pTrace->WriteAttribute("ph");
+	m_pTrace->WriteStrValue("X");
+	m_pTrace->WriteAttribute("ts");
+	m_pTrace->WriteIntValue(TraceTime(Start));
+	m_pTrace->WriteAttribute("dur");
+	m_pTrace->WriteIntValue(TraceTime(End)-TraceTime(Start));
+	m_pTrace->WriteAttribute("pid");
+	m_pTrace->WriteIntValue(0);
+	m_pTrace->WriteAttribute("tid");
+	m_pTrace->WriteIntValue(0);
+	m_pTrace->EndObject();
+}
+
+void CProfiler::WriteTraceCounters(int64 Time)
+{
+	if(!m_NumCounters)
+		return;
+
+	m_pTrace->BeginObject();
+	m_pTrace->WriteAttribute("name");
+	m_pTrace->WriteStrValue("counters");
+	m_pTrace->WriteAttribute("ph");
+	m_pTrace->WriteStrValue("C");
+	m_pTrace->WriteAttribute("ts");
+	m_pTrace->WriteIntValue(TraceTime(Time));
+	m_pTrace->WriteAttribute("pid");
+	m_pTrace->WriteIntValue(0);
+	m_pTrace->WriteAttribute("args");
+	m_pTrace->BeginObject();
+	for(int i = 0; i < m_NumCounters; i++)
+	{
+		m_pTrace->WriteAttribute(m_aCounters[i].m_aName);
+		m_pTrace->WriteIntValue(m_aCounters[i].m_Value);
+	}
+	m_pTrace->EndObject();
+	m_pTrace->EndObject();
+}
+
+void CProfiler::ResetTotals()
+{
+	m_TotalFrames = 0;
+	m_TotalFrameTime = 0;
+	for(int i = 0; i < m_NumScopes; i++)
+	{
+		m_aScopes[i].m_TotalTime = 0;
+		m_aScopes[i].m_TotalMax = 0;
+	}
+	for(int i = 0; i < m_NumCounters; i++)
+		m_aCounters[i].m_Total = 0;
+}
+
+int64 CProfiler::ScopeAverage(int Scope) const
+{
+	if(!m_NumFrames)
+		return 0;
+
+	int64 Sum = 0;
+	for(int i = 0; i < m_NumFrames; i++)
+		Sum += ScopeTime(Scope, i);
+	return Sum/m_NumFrames;
+}
+
+int64 CProfiler::ScopeMax(int Scope) const
+{
+	int64 Max = 0;
+	for(int i = 0; i < m_NumFrames; i++)
+		Max = max(Max, ScopeTime(Scope, i));
+	return Max;
+}
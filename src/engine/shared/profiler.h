@@ -0,0 +1,132 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_PROFILER_H
+#define ENGINE_SHARED_PROFILER_H
+
+#include <base/system.h>
+
+/*
+	Sums up the time spent in named scopes and a few counters per frame.
+	The last frames are kept for graphs, longer runs like benchmarks are
+	summed up since the last ResetTotals(). The following frames can also be
+	written to a Chrome trace file (chrome://tracing) to look at single
+	spikes. Nothing is measured while the profiler is neither enabled nor
+	tracing.
+*/
+class CProfiler
+{
+public:
+	enum
+	{
+		MAX_SCOPES=128,
+		MAX_COUNTERS=8,
+		HISTORY_SIZE=128,
+	};
+
+	// measures its own lifetime
+	class CScopeTimer
+	{
+		CProfiler *m_pProfiler;
+		int m_Scope;
+		int64 m_Start;
+
+	public:
+		CScopeTimer(CProfiler *pProfiler, int Scope)
+		{
+			m_pProfiler = pProfiler;
+			m_Scope = Scope;
+			m_Start = pProfiler->Active() ? time_get() : 0;
+		}
+		~CScopeTimer()
+		{
+			if(m_Start)
+				m_pProfiler->AddTime(m_Scope, m_Start, time_get());
+		}
+	};
+
+private:
+	struct CScope
+	{
+		char m_aName[32];
+		char m_aCategory[16];
+		int64 m_Time;
+		int64 m_aHistory[HISTORY_SIZE];
+		int64 m_TotalTime;
+		int64 m_TotalMax;
+	};
+
+	struct CCounter
+	{
+		char m_aName[32];
+		int m_Value;
+		int m_aHistory[HISTORY_SIZE];
+		int64 m_Total;
+	};
+
+	CScope m_aScopes[MAX_SCOPES];
+	int m_NumScopes;
+	CCounter m_aCounters[MAX_COUNTERS];
+	int m_NumCounters;
+
+	int64 m_aFrameHistory[HISTORY_SIZE];
+	int m_HistoryPos;
+	int m_NumFrames;
+	int64 m_FrameStart;
+	bool m_Enabled;
+	int m_TotalFrames;
+	int64 m_TotalFrameTime;
+
+	class CJsonWriter *m_pTrace;
+	int64 m_TraceStart;
+	int m_TraceFrames;
+
+	int TraceTime(int64 Time) const;
+	void WriteTraceEvent(const char *pName, const char *pCategory, int64 Start, int64 End);
+	void WriteTraceCounters(int64 Time);
+	int HistoryIndex(int FramesAgo) const { return (m_HistoryPos-1-FramesAgo+HISTORY_SIZE*2)%HISTORY_SIZE; }
+
+public:
+	CProfiler();
+	~CProfiler();
+
+	// scopes and counters live as long as the profiler
+	int AddScope(const char *pName, const char *pCategory);
+	int AddCounter(const char *pName);
+
+	void SetEnabled(bool Enabled);
+	bool Active() const { return m_Enabled || m_pTrace; }
+
+	void AddTime(int Scope, int64 Start, int64 End);
+	void SetCounter(int Counter, int Value) { m_aCounters[Counter].m_Value = Value; }
+
+	// closes the current frame and starts the next one
+	void NextFrame();
+
+	// records the next frames to the file, which is closed afterwards
+	void StartTrace(IOHANDLE File, int Frames);
+	void StopTrace();
+	bool Tracing() const { return m_pTrace != 0; }
+
+	// the history of the closed frames, 0 is the last one
+	int NumFrames() const { return m_NumFrames; }
+	int NumScopes() const { return m_NumScopes; }
+	int NumCounters() const { return m_NumCounters; }
+	const char *ScopeName(int Scope) const { return m_aScopes[Scope].m_aName; }
+	const char *ScopeCategory(int Scope) const { return m_aScopes[Scope].m_aCategory; }
+	const char *CounterName(int Counter) const { return m_aCounters[Counter].m_aName; }
+	int64 FrameTime(int FramesAgo) const { return m_aFrameHistory[HistoryIndex(FramesAgo)]; }
+	int64 ScopeTime(int Scope, int FramesAgo) const { return m_aScopes[Scope].m_aHistory[HistoryIndex(FramesAgo)]; }
+	int CounterValue(int Counter, int FramesAgo) const { return m_aCounters[Counter].m_aHistory[HistoryIndex(FramesAgo)]; }
+	int64 ScopeAverage(int Scope) const;
+	int64 ScopeMax(int Scope) const;
+
+	// the sums of the closed frames since the last reset
+	void ResetTotals();
+	int TotalFrames() const { return m_TotalFrames; }
+	int64 TotalFrameTime() const { return m_TotalFrameTime; }
+	int64 ScopeTotal(int Scope) const { return m_aScopes[Scope].m_TotalTime; }
+	int64 ScopeTotalMax(int Scope) const { return m_aScopes[Scope].m_TotalMax; }
+	int64 CounterTotal(int Counter) const { return m_aCounters[Counter].m_Total; }
+};
+
+#endif
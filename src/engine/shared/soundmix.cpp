@@ -0,0 +1,164 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "soundmix.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SOUNDMIX_SSE2 1
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define SOUNDMIX_NEON 1
+	#include <arm_neon.h>
+#endif
+
+// same as ((Sample*MasterVol)/101)>>8, but without overflowing on loud mixes
+static inline float OutputScale(int MasterVol)
+{
+	return MasterVol/(101.0f*256.0f);
+}
+
+void SoundMixVoiceScalar(int *pMix, const short *pIn, int Channels, unsigned Frames, int VolL, int VolR)
+{
+	if(Channels == 1)
+	{
+		for(unsigned i = 0; i < Frames; i++)
+		{
+			pMix[i*2] += pIn[i]*VolL;
+			pMix[i*2+1] += pIn[i]*VolR;
+		}
+	}
+	else
+	{
+		for(unsigned i = 0; i < Frames; i++)
+		{
+			pMix[i*2] += pIn[i*2]*VolL;
+			pMix[i*2+1] += pIn[i*2+1]*VolR;
+		}
+	}
+}
+
+void SoundMixOutputScalar(short *pOut, const int *pMix, unsigned Frames, int MasterVol)
+{
+	float Scale = OutputScale(MasterVol);
+	for(unsigned i = 0; i < Frames*2; i++)
+	{
+		int v = (int)(pMix[i]*Scale);
+		if(v > 0x7fff)
+			v = 0x7fff;
+		else if(v < -0x7fff)
+			v = -0x7fff;
+		pOut[i] = v;
+	}
+}
+
+#if defined(SOUNDMIX_SSE2)
+
+// multiplies 8 shorts with the volumes and adds the 32 bit results to the mix
+static inline void MixBlock(int *pMix, __m128i In, __m128i Vol)
+{
+	__m128i Lo = _mm_mullo_epi16(In, Vol);
+	__m128i Hi = _mm_mulhi_epi16(In, Vol);
+	__m128i *pDst = (__m128i *)pMix;
+	_mm_storeu_si128(pDst, _mm_add_epi32(_mm_loadu_si128(pDst), _mm_unpacklo_epi16(Lo, Hi)));
+	_mm_storeu_si128(pDst+1, _mm_add_epi32(_mm_loadu_si128(pDst+1), _mm_unpackhi_epi16(Lo, Hi)));
+}
+
+void SoundMixVoice(int *pMix, const short *pIn, int Channels, unsigned Frames, int VolL, int VolR)
+{
+	__m128i Vol = _mm_set_epi16(VolR, VolL, VolR, VolL, VolR, VolL, VolR, VolL);
+	unsigned i = 0;
+	if(Channels == 1)
+	{
+		for(; i+8 <= Frames; i += 8)
+		{
+			__m128i In = _mm_loadu_si128((const __m128i *)(pIn+i));
+			MixBlock(pMix+i*2, _mm_unpacklo_epi16(In, In), Vol);
+			MixBlock(pMix+i*2+8, _mm_unpackhi_epi16(In, In), Vol);
+		}
+	}
+	else
+	{
+		for(; i+4 <= Frames; i += 4)
+			MixBlock(pMix+i*2, _mm_loadu_si128((const __m128i *)(pIn+i*2)), Vol);
+	}
+	SoundMixVoiceScalar(pMix+i*2, pIn+i*Channels, Channels, Frames-i, VolL, VolR);
+}
+
+void SoundMixOutput(short *pOut, const int *pMix, unsigned Frames, int MasterVol)
+{
+	__m128 Scale = _mm_set1_ps(OutputScale(MasterVol));
+	__m128i Min = _mm_set1_epi16(-0x7fff);
+	unsigned i = 0;
+	for(; i+4 <= Frames; i += 4)
+	{
+		__m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(pMix+i*2))), Scale));
+		__m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(pMix+i*2+4))), Scale));
+		_mm_storeu_si128((__m128i *)(pOut+i*2), _mm_max_epi16(_mm_packs_epi32(a, b), Min));
+	}
+	SoundMixOutputScalar(pOut+i*2, pMix+i*2, Frames-i, MasterVol);
+}
+
+const char *SoundMixKernelName() { return "sse2"; }
+
+#elif defined(SOUNDMIX_NEON)
+
+static inline void MixBlock(int *pMix, int16x8_t In, int16x4_t Vol)
+{
+	vst1q_s32(pMix, vmlal_s16(vld1q_s32(pMix), vget_low_s16(In), Vol));
+	vst1q_s32(pMix+4, vmlal_s16(vld1q_s32(pMix+4), vget_high_s16(In), Vol));
+}
+
+void SoundMixVoice(int *pMix, const short *pIn, int Channels, unsigned Frames, int VolL, int VolR)
+{
+	const short aVol[4] = { (short)VolL, (short)VolR, (short)VolL, (short)VolR };
+	int16x4_t Vol = vld1_s16(aVol);
+	unsigned i = 0;
+	if(Channels == 1)
+	{
+		for(; i+8 <= Frames; i += 8)
+		{
+			int16x8x2_t In = vzipq_s16(vld1q_s16(pIn+i), vld1q_s16(pIn+i));
+			MixBlock(pMix+i*2, In.val[0], Vol);
+			MixBlock(pMix+i*2+8, In.val[1], Vol);
+		}
+	}
+	else
+	{
+		for(; i+4 <= Frames; i += 4)
+			MixBlock(pMix+i*2, vld1q_s16(pIn+i*2), Vol);
+	}
+	SoundMixVoiceScalar(pMix+i*2, pIn+i*Channels, Channels, Frames-i, VolL, VolR);
+}
+
+void SoundMixOutput(short *pOut, const int *pMix, unsigned Frames, int MasterVol)
+{
+	float32x4_t Scale = vdupq_n_f32(OutputScale(MasterVol));
+	int16x8_t Min = vdupq_n_s16(-0x7fff);
+	unsigned i = 0;
+	for(; i+4 <= Frames; i += 4)
+	{
+		int32x4_t a = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(vld1q_s32(pMix+i*2)), Scale));
+		int32x4_t b = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(vld1q_s32(pMix+i*2+4)), Scale));
+		vst1q_s16(pOut+i*2, vmaxq_s16(vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)), Min));
+	}
+	SoundMixOutputScalar(pOut+i*2, pMix+i*2, Frames-i, MasterVol);
+}
+
+const char *SoundMixKernelName() { return "neon"; }
+
+#else
+
+void SoundMixVoice(int *pMix, const short *pIn, int Channels, unsigned Frames, int VolL, int VolR)
+{
+	SoundMixVoiceScalar(pMix, pIn, Channels, Frames, VolL, VolR);
+}
+
+void SoundMixOutput(short *pOut, const int *pMix, unsigned Frames, int MasterVol)
+{
+	SoundMixOutputScalar(pOut, pMix, Frames, MasterVol);
+}
+
+const char *SoundMixKernelName() { return "scalar"; }
+
+#endif
@@ -0,0 +1,22 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_SOUNDMIX_H
+#define ENGINE_SHARED_SOUNDMIX_H
+
+/*
+	Mixing routines of the sound. The mix buffer holds interleaved stereo
+	frames. SSE2 or NEON is used when the compiler targets it, the scalar
+	versions give the same results.
+*/
+
+// adds the frames of a mono or stereo sample, scaled by the volumes (0-255)
+void SoundMixVoice(int *pMix, const short *pIn, int Channels, unsigned Frames, int VolL, int VolR);
+void SoundMixVoiceScalar(int *pMix, const short *pIn, int Channels, unsigned Frames, int VolL, int VolR);
+
+// applies the master volume (0-100) to the mix and clamps it to 16 bit
+void SoundMixOutput(short *pOut, const int *pMix, unsigned Frames, int MasterVol);
+void SoundMixOutputScalar(short *pOut, const int *pMix, unsigned Frames, int MasterVol);
+
+const char *SoundMixKernelName();
+
+#endif
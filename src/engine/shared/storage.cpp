@@ -1,7 +1,10 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/hash_ctxt.h>
+#include <base/math.h>
 #include <base/system.h>
+#include <base/tl/array.h>
+#include <base/tl/threading.h>
 #include <engine/storage.h>
 #include "linereader.h"
 #include <zlib.h>
@@ -9,6 +12,142 @@
 // compiled-in data-dir path
 #define DATA_DIR "data"
 
+// caches directory listings in memory. a listing is reused as long as the
+// modification time of the directory didn't change, so adding, removing or
+// renaming files invalidates it on all platforms without rescanning.
+class CDirectoryCache
+{
+public:
+	class CDir
+	{
+	public:
+		char m_aPath[IO_MAX_PATH_LENGTH];
+		time_t m_ModTime;
+		int m_ListTime;
+
+		// packed entries: is_dir byte followed by the zero terminated name
+		char *m_pData;
+		int m_DataSize;
+		int m_DataCapacity;
+
+		CDir *m_pNext;
+
+		const char *First() const { return m_DataSize ? m_pData : 0; }
+		const char *Next(const char *pEntry) const
+		{
+			pEntry += str_length(pEntry+1)+2;
+			return pEntry < m_pData+m_DataSize ? pEntry : 0;
+		}
+		static int IsDir(const char *pEntry) { return pEntry[0]; }
+		static const char *Name(const char *pEntry) { return pEntry+1; }
+	};
+
+private:
+	enum
+	{
+		HASH_SIZE=256,
+	};
+
+	CDir *m_apHash[HASH_SIZE];
+
+	static int AddEntryCallback(const char *pName, int IsDir, int Type, void *pUser)
+	{
+		CDir *pDir = static_cast<CDir *>(pUser);
+		int Size = str_length(pName)+2;
+		if(pDir->m_DataSize+Size > pDir->m_DataCapacity)
+		{
+			pDir->m_DataCapacity = max(pDir->m_DataCapacity*2, pDir->m_DataSize+Size+1024);
+			char *pNewData = (char *)mem_alloc(pDir->m_DataCapacity, 1);
+			if(pDir->m_pData)
+			{
+				mem_copy(pNewData, pDir->m_pData, pDir->m_DataSize);
+				mem_free(pDir->m_pData);
+			}
+			pDir->m_pData = pNewData;
+		}
+		pDir->m_pData[pDir->m_DataSize] = IsDir ? 1 : 0;
+		mem_copy(pDir->m_pData+pDir->m_DataSize+1, pName, Size-1);
+		pDir->m_DataSize += Size;
+		return 0;
+	}
+
+	CDir *Find(const char *pPath, unsigned Hash) const
+	{
+		for(CDir *pDir = m_apHash[Hash]; pDir; pDir = pDir->m_pNext)
+			if(!str_comp(pDir->m_aPath, pPath))
+				return pDir;
+		return 0;
+	}
+
+public:
+	lock m_Lock;
+
+	CDirectoryCache()
+	{
+		mem_zero(m_apHash, sizeof(m_apHash));
+	}
+
+	~CDirectoryCache()
+	{
+		for(int i = 0; i < HASH_SIZE; i++)
+		{
+			while(m_apHash[i])
+			{
+				CDir *pNext = m_apHash[i]->m_pNext;
+				if(m_apHash[i]->m_pData)
+					mem_free(m_apHash[i]->m_pData);
+				delete m_apHash[i];
+				m_apHash[i] = pNext;
+			}
+		}
+	}
+
+	// the lock has to be held while using the returned directory
+	const CDir *Get(const char *pPath)
+	{
+		unsigned Hash = str_quickhash(pPath)%HASH_SIZE;
+		CDir *pDir = Find(pPath, Hash);
+		time_t ModTime = fs_getmtime(pPath);
+
+		// a listing taken within the same second as the last modification might miss later changes
+		if(pDir && pDir->m_ModTime == ModTime && pDir->m_ListTime > ModTime)
+			return pDir;
+
+		if(!pDir)
+		{
+			pDir = new CDir;
+			str_copy(pDir->m_aPath, pPath, sizeof(pDir->m_aPath));
+			pDir->m_pData = 0;
+			pDir->m_DataCapacity = 0;
+			pDir->m_pNext = m_apHash[Hash];
+			m_apHash[Hash] = pDir;
+		}
+
+		pDir->m_DataSize = 0;
+		pDir->m_ModTime = ModTime;
+		pDir->m_ListTime = time_timestamp();
+		fs_listdir(pPath, AddEntryCallback, 0, pDir);
+		return pDir;
+	}
+
+	void Invalidate(const char *pPath)
+	{
+		scope_lock ScopeLock(&m_Lock);
+		CDir *pDir = Find(pPath, str_quickhash(pPath)%HASH_SIZE);
+		if(pDir)
+			pDir->m_ListTime = 0;
+	}
+
+	// invalidates the directory containing the given file
+	void InvalidateParent(const char *pFilename)
+	{
+		char aPath[IO_MAX_PATH_LENGTH];
+		str_copy(aPath, pFilename, sizeof(aPath));
+		if(fs_parent_dir(aPath) == 0)
+			Invalidate(aPath);
+	}
+};
+
 class CStorage : public IStorage
 {
 public:
@@ -24,6 +163,8 @@ public:
 	char m_aCurrentDir[IO_MAX_PATH_LENGTH];
 	char m_aAppDir[IO_MAX_PATH_LENGTH];
 
+	CDirectoryCache m_DirectoryCache;
+
 	CStorage()
 	{
 		mem_zero(m_aaStoragePaths, sizeof(m_aaStoragePaths));
@@ -291,19 +432,45 @@ public:
 		dbg_msg("storage", "warning no data directory found");
 	}
 
-	virtual void ListDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser)
+	bool ListCachedDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser)
 	{
 		char aBuffer[IO_MAX_PATH_LENGTH];
+		char *pData = 0;
+		int DataSize = 0;
+
+		// copy the listing, so the callback is free to use the storage again
+		{
+			scope_lock ScopeLock(&m_DirectoryCache.m_Lock);
+			const CDirectoryCache::CDir *pDir = m_DirectoryCache.Get(GetPath(Type, pPath, aBuffer, sizeof(aBuffer)));
+			if(pDir->m_DataSize)
+			{
+				DataSize = pDir->m_DataSize;
+				pData = (char *)mem_alloc(DataSize, 1);
+				mem_copy(pData, pDir->m_pData, DataSize);
+			}
+		}
+
+		bool Stop = false;
+		for(int Offset = 0; Offset < DataSize && !Stop; Offset += str_length(pData+Offset+1)+2)
+			Stop = pfnCallback(pData+Offset+1, pData[Offset], Type, pUser) != 0;
+
+		if(pData)
+			mem_free(pData);
+		return Stop;
+	}
+
+	virtual void ListDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser)
+	{
 		if(Type == TYPE_ALL)
 		{
 			// list all available directories
 			for(int i = 0; i < m_NumPaths; ++i)
-				fs_listdir(GetPath(i, pPath, aBuffer, sizeof(aBuffer)), pfnCallback, i, pUser);
+				ListCachedDirectory(i, pPath, pfnCallback, pUser);
 		}
 		else if(Type >= 0 && Type < m_NumPaths)
 		{
 			// list wanted directory
-			fs_listdir(GetPath(Type, pPath, aBuffer, sizeof(aBuffer)), pfnCallback, Type, pUser);
+			ListCachedDirectory(Type, pPath, pfnCallback, pUser);
 		}
 	}
 
@@ -357,7 +524,9 @@ public:
 		// open file
 		if(Flags&IOFLAG_WRITE)
 		{
-			return io_open(GetPath(TYPE_SAVE, pFilename, pBuffer, BufferSize), Flags);
+			IOHANDLE Handle = io_open(GetPath(TYPE_SAVE, pFilename, pBuffer, BufferSize), Flags);
+			m_DirectoryCache.InvalidateParent(pBuffer);
+			return Handle;
 		}
 		else
 		{
@@ -419,9 +588,14 @@ public:
 		return pResult;
 	}
 
+	struct CFindCandidate
+	{
+		int m_Type;
+		char m_aPath[IO_MAX_PATH_LENGTH];
+	};
+
 	struct CFindCBData
 	{
-		CStorage *m_pStorage;
 		const char *m_pFilename;
 		const char *m_pPath;
 		char *m_pBuffer;
@@ -430,47 +604,46 @@ public:
 		unsigned m_WantedCrc;
 		unsigned m_WantedSize;
 		bool m_CheckHashAndSize;
+		array<CFindCandidate> m_lCandidates;
 	};
 
-	static int FindFileCallback(const char *pName, int IsDir, int Type, void *pUser)
+	bool FindFileInDirectory(int Type, const char *pPath, CFindCBData *pData)
 	{
-		CFindCBData Data = *static_cast<CFindCBData *>(pUser);
-		if(IsDir)
-		{
-			if(pName[0] == '.')
-				return 0;
-
-			// search within the folder
-			char aBuf[IO_MAX_PATH_LENGTH];
-			char aPath[IO_MAX_PATH_LENGTH];
-			str_format(aPath, sizeof(aPath), "%s/%s", Data.m_pPath, pName);
-			Data.m_pPath = aPath;
-			fs_listdir(Data.m_pStorage->GetPath(Type, aPath, aBuf, sizeof(aBuf)), FindFileCallback, Type, &Data);
-			if(Data.m_pBuffer[0])
-				return 1;
-		}
-		else if(!str_comp(pName, Data.m_pFilename))
+		char aBuf[IO_MAX_PATH_LENGTH];
+		const CDirectoryCache::CDir *pDir = m_DirectoryCache.Get(GetPath(Type, pPath, aBuf, sizeof(aBuf)));
+		for(const char *pEntry = pDir->First(); pEntry; pEntry = pDir->Next(pEntry))
 		{
-			// found the file
-			str_format(Data.m_pBuffer, Data.m_BufferSize, "%s/%s", Data.m_pPath, Data.m_pFilename);
+			const char *pName = CDirectoryCache::CDir::Name(pEntry);
+			if(CDirectoryCache::CDir::IsDir(pEntry))
+			{
+				if(pName[0] == '.')
+					continue;
 
-			if(Data.m_CheckHashAndSize)
+				// search within the folder
+				char aPath[IO_MAX_PATH_LENGTH];
+				str_format(aPath, sizeof(aPath), "%s/%s", pPath, pName);
+				if(FindFileInDirectory(Type, aPath, pData))
+					return true;
+			}
+			else if(!str_comp(pName, pData->m_pFilename))
 			{
-				// check crc and size
-				SHA256_DIGEST Sha256;
-				unsigned Crc = 0;
-				unsigned Size = 0;
-				if(!Data.m_pStorage->GetHashAndSize(Data.m_pBuffer, Type, &Sha256, &Crc, &Size) || (Data.m_pWantedSha256 && Sha256 != *Data.m_pWantedSha256) || Crc != Data.m_WantedCrc || Size != Data.m_WantedSize)
+				// found the file
+				if(pData->m_CheckHashAndSize)
 				{
-					Data.m_pBuffer[0] = 0;
-					return 0;
+					// hashed after the directory cache is unlocked
+					CFindCandidate Candidate;
+					Candidate.m_Type = Type;
+					str_format(Candidate.m_aPath, sizeof(Candidate.m_aPath), "%s/%s", pPath, pData->m_pFilename);
+					pData->m_lCandidates.add(Candidate);
+					continue;
 				}
-			}
 
-			return 1;
+				str_format(pData->m_pBuffer, pData->m_BufferSize, "%s/%s", pPath, pData->m_pFilename);
+				return true;
+			}
 		}
 
-		return 0;
+		return false;
 	}
 
 	bool FindFileImpl(int Type, CFindCBData *pCBData)
@@ -480,22 +653,36 @@ public:
 
 		pCBData->m_pBuffer[0] = 0;
 
-		char aBuf[IO_MAX_PATH_LENGTH];
-
-		if(Type == TYPE_ALL)
 		{
-			// search within all available directories
-			for(int i = 0; i < m_NumPaths; ++i)
+			scope_lock ScopeLock(&m_DirectoryCache.m_Lock);
+			if(Type == TYPE_ALL)
 			{
-				fs_listdir(GetPath(i, pCBData->m_pPath, aBuf, sizeof(aBuf)), FindFileCallback, i, pCBData);
-				if(pCBData->m_pBuffer[0])
-					return true;
+				// search within all available directories
+				for(int i = 0; i < m_NumPaths; ++i)
+				{
+					if(FindFileInDirectory(i, pCBData->m_pPath, pCBData))
+						return true;
+				}
+			}
+			else if(Type >= 0 && Type < m_NumPaths)
+			{
+				// search within wanted directory
+				FindFileInDirectory(Type, pCBData->m_pPath, pCBData);
 			}
 		}
-		else if(Type >= 0 && Type < m_NumPaths)
+
+		// check crc and size of the candidates in search order
+		for(int i = 0; i < pCBData->m_lCandidates.size(); i++)
 		{
-			// search within wanted directory
-			fs_listdir(GetPath(Type, pCBData->m_pPath, aBuf, sizeof(aBuf)), FindFileCallback, Type, pCBData);
+			const CFindCandidate *pCandidate = &pCBData->m_lCandidates[i];
+			SHA256_DIGEST Sha256;
+			unsigned Crc = 0;
+			unsigned Size = 0;
+			if(GetHashAndSize(pCandidate->m_aPath, pCandidate->m_Type, &Sha256, &Crc, &Size) && (!pCBData->m_pWantedSha256 || Sha256 == *pCBData->m_pWantedSha256) && Crc == pCBData->m_WantedCrc && Size == pCBData->m_WantedSize)
+			{
+				str_copy(pCBData->m_pBuffer, pCandidate->m_aPath, pCBData->m_BufferSize);
+				return true;
+			}
 		}
 
 		return pCBData->m_pBuffer[0] != 0;
@@ -504,7 +691,6 @@ public:
 	virtual bool FindFile(const char *pFilename, const char *pPath, int Type, char *pBuffer, int BufferSize)
 	{
 		CFindCBData Data;
-		Data.m_pStorage = this;
 		Data.m_pFilename = pFilename;
 		Data.m_pPath = pPath;
 		Data.m_pBuffer = pBuffer;
@@ -519,7 +705,6 @@ public:
 	virtual bool FindFile(const char *pFilename, const char *pPath, int Type, char *pBuffer, int BufferSize, const SHA256_DIGEST *pWantedSha256, unsigned WantedCrc, unsigned WantedSize)
 	{
 		CFindCBData Data;
-		Data.m_pStorage = this;
 		Data.m_pFilename = pFilename;
 		Data.m_pPath = pPath;
 		Data.m_pBuffer = pBuffer;
@@ -537,7 +722,9 @@ public:
 			return false;
 
 		char aBuffer[IO_MAX_PATH_LENGTH];
-		return !fs_remove(GetPath(Type, pFilename, aBuffer, sizeof(aBuffer)));
+		bool Success = !fs_remove(GetPath(Type, pFilename, aBuffer, sizeof(aBuffer)));
+		m_DirectoryCache.InvalidateParent(aBuffer);
+		return Success;
 	}
 
 	virtual bool RenameFile(const char* pOldFilename, const char* pNewFilename, int Type)
@@ -546,7 +733,10 @@ public:
 			return false;
 		char aOldBuffer[IO_MAX_PATH_LENGTH];
 		char aNewBuffer[IO_MAX_PATH_LENGTH];
-		return !fs_rename(GetPath(Type, pOldFilename, aOldBuffer, sizeof(aOldBuffer)), GetPath(Type, pNewFilename, aNewBuffer, sizeof (aNewBuffer)));
+		bool Success = !fs_rename(GetPath(Type, pOldFilename, aOldBuffer, sizeof(aOldBuffer)), GetPath(Type, pNewFilename, aNewBuffer, sizeof (aNewBuffer)));
+		m_DirectoryCache.InvalidateParent(aOldBuffer);
+		m_DirectoryCache.InvalidateParent(aNewBuffer);
+		return Success;
 	}
 
 	virtual bool CreateFolder(const char *pFoldername, int Type)
@@ -555,7 +745,9 @@ public:
 			return false;
 
 		char aBuffer[IO_MAX_PATH_LENGTH];
-		return !fs_makedir(GetPath(Type, pFoldername, aBuffer, sizeof(aBuffer)));
+		bool Success = !fs_makedir(GetPath(Type, pFoldername, aBuffer, sizeof(aBuffer)));
+		m_DirectoryCache.InvalidateParent(aBuffer);
+		return Success;
 	}
 
 	virtual void GetCompletePath(int Type, const char *pDir, char *pBuffer, unsigned BufferSize)
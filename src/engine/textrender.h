@@ -59,6 +59,10 @@ public:
 	virtual int TextLineCount(void *pFontSetV, float Size, const char *pText, float LineWidth) = 0;
 
 	virtual float TextGetLineBaseY(const CTextCursor *pCursor) = 0;
+
+	// layouts taken from the cache and laid out anew, since startup
+	virtual int LayoutCacheHits() const = 0;
+	virtual int LayoutCacheMisses() const = 0;
 };
 
 class IEngineTextRender : public ITextRender
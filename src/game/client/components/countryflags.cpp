@@ -10,6 +10,8 @@
 #include <engine/external/json-parser/json.h>
 #include <engine/shared/config.h>
 
+#include <game/client/imageloader.h>
+
 #include "menus.h"
 #include "countryflags.h"
 
@@ -42,7 +44,10 @@ void CCountryFlags::LoadCountryflagsIndexfile()
 		return;
 	}
 
-	// extract data
+	// extract data, the flags are decoded in parallel once all are queued
+	CImageLoader ImageLoader(m_pClient->Engine(), Graphics(), Console(), Config()->m_Debug);
+	array<CCountryFlag> lFlags;
+	array<int> lFlagImages;
 	const json_value &rInit = (*pJsonData)["country codes"];
 	if(rInit.type == json_object)
 	{
@@ -74,34 +79,16 @@ void CCountryFlags::LoadCountryflagsIndexfile()
 					CCountryFlag CountryFlag;
 					CountryFlag.m_CountryCode = CountryCode;
 					str_copy(CountryFlag.m_aCountryCodeString, pCountryName, sizeof(CountryFlag.m_aCountryCodeString));
-					if(Config()->m_ClLoadCountryFlags)
-					{
-						// load the graphic file
-						CImageInfo Info;
-						str_format(aBuf, sizeof(aBuf), "countryflags/%s.png", pCountryName);
-						if(!Graphics()->LoadPNG(&Info, aBuf, IStorage::TYPE_ALL))
-						{
-							char aMsg[64];
-							str_format(aMsg, sizeof(aMsg), "failed to load '%s'", aBuf);
-							Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", aMsg);
-							continue;
-						}
-						CountryFlag.m_Texture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
-						mem_free(Info.m_pData);
-					}
 					// blocked?
 					CountryFlag.m_Blocked = false;
 					const json_value Check = rStart[i]["blocked"];
 					if(Check.type == json_boolean && Check)
 						CountryFlag.m_Blocked = true;
-					m_aCountryFlags.add_unsorted(CountryFlag);
+					lFlags.add(CountryFlag);
 
-					// print message
-					if(Config()->m_Debug)
-					{
-						str_format(aBuf, sizeof(aBuf), "loaded country flag '%s'", pCountryName);
-						Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", aBuf);
-					}
+					// queue the graphic file
+					str_format(aBuf, sizeof(aBuf), "countryflags/%s.png", pCountryName);
+					lFlagImages.add(Config()->m_ClLoadCountryFlags ? ImageLoader.Add(aBuf, IStorage::TYPE_ALL) : -1);
 				}
 			}
 		}
@@ -109,6 +96,34 @@ void CCountryFlags::LoadCountryflagsIndexfile()
 
 	// clean up
 	json_value_free(pJsonData);
+
+	// load the graphic files
+	ImageLoader.Start();
+	for(int i = 0; i < lFlags.size(); i++)
+	{
+		CCountryFlag CountryFlag = lFlags[i];
+		if(lFlagImages[i] >= 0)
+		{
+			if(!ImageLoader.Get(lFlagImages[i]))
+			{
+				char aMsg[64];
+				str_format(aMsg, sizeof(aMsg), "failed to load '%s'", ImageLoader.Filename(lFlagImages[i]));
+				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", aMsg);
+				continue;
+			}
+			CountryFlag.m_Texture = ImageLoader.LoadTexture(lFlagImages[i], 0);
+		}
+		m_aCountryFlags.add_unsorted(CountryFlag);
+
+		// print message
+		if(Config()->m_Debug)
+		{
+			char aBuf[64];
+			str_format(aBuf, sizeof(aBuf), "loaded country flag '%s'", CountryFlag.m_aCountryCodeString);
+			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "countryflags", aBuf);
+		}
+	}
+	ImageLoader.Finish();
 	m_aCountryFlags.sort_range();
 
 	// find index of default item
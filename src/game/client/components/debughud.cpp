@@ -138,8 +138,145 @@ void CDebugHud::RenderTuning()
 	TextRender()->TextColor(1,1,1,1);
 }
 
+void CDebugHud::RenderDrawCalls()
+{
+	if(!Config()->m_DbgDrawcalls)
+		return;
+
+	// the numbers are from the last complete frame
+	const IGraphics::CFrameStats &Stats = Graphics()->FrameStats();
+	char aBuf[64];
+	str_format(aBuf, sizeof(aBuf), "draw calls: %d (merged %d)", Stats.m_DrawCalls, Stats.m_MergedDrawCalls);
+	Graphics()->MapScreen(0, 0, 300*Graphics()->ScreenAspect(), 300);
+	TextRender()->Text(0, 5.0f, 290.0f, 5.0f, aBuf, -1.0f);
+
+	str_format(aBuf, sizeof(aBuf), "text layouts: %d cached, %d laid out", TextRender()->LayoutCacheHits(), TextRender()->LayoutCacheMisses());
+	TextRender()->Text(0, 5.0f, 284.0f, 5.0f, aBuf, -1.0f);
+}
+
+void CDebugHud::RenderHistogram(float x, float y, float w, float h, const float *pValues, int Num, float Max)
+{
+	if(Max <= 0.0f)
+		return;
+
+	// oldest value on the left
+	IGraphics::CQuadItem aBars[CProfiler::HISTORY_SIZE];
+	int NumBars = 0;
+	float BarWidth = w/CProfiler::HISTORY_SIZE;
+	for(int i = 0; i < Num; i++)
+	{
+		float BarHeight = min(pValues[i]/Max, 1.0f)*h;
+		if(BarHeight > 0.0f)
+			aBars[NumBars++] = IGraphics::CQuadItem(x+w-(i+1)*BarWidth, y+h-BarHeight, BarWidth, BarHeight);
+	}
+	Graphics()->QuadsDrawTL(aBars, NumBars);
+}
+
+void CDebugHud::RenderProfiler()
+{
+	const CProfiler *pProfiler = m_pClient->Profiler();
+	if(!Config()->m_DbgProfiler || !pProfiler->NumFrames())
+		return;
+
+	const int MaxRows = 16;
+	const float FontSize = 5.0f;
+	const float RowHeight = 7.0f;
+	const float Width = 300*Graphics()->ScreenAspect();
+	const float ToMs = 1000.0f/time_freq();
+	Graphics()->MapScreen(0, 0, Width, 300);
+
+	// the most expensive scopes first
+	int aRows[MaxRows];
+	int64 aAverage[MaxRows];
+	int NumRows = 0;
+	for(int s = 0; s < pProfiler->NumScopes(); s++)
+	{
+		int64 Average = pProfiler->ScopeAverage(s);
+		if(!pProfiler->ScopeMax(s))
+			continue;
+		if(NumRows == MaxRows && Average <= aAverage[MaxRows-1])
+			continue;
+		int i = min(NumRows, MaxRows-1);
+		for(; i > 0 && aAverage[i-1] < Average; i--)
+		{
+			aRows[i] = aRows[i-1];
+			aAverage[i] = aAverage[i-1];
+		}
+		aRows[i] = s;
+		aAverage[i] = Average;
+		NumRows = min(NumRows+1, MaxRows);
+	}
+
+	const int NumCounters = pProfiler->NumCounters();
+	const float HistX = 130.0f, HistWidth = 100.0f;
+	CUIRect Background = {2.0f, 2.0f, HistX+HistWidth+4.0f, (2+NumRows+NumCounters)*RowHeight+4.0f};
+	RenderTools()->DrawRoundRect(&Background, vec4(0.0f, 0.0f, 0.0f, 0.5f), 3.0f);
+
+	// all rows share the scale of the slowest frame
+	float aValues[CProfiler::HISTORY_SIZE];
+	float FrameMax = 0.0f;
+	int64 FrameSum = 0;
+	for(int i = 0; i < pProfiler->NumFrames(); i++)
+	{
+		aValues[i] = pProfiler->FrameTime(i)*ToMs;
+		FrameMax = max(FrameMax, aValues[i]);
+		FrameSum += pProfiler->FrameTime(i);
+	}
+
+	Graphics()->TextureClear();
+	Graphics()->QuadsBegin();
+	float y = 5.0f;
+	Graphics()->SetColor(0.5f, 0.8f, 1.0f, 0.8f);
+	RenderHistogram(HistX, y, HistWidth, RowHeight-1.0f, aValues, pProfiler->NumFrames(), FrameMax);
+	y += 2*RowHeight;
+	Graphics()->SetColor(1.0f, 0.7f, 0.3f, 0.8f);
+	for(int r = 0; r < NumRows; r++, y += RowHeight)
+	{
+		for(int i = 0; i < pProfiler->NumFrames(); i++)
+			aValues[i] = pProfiler->ScopeTime(aRows[r], i)*ToMs;
+		RenderHistogram(HistX, y, HistWidth, RowHeight-1.0f, aValues, pProfiler->NumFrames(), FrameMax);
+	}
+	Graphics()->SetColor(0.6f, 1.0f, 0.6f, 0.8f);
+	for(int c = 0; c < NumCounters; c++, y += RowHeight)
+	{
+		float CounterMax = 1.0f;
+		for(int i = 0; i < pProfiler->NumFrames(); i++)
+		{
+			aValues[i] = (float)pProfiler->CounterValue(c, i);
+			CounterMax = max(CounterMax, aValues[i]);
+		}
+		RenderHistogram(HistX, y, HistWidth, RowHeight-1.0f, aValues, pProfiler->NumFrames(), CounterMax);
+	}
+	Graphics()->QuadsEnd();
+
+	char aBuf[128];
+	y = 5.0f;
+	str_format(aBuf, sizeof(aBuf), "frame %.2fms avg, %.2fms max%s", FrameSum*ToMs/pProfiler->NumFrames(), FrameMax,
+		pProfiler->Tracing() ? " (tracing)" : "");
+	TextRender()->Text(0, 5.0f, y, FontSize, aBuf, -1.0f);
+	y += RowHeight;
+	TextRender()->Text(0, 5.0f, y, FontSize, "scope", -1.0f);
+	TextRender()->Text(0, 80.0f, y, FontSize, "avg / max ms", -1.0f);
+	y += RowHeight;
+	for(int r = 0; r < NumRows; r++, y += RowHeight)
+	{
+		str_format(aBuf, sizeof(aBuf), "%s %s", pProfiler->ScopeName(aRows[r]), pProfiler->ScopeCategory(aRows[r]));
+		TextRender()->Text(0, 5.0f, y, FontSize, aBuf, -1.0f);
+		str_format(aBuf, sizeof(aBuf), "%.2f / %.2f", aAverage[r]*ToMs, pProfiler->ScopeMax(aRows[r])*ToMs);
+		TextRender()->Text(0, 80.0f, y, FontSize, aBuf, -1.0f);
+	}
+	for(int c = 0; c < NumCounters; c++, y += RowHeight)
+	{
+		TextRender()->Text(0, 5.0f, y, FontSize, pProfiler->CounterName(c), -1.0f);
+		str_format(aBuf, sizeof(aBuf), "%d", pProfiler->CounterValue(c, 0));
+		TextRender()->Text(0, 80.0f, y, FontSize, aBuf, -1.0f);
+	}
+}
+
 void CDebugHud::OnRender()
 {
 	RenderTuning();
 	RenderNetCorrections();
+	RenderDrawCalls();
+	RenderProfiler();
 }
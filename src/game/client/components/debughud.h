@@ -8,6 +8,9 @@ class CDebugHud : public CComponent
 {
 	void RenderNetCorrections();
 	void RenderTuning();
+	void RenderDrawCalls();
+	void RenderProfiler();
+	void RenderHistogram(float x, float y, float w, float h, const float *pValues, int Num, float Max);
 public:
 	virtual void OnRender();
 };
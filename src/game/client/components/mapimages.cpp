@@ -3,7 +3,10 @@
 #include <engine/graphics.h>
 #include <engine/map.h>
 #include <engine/storage.h>
+#include <engine/shared/config.h>
 #include <game/client/component.h>
+#include <game/client/gameclient.h>
+#include <game/client/imageloader.h>
 #include <game/mapitems.h>
 
 #include "mapimages.h"
@@ -14,23 +17,28 @@ CMapImages::CMapImages()
 	m_Info[MAP_TYPE_MENU].m_Count = 0;
 
 	m_EasterIsLoaded = false;
+
+	m_GameMapLoad.m_pMap = 0;
+	m_GameMapLoad.m_pImageLoader = 0;
+	m_GameMapLoad.m_NumLoaded = 0;
 }
 
-void CMapImages::LoadMapImages(IMap *pMap, class CLayers *pLayers, int MapType)
+void CMapImages::BeginLoad(CLoad *pLoad, IMap *pMap, class CLayers *pLayers, int MapType)
 {
-	if(MapType < 0 || MapType >= NUM_MAP_TYPES)
-		return;
-
 	// unload all textures
 	for(int i = 0; i < m_Info[MapType].m_Count; i++)
 		Graphics()->UnloadTexture(&(m_Info[MapType].m_aTextures[i]));
 	m_Info[MapType].m_Count = 0;
 
-	int Start;
-	pMap->GetType(MAPITEMTYPE_IMAGE, &Start, &m_Info[MapType].m_Count);
-	m_Info[MapType].m_Count = clamp(m_Info[MapType].m_Count, 0, int(MAX_TEXTURES));
+	int Num;
+	pMap->GetType(MAPITEMTYPE_IMAGE, &pLoad->m_Start, &Num);
+	pLoad->m_pMap = pMap;
+	pLoad->m_MapType = MapType;
+	pLoad->m_NumLoaded = 0;
+	m_Info[MapType].m_Count = clamp(Num, 0, int(MAX_TEXTURES));
 
-	// load new textures
+	// find the texture flags and queue the external images
+	pLoad->m_pImageLoader = new CImageLoader(m_pClient->Engine(), Graphics(), Console(), Config()->m_Debug);
 	for(int i = 0; i < m_Info[MapType].m_Count; i++)
 	{
 		int TextureFlags = 0;
@@ -46,38 +54,101 @@ void CMapImages::LoadMapImages(IMap *pMap, class CLayers *pLayers, int MapType)
 		}
 		if(FoundTileLayer)
 			TextureFlags = FoundQuadLayer ? IGraphics::TEXLOAD_MULTI_DIMENSION : IGraphics::TEXLOAD_ARRAY_256;
+		pLoad->m_aTextureFlags[i] = TextureFlags;
 
-		CMapItemImage *pImg = (CMapItemImage *)pMap->GetItem(Start+i, 0, 0);
+		pLoad->m_aExternalImages[i] = -1;
+		CMapItemImage *pImg = (CMapItemImage *)pMap->GetItem(pLoad->m_Start+i, 0, 0);
 		if(pImg->m_External || (pImg->m_Version > 1 && pImg->m_Format != CImageInfo::FORMAT_RGB && pImg->m_Format != CImageInfo::FORMAT_RGBA))
 		{
 			char Buf[IO_MAX_PATH_LENGTH];
 			char *pName = (char *)pMap->GetData(pImg->m_ImageName);
 			str_format(Buf, sizeof(Buf), "mapres/%s.png", pName);
-			m_Info[MapType].m_aTextures[i] = Graphics()->LoadTexture(Buf, IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, TextureFlags);
-		}
-		else
-		{
-			void *pData = pMap->GetData(pImg->m_ImageData);
-			m_Info[MapType].m_aTextures[i] = Graphics()->LoadTextureRaw(pImg->m_Width, pImg->m_Height, pImg->m_Version == 1 ? CImageInfo::FORMAT_RGBA : pImg->m_Format, pData, CImageInfo::FORMAT_RGBA, TextureFlags);
-			pMap->UnloadData(pImg->m_ImageData);
+			pLoad->m_aExternalImages[i] = pLoad->m_pImageLoader->Add(Buf, IStorage::TYPE_ALL);
 		}
 	}
+	pLoad->m_pImageLoader->Start();
+}
+
+bool CMapImages::LoadNext(CLoad *pLoad, bool Wait)
+{
+	int i = pLoad->m_NumLoaded;
+	if(i >= m_Info[pLoad->m_MapType].m_Count)
+		return false;
+
+	IGraphics::CTextureHandle *pTexture = &m_Info[pLoad->m_MapType].m_aTextures[i];
+	if(pLoad->m_aExternalImages[i] >= 0)
+	{
+		if(!Wait && !pLoad->m_pImageLoader->IsDone(pLoad->m_aExternalImages[i]))
+			return false;
+		*pTexture = pLoad->m_pImageLoader->LoadTexture(pLoad->m_aExternalImages[i], pLoad->m_aTextureFlags[i]);
+	}
+	else
+	{
+		CMapItemImage *pImg = (CMapItemImage *)pLoad->m_pMap->GetItem(pLoad->m_Start+i, 0, 0);
+		void *pData = pLoad->m_pMap->GetData(pImg->m_ImageData);
+		*pTexture = Graphics()->LoadTextureRaw(pImg->m_Width, pImg->m_Height, pImg->m_Version == 1 ? CImageInfo::FORMAT_RGBA : pImg->m_Format, pData, CImageInfo::FORMAT_RGBA, pLoad->m_aTextureFlags[i]);
+		pLoad->m_pMap->UnloadData(pImg->m_ImageData);
+	}
+	pLoad->m_NumLoaded++;
+	return true;
+}
+
+void CMapImages::EndLoad(CLoad *pLoad)
+{
+	if(!pLoad->m_pImageLoader)
+		return;
+
+	// textures that were not created are left invalid
+	delete pLoad->m_pImageLoader;
+	pLoad->m_pImageLoader = 0;
+	pLoad->m_pMap = 0;
 
 	// easter time, preload easter tileset
 	if(m_pClient->IsEaster())
 		GetEasterTexture();
 }
 
-void CMapImages::OnMapLoad()
+void CMapImages::BeginGameMapLoad()
+{
+	EndLoad(&m_GameMapLoad);
+	BeginLoad(&m_GameMapLoad, Kernel()->RequestInterface<IMap>(), Layers(), MAP_TYPE_GAME);
+}
+
+bool CMapImages::UpdateGameMapLoad(int64 Deadline)
 {
-	LoadMapImages(Kernel()->RequestInterface<IMap>(), Layers(), MAP_TYPE_GAME);
+	if(!m_GameMapLoad.m_pImageLoader)
+		return true;
+
+	bool Wait = Deadline <= 0;
+	while(Wait || time_get() < Deadline)
+	{
+		if(!LoadNext(&m_GameMapLoad, Wait))
+			break;
+	}
+	return m_GameMapLoad.m_NumLoaded >= m_Info[MAP_TYPE_GAME].m_Count;
+}
+
+void CMapImages::EndGameMapLoad()
+{
+	EndLoad(&m_GameMapLoad);
+}
+
+float CMapImages::GameMapLoadProgress() const
+{
+	if(!m_GameMapLoad.m_pImageLoader || !m_Info[MAP_TYPE_GAME].m_Count)
+		return 1.0f;
+	return m_GameMapLoad.m_NumLoaded/(float)m_Info[MAP_TYPE_GAME].m_Count;
 }
 
 void CMapImages::OnMenuMapLoad(IMap *pMap)
 {
 	CLayers MenuLayers;
 	MenuLayers.Init(Kernel(), pMap);
-	LoadMapImages(pMap, &MenuLayers, MAP_TYPE_MENU);
+
+	CLoad Load;
+	BeginLoad(&Load, pMap, &MenuLayers, MAP_TYPE_MENU);
+	while(LoadNext(&Load, true));
+	EndLoad(&Load);
 }
 
 IGraphics::CTextureHandle CMapImages::GetEasterTexture()
@@ -23,7 +23,23 @@ class CMapImages : public CComponent
 	IGraphics::CTextureHandle m_EasterTexture;
 	bool m_EasterIsLoaded;
 
-	void LoadMapImages(class IMap *pMap, class CLayers *pLayers, int MapType);
+	// state of a load, the textures are created one after another
+	struct CLoad
+	{
+		class IMap *m_pMap;
+		class CImageLoader *m_pImageLoader;
+		int m_MapType;
+		int m_Start;
+		int m_NumLoaded;
+		int m_aTextureFlags[MAX_TEXTURES];
+		int m_aExternalImages[MAX_TEXTURES];
+	};
+	CLoad m_GameMapLoad;
+
+	void BeginLoad(CLoad *pLoad, class IMap *pMap, class CLayers *pLayers, int MapType);
+	// returns false if all images are loaded or the next one isn't decoded yet and Wait is false
+	bool LoadNext(CLoad *pLoad, bool Wait);
+	void EndLoad(CLoad *pLoad);
 
 public:
 	CMapImages();
@@ -31,7 +47,15 @@ public:
 	IGraphics::CTextureHandle Get(int Index) const;
 	int Num() const;
 
-	virtual void OnMapLoad();
+	// loads the images of the game map over several calls, the map data has to be decompressed
+	// beforehand and must not be accessed by other threads meanwhile
+	void BeginGameMapLoad();
+	// creates textures until the deadline passed, returns true once all of them are done.
+	// without a deadline it waits for the external images and creates all textures
+	bool UpdateGameMapLoad(int64 Deadline);
+	void EndGameMapLoad();
+	float GameMapLoadProgress() const;
+
 	void OnMenuMapLoad(class IMap *pMap);
 	
 	IGraphics::CTextureHandle GetEasterTexture();
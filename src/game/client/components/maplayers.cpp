@@ -28,6 +28,8 @@ CMapLayers::CMapLayers(int t)
 	m_pMenuMap = 0;
 	m_pMenuLayers = 0;
 	m_OnlineStartTime = 0;
+	m_pBufferLayers = 0;
+	m_pLayerBuffers = 0;
 }
 
 void CMapLayers::OnStateChange(int NewState, int OldState)
@@ -147,6 +149,7 @@ static void PlaceEggDoodads(int LayerWidth, int LayerHeight, CTile* aOutTiles, C
 
 void CMapLayers::OnMapLoad()
 {
+	ClearLayerBuffers();
 	if(Layers())
 		LoadEnvPoints(Layers(), m_lEnvPoints);
 
@@ -203,6 +206,7 @@ void CMapLayers::OnMapLoad()
 
 void CMapLayers::OnShutdown()
 {
+	ClearLayerBuffers();
 	if(m_pEggTiles)
 	{
 		mem_free(m_pEggTiles);
@@ -210,6 +214,56 @@ void CMapLayers::OnShutdown()
 	}
 }
 
+CMapLayers::CLayerBuffer *CMapLayers::GetLayerBuffer(CLayers *pLayers, int Layer)
+{
+	if(!Graphics()->BuffersSupported())
+		return 0;
+
+	if(pLayers != m_pBufferLayers)
+	{
+		ClearLayerBuffers();
+		m_pBufferLayers = pLayers;
+		m_pLayerBuffers = new CLayerBuffer[pLayers->NumLayers()];
+	}
+
+	CLayerBuffer *pBuffer = &m_pLayerBuffers[Layer];
+	if(!pBuffer->m_Created)
+	{
+		pBuffer->m_Created = true;
+		CMapItemLayer *pLayer = pLayers->GetLayer(Layer);
+		if(pLayer->m_Type == LAYERTYPE_TILES)
+		{
+			// color envelopes are applied when drawing, so tile layers are always static
+			CMapItemLayerTilemap *pTMap = (CMapItemLayerTilemap *)pLayer;
+			CTile *pTiles = (CTile *)pLayers->Map()->GetData(pTMap->m_Data);
+			RenderTools()->CreateTilemapBuffer(&pBuffer->m_Tilemap, pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f);
+			pBuffer->m_Buffered = true;
+		}
+		else if(pLayer->m_Type == LAYERTYPE_QUADS)
+		{
+			CMapItemLayerQuads *pQLayer = (CMapItemLayerQuads *)pLayer;
+			CQuad *pQuads = (CQuad *)pLayers->Map()->GetDataSwapped(pQLayer->m_Data);
+			pBuffer->m_Buffered = RenderTools()->CreateQuadsBuffer(&pBuffer->m_Quads, pQuads, pQLayer->m_NumQuads);
+		}
+	}
+	return pBuffer->m_Buffered ? pBuffer : 0;
+}
+
+void CMapLayers::ClearLayerBuffers()
+{
+	if(!m_pLayerBuffers)
+		return;
+
+	for(int i = 0; i < m_pBufferLayers->NumLayers(); i++)
+	{
+		Graphics()->UnloadBuffer(&m_pLayerBuffers[i].m_Tilemap.m_Buffer);
+		Graphics()->UnloadBuffer(&m_pLayerBuffers[i].m_Quads.m_Buffer);
+	}
+	delete [] m_pLayerBuffers;
+	m_pLayerBuffers = 0;
+	m_pBufferLayers = 0;
+}
+
 void CMapLayers::LoadEnvPoints(const CLayers *pLayers, array<CEnvPoint>& lEnvPoints)
 {
 	lEnvPoints.clear();
@@ -463,13 +517,26 @@ void CMapLayers::OnRender()
 							Graphics()->TextureSet(m_pClient->m_pMapimages->Get(pTMap->m_Image));
 
 						CTile *pTiles = (CTile *)pLayers->Map()->GetData(pTMap->m_Data);
-						Graphics()->BlendNone();
 						vec4 Color = vec4(pTMap->m_Color.r/255.0f, pTMap->m_Color.g/255.0f, pTMap->m_Color.b/255.0f, pTMap->m_Color.a/255.0f);
-						RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_OPAQUE,
-														EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
-						Graphics()->BlendNormal();
-						RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_TRANSPARENT,
-														EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+						CLayerBuffer *pBuffer = GetLayerBuffer(pLayers, pGroup->m_StartLayer+l);
+						if(pBuffer)
+						{
+							Graphics()->BlendNone();
+							RenderTools()->RenderTilemapBuffer(&pBuffer->m_Tilemap, pTiles, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_OPAQUE,
+															EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+							Graphics()->BlendNormal();
+							RenderTools()->RenderTilemapBuffer(&pBuffer->m_Tilemap, pTiles, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_TRANSPARENT,
+															EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+						}
+						else
+						{
+							Graphics()->BlendNone();
+							RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_OPAQUE,
+															EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+							Graphics()->BlendNormal();
+							RenderTools()->RenderTilemap(pTiles, pTMap->m_Width, pTMap->m_Height, 32.0f, Color, TILERENDERFLAG_EXTEND|LAYERRENDERFLAG_TRANSPARENT,
+															EnvelopeEval, this, pTMap->m_ColorEnv, pTMap->m_ColorEnvOffset);
+						}
 					}
 					else if(pLayer->m_Type == LAYERTYPE_QUADS)
 					{
@@ -484,7 +551,11 @@ void CMapLayers::OnRender()
 						//Graphics()->BlendNone();
 						//RenderTools()->RenderQuads(pQuads, pQLayer->m_NumQuads, LAYERRENDERFLAG_OPAQUE, EnvelopeEval, this);
 						Graphics()->BlendNormal();
-						RenderTools()->RenderQuads(pQuads, pQLayer->m_NumQuads, LAYERRENDERFLAG_TRANSPARENT, EnvelopeEval, this);
+						CLayerBuffer *pBuffer = GetLayerBuffer(pLayers, pGroup->m_StartLayer+l);
+						if(pBuffer)
+							RenderTools()->RenderQuadsBuffer(&pBuffer->m_Quads);
+						else
+							RenderTools()->RenderQuads(pQuads, pQLayer->m_NumQuads, LAYERRENDERFLAG_TRANSPARENT, EnvelopeEval, this);
 					}
 				}
 			}
@@ -530,6 +601,7 @@ void CMapLayers::BackgroundMapUpdate()
 	if(m_Type == TYPE_BACKGROUND && m_pMenuMap)
 	{
 		// unload map
+		ClearLayerBuffers();
 		m_pMenuMap->Unload();
 		if(Config()->m_ClShowMenuMap)
 			LoadBackgroundMap();
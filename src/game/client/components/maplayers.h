@@ -4,6 +4,7 @@
 #define GAME_CLIENT_COMPONENTS_MAPLAYERS_H
 #include <base/tl/array.h>
 #include <game/client/component.h>
+#include <game/client/render.h>
 
 class CMapLayers : public CComponent
 {
@@ -23,6 +24,21 @@ class CMapLayers : public CComponent
 	int m_EggLayerWidth;
 	int m_EggLayerHeight;
 
+	// vertex buffers of the static layers, built when a layer is first drawn
+	struct CLayerBuffer
+	{
+		CLayerBuffer() : m_Created(false), m_Buffered(false) {}
+		bool m_Created;
+		bool m_Buffered;
+		CTilemapBuffer m_Tilemap;
+		CQuadsBuffer m_Quads;
+	};
+	CLayers *m_pBufferLayers;
+	CLayerBuffer *m_pLayerBuffers;
+
+	CLayerBuffer *GetLayerBuffer(CLayers *pLayers, int Layer);
+	void ClearLayerBuffers();
+
 	static void EnvelopeEval(float TimeOffset, int Env, float *pChannels, void *pUser);
 
 	void LoadEnvPoints(const CLayers *pLayers, array<CEnvPoint>& lEnvPoints);
@@ -70,6 +70,7 @@ CMenus::CMenus()
 	m_MenuActive = true;
 	m_SeekBarActivatedTime = 0;
 	m_SeekBarActive = true;
+	m_DemoInfoJobRunning = false;
 	m_UseMouseButtons = true;
 	m_SkinModified = false;
 	m_KeyReaderWasActive = false;
@@ -1505,6 +1506,9 @@ void CMenus::OnInit()
 	Storage()->ListDirectory(IStorage::TYPE_ALL, "ui/gametypes", GameIconScan, this);
 	RenderLoading(1);
 
+	// load the headers of known demos
+	m_DemoInfoCache.Load(Storage(), "demoinfo.dat");
+
 	// initial launch preparations
 	if(Config()->m_ClShowWelcome)
 		m_Popup = POPUP_LANGUAGE;
@@ -1725,6 +1729,12 @@ int CMenus::Render()
 				pExtraText = "";
 				NumOptions = 5;
 			}
+			else if(m_pClient->MapLoadProgress() >= 0.0f)
+			{
+				str_format(aTitleBuf, sizeof(aTitleBuf), "%s: %s", Localize("Loading map"), Client()->GetCurrentMapName());
+				pTitle = aTitleBuf;
+				pExtraText = "";
+			}
 		}
 		else if(m_Popup == POPUP_LANGUAGE)
 		{
@@ -1924,6 +1934,23 @@ int CMenus::Render()
 				Part.w = max(10.0f, (Part.w*Client()->MapDownloadAmount())/Client()->MapDownloadTotalsize());
 				RenderTools()->DrawUIRect(&Part, vec4(1.0f, 1.0f, 1.0f, 0.5f), CUI::CORNER_ALL, 5.0f);
 			}
+			else if(m_pClient->MapLoadProgress() >= 0.0f)
+			{
+				char aBuf[32];
+				float Progress = m_pClient->MapLoadProgress();
+				Box.HSplitTop(15.f, 0, &Box);
+				Box.HSplitTop(ButtonHeight, &Part, &Box);
+				str_format(aBuf, sizeof(aBuf), "%d%%", round_to_int(Progress*100.0f));
+				UI()->DoLabel(&Part, aBuf, FontSize, CUI::ALIGN_CENTER);
+
+				// progress bar
+				Box.HSplitTop(SpacingH, 0, &Box);
+				Box.HSplitTop(ButtonHeight, &Part, &Box);
+				Part.VMargin(40.0f, &Part);
+				RenderTools()->DrawUIRect(&Part, vec4(1.0f, 1.0f, 1.0f, 0.25f), CUI::CORNER_ALL, 5.0f);
+				Part.w = max(10.0f, Part.w*Progress);
+				RenderTools()->DrawUIRect(&Part, vec4(1.0f, 1.0f, 1.0f, 0.5f), CUI::CORNER_ALL, 5.0f);
+			}
 			else
 			{
 				Box.HSplitTop(27.0f, 0, &Box);
@@ -2256,6 +2283,12 @@ void CMenus::OnShutdown()
 {
 	// save filters
 	SaveFilters();
+
+	// let a running header job finish, it writes into our memory
+	if(m_DemoInfoJobRunning)
+		m_pClient->Engine()->WaitJob(&m_DemoInfoJob);
+	if(m_DemoInfoCache.Changed())
+		m_DemoInfoCache.Save(Storage(), "demoinfo.dat");
 }
 
 void CMenus::OnStateChange(int NewState, int OldState)
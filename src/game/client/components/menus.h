@@ -10,6 +10,8 @@
 #include <engine/demo.h>
 #include <engine/contacts.h>
 #include <engine/serverbrowser.h>
+#include <engine/shared/demoinfocache.h>
+#include <engine/shared/jobs.h>
 
 #include <game/voting.h>
 #include <game/client/component.h>
@@ -475,6 +477,7 @@ private:
 		time_t m_Date;
 
 		bool m_InfosLoaded;
+		bool m_InfoRequested;
 		bool m_Valid;
 		CDemoHeader m_Info;
 
@@ -554,6 +557,37 @@ private:
 	void DemolistPopulate();
 	static int DemolistFetchCallback(const char *pName, time_t Date, int IsDir, int StorageType, void *pUser);
 
+	// headers of new demos are read on a job in batches, the cache is only used on the main thread
+	enum
+	{
+		MAX_DEMOINFO_REQUESTS=64,
+	};
+
+	struct CDemoInfoRequest
+	{
+		char m_aPath[IO_MAX_PATH_LENGTH];
+		int m_StorageType;
+		time_t m_Date;
+		bool m_Valid;
+		CDemoHeader m_Info;
+	};
+
+	struct CDemoInfoJobData
+	{
+		class IStorage *m_pStorage;
+		class IDemoPlayer *m_pDemoPlayer;
+		CDemoInfoRequest m_aRequests[MAX_DEMOINFO_REQUESTS];
+		int m_NumRequests;
+	};
+
+	CDemoInfoCache m_DemoInfoCache;
+	CJob m_DemoInfoJob;
+	CDemoInfoJobData m_DemoInfoJobData;
+	bool m_DemoInfoJobRunning;
+
+	static int DemoInfoJobThread(void *pUser);
+	void UpdateDemoInfos();
+
 	// friends
 	class CFriendItem
 	{
@@ -4,6 +4,7 @@
 #include <base/math.h>
 
 #include <engine/demo.h>
+#include <engine/engine.h>
 #include <engine/keys.h>
 #include <engine/graphics.h>
 #include <engine/textrender.h>
@@ -374,8 +375,12 @@ int CMenus::DemolistFetchCallback(const char *pName, time_t Date, int IsDir, int
 	else
 	{
 		str_truncate(Item.m_aName, sizeof(Item.m_aName), pName, str_length(pName) - 5);
-		Item.m_InfosLoaded = false;
 		Item.m_Date = Date;
+
+		char aPath[IO_MAX_PATH_LENGTH];
+		str_format(aPath, sizeof(aPath), "%s/%s", pSelf->m_aCurrentDemoFolder, pName);
+		Item.m_InfosLoaded = pSelf->m_DemoInfoCache.Get(aPath, StorageType, Date, &Item.m_Info, &Item.m_Valid);
+		Item.m_InfoRequested = false;
 	}
 	Item.m_IsDir = IsDir != 0;
 	Item.m_StorageType = StorageType;
@@ -389,7 +394,9 @@ void CMenus::DemolistPopulate()
 	m_lDemos.clear();
 	if(!str_comp(m_aCurrentDemoFolder, "demos"))
 		m_DemolistStorageType = IStorage::TYPE_ALL;
+	m_DemoInfoCache.BeginScan();
 	Storage()->ListDirectoryInfo(m_DemolistStorageType, m_aCurrentDemoFolder, DemolistFetchCallback, this);
+	m_DemoInfoCache.EndScan(m_aCurrentDemoFolder);
 	m_lDemos.sort_range_by(CDemoComparator(
 		Config()->m_BrDemoSort, Config()->m_BrDemoSortOrder
 	));
@@ -410,10 +417,93 @@ bool CMenus::FetchHeader(CDemoItem *pItem)
 		str_format(aBuffer, sizeof(aBuffer), "%s/%s", m_aCurrentDemoFolder, pItem->m_aFilename);
 		pItem->m_Valid = DemoPlayer()->GetDemoInfo(Storage(), aBuffer, pItem->m_StorageType, &pItem->m_Info);
 		pItem->m_InfosLoaded = true;
+		m_DemoInfoCache.Set(aBuffer, pItem->m_StorageType, pItem->m_Date, &pItem->m_Info, pItem->m_Valid);
 	}
 	return pItem->m_Valid;
 }
 
+int CMenus::DemoInfoJobThread(void *pUser)
+{
+	CDemoInfoJobData *pData = (CDemoInfoJobData *)pUser;
+	for(int i = 0; i < pData->m_NumRequests; i++)
+	{
+		CDemoInfoRequest *pRequest = &pData->m_aRequests[i];
+		pRequest->m_Valid = pData->m_pDemoPlayer->GetDemoInfo(pData->m_pStorage, pRequest->m_aPath, pRequest->m_StorageType, &pRequest->m_Info);
+	}
+	return 0;
+}
+
+void CMenus::UpdateDemoInfos()
+{
+	if(m_DemoInfoJobRunning)
+	{
+		if(m_DemoInfoJob.Status() != CJob::STATE_DONE)
+			return;
+		m_DemoInfoJobRunning = false;
+
+		// the list might have been repopulated meanwhile, so go through the cache
+		for(int i = 0; i < m_DemoInfoJobData.m_NumRequests; i++)
+		{
+			const CDemoInfoRequest *pRequest = &m_DemoInfoJobData.m_aRequests[i];
+			m_DemoInfoCache.Set(pRequest->m_aPath, pRequest->m_StorageType, pRequest->m_Date, &pRequest->m_Info, pRequest->m_Valid);
+		}
+		for(sorted_array<CDemoItem>::range r = m_lDemos.all(); !r.empty(); r.pop_front())
+		{
+			CDemoItem *pItem = &r.front();
+			if(pItem->m_IsDir || pItem->m_InfosLoaded || !pItem->m_InfoRequested)
+				continue;
+			char aPath[IO_MAX_PATH_LENGTH];
+			str_format(aPath, sizeof(aPath), "%s/%s", m_aCurrentDemoFolder, pItem->m_aFilename);
+			pItem->m_InfosLoaded = m_DemoInfoCache.Get(aPath, pItem->m_StorageType, pItem->m_Date, &pItem->m_Info, &pItem->m_Valid);
+		}
+		if(Config()->m_BrDemoSort == SORT_LENGTH)
+		{
+			// the lengths moved the items around, keep the selected one selected
+			char aSelected[IO_MAX_PATH_LENGTH] = {0};
+			int SelectedStorageType = 0;
+			if(m_DemolistSelectedIndex >= 0)
+			{
+				str_copy(aSelected, m_lDemos[m_DemolistSelectedIndex].m_aFilename, sizeof(aSelected));
+				SelectedStorageType = m_lDemos[m_DemolistSelectedIndex].m_StorageType;
+			}
+			m_lDemos.sort_range_by(CDemoComparator(
+				Config()->m_BrDemoSort, Config()->m_BrDemoSortOrder
+			));
+			for(int i = 0; aSelected[0] && i < m_lDemos.size(); i++)
+			{
+				if(m_lDemos[i].m_IsDir == m_DemolistSelectedIsDir && m_lDemos[i].m_StorageType == SelectedStorageType && str_comp(m_lDemos[i].m_aFilename, aSelected) == 0)
+				{
+					m_DemolistSelectedIndex = i;
+					break;
+				}
+			}
+		}
+	}
+
+	m_DemoInfoJobData.m_NumRequests = 0;
+	for(sorted_array<CDemoItem>::range r = m_lDemos.all(); !r.empty() && m_DemoInfoJobData.m_NumRequests < MAX_DEMOINFO_REQUESTS; r.pop_front())
+	{
+		CDemoItem *pItem = &r.front();
+		if(pItem->m_IsDir || pItem->m_InfosLoaded || pItem->m_InfoRequested)
+			continue;
+		CDemoInfoRequest *pRequest = &m_DemoInfoJobData.m_aRequests[m_DemoInfoJobData.m_NumRequests++];
+		str_format(pRequest->m_aPath, sizeof(pRequest->m_aPath), "%s/%s", m_aCurrentDemoFolder, pItem->m_aFilename);
+		pRequest->m_StorageType = pItem->m_StorageType;
+		pRequest->m_Date = pItem->m_Date;
+		pItem->m_InfoRequested = true;
+	}
+
+	if(m_DemoInfoJobData.m_NumRequests > 0)
+	{
+		m_DemoInfoJobData.m_pStorage = Storage();
+		m_DemoInfoJobData.m_pDemoPlayer = DemoPlayer();
+		m_pClient->Engine()->AddJob(&m_DemoInfoJob, DemoInfoJobThread, &m_DemoInfoJobData);
+		m_DemoInfoJobRunning = true;
+	}
+	else if(m_DemoInfoCache.Changed())
+		m_DemoInfoCache.Save(Storage(), "demoinfo.dat");
+}
+
 void CMenus::RenderDemoList(CUIRect MainView)
 {
 	CUIRect BottomView;
@@ -434,6 +524,7 @@ void CMenus::RenderDemoList(CUIRect MainView)
 		DemolistOnUpdate(true);
 		s_Inited = 1;
 	}
+	UpdateDemoInfos();
 
 	char aFooterLabel[128] = {0};
 	if(m_DemolistSelectedIndex >= 0)
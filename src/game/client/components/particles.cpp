@@ -21,18 +21,9 @@ CParticles::CParticles()
 void CParticles::OnReset()
 {
 	// reset particles
-	for(int i = 0; i < MAX_PARTICLES; i++)
-	{
-		m_aParticles[i].m_PrevPart = i-1;
-		m_aParticles[i].m_NextPart = i+1;
-	}
-
-	m_aParticles[0].m_PrevPart = 0;
-	m_aParticles[MAX_PARTICLES-1].m_NextPart = -1;
-	m_FirstFree = 0;
-
 	for(int i = 0; i < NUM_GROUPS; i++)
-		m_aFirstPart[i] = -1;
+		m_aGroups[i].m_Num = 0;
+	m_NumParticles = 0;
 }
 
 void CParticles::Add(int Group, CParticle *pPart)
@@ -49,31 +40,113 @@ void CParticles::Add(int Group, CParticle *pPart)
 			return;
 	}
 
-	if (m_FirstFree == -1)
+	if(m_NumParticles == MAX_PARTICLES || pPart->m_Spr < 0 || pPart->m_Spr >= g_pData->m_NumSprites)
 		return;
 
-	// remove from the free list
-	int Id = m_FirstFree;
-	m_FirstFree = m_aParticles[Id].m_NextPart;
-	if(m_FirstFree != -1)
-		m_aParticles[m_FirstFree].m_PrevPart = -1;
+	CGroup *pGroup = &m_aGroups[Group];
+	int i = pGroup->m_Num++;
+	m_NumParticles++;
 
 	// copy data
-	m_aParticles[Id] = *pPart;
-
-	// insert to the group list
-	m_aParticles[Id].m_PrevPart = -1;
-	m_aParticles[Id].m_NextPart = m_aFirstPart[Group];
-	if(m_aFirstPart[Group] != -1)
-		m_aParticles[m_aFirstPart[Group]].m_PrevPart = Id;
-	m_aFirstPart[Group] = Id;
+	pGroup->m_aPosX[i] = pPart->m_Pos.x;
+	pGroup->m_aPosY[i] = pPart->m_Pos.y;
+	pGroup->m_aVelX[i] = pPart->m_Vel.x;
+	pGroup->m_aVelY[i] = pPart->m_Vel.y;
+	pGroup->m_aLifeSpan[i] = pPart->m_LifeSpan;
+	pGroup->m_aStartSize[i] = pPart->m_StartSize;
+	pGroup->m_aEndSize[i] = pPart->m_EndSize;
+	pGroup->m_aRot[i] = pPart->m_Rot;
+	pGroup->m_aRotspeed[i] = pPart->m_Rotspeed;
+	pGroup->m_aGravity[i] = pPart->m_Gravity;
+	pGroup->m_aFriction[i] = pPart->m_Friction;
+	pGroup->m_aColor[i] = pPart->m_Color;
+	RenderTools()->GetSpriteSubset(&g_pData->m_aSprites[pPart->m_Spr], 0, 0, 0, pGroup->m_aaSubset[i]);
 
 	// set some parameters
-	m_aParticles[Id].m_Life = 0;
+	pGroup->m_aLife[i] = 0;
+}
+
+void CParticles::UpdateGroup(CGroup *pGroup, float TimePassed, int FrictionCount)
+{
+	const int Num = pGroup->m_Num;
+	float *pVelX = pGroup->m_aVelX;
+	float *pVelY = pGroup->m_aVelY;
+
+	//m_aParticles[i].vel += flow_get(m_aParticles[i].pos)*time_passed * m_aParticles[i].flow_affected;
+	for(int i = 0; i < Num; i++)
+		pVelY[i] += pGroup->m_aGravity[i]*TimePassed;
+
+	for(int f = 0; f < FrictionCount; f++) // apply friction
+	{
+		for(int i = 0; i < Num; i++)
+		{
+			pVelX[i] *= pGroup->m_aFriction[i];
+			pVelY[i] *= pGroup->m_aFriction[i];
+		}
+	}
+
+	// move the points, only the ones that hit something take the slow path
+	for(int i = 0; i < Num; i++)
+	{
+		m_aMoveX[i] = pVelX[i]*TimePassed;
+		m_aMoveY[i] = pVelY[i]*TimePassed;
+	}
+	int NumHits = Collision()->MovePoints(pGroup->m_aPosX, pGroup->m_aPosY, m_aMoveX, m_aMoveY, Num, m_aHits);
+	for(int h = 0; h < NumHits; h++)
+	{
+		int i = m_aHits[h];
+		vec2 Pos(pGroup->m_aPosX[i], pGroup->m_aPosY[i]);
+		vec2 Vel(m_aMoveX[i], m_aMoveY[i]);
+		Collision()->MovePoint(&Pos, &Vel, 0.1f+0.9f*frandom(), NULL);
+		pGroup->m_aPosX[i] = Pos.x;
+		pGroup->m_aPosY[i] = Pos.y;
+		m_aMoveX[i] = Vel.x;
+		m_aMoveY[i] = Vel.y;
+	}
+
+	const float InvTime = 1.0f/TimePassed;
+	for(int i = 0; i < Num; i++)
+	{
+		pVelX[i] = m_aMoveX[i]*InvTime;
+		pVelY[i] = m_aMoveY[i]*InvTime;
+		pGroup->m_aLife[i] += TimePassed;
+		pGroup->m_aRot[i] += TimePassed * pGroup->m_aRotspeed[i];
+	}
+
+	// remove the dead particles, keeping the order of the others
+	int Alive = 0;
+	for(int i = 0; i < Num; i++)
+	{
+		if(pGroup->m_aLife[i] > pGroup->m_aLifeSpan[i])
+			continue;
+		if(Alive != i)
+		{
+			pGroup->m_aPosX[Alive] = pGroup->m_aPosX[i];
+			pGroup->m_aPosY[Alive] = pGroup->m_aPosY[i];
+			pGroup->m_aVelX[Alive] = pGroup->m_aVelX[i];
+			pGroup->m_aVelY[Alive] = pGroup->m_aVelY[i];
+			pGroup->m_aLife[Alive] = pGroup->m_aLife[i];
+			pGroup->m_aLifeSpan[Alive] = pGroup->m_aLifeSpan[i];
+			pGroup->m_aStartSize[Alive] = pGroup->m_aStartSize[i];
+			pGroup->m_aEndSize[Alive] = pGroup->m_aEndSize[i];
+			pGroup->m_aRot[Alive] = pGroup->m_aRot[i];
+			pGroup->m_aRotspeed[Alive] = pGroup->m_aRotspeed[i];
+			pGroup->m_aGravity[Alive] = pGroup->m_aGravity[i];
+			pGroup->m_aFriction[Alive] = pGroup->m_aFriction[i];
+			mem_copy(pGroup->m_aaSubset[Alive], pGroup->m_aaSubset[i], sizeof(pGroup->m_aaSubset[i]));
+			pGroup->m_aColor[Alive] = pGroup->m_aColor[i];
+		}
+		Alive++;
+	}
+	m_NumParticles -= Num-Alive;
+	pGroup->m_Num = Alive;
 }
 
 void CParticles::Update(float TimePassed)
 {
+	if(TimePassed <= 0.0f)
+		return;
+
 	static float FrictionFraction = 0;
 	FrictionFraction += TimePassed;
 
@@ -88,48 +161,7 @@ void CParticles::Update(float TimePassed)
 	}
 
 	for(int g = 0; g < NUM_GROUPS; g++)
-	{
-		int i = m_aFirstPart[g];
-		while(i != -1)
-		{
-			int Next = m_aParticles[i].m_NextPart;
-			//m_aParticles[i].vel += flow_get(m_aParticles[i].pos)*time_passed * m_aParticles[i].flow_affected;
-			m_aParticles[i].m_Vel.y += m_aParticles[i].m_Gravity*TimePassed;
-
-			for(int f = 0; f < FrictionCount; f++) // apply friction
-				m_aParticles[i].m_Vel *= m_aParticles[i].m_Friction;
-
-			// move the point
-			vec2 Vel = m_aParticles[i].m_Vel*TimePassed;
-			Collision()->MovePoint(&m_aParticles[i].m_Pos, &Vel, 0.1f+0.9f*frandom(), NULL);
-			m_aParticles[i].m_Vel = Vel* (1.0f/TimePassed);
-
-			m_aParticles[i].m_Life += TimePassed;
-			m_aParticles[i].m_Rot += TimePassed * m_aParticles[i].m_Rotspeed;
-
-			// check particle death
-			if(m_aParticles[i].m_Life > m_aParticles[i].m_LifeSpan)
-			{
-				// remove it from the group list
-				if(m_aParticles[i].m_PrevPart != -1)
-					m_aParticles[m_aParticles[i].m_PrevPart].m_NextPart = m_aParticles[i].m_NextPart;
-				else
-					m_aFirstPart[g] = m_aParticles[i].m_NextPart;
-
-				if(m_aParticles[i].m_NextPart != -1)
-					m_aParticles[m_aParticles[i].m_NextPart].m_PrevPart = m_aParticles[i].m_PrevPart;
-
-				// insert to the free list
-				if(m_FirstFree != -1)
-					m_aParticles[m_FirstFree].m_PrevPart = i;
-				m_aParticles[i].m_PrevPart = -1;
-				m_aParticles[i].m_NextPart = m_FirstFree;
-				m_FirstFree = i;
-			}
-
-			i = Next;
-		}
-	}
+		UpdateGroup(&m_aGroups[g], TimePassed, FrictionCount);
 }
 
 void CParticles::OnRender()
@@ -157,32 +189,33 @@ void CParticles::OnRender()
 
 void CParticles::RenderGroup(int Group)
 {
+	const CGroup *pGroup = &m_aGroups[Group];
+	if(!pGroup->m_Num)
+		return;
+
+	// newest first, like the old list
+	for(int i = pGroup->m_Num-1, n = 0; i >= 0; i--, n++)
+	{
+		IGraphics::CSpriteItem *pItem = &m_aSpriteItems[n];
+		float a = pGroup->m_aLife[i] / pGroup->m_aLifeSpan[i];
+		float Size = mix(pGroup->m_aStartSize[i], pGroup->m_aEndSize[i], a);
+		pItem->m_X = pGroup->m_aPosX[i];
+		pItem->m_Y = pGroup->m_aPosY[i];
+		pItem->m_Width = Size;
+		pItem->m_Height = Size;
+		pItem->m_Rotation = pGroup->m_aRot[i];
+		pItem->m_U0 = pGroup->m_aaSubset[i][0];
+		pItem->m_V0 = pGroup->m_aaSubset[i][1];
+		pItem->m_U1 = pGroup->m_aaSubset[i][2];
+		pItem->m_V1 = pGroup->m_aaSubset[i][3];
+		pItem->m_Color = pGroup->m_aColor[i]; // pow(a, 0.75f) *
+	}
+
 	Graphics()->BlendNormal();
 	//gfx_blend_additive();
 	Graphics()->TextureSet(g_pData->m_aImages[IMAGE_PARTICLES].m_Id);
 	Graphics()->QuadsBegin();
-
-	int i = m_aFirstPart[Group];
-	while(i != -1)
-	{
-		RenderTools()->SelectSprite(m_aParticles[i].m_Spr);
-		float a = m_aParticles[i].m_Life / m_aParticles[i].m_LifeSpan;
-		vec2 p = m_aParticles[i].m_Pos;
-		float Size = mix(m_aParticles[i].m_StartSize, m_aParticles[i].m_EndSize, a);
-
-		Graphics()->QuadsSetRotation(m_aParticles[i].m_Rot);
-
-		Graphics()->SetColor(
-			m_aParticles[i].m_Color.r,
-			m_aParticles[i].m_Color.g,
-			m_aParticles[i].m_Color.b,
-			m_aParticles[i].m_Color.a); // pow(a, 0.75f) *
-
-		IGraphics::CQuadItem QuadItem(p.x, p.y, Size, Size);
-		Graphics()->QuadsDraw(&QuadItem, 1);
-
-		i = m_aParticles[i].m_NextPart;
-	}
+	Graphics()->QuadsDrawSprites(m_aSpriteItems, pGroup->m_Num);
 	Graphics()->QuadsEnd();
 	Graphics()->BlendNormal();
 }
@@ -12,6 +12,8 @@
 #include <engine/shared/config.h>
 #include <engine/shared/jsonwriter.h>
 
+#include <game/client/imageloader.h>
+
 #include "menus.h"
 #include "skins.h"
 
@@ -31,25 +33,35 @@ int CSkins::SkinPartScan(const char *pName, int IsDir, int DirType, void *pUser)
 	if(IsDir || !str_endswith(pName, ".png"))
 		return 0;
 
+	// only queue the file here, it gets decoded together with all the other parts
 	char aBuf[IO_MAX_PATH_LENGTH];
 	str_format(aBuf, sizeof(aBuf), "skins/%s/%s", CSkins::ms_apSkinPartNames[pSelf->m_ScanningPart], pName);
-	CImageInfo Info;
-	if(!pSelf->Graphics()->LoadPNG(&Info, aBuf, DirType))
+	pSelf->m_pImageLoader->Add(aBuf, DirType);
+	return 0;
+}
+
+void CSkins::LoadSkinPart(int PartType, CImageLoader *pImageLoader, int Image)
+{
+	char aBuf[IO_MAX_PATH_LENGTH];
+	const char *pName = pImageLoader->Filename(Image) + str_length("skins/") + str_length(ms_apSkinPartNames[PartType]) + 1;
+	CImageInfo *pInfo = pImageLoader->Get(Image);
+	if(!pInfo)
 	{
 		str_format(aBuf, sizeof(aBuf), "failed to load skin part '%s'", pName);
-		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
-		return 0;
+		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
+		return;
 	}
+	CImageInfo Info = *pInfo;
 
 	CSkinPart Part;
-	Part.m_OrgTexture = pSelf->Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
+	Part.m_OrgTexture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, IGraphics::TEXLOAD_ATLAS);
 	Part.m_BloodColor = vec3(1.0f, 1.0f, 1.0f);
 
 	unsigned char *d = (unsigned char *)Info.m_pData;
 	int Pitch = Info.m_Width*4;
 
 	// dig out blood color
-	if(pSelf->m_ScanningPart == SKINPART_BODY)
+	if(PartType == SKINPART_BODY)
 	{
 		int PartX = Info.m_Width/2;
 		int PartY = 0;
@@ -83,24 +95,22 @@ int CSkins::SkinPartScan(const char *pName, int IsDir, int DirType, void *pUser)
 		d[i*Step+2] = v;
 	}
 
-	Part.m_ColorTexture = pSelf->Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
-	mem_free(Info.m_pData);
+	Part.m_ColorTexture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, IGraphics::TEXLOAD_ATLAS);
+	pImageLoader->Release(Image);
 
 	// set skin part data
 	Part.m_Flags = 0;
 	if(pName[0] == 'x' && pName[1] == '_')
 		Part.m_Flags |= SKINFLAG_SPECIAL;
-	if(DirType != IStorage::TYPE_SAVE)
+	if(pImageLoader->StorageType(Image) != IStorage::TYPE_SAVE)
 		Part.m_Flags |= SKINFLAG_STANDARD;
 	str_truncate(Part.m_aName, sizeof(Part.m_aName), pName, str_length(pName) - 4);
-	if(pSelf->Config()->m_Debug)
+	if(Config()->m_Debug)
 	{
 		str_format(aBuf, sizeof(aBuf), "load skin part %s", Part.m_aName);
-		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
+		Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "skins", aBuf);
 	}
-	pSelf->m_aaSkinParts[pSelf->m_ScanningPart].add(Part);
-
-	return 0;
+	m_aaSkinParts[PartType].add(Part);
 }
 
 int CSkins::SkinScan(const char *pName, int IsDir, int DirType, void *pUser)
@@ -236,6 +246,26 @@ void CSkins::OnInit()
 	ms_apColorVariables[SKINPART_FEET] = &Config()->m_PlayerColorFeet;
 	ms_apColorVariables[SKINPART_EYES] = &Config()->m_PlayerColorEyes;
 
+	// queue all images first, so they get decoded in parallel
+	CImageLoader ImageLoader(m_pClient->Engine(), Graphics(), Console(), Config()->m_Debug);
+	m_pImageLoader = &ImageLoader;
+	int aPartImages[NUM_SKINPARTS+1];
+	for(int p = 0; p < NUM_SKINPARTS; p++)
+	{
+		char aBuf[64];
+		str_format(aBuf, sizeof(aBuf), "skins/%s", ms_apSkinPartNames[p]);
+		aPartImages[p] = ImageLoader.Num();
+		m_ScanningPart = p;
+		Storage()->ListDirectory(IStorage::TYPE_ALL, aBuf, SkinPartScan, this);
+	}
+	aPartImages[NUM_SKINPARTS] = ImageLoader.Num();
+	m_pImageLoader = 0;
+	const int XmasHatImage = ImageLoader.Add("skins/xmas_hat.png", IStorage::TYPE_ALL);
+	const int BotImage = ImageLoader.Add("skins/bot.png", IStorage::TYPE_ALL);
+	ImageLoader.Start();
+
+	// the parts aren't drawn before the end of the init
+	Graphics()->AtlasBegin();
 	for(int p = 0; p < NUM_SKINPARTS; p++)
 	{
 		m_aaSkinParts[p].clear();
@@ -251,10 +281,8 @@ void CSkins::OnInit()
 		}
 
 		// load skin parts
-		char aBuf[64];
-		str_format(aBuf, sizeof(aBuf), "skins/%s", ms_apSkinPartNames[p]);
-		m_ScanningPart = p;
-		Storage()->ListDirectory(IStorage::TYPE_ALL, aBuf, SkinPartScan, this);
+		for(int i = aPartImages[p]; i < aPartImages[p+1]; i++)
+			LoadSkinPart(p, &ImageLoader, i);
 
 		// add dummy skin part
 		if(!m_aaSkinParts[p].size())
@@ -298,9 +326,9 @@ void CSkins::OnInit()
 
 	{
 		// add xmas hat
-		const char *pFileName = "skins/xmas_hat.png";
-		CImageInfo Info;
-		if(!Graphics()->LoadPNG(&Info, pFileName, IStorage::TYPE_ALL) || Info.m_Width != 128 || Info.m_Height != 512)
+		const char *pFileName = ImageLoader.Filename(XmasHatImage);
+		const CImageInfo *pInfo = ImageLoader.Get(XmasHatImage);
+		if(!pInfo || pInfo->m_Width != 128 || pInfo->m_Height != 512)
 		{
 			char aBuf[128];
 			str_format(aBuf, sizeof(aBuf), "failed to load xmas hat '%s'", pFileName);
@@ -311,16 +339,16 @@ void CSkins::OnInit()
 			char aBuf[128];
 			str_format(aBuf, sizeof(aBuf), "loaded xmas hat '%s'", pFileName);
 			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "game", aBuf);
-			m_XmasHatTexture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
+			m_XmasHatTexture = ImageLoader.LoadTexture(XmasHatImage, IGraphics::TEXLOAD_ATLAS);
 		}
 	}
 	m_pClient->m_pMenus->RenderLoading(1);
 
 	{
 		// add bot decoration
-		const char *pFileName = "skins/bot.png";
-		CImageInfo Info;
-		if(!Graphics()->LoadPNG(&Info, pFileName, IStorage::TYPE_ALL) || Info.m_Width != 384 || Info.m_Height != 160)
+		const char *pFileName = ImageLoader.Filename(BotImage);
+		const CImageInfo *pInfo = ImageLoader.Get(BotImage);
+		if(!pInfo || pInfo->m_Width != 384 || pInfo->m_Height != 160)
 		{
 			char aBuf[128];
 			str_format(aBuf, sizeof(aBuf), "failed to load bot '%s'", pFileName);
@@ -331,9 +359,10 @@ void CSkins::OnInit()
 			char aBuf[128];
 			str_format(aBuf, sizeof(aBuf), "loaded bot '%s'", pFileName);
 			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "game", aBuf);
-			m_BotTexture = Graphics()->LoadTextureRaw(Info.m_Width, Info.m_Height, Info.m_Format, Info.m_pData, Info.m_Format, 0);
+			m_BotTexture = ImageLoader.LoadTexture(BotImage, IGraphics::TEXLOAD_ATLAS);
 		}
 	}
+	Graphics()->AtlasEnd();
 	m_pClient->m_pMenus->RenderLoading(1);
 }
 
@@ -79,11 +79,13 @@ public:
 
 private:
 	int m_ScanningPart;
+	class CImageLoader *m_pImageLoader;
 	sorted_array<CSkinPart> m_aaSkinParts[NUM_SKINPARTS];
 	sorted_array<CSkin> m_aSkins;
 	CSkin m_DummySkin;
 
 	static int SkinPartScan(const char *pName, int IsDir, int DirType, void *pUser);
+	void LoadSkinPart(int PartType, class CImageLoader *pImageLoader, int Image);
 	static int SkinScan(const char *pName, int IsDir, int DirType, void *pUser);
 };
 
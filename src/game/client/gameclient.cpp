@@ -17,6 +17,7 @@
 #include <generated/client_data.h>
 
 #include <game/version.h>
+#include "imageloader.h"
 #include "localization.h"
 #include "render.h"
 
@@ -123,7 +124,7 @@ static CMapLayers gs_MapLayersBackGround(CMapLayers::TYPE_BACKGROUND);
 static CMapLayers gs_MapLayersForeGround(CMapLayers::TYPE_FOREGROUND);
 
 CGameClient::CStack::CStack() { m_Num = 0; }
-void CGameClient::CStack::Add(class CComponent *pComponent) { m_paComponents[m_Num++] = pComponent; }
+void CGameClient::CStack::Add(class CComponent *pComponent, const char *pName) { m_paComponents[m_Num] = pComponent; m_apNames[m_Num++] = pName; }
 
 const char *CGameClient::Version() const { return GAME_VERSION; }
 const char *CGameClient::NetVersion() const { return GAME_NETVERSION; }
@@ -246,41 +247,41 @@ void CGameClient::OnConsoleInit()
 	m_pStats = &::gs_Stats;
 
 	// make a list of all the systems, make sure to add them in the corrent render order
-	m_All.Add(m_pSkins);
-	m_All.Add(m_pCountryFlags);
-	m_All.Add(m_pMapimages);
-	m_All.Add(m_pEffects); // doesn't render anything, just updates effects
-	m_All.Add(m_pParticles); // doesn't render anything, just updates all the particles
-	m_All.Add(m_pBinds);
-	m_All.Add(&m_pBinds->m_SpecialBinds);
-	m_All.Add(m_pControls);
-	m_All.Add(m_pCamera);
-	m_All.Add(m_pSounds);
-	m_All.Add(m_pVoting);
-
-	m_All.Add(&gs_MapLayersBackGround); // first to render
-	m_All.Add(&m_pParticles->m_RenderTrail);
-	m_All.Add(m_pItems);
-	m_All.Add(&gs_Players);
-	m_All.Add(&gs_MapLayersForeGround);
-	m_All.Add(&m_pParticles->m_RenderExplosions);
-	m_All.Add(&gs_NamePlates);
-	m_All.Add(&m_pParticles->m_RenderGeneral);
-	m_All.Add(m_pDamageind);
-	m_All.Add(&gs_Hud);
-	m_All.Add(&gs_Spectator);
-	m_All.Add(&gs_Emoticon);
-	m_All.Add(&gs_InfoMessages);
-	m_All.Add(m_pChat);
-	m_All.Add(&gs_Broadcast);
-	m_All.Add(&gs_DebugHud);
-	m_All.Add(&gs_Notifications);
-	m_All.Add(&gs_Scoreboard);
-	m_All.Add(m_pStats);
-	m_All.Add(m_pMotd);
-	m_All.Add(m_pMenus);
-	m_All.Add(&m_pMenus->m_Binder);
-	m_All.Add(m_pGameConsole);
+	m_All.Add(m_pSkins, "skins");
+	m_All.Add(m_pCountryFlags, "country flags");
+	m_All.Add(m_pMapimages, "map images");
+	m_All.Add(m_pEffects, "effects"); // doesn't render anything, just updates effects
+	m_All.Add(m_pParticles, "particles"); // doesn't render anything, just updates all the particles
+	m_All.Add(m_pBinds, "binds");
+	m_All.Add(&m_pBinds->m_SpecialBinds, "special binds");
+	m_All.Add(m_pControls, "controls");
+	m_All.Add(m_pCamera, "camera");
+	m_All.Add(m_pSounds, "sounds");
+	m_All.Add(m_pVoting, "voting");
+
+	m_All.Add(&gs_MapLayersBackGround, "map background"); // first to render
+	m_All.Add(&m_pParticles->m_RenderTrail, "particles trail");
+	m_All.Add(m_pItems, "items");
+	m_All.Add(&gs_Players, "players");
+	m_All.Add(&gs_MapLayersForeGround, "map foreground");
+	m_All.Add(&m_pParticles->m_RenderExplosions, "particles explosions");
+	m_All.Add(&gs_NamePlates, "nameplates");
+	m_All.Add(&m_pParticles->m_RenderGeneral, "particles general");
+	m_All.Add(m_pDamageind, "damage indicator");
+	m_All.Add(&gs_Hud, "hud");
+	m_All.Add(&gs_Spectator, "spectator");
+	m_All.Add(&gs_Emoticon, "emoticon");
+	m_All.Add(&gs_InfoMessages, "info messages");
+	m_All.Add(m_pChat, "chat");
+	m_All.Add(&gs_Broadcast, "broadcast");
+	m_All.Add(&gs_DebugHud, "debug hud");
+	m_All.Add(&gs_Notifications, "notifications");
+	m_All.Add(&gs_Scoreboard, "scoreboard");
+	m_All.Add(m_pStats, "stats");
+	m_All.Add(m_pMotd, "motd");
+	m_All.Add(m_pMenus, "menus");
+	m_All.Add(&m_pMenus->m_Binder, "binder");
+	m_All.Add(m_pGameConsole, "console");
 
 	// build the input stack
 	m_Input.Add(&m_pMenus->m_Binder); // this will take over all input when we want to bind a key
@@ -298,6 +299,22 @@ void CGameClient::OnConsoleInit()
 	Console()->Register("team", "i[team]", CFGFLAG_CLIENT, ConTeam, this, "Switch team");
 	Console()->Register("kill", "", CFGFLAG_CLIENT, ConKill, this, "Kill yourself");
 	Console()->Register("ready_change", "", CFGFLAG_CLIENT, ConReadyChange, this, "Change ready state");
+	Console()->Register("dbg_profiler_trace", "?i[frames]", CFGFLAG_CLIENT, ConProfilerTrace, this, "Write the profile of the next frames to a chrome trace file in dumps");
+
+	// the profiler measures every component
+	for(int i = 0; i < m_All.m_Num; i++)
+	{
+		m_aRenderScopes[i] = m_Profiler.AddScope(m_All.m_apNames[i], "render");
+		m_aMessageScopes[i] = m_Profiler.AddScope(m_All.m_apNames[i], "message");
+	}
+	m_SnapshotScope = m_Profiler.AddScope("snapshot", "update");
+	m_PredictScope = m_Profiler.AddScope("prediction", "update");
+	m_aGraphicsCounters[0] = m_Profiler.AddCounter("draw calls");
+	m_aGraphicsCounters[1] = m_Profiler.AddCounter("merged draws");
+	m_aGraphicsCounters[2] = m_Profiler.AddCounter("vertices");
+	m_aGraphicsCounters[3] = m_Profiler.AddCounter("texture switches");
+	m_aGraphicsCounters[4] = m_Profiler.AddCounter("commands");
+	m_aGraphicsCounters[5] = m_Profiler.AddCounter("command buffers");
 
 	Console()->Chain("add_friend", ConchainFriendUpdate, this);
 	Console()->Chain("remove_friend", ConchainFriendUpdate, this);
@@ -333,6 +350,10 @@ void CGameClient::OnConsoleInit()
 
 	//
 	m_SuppressEvents = false;
+	m_PredictionPending = false;
+	m_Benchmark = false;
+	m_MapLoadState = MAPLOAD_NONE;
+	m_MapLoader.Init(Engine(), &m_Layers, &m_Collision);
 }
 
 void CGameClient::OnInit()
@@ -367,6 +388,12 @@ void CGameClient::OnInit()
 	m_pMenus->InitLoading(TotalWorkAmount);
 	m_pMenus->RenderLoading(4);
 
+	// start decoding the textures, they are needed only after the components are initialised
+	CImageLoader ImageLoader(Engine(), Graphics(), Console(), Config()->m_Debug);
+	for(int i = 0; i < g_pData->m_NumImages; i++)
+		ImageLoader.Add(g_pData->m_aImages[i].m_pFilename, IStorage::TYPE_ALL);
+	ImageLoader.Start();
+
 	// load default font
 	char aFontName[IO_MAX_PATH_LENGTH];
 	str_format(aFontName, sizeof(aFontName), "fonts/%s", Config()->m_ClFontfile);
@@ -392,12 +419,17 @@ void CGameClient::OnInit()
 	for(int i = m_All.m_Num-1; i >= 0; --i)
 		m_All.m_paComponents[i]->OnInit(); // this will call RenderLoading again
 
-	// load textures
+	// load textures, all but the repeating console images share atlas pages
+	Graphics()->AtlasBegin();
 	for(int i = 0; i < g_pData->m_NumImages; i++)
 	{
-		g_pData->m_aImages[i].m_Id = Graphics()->LoadTexture(g_pData->m_aImages[i].m_pFilename, IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, g_pData->m_aImages[i].m_Flag ? IGraphics::TEXLOAD_LINEARMIPMAPS : 0);
+		int Flags = g_pData->m_aImages[i].m_Flag ? IGraphics::TEXLOAD_LINEARMIPMAPS : 0;
+		if(i != IMAGE_CONSOLE_BG && i != IMAGE_CONSOLE_BAR)
+			Flags |= IGraphics::TEXLOAD_ATLAS;
+		g_pData->m_aImages[i].m_Id = ImageLoader.LoadTexture(i, Flags);
 		m_pMenus->RenderLoading(1);
 	}
+	Graphics()->AtlasEnd();
 
 	// init the editor
 	m_pEditor->Init();
@@ -420,6 +452,10 @@ void CGameClient::OnInit()
 
 void CGameClient::OnUpdate()
 {
+	// create the textures of the map for at most 4ms per update, so the client stays responsive
+	if(m_MapLoadState != MAPLOAD_NONE)
+		UpdateMapLoad(time_get()+time_freq()*4/1000);
+
 	// handle mouse movement
 	float x = 0.0f, y = 0.0f;
 	Input()->MouseRelative(&x, &y);
@@ -452,27 +488,84 @@ int CGameClient::OnSnapInput(int *pData)
 	return m_pControls->SnapInput(pData);
 }
 
-void CGameClient::OnConnected()
+void CGameClient::OnConnected(bool LoadMapNow)
 {
-	m_Layers.Init(Kernel());
-	m_Collision.Init(Layers());
+	AbortMapLoad();
 
+	// messages of the server can already arrive while the map loads
 	for(int i = 0; i < m_All.m_Num; i++)
-	{
-		m_All.m_paComponents[i]->OnMapLoad();
 		m_All.m_paComponents[i]->OnReset();
+
+	m_MapLoader.Start(Kernel()->RequestInterface<IMap>(), LoadMapNow);
+	if(LoadMapNow)
+	{
+		m_pMapimages->BeginGameMapLoad();
+		m_pMapimages->UpdateGameMapLoad(0);
+		FinishMapLoad();
+		return;
 	}
 
+	m_MapLoadState = MAPLOAD_DATA;
+}
+
+void CGameClient::UpdateMapLoad(int64 Deadline)
+{
+	if(m_MapLoadState == MAPLOAD_DATA)
+	{
+		if(!m_MapLoader.Done())
+			return;
+		m_pMapimages->BeginGameMapLoad();
+		m_MapLoadState = MAPLOAD_TEXTURES;
+	}
+
+	if(m_MapLoadState == MAPLOAD_TEXTURES && m_pMapimages->UpdateGameMapLoad(Deadline))
+		FinishMapLoad();
+}
+
+void CGameClient::FinishMapLoad()
+{
+	m_MapLoadState = MAPLOAD_NONE;
+	m_pMapimages->EndGameMapLoad();
+	m_Prediction.Init(Collision());
+
+	for(int i = 0; i < m_All.m_Num; i++)
+		m_All.m_paComponents[i]->OnMapLoad();
+
 	m_ServerMode = SERVERMODE_PURE;
 
 	// send the inital info
 	SendStartInfo();
 }
 
+void CGameClient::AbortMapLoad()
+{
+	m_MapLoader.Abort();
+	if(m_MapLoadState == MAPLOAD_TEXTURES)
+		m_pMapimages->EndGameMapLoad();
+	m_MapLoadState = MAPLOAD_NONE;
+}
+
+void CGameClient::OnMapUnload()
+{
+	// the job reads the map
+	AbortMapLoad();
+}
+
+float CGameClient::MapLoadProgress() const
+{
+	if(m_MapLoadState == MAPLOAD_DATA)
+		return 0.5f*m_MapLoader.Progress();
+	if(m_MapLoadState == MAPLOAD_TEXTURES)
+		return 0.5f+0.5f*m_pMapimages->GameMapLoadProgress();
+	return -1.0f;
+}
+
 void CGameClient::OnReset()
 {
 	// clear out the invalid pointers
 	m_LastNewPredictedTick = -1;
+	m_Prediction.Reset();
+	m_PredictionPending = false;
 	mem_zero(&m_Snap, sizeof(m_Snap));
 
 	for(int i = 0; i < MAX_CLIENTS; i++)
@@ -591,8 +684,61 @@ void CGameClient::StartRendering()
 	}
 }
 
+void CGameClient::UpdateProfiler()
+{
+	m_Profiler.SetEnabled(Config()->m_DbgProfiler || m_Benchmark);
+
+	// the graphics stats are from the frame that ends here
+	const IGraphics::CFrameStats &Stats = Graphics()->FrameStats();
+	m_Profiler.SetCounter(m_aGraphicsCounters[0], Stats.m_DrawCalls);
+	m_Profiler.SetCounter(m_aGraphicsCounters[1], Stats.m_MergedDrawCalls);
+	m_Profiler.SetCounter(m_aGraphicsCounters[2], Stats.m_Vertices);
+	m_Profiler.SetCounter(m_aGraphicsCounters[3], Stats.m_TextureSwitches);
+	m_Profiler.SetCounter(m_aGraphicsCounters[4], Stats.m_Commands);
+	m_Profiler.SetCounter(m_aGraphicsCounters[5], Stats.m_CommandBuffers);
+	m_Profiler.NextFrame();
+}
+
+void CGameClient::OnBenchmark(bool Running)
+{
+	m_Benchmark = Running;
+	if(Running)
+	{
+		m_Profiler.ResetTotals();
+		return;
+	}
+
+	const int Frames = m_Profiler.TotalFrames();
+	if(!Frames)
+		return;
+
+	// the cpu time of every scope that was measured
+	const float Scale = 1000.0f/time_freq();
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "%d frames measured, %.3fms per frame", Frames, m_Profiler.TotalFrameTime()*Scale/Frames);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "benchmark", aBuf);
+	for(int i = 0; i < m_Profiler.NumScopes(); i++)
+	{
+		if(!m_Profiler.ScopeTotal(i))
+			continue;
+		str_format(aBuf, sizeof(aBuf), "%s %s: avg=%.3fms max=%.3fms", m_Profiler.ScopeCategory(i), m_Profiler.ScopeName(i),
+			m_Profiler.ScopeTotal(i)*Scale/Frames, m_Profiler.ScopeTotalMax(i)*Scale);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "benchmark", aBuf);
+	}
+	for(int i = 0; i < m_Profiler.NumCounters(); i++)
+	{
+		str_format(aBuf, sizeof(aBuf), "%s: %d per frame", m_Profiler.CounterName(i), (int)(m_Profiler.CounterTotal(i)/Frames));
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "benchmark", aBuf);
+	}
+}
+
 void CGameClient::OnRender()
 {
+	UpdateProfiler();
+
+	// pick up the prediction of the job
+	UpdatePrediction();
+
 	// update the local character and spectate position
 	UpdatePositions();
 
@@ -600,7 +746,10 @@ void CGameClient::OnRender()
 
 	// render all systems
 	for(int i = 0; i < m_All.m_Num; i++)
+	{
+		CProfiler::CScopeTimer Timer(&m_Profiler, m_aRenderScopes[i]);
 		m_All.m_paComponents[i]->OnRender();
+	}
 
 	// clear all events/input for this frame
 	Input()->Clear();
@@ -802,7 +951,10 @@ void CGameClient::OnMessage(int MsgId, CUnpacker *pUnpacker)
 
 	// TODO: this should be done smarter
 	for(int i = 0; i < m_All.m_Num; i++)
+	{
+		CProfiler::CScopeTimer Timer(&m_Profiler, m_aMessageScopes[i]);
 		m_All.m_paComponents[i]->OnMessage(MsgId, pRawMsg);
+	}
 
 	if(MsgId == NETMSGTYPE_SV_CLIENTINFO && Client()->State() != IClient::STATE_DEMOPLAYBACK)
 	{
@@ -1023,6 +1175,9 @@ void CGameClient::OnStateChange(int NewState, int OldState)
 
 void CGameClient::OnShutdown()
 {
+	AbortMapLoad();
+	m_Prediction.Reset();
+
 	for(int i = 0; i < m_All.m_Num; i++)
 		m_All.m_paComponents[i]->OnShutdown();
 }
@@ -1129,6 +1284,8 @@ bool CompareTime(const CNetObj_PlayerInfo *Pl1, const CNetObj_PlayerInfo *Pl2)
 
 void CGameClient::OnNewSnapshot()
 {
+	CProfiler::CScopeTimer Timer(&m_Profiler, m_SnapshotScope);
+
 	// clear out the invalid pointers
 	mem_zero(&m_Snap, sizeof(m_Snap));
 
@@ -1506,9 +1663,7 @@ void CGameClient::OnDemoRecSnap()
 
 void CGameClient::OnPredict()
 {
-	// store the previous values so we can detect prediction errors
-	CCharacterCore BeforePrevChar = m_PredictedPrevChar;
-	CCharacterCore BeforeChar = m_PredictedChar;
+	CProfiler::CScopeTimer Timer(&m_Profiler, m_PredictScope);
 
 	// we can't predict without our own id or own character
 	if(m_LocalClientID == -1 || !m_Snap.m_aCharacters[m_LocalClientID].m_Active)
@@ -1524,74 +1679,80 @@ void CGameClient::OnPredict()
 		return;
 	}
 
-	// repredict character
-	CWorldCore World;
-	World.m_Tuning = m_Tuning;
-
-	// search for players
+	// copy everything the prediction needs, as it might run on a job
+	CPrediction::CRequest *pRequest = &m_PredictionRequest;
+	pRequest->m_LocalClientID = m_LocalClientID;
+	pRequest->m_BaseTick = Client()->GameTick();
+	// a lag spike can put the prediction tick out of the range of the kept states
+	pRequest->m_PredTick = clamp(Client()->PredGameTick(), pRequest->m_BaseTick+1, pRequest->m_BaseTick+CPrediction::MAX_TICKS-1);
+	pRequest->m_Tuning = m_Tuning;
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
-		if(!m_Snap.m_aCharacters[i].m_Active)
-			continue;
-
-		m_aClients[i].m_Predicted.Init(&World, Collision());
-		World.m_apCharacters[i] = &m_aClients[i].m_Predicted;
-		m_aClients[i].m_Predicted.Read(&m_Snap.m_aCharacters[i].m_Cur);
+		pRequest->m_aActive[i] = m_Snap.m_aCharacters[i].m_Active;
+		mem_zero(&pRequest->m_aCores[i], sizeof(pRequest->m_aCores[i]));
+		if(pRequest->m_aActive[i])
+		{
+			mem_copy(&pRequest->m_aCores[i], &m_Snap.m_aCharacters[i].m_Cur, sizeof(CNetObj_CharacterCore));
+			pRequest->m_aCores[i].m_Tick = 0;
+		}
 	}
-
-	// predict
-	for(int Tick = Client()->GameTick()+1; Tick <= Client()->PredGameTick(); Tick++)
+	for(int Tick = pRequest->m_BaseTick+1; Tick <= pRequest->m_PredTick; Tick++)
 	{
-		// fetch the local
-		if(Tick == Client()->PredGameTick() && World.m_apCharacters[m_LocalClientID])
-			m_PredictedPrevChar = *World.m_apCharacters[m_LocalClientID];
-
-		// first calculate where everyone should move
-		for(int c = 0; c < MAX_CLIENTS; c++)
-		{
-			if(!World.m_apCharacters[c])
-				continue;
+		int Input = Tick-pRequest->m_BaseTick-1;
+		const int *pInput = Client()->GetInput(Tick);
+		pRequest->m_aHasInput[Input] = pInput != 0;
+		if(pInput)
+			pRequest->m_aInputs[Input] = *((const CNetObj_PlayerInput*)pInput);
+	}
 
-			mem_zero(&World.m_apCharacters[c]->m_Input, sizeof(World.m_apCharacters[c]->m_Input));
-			if(m_LocalClientID == c)
-			{
-				// apply player input
-				const int *pInput = Client()->GetInput(Tick);
-				if(pInput)
-					World.m_apCharacters[c]->m_Input = *((const CNetObj_PlayerInput*)pInput);
-				World.m_apCharacters[c]->Tick(true);
-			}
-			else
-				World.m_apCharacters[c]->Tick(false);
+	m_PredictionPending = true;
+	UpdatePrediction();
+}
 
-		}
+void CGameClient::UpdatePrediction()
+{
+	CPrediction::CResult Result;
+	if(m_Prediction.Fetch(&Result))
+		ApplyPrediction(&Result);
 
-		// move all players and quantize their data
-		for(int c = 0; c < MAX_CLIENTS; c++)
-		{
-			if(!World.m_apCharacters[c])
-				continue;
+	// a running job owns the predicted states, the newest request waits for it
+	if(!m_PredictionPending || m_Prediction.Running())
+		return;
 
-			World.m_apCharacters[c]->AddDragVelocity();
-			World.m_apCharacters[c]->ResetDragVelocity();
-			World.m_apCharacters[c]->Move();
-			World.m_apCharacters[c]->Quantize();
-		}
+	m_PredictionPending = false;
+	m_PredictionRequest.m_LastNewPredictedTick = m_LastNewPredictedTick;
+	if(Config()->m_ClPredictThreaded)
+		m_Prediction.Start(Engine(), &m_PredictionRequest);
+	else
+	{
+		m_Prediction.Predict(&m_PredictionRequest, &Result);
+		ApplyPrediction(&Result);
+	}
+}
 
-		// check if we want to trigger effects
-		if(Tick > m_LastNewPredictedTick)
-		{
-			m_LastNewPredictedTick = Tick;
+void CGameClient::ApplyPrediction(const CPrediction::CResult *pResult)
+{
+	// the game might have changed while the job was running
+	if(m_LocalClientID == -1 || IsWorldPaused())
+		return;
 
-			if(m_LocalClientID != -1 && World.m_apCharacters[m_LocalClientID])
-				ProcessTriggeredEvents(World.m_apCharacters[m_LocalClientID]->m_TriggeredEvents, World.m_apCharacters[m_LocalClientID]->m_Pos);
-		}
+	// store the previous values so we can detect prediction errors
+	CCharacterCore BeforePrevChar = m_PredictedPrevChar;
+	CCharacterCore BeforeChar = m_PredictedChar;
+	m_PredictedPrevChar = pResult->m_PrevChar;
+	m_PredictedChar = pResult->m_Char;
 
-		if(Tick == Client()->PredGameTick() && World.m_apCharacters[m_LocalClientID])
-			m_PredictedChar = *World.m_apCharacters[m_LocalClientID];
+	// trigger the effects of the newly predicted ticks
+	for(int i = 0; i < pResult->m_NumEvents; i++)
+	{
+		const CPrediction::CEvent *pEvent = &pResult->m_aEvents[i];
+		if(pEvent->m_Tick <= m_LastNewPredictedTick)
+			continue;
+		m_LastNewPredictedTick = pEvent->m_Tick;
+		ProcessTriggeredEvents(pEvent->m_Events, pEvent->m_Pos);
 	}
 
-	if(Config()->m_Debug && Config()->m_ClPredict && m_PredictedTick == Client()->PredGameTick())
+	if(Config()->m_Debug && Config()->m_ClPredict && m_PredictedTick == pResult->m_PredTick)
 	{
 		CNetObj_CharacterCore Before = {0}, Now = {0}, BeforePrev = {0}, NowPrev = {0};
 		BeforeChar.Write(&Before);
@@ -1612,7 +1773,7 @@ void CGameClient::OnPredict()
 		}
 	}
 
-	m_PredictedTick = Client()->PredGameTick();
+	m_PredictedTick = pResult->m_PredTick;
 }
 
 void CGameClient::OnActivateEditor()
@@ -1881,6 +2042,29 @@ void CGameClient::ConReadyChange(IConsole::IResult *pResult, void *pUserData)
 		pClient->SendReadyChange();
 }
 
+void CGameClient::ConProfilerTrace(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameClient *pClient = static_cast<CGameClient *>(pUserData);
+	int Frames = pResult->NumArguments() ? max(pResult->GetInteger(0), 1) : 300;
+
+	char aDate[20];
+	char aFilename[128];
+	str_timestamp(aDate, sizeof(aDate));
+	str_format(aFilename, sizeof(aFilename), "dumps/profile_%s.json", aDate);
+	IOHANDLE File = pClient->Storage()->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	char aBuf[256];
+	if(!File)
+	{
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s'", aFilename);
+		pClient->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profiler", aBuf);
+		return;
+	}
+
+	pClient->m_Profiler.StartTrace(File, Frames);
+	str_format(aBuf, sizeof(aBuf), "writing %d frames to '%s'", Frames, aFilename);
+	pClient->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "profiler", aBuf);
+}
+
 void CGameClient::ConchainSkinChange(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -6,8 +6,11 @@
 #include <base/vmath.h>
 #include <engine/client.h>
 #include <engine/console.h>
+#include <engine/shared/profiler.h>
 #include <game/layers.h>
 #include <game/gamecore.h>
+#include <game/maploader.h>
+#include "prediction.h"
 #include "render.h"
 
 class CGameClient : public IGameClient
@@ -21,9 +24,10 @@ class CGameClient : public IGameClient
 		};
 
 		CStack();
-		void Add(class CComponent *pComponent);
+		void Add(class CComponent *pComponent, const char *pName = 0);
 
 		class CComponent *m_paComponents[MAX_COMPONENTS];
+		const char *m_apNames[MAX_COMPONENTS];
 		int m_Num;
 	};
 
@@ -58,6 +62,34 @@ class CGameClient : public IGameClient
 	int m_PredictedTick;
 	int m_LastNewPredictedTick;
 
+	CProfiler m_Profiler;
+	int m_aRenderScopes[CStack::MAX_COMPONENTS];
+	int m_aMessageScopes[CStack::MAX_COMPONENTS];
+	int m_SnapshotScope;
+	int m_PredictScope;
+	int m_aGraphicsCounters[6];
+	bool m_Benchmark;
+	void UpdateProfiler();
+
+	CPrediction m_Prediction;
+	CPrediction::CRequest m_PredictionRequest;
+	bool m_PredictionPending;
+	void UpdatePrediction();
+	void ApplyPrediction(const CPrediction::CResult *pResult);
+
+	// the map data is decompressed on a job, the textures are created over several updates after it
+	enum
+	{
+		MAPLOAD_NONE=0,
+		MAPLOAD_DATA,
+		MAPLOAD_TEXTURES,
+	};
+	CMapLoader m_MapLoader;
+	int m_MapLoadState;
+	void UpdateMapLoad(int64 Deadline);
+	void FinishMapLoad();
+	void AbortMapLoad();
+
 	int m_LastGameStartTick;
 	int m_LastFlagCarrierRed;
 	int m_LastFlagCarrierBlue;
@@ -65,6 +97,7 @@ class CGameClient : public IGameClient
 	static void ConTeam(IConsole::IResult *pResult, void *pUserData);
 	static void ConKill(IConsole::IResult *pResult, void *pUserData);
 	static void ConReadyChange(IConsole::IResult *pResult, void *pUserData);
+	static void ConProfilerTrace(IConsole::IResult *pResult, void *pUserData);
 	static void ConchainSkinChange(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainFriendUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainBlacklistUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -93,6 +126,9 @@ public:
 	class IEditor *Editor() { return m_pEditor; }
 	class IFriends *Friends() { return m_pFriends; }
 	class IBlacklist *Blacklist() { return m_pBlacklist; }
+	const CProfiler *Profiler() const { return &m_Profiler; }
+	// between 0 and 1 while the map is loading, -1 otherwise
+	float MapLoadProgress() const;
 
 	const char *NetobjFailedOn() { return m_NetObjHandler.FailedObjOn(); };
 	int NetobjNumFailures() { return m_NetObjHandler.NumObjFailures(); };
@@ -189,7 +225,6 @@ public:
 		int m_Team;
 		int m_Emoticon;
 		int m_EmoticonStart;
-		CCharacterCore m_Predicted;
 
 		CTeeRenderInfo m_SkinInfo; // this is what the server reports
 		CTeeRenderInfo m_RenderInfo; // this is what we use
@@ -243,7 +278,9 @@ public:
 	void OnReset();
 
 	// hooks
-	virtual void OnConnected();
+	virtual void OnConnected(bool LoadMapNow);
+	virtual void OnMapUnload();
+	virtual void OnBenchmark(bool Running);
 	virtual void OnRender();
 	virtual void OnUpdate();
 	virtual void OnRelease();
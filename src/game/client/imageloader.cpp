@@ -0,0 +1,193 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
+#include <engine/console.h>
+#include <engine/engine.h>
+
+#include "imageloader.h"
+
+CImageLoader::CImageLoader(IEngine *pEngine, IGraphics *pGraphics, IConsole *pConsole, bool Profile)
+{
+	m_pEngine = pEngine;
+	m_pGraphics = pGraphics;
+	m_pConsole = pConsole;
+	m_Profile = Profile;
+	m_NumWorkers = 0;
+	m_Started = false;
+	m_Lock = lock_create();
+	m_NextImage = 0;
+	m_StartTime = 0;
+}
+
+CImageLoader::~CImageLoader()
+{
+	Finish();
+	lock_destroy(m_Lock);
+}
+
+int CImageLoader::WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+	while(pWorker->m_pLoader->DecodeNext(pWorker->m_Index));
+	return 0;
+}
+
+bool CImageLoader::DecodeNext(int Worker)
+{
+	lock_wait(m_Lock);
+	int Index = m_NextImage < m_lImages.size() ? m_NextImage++ : -1;
+	lock_unlock(m_Lock);
+	if(Index < 0)
+		return false;
+
+	CImage *pImage = &m_lImages[Index];
+	if(pImage->m_Skipped)
+		return true;
+
+	int64 Start = time_get();
+	pImage->m_Loaded = m_pGraphics->LoadPNG(&pImage->m_Info, pImage->m_aFilename, pImage->m_StorageType) != 0;
+	pImage->m_DecodeTime = time_get()-Start;
+	pImage->m_Worker = Worker;
+
+	// the lock makes sure the image is complete once it is seen as done
+	lock_wait(m_Lock);
+	pImage->m_Done = true;
+	lock_unlock(m_Lock);
+	return true;
+}
+
+bool CImageLoader::IsDone(int Index)
+{
+	lock_wait(m_Lock);
+	bool Done = m_lImages[Index].m_Done;
+	lock_unlock(m_Lock);
+	return Done;
+}
+
+int CImageLoader::Add(const char *pFilename, int StorageType)
+{
+	dbg_assert(!m_Started, "images can't be added while loading");
+
+	CImage Image;
+	mem_zero(&Image, sizeof(Image));
+	str_copy(Image.m_aFilename, pFilename, sizeof(Image.m_aFilename));
+	Image.m_StorageType = StorageType;
+	Image.m_Worker = -1;
+	if(str_length(pFilename) < 3)
+	{
+		Image.m_Skipped = true;
+		Image.m_Done = true;
+	}
+	return m_lImages.add(Image);
+}
+
+void CImageLoader::Start()
+{
+	if(m_Started)
+		return;
+	m_Started = true;
+	m_StartTime = time_get();
+
+	// the images are fetched one by one, so late jobs just find nothing left to do
+	m_NumWorkers = min((int)MAX_JOBS, m_lImages.size()-m_NextImage);
+	for(int i = 0; i < m_NumWorkers; i++)
+	{
+		m_aWorkers[i].m_pLoader = this;
+		m_aWorkers[i].m_Index = i;
+		m_pEngine->AddJob(&m_aWorkers[i].m_Job, WorkerThread, &m_aWorkers[i]);
+	}
+}
+
+void CImageLoader::Finish()
+{
+	if(!m_Started && !m_lImages.size())
+		return;
+
+	// every image is taken by now, the jobs finish the ones they took
+	while(DecodeNext(-1));
+
+	// the jobs reference this loader, so they have to be done before it goes away
+	for(int i = 0; i < m_NumWorkers; i++)
+		m_pEngine->WaitJob(&m_aWorkers[i].m_Job);
+
+	int64 DecodeTime = 0;
+	for(int i = 0; i < m_lImages.size(); i++)
+	{
+		DecodeTime += m_lImages[i].m_DecodeTime;
+		Release(i);
+	}
+	if(m_Profile)
+	{
+		char aBuf[128];
+		str_format(aBuf, sizeof(aBuf), "%d images loaded in %.2fms, decoding took %.2fms on %d jobs",
+			m_lImages.size(), (time_get()-m_StartTime)*1000.0f/time_freq(), DecodeTime*1000.0f/time_freq(), m_NumWorkers);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "imageloader", aBuf);
+	}
+
+	m_lImages.clear();
+	m_NumWorkers = 0;
+	m_NextImage = 0;
+	m_Started = false;
+}
+
+CImageInfo *CImageLoader::Get(int Index)
+{
+	CImage *pImage = &m_lImages[Index];
+	if(!IsDone(Index))
+	{
+		int64 Start = time_get();
+		while(!IsDone(Index))
+		{
+			if(!DecodeNext(-1))
+				thread_yield();
+		}
+		pImage->m_WaitTime += time_get()-Start;
+	}
+	return pImage->m_Loaded && !pImage->m_Released ? &pImage->m_Info : 0;
+}
+
+void CImageLoader::Release(int Index)
+{
+	CImage *pImage = &m_lImages[Index];
+	if(pImage->m_Released)
+		return;
+	pImage->m_Released = true;
+	if(pImage->m_Loaded)
+		mem_free(pImage->m_Info.m_pData);
+
+	if(m_Profile && !pImage->m_Skipped)
+	{
+		char aWorker[16];
+		if(pImage->m_Worker < 0)
+			str_copy(aWorker, "main", sizeof(aWorker));
+		else
+			str_format(aWorker, sizeof(aWorker), "job %d", pImage->m_Worker);
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "'%s' decode=%.2fms (%s) wait=%.2fms upload=%.2fms%s", pImage->m_aFilename,
+			pImage->m_DecodeTime*1000.0f/time_freq(), aWorker, pImage->m_WaitTime*1000.0f/time_freq(),
+			pImage->m_UploadTime*1000.0f/time_freq(), pImage->m_Loaded ? "" : " failed");
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "imageloader", aBuf);
+	}
+}
+
+IGraphics::CTextureHandle CImageLoader::LoadTexture(int Index, int Flags)
+{
+	// LoadPNG already reported a failed decode, hand out the placeholder then
+	if(m_lImages[Index].m_Skipped)
+	{
+		Release(Index);
+		return IGraphics::CTextureHandle();
+	}
+
+	IGraphics::CTextureHandle Texture = m_pGraphics->InvalidTexture();
+	CImageInfo *pInfo = Get(Index);
+	if(pInfo)
+	{
+		int64 Start = time_get();
+		Texture = m_pGraphics->LoadTextureRaw(pInfo->m_Width, pInfo->m_Height, pInfo->m_Format, pInfo->m_pData, pInfo->m_Format, Flags);
+		m_lImages[Index].m_UploadTime = time_get()-Start;
+	}
+	Release(Index);
+	return Texture;
+}
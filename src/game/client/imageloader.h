@@ -0,0 +1,85 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_CLIENT_IMAGELOADER_H
+#define GAME_CLIENT_IMAGELOADER_H
+
+#include <base/system.h>
+#include <base/tl/array.h>
+
+#include <engine/graphics.h>
+#include <engine/shared/jobs.h>
+
+/*
+	Decodes a batch of PNG files on the job pool. Images are queued with
+	Add() and decoded in parallel after Start(). The results are picked up
+	on the main thread with Get() or LoadTexture(), as textures can only be
+	created there. The main thread helps decoding while it has to wait.
+*/
+class CImageLoader
+{
+	enum
+	{
+		MAX_JOBS=4,
+	};
+
+	struct CImage
+	{
+		char m_aFilename[IO_MAX_PATH_LENGTH];
+		int m_StorageType;
+		CImageInfo m_Info;
+		bool m_Skipped;
+		bool m_Loaded;
+		bool m_Released;
+		int m_Worker;
+		int64 m_DecodeTime;
+		int64 m_WaitTime;
+		int64 m_UploadTime;
+		bool m_Done;
+	};
+
+	struct CWorker
+	{
+		CImageLoader *m_pLoader;
+		int m_Index;
+		CJob m_Job;
+	};
+
+	class IEngine *m_pEngine;
+	IGraphics *m_pGraphics;
+	class IConsole *m_pConsole;
+	bool m_Profile;
+
+	array<CImage> m_lImages;
+	CWorker m_aWorkers[MAX_JOBS];
+	int m_NumWorkers;
+	bool m_Started;
+	LOCK m_Lock;
+	int m_NextImage;
+	int64 m_StartTime;
+
+	static int WorkerThread(void *pUser);
+	bool DecodeNext(int Worker);
+
+public:
+	// profile prints the timings of every image to the console
+	CImageLoader(class IEngine *pEngine, IGraphics *pGraphics, class IConsole *pConsole, bool Profile);
+	~CImageLoader();
+
+	// names that are too short to be files, like the ones of unused images, are skipped
+	int Add(const char *pFilename, int StorageType);
+	void Start();
+	void Finish();
+
+	// checks without waiting whether the image is decoded
+	bool IsDone(int Index);
+	// waits for the image, returns 0 if it failed to load or was skipped
+	CImageInfo *Get(int Index);
+	void Release(int Index);
+	IGraphics::CTextureHandle LoadTexture(int Index, int Flags);
+
+	int Num() const { return m_lImages.size(); }
+	const char *Filename(int Index) const { return m_lImages[Index].m_aFilename; }
+	int StorageType(int Index) const { return m_lImages[Index].m_StorageType; }
+};
+
+#endif
@@ -0,0 +1,195 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <base/tl/threading.h>
+
+#include <engine/engine.h>
+
+#include "prediction.h"
+
+CPrediction::CPrediction()
+{
+	m_pEngine = 0;
+	m_pCollision = 0;
+	m_Running = false;
+	Reset();
+}
+
+void CPrediction::Init(CCollision *pCollision)
+{
+	Reset();
+	m_pCollision = pCollision;
+}
+
+void CPrediction::Reset()
+{
+	// the job uses the states and the collision of the map
+	if(m_pEngine)
+		m_pEngine->WaitJob(&m_Job);
+	m_Running = false;
+
+	for(int i = 0; i < MAX_TICKS; i++)
+		m_aStates[i].m_Tick = -1;
+	m_LastTick = -1;
+	m_LocalClientID = -1;
+	mem_zero(&m_Tuning, sizeof(m_Tuning));
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aCharacters[i].Reset();
+}
+
+bool CPrediction::MatchesSnapshot(const CState *pState, const CRequest *pRequest) const
+{
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pState->m_aActive[i] != pRequest->m_aActive[i])
+			return false;
+		if(pState->m_aActive[i] && mem_comp(&pState->m_aCores[i], &pRequest->m_aCores[i], sizeof(CNetObj_CharacterCore)) != 0)
+			return false;
+	}
+	return true;
+}
+
+void CPrediction::Simulate(const CState *pPrev, CState *pState, int LocalClientID)
+{
+	m_World.m_Tuning = m_Tuning;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		pState->m_aActive[i] = pPrev->m_aActive[i];
+		if(!pPrev->m_aActive[i])
+		{
+			m_World.m_apCharacters[i] = 0;
+			continue;
+		}
+
+		m_aCharacters[i].Init(&m_World, m_pCollision);
+		m_aCharacters[i].Read(&pPrev->m_aCores[i]);
+		m_World.m_apCharacters[i] = &m_aCharacters[i];
+	}
+
+	// first calculate where everyone should move
+	for(int c = 0; c < MAX_CLIENTS; c++)
+	{
+		if(!m_World.m_apCharacters[c])
+			continue;
+
+		mem_zero(&m_aCharacters[c].m_Input, sizeof(m_aCharacters[c].m_Input));
+		if(c == LocalClientID)
+		{
+			if(pState->m_HasInput)
+				m_aCharacters[c].m_Input = pState->m_Input;
+			m_aCharacters[c].Tick(true);
+		}
+		else
+			m_aCharacters[c].Tick(false);
+	}
+
+	// move all players and quantize their data
+	for(int c = 0; c < MAX_CLIENTS; c++)
+	{
+		if(!m_World.m_apCharacters[c])
+			continue;
+
+		m_aCharacters[c].AddDragVelocity();
+		m_aCharacters[c].ResetDragVelocity();
+		m_aCharacters[c].Move();
+		mem_zero(&pState->m_aCores[c], sizeof(pState->m_aCores[c]));
+		m_aCharacters[c].Write(&pState->m_aCores[c]);
+	}
+}
+
+void CPrediction::Predict(const CRequest *pRequest, CResult *pResult)
+{
+	const int BaseTick = pRequest->m_BaseTick;
+	const int PredTick = clamp(pRequest->m_PredTick, BaseTick+1, BaseTick+MAX_TICKS-1);
+	const int Local = pRequest->m_LocalClientID;
+
+	pResult->m_PredTick = PredTick;
+	pResult->m_NumSimulated = 0;
+	pResult->m_NumEvents = 0;
+
+	// everything predicted so far is useless with another player or other physics
+	if(m_LocalClientID != Local || mem_comp(&m_Tuning, &pRequest->m_Tuning, sizeof(m_Tuning)) != 0)
+	{
+		for(int i = 0; i < MAX_TICKS; i++)
+			m_aStates[i].m_Tick = -1;
+		m_LocalClientID = Local;
+		m_Tuning = pRequest->m_Tuning;
+	}
+
+	// keep the predicted ticks if the snapshot confirms the prediction of its tick
+	CState *pBase = &m_aStates[BaseTick%MAX_TICKS];
+	bool Valid = pBase->m_Tick == BaseTick && BaseTick <= m_LastTick && MatchesSnapshot(pBase, pRequest);
+	if(!Valid)
+	{
+		pBase->m_Tick = BaseTick;
+		pBase->m_HasInput = false;
+		mem_copy(pBase->m_aActive, pRequest->m_aActive, sizeof(pBase->m_aActive));
+		mem_copy(pBase->m_aCores, pRequest->m_aCores, sizeof(pBase->m_aCores));
+	}
+
+	for(int Tick = BaseTick+1; Tick <= PredTick; Tick++)
+	{
+		CState *pState = &m_aStates[Tick%MAX_TICKS];
+		int Input = Tick-BaseTick-1;
+		bool HasInput = pRequest->m_aHasInput[Input];
+		if(Valid && pState->m_Tick == Tick && Tick <= m_LastTick && pState->m_HasInput == HasInput &&
+			(!HasInput || mem_comp(&pState->m_Input, &pRequest->m_aInputs[Input], sizeof(CNetObj_PlayerInput)) == 0))
+			continue;
+
+		// from here on every tick has to be simulated again
+		Valid = false;
+		pState->m_Tick = Tick;
+		pState->m_HasInput = HasInput;
+		if(HasInput)
+			pState->m_Input = pRequest->m_aInputs[Input];
+		else
+			mem_zero(&pState->m_Input, sizeof(pState->m_Input));
+		Simulate(&m_aStates[(Tick-1)%MAX_TICKS], pState, Local);
+		pResult->m_NumSimulated++;
+
+		// effects are only triggered the first time a tick is predicted
+		if(Tick > pRequest->m_LastNewPredictedTick && pState->m_aActive[Local] && pResult->m_NumEvents < MAX_TICKS)
+		{
+			CEvent *pEvent = &pResult->m_aEvents[pResult->m_NumEvents++];
+			pEvent->m_Tick = Tick;
+			pEvent->m_Events = m_aCharacters[Local].m_TriggeredEvents;
+			pEvent->m_Pos = m_aCharacters[Local].m_Pos;
+		}
+	}
+
+	// states after the prediction tick might belong to an older prediction
+	m_LastTick = PredTick;
+
+	pResult->m_PrevChar.Reset();
+	pResult->m_PrevChar.Read(&m_aStates[(PredTick-1)%MAX_TICKS].m_aCores[Local]);
+	pResult->m_Char.Reset();
+	pResult->m_Char.Read(&m_aStates[PredTick%MAX_TICKS].m_aCores[Local]);
+}
+
+int CPrediction::PredictJob(void *pUser)
+{
+	CPrediction *pSelf = (CPrediction *)pUser;
+	pSelf->Predict(&pSelf->m_JobRequest, &pSelf->m_JobResult);
+	return 0;
+}
+
+void CPrediction::Start(IEngine *pEngine, const CRequest *pRequest)
+{
+	dbg_assert(!m_Running, "prediction job is already running");
+	mem_copy(&m_JobRequest, pRequest, sizeof(m_JobRequest));
+	m_Running = true;
+	m_pEngine = pEngine;
+	pEngine->AddJob(&m_Job, PredictJob, this);
+}
+
+bool CPrediction::Fetch(CResult *pResult)
+{
+	if(!m_Running || m_Job.Status() != CJob::STATE_DONE)
+		return false;
+
+	sync_barrier();
+	mem_copy(pResult, &m_JobResult, sizeof(*pResult));
+	m_Running = false;
+	return true;
+}
@@ -0,0 +1,103 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_CLIENT_PREDICTION_H
+#define GAME_CLIENT_PREDICTION_H
+
+#include <engine/client.h>
+#include <engine/shared/jobs.h>
+#include <game/gamecore.h>
+
+/*
+	Predicts the characters from the snapshot tick up to the prediction
+	tick. The predicted states of the past ticks are kept, so a new
+	snapshot or input only simulates the ticks from the first one that
+	changed. The prediction can also run on a job, its result is then
+	picked up with Fetch() on a later frame.
+*/
+class CPrediction
+{
+public:
+	enum
+	{
+		// the client keeps no inputs beyond that anyway
+		MAX_TICKS=IClient::MAX_INPUTS,
+	};
+
+	struct CRequest
+	{
+		int m_LocalClientID;
+		int m_BaseTick;
+		int m_PredTick;
+		int m_LastNewPredictedTick;
+		CTuningParams m_Tuning;
+		bool m_aActive[MAX_CLIENTS];
+		CNetObj_CharacterCore m_aCores[MAX_CLIENTS];
+
+		// local inputs of the ticks after the base tick
+		bool m_aHasInput[MAX_TICKS];
+		CNetObj_PlayerInput m_aInputs[MAX_TICKS];
+	};
+
+	struct CEvent
+	{
+		int m_Tick;
+		int m_Events;
+		vec2 m_Pos;
+	};
+
+	struct CResult
+	{
+		int m_PredTick;
+		CCharacterCore m_PrevChar;
+		CCharacterCore m_Char;
+		int m_NumSimulated;
+		int m_NumEvents;
+		CEvent m_aEvents[MAX_TICKS];
+	};
+
+private:
+	struct CState
+	{
+		int m_Tick;
+		bool m_HasInput;
+		CNetObj_PlayerInput m_Input;
+		bool m_aActive[MAX_CLIENTS];
+		CNetObj_CharacterCore m_aCores[MAX_CLIENTS];
+	};
+
+	CCollision *m_pCollision;
+	CState m_aStates[MAX_TICKS];
+	int m_LastTick;
+	int m_LocalClientID;
+	CTuningParams m_Tuning;
+
+	CWorldCore m_World;
+	CCharacterCore m_aCharacters[MAX_CLIENTS];
+
+	class IEngine *m_pEngine;
+	CJob m_Job;
+	bool m_Running;
+	CRequest m_JobRequest;
+	CResult m_JobResult;
+
+	static int PredictJob(void *pUser);
+	bool MatchesSnapshot(const CState *pState, const CRequest *pRequest) const;
+	void Simulate(const CState *pPrev, CState *pState, int LocalClientID);
+
+public:
+	CPrediction();
+
+	void Init(CCollision *pCollision);
+	// waits for a running job and forgets all predicted states
+	void Reset();
+
+	// predicts at most MAX_TICKS-1 ticks after the base tick
+	void Predict(const CRequest *pRequest, CResult *pResult);
+
+	bool Running() const { return m_Running; }
+	void Start(class IEngine *pEngine, const CRequest *pRequest);
+	// returns true once with the result of the finished job
+	bool Fetch(CResult *pResult);
+};
+
+#endif
@@ -24,6 +24,19 @@ void CRenderTools::Init(CConfig *pConfig, IGraphics *pGraphics, CUI *pUI)
 }
 
 void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
+{
+	int w = pSpr->m_W;
+	int h = pSpr->m_H;
+	float f = sqrtf(h*h + w*w);
+	gs_SpriteWScale = w/f;
+	gs_SpriteHScale = h/f;
+
+	float aSubset[4];
+	GetSpriteSubset(pSpr, Flags, sx, sy, aSubset);
+	Graphics()->QuadsSetSubset(aSubset[0], aSubset[1], aSubset[2], aSubset[3]);
+}
+
+void CRenderTools::GetSpriteSubset(CDataSprite *pSpr, int Flags, int sx, int sy, float *pSubset)
 {
 	int x = pSpr->m_X+sx;
 	int y = pSpr->m_Y+sy;
@@ -32,10 +45,6 @@ void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
 	int cx = pSpr->m_pSet->m_Gridx;
 	int cy = pSpr->m_pSet->m_Gridy;
 
-	float f = sqrtf(h*h + w*w);
-	gs_SpriteWScale = w/f;
-	gs_SpriteHScale = h/f;
-
 	float x1 = x/(float)cx + 0.5f/(float)(cx*32);
 	float x2 = (x+w)/(float)cx - 0.5f/(float)(cx*32);
 	float y1 = y/(float)cy + 0.5f/(float)(cy*32);
@@ -57,7 +66,10 @@ void CRenderTools::SelectSprite(CDataSprite *pSpr, int Flags, int sx, int sy)
 		x2 = Temp;
 	}
 
-	Graphics()->QuadsSetSubset(x1, y1, x2, y2);
+	pSubset[0] = x1;
+	pSubset[1] = y1;
+	pSubset[2] = x2;
+	pSubset[3] = y2;
 }
 
 void CRenderTools::SelectSprite(int Id, int Flags, int sx, int sy)
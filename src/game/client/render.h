@@ -5,6 +5,7 @@
 
 #include <engine/graphics.h>
 #include <base/vmath.h>
+#include <base/tl/array.h>
 #include <generated/protocol.h>
 #include <game/mapitems.h>
 #include "ui.h"
@@ -20,6 +21,44 @@ enum
 	LAYERRENDERFLAG_TRANSPARENT = 2,
 
 	TILERENDERFLAG_EXTEND = 4,
+	TILERENDERFLAG_OUTSIDE = 8, // only the extended border around the map
+};
+
+// a tile layer kept in a vertex buffer
+class CTilemapBuffer
+{
+public:
+	enum
+	{
+		CHUNK_SIZE=16,
+	};
+
+	IGraphics::CBufferHandle m_Buffer;
+	int m_Width;
+	int m_Height;
+	float m_Scale;
+	int m_NumChunksX;
+	int m_NumChunksY;
+
+	// quad offset of every chunk, the opaque tiles of all chunks come
+	// first, then the others. the last entry is the total
+	array<int> m_lChunkStarts;
+};
+
+// a quad layer without envelopes kept in a vertex buffer
+class CQuadsBuffer
+{
+public:
+	struct CRun
+	{
+		int m_Start;
+		int m_Count;
+		int m_WrapU;
+		int m_WrapV;
+	};
+
+	IGraphics::CBufferHandle m_Buffer;
+	array<CRun> m_lRuns; // consecutive quads with the same wrap mode
 };
 
 class CTeeRenderInfo
@@ -63,6 +102,8 @@ public:
 	void Init(class CConfig *pConfig, class IGraphics *pGraphics, class CUI *pUI);
 
 	void SelectSprite(struct CDataSprite *pSprite, int Flags=0, int sx=0, int sy=0);
+	// the texture coordinates SelectSprite sets, as x1, y1, x2, y2
+	void GetSpriteSubset(struct CDataSprite *pSprite, int Flags, int sx, int sy, float *pSubset);
 	void SelectSprite(int id, int Flags=0, int sx=0, int sy=0);
 
 	void DrawSprite(float x, float y, float size);
@@ -83,6 +124,12 @@ public:
 	void RenderQuads(CQuad *pQuads, int NumQuads, int Flags, ENVELOPE_EVAL pfnEval, void *pUser);
 	void RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4 Color, int RenderFlags, ENVELOPE_EVAL pfnEval, void *pUser, int ColorEnv, int ColorEnvOffset);
 
+	// static layers in vertex buffers, see IGraphics::BuffersSupported
+	void CreateTilemapBuffer(CTilemapBuffer *pBuffer, CTile *pTiles, int w, int h, float Scale);
+	void RenderTilemapBuffer(const CTilemapBuffer *pBuffer, CTile *pTiles, vec4 Color, int RenderFlags, ENVELOPE_EVAL pfnEval, void *pUser, int ColorEnv, int ColorEnvOffset);
+	bool CreateQuadsBuffer(CQuadsBuffer *pBuffer, CQuad *pQuads, int NumQuads);
+	void RenderQuadsBuffer(const CQuadsBuffer *pBuffer);
+
 	// helpers
 	void MapScreenToWorld(float CenterX, float CenterY, float ParallaxX, float ParallaxY,
 		float OffsetX, float OffsetY, float Aspect, float Zoom, float aPoints[4]);
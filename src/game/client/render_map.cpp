@@ -224,6 +224,71 @@ static void Rotate(CPoint *pCenter, CPoint *pPoint, float Rotation)
 	pPoint->y = (int)(x * sinf(Rotation) + y * cosf(Rotation) + pCenter->y);
 }
 
+static void GetQuadWrapMode(const CQuad *pQuad, int *pWrapU, int *pWrapV)
+{
+	// Check if we want to repeat the texture
+	// Otherwise clamp to the edge to prevent texture bleeding
+	bool RepeatU = false, RepeatV = false;
+	for(int k = 0; k < 4; k++)
+	{
+		float u = fx2f(pQuad->m_aTexcoords[k].x);
+		float v = fx2f(pQuad->m_aTexcoords[k].y);
+		if(u < 0.0f || u > 1.0f)
+			RepeatU = true;
+		if(v < 0.0f || v > 1.0f)
+			RepeatV = true;
+	}
+	*pWrapU = RepeatU ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP;
+	*pWrapV = RepeatV ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP;
+}
+
+static void GetTileTexCoords(int Flags, float *pCoords)
+{
+	float x0 = 0;
+	float y0 = 0;
+	float x1 = 1;
+	float y1 = 0;
+	float x2 = 1;
+	float y2 = 1;
+	float x3 = 0;
+	float y3 = 1;
+
+	if(Flags&TILEFLAG_VFLIP)
+	{
+		x0 = x2;
+		x1 = x3;
+		x2 = x3;
+		x3 = x0;
+	}
+
+	if(Flags&TILEFLAG_HFLIP)
+	{
+		y0 = y3;
+		y2 = y1;
+		y3 = y1;
+		y1 = y0;
+	}
+
+	if(Flags&TILEFLAG_ROTATE)
+	{
+		float Tmp = x0;
+		x0 = x3;
+		x3 = x2;
+		x2 = x1;
+		x1 = Tmp;
+		Tmp = y0;
+		y0 = y3;
+		y3 = y2;
+		y2 = y1;
+		y1 = Tmp;
+	}
+
+	pCoords[0] = x0; pCoords[1] = y0;
+	pCoords[2] = x1; pCoords[3] = y1;
+	pCoords[4] = x2; pCoords[5] = y2;
+	pCoords[6] = x3; pCoords[7] = y3;
+}
+
 void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENVELOPE_EVAL pfnEval, void *pUser)
 {
 	Graphics()->QuadsBegin();
@@ -261,19 +326,9 @@ void CRenderTools::RenderQuads(CQuad *pQuads, int NumQuads, int RenderFlags, ENV
 			aTexCoords[k].y = fx2f(q->m_aTexcoords[k].y);
 		}
 
-		// Check if we want to repeat the texture
-		// Otherwise clamp to the edge to prevent texture bleeding
-		bool RepeatU = false, RepeatV = false;
-		for(int k = 0; k < 4; k++)
-		{
-			if(aTexCoords[k].x < 0.0f || aTexCoords[k].x > 1.0f)
-				RepeatU = true;
-			if(aTexCoords[k].y < 0.0f || aTexCoords[k].y > 1.0f)
-				RepeatV = true;
-		}
-		Graphics()->WrapMode(
-			RepeatU ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP,
-			RepeatV ? IGraphics::WRAP_REPEAT : IGraphics::WRAP_CLAMP);
+		int WrapU, WrapV;
+		GetQuadWrapMode(q, &WrapU, &WrapV);
+		Graphics()->WrapMode(WrapU, WrapV);
 
 		Graphics()->QuadsSetSubsetFree(
 			aTexCoords[0].x, aTexCoords[0].y,
@@ -385,6 +440,13 @@ void CRenderTools::RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4
 					continue; // my = h-1;
 			}
 
+			if(RenderFlags&TILERENDERFLAG_OUTSIDE && x >= 0 && x < w && y >= 0 && y < h)
+			{
+				// jump over the map itself
+				x = w-1;
+				continue;
+			}
+
 			int c = mx + my*w;
 
 			unsigned char Index = pTiles[c].m_Index;
@@ -406,46 +468,9 @@ void CRenderTools::RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4
 
 				if(Render)
 				{
-					float x0 = 0;
-					float y0 = 0;
-					float x1 = 1;
-					float y1 = 0;
-					float x2 = 1;
-					float y2 = 1;
-					float x3 = 0;
-					float y3 = 1;
-
-					if(Flags&TILEFLAG_VFLIP)
-					{
-						x0 = x2;
-						x1 = x3;
-						x2 = x3;
-						x3 = x0;
-					}
-
-					if(Flags&TILEFLAG_HFLIP)
-					{
-						y0 = y3;
-						y2 = y1;
-						y3 = y1;
-						y1 = y0;
-					}
-
-					if(Flags&TILEFLAG_ROTATE)
-					{
-						float Tmp = x0;
-						x0 = x3;
-						x3 = x2;
-						x2 = x1;
-						x1 = Tmp;
-						Tmp = y0;
-						y0 = y3;
-						y3 = y2;
-						y2 = y1;
-						y1 = Tmp;
-					}
-
-					Graphics()->QuadsSetSubsetFree(x0, y0, x1, y1, x2, y2, x3, y3, Index);
+					float aCoords[8];
+					GetTileTexCoords(Flags, aCoords);
+					Graphics()->QuadsSetSubsetFree(aCoords[0], aCoords[1], aCoords[2], aCoords[3], aCoords[4], aCoords[5], aCoords[6], aCoords[7], Index);
 					IGraphics::CQuadItem QuadItem(x*Scale, y*Scale, Scale, Scale);
 					Graphics()->QuadsDrawTL(&QuadItem, 1);
 				}
@@ -456,3 +481,164 @@ void CRenderTools::RenderTilemap(CTile *pTiles, int w, int h, float Scale, vec4
 	Graphics()->QuadsEnd();
 	Graphics()->MapScreen(ScreenX0, ScreenY0, ScreenX1, ScreenY1);
 }
+
+void CRenderTools::CreateTilemapBuffer(CTilemapBuffer *pBuffer, CTile *pTiles, int w, int h, float Scale)
+{
+	pBuffer->m_Width = w;
+	pBuffer->m_Height = h;
+	pBuffer->m_Scale = Scale;
+	pBuffer->m_NumChunksX = (w+CTilemapBuffer::CHUNK_SIZE-1)/CTilemapBuffer::CHUNK_SIZE;
+	pBuffer->m_NumChunksY = (h+CTilemapBuffer::CHUNK_SIZE-1)/CTilemapBuffer::CHUNK_SIZE;
+	pBuffer->m_lChunkStarts.clear();
+
+	Graphics()->BufferBegin();
+	Graphics()->QuadsBegin();
+	int NumQuads = 0;
+	for(int Opaque = 1; Opaque >= 0; Opaque--)
+		for(int cy = 0; cy < pBuffer->m_NumChunksY; cy++)
+			for(int cx = 0; cx < pBuffer->m_NumChunksX; cx++)
+			{
+				pBuffer->m_lChunkStarts.add(NumQuads);
+				int EndY = min((cy+1)*CTilemapBuffer::CHUNK_SIZE, h);
+				int EndX = min((cx+1)*CTilemapBuffer::CHUNK_SIZE, w);
+				for(int y = cy*CTilemapBuffer::CHUNK_SIZE; y < EndY; y++)
+					for(int x = cx*CTilemapBuffer::CHUNK_SIZE; x < EndX; x++)
+					{
+						const CTile *pTile = &pTiles[y*w+x];
+						if(!pTile->m_Index || ((pTile->m_Flags&TILEFLAG_OPAQUE) != 0) != (Opaque != 0))
+							continue;
+
+						float aCoords[8];
+						GetTileTexCoords(pTile->m_Flags, aCoords);
+						Graphics()->QuadsSetSubsetFree(aCoords[0], aCoords[1], aCoords[2], aCoords[3], aCoords[4], aCoords[5], aCoords[6], aCoords[7], pTile->m_Index);
+						IGraphics::CQuadItem QuadItem(x*Scale, y*Scale, Scale, Scale);
+						Graphics()->QuadsDrawTL(&QuadItem, 1);
+						NumQuads++;
+					}
+			}
+	pBuffer->m_lChunkStarts.add(NumQuads);
+	Graphics()->QuadsEnd();
+	pBuffer->m_Buffer = Graphics()->BufferEnd();
+}
+
+void CRenderTools::RenderTilemapBuffer(const CTilemapBuffer *pBuffer, CTile *pTiles, vec4 Color, int RenderFlags,
+									ENVELOPE_EVAL pfnEval, void *pUser, int ColorEnv, int ColorEnvOffset)
+{
+	float ScreenX0, ScreenY0, ScreenX1, ScreenY1;
+	Graphics()->GetScreen(&ScreenX0, &ScreenY0, &ScreenX1, &ScreenY1);
+
+	const int w = pBuffer->m_Width;
+	const int h = pBuffer->m_Height;
+	const float Scale = pBuffer->m_Scale;
+	int StartY = (int)(ScreenY0/Scale)-1;
+	int StartX = (int)(ScreenX0/Scale)-1;
+	int EndY = (int)(ScreenY1/Scale)+1;
+	int EndX = (int)(ScreenX1/Scale)+1;
+
+	// the border around the map has no geometry of its own
+	if(RenderFlags&TILERENDERFLAG_EXTEND && (StartX < 0 || StartY < 0 || EndX > w || EndY > h))
+		RenderTilemap(pTiles, w, h, Scale, Color, RenderFlags|TILERENDERFLAG_OUTSIDE, pfnEval, pUser, ColorEnv, ColorEnvOffset);
+
+	if(!pBuffer->m_Buffer.IsValid() || StartX >= w || StartY >= h || EndX <= 0 || EndY <= 0)
+		return;
+	int ChunkX0 = max(StartX, 0)/CTilemapBuffer::CHUNK_SIZE;
+	int ChunkY0 = max(StartY, 0)/CTilemapBuffer::CHUNK_SIZE;
+	int ChunkX1 = (min(EndX, w)-1)/CTilemapBuffer::CHUNK_SIZE;
+	int ChunkY1 = (min(EndY, h)-1)/CTilemapBuffer::CHUNK_SIZE;
+
+	float r=1, g=1, b=1, a=1;
+	if(ColorEnv >= 0)
+	{
+		float aChannels[4];
+		pfnEval(ColorEnvOffset/1000.0f, ColorEnv, aChannels, pUser);
+		r = aChannels[0];
+		g = aChannels[1];
+		b = aChannels[2];
+		a = aChannels[3];
+	}
+
+	// opaque tiles are only drawn in the opaque pass while the layer is fully visible
+	const float Alpha = Color.a*a;
+	const bool Opaque = Alpha > 254.0f/255.0f;
+	bool aDrawGroup[2];
+	aDrawGroup[0] = (RenderFlags&LAYERRENDERFLAG_TRANSPARENT) != 0;
+	aDrawGroup[1] = (RenderFlags&(Opaque ? LAYERRENDERFLAG_OPAQUE : LAYERRENDERFLAG_TRANSPARENT)) != 0;
+
+	// one range per visible row of chunks
+	enum { MAX_RANGES=64 };
+	int aOffsets[MAX_RANGES];
+	int aCounts[MAX_RANGES];
+	int NumRanges = 0;
+	const int NumChunks = pBuffer->m_NumChunksX*pBuffer->m_NumChunksY;
+	const vec4 DrawColor(Color.r*r*Alpha, Color.g*g*Alpha, Color.b*b*Alpha, Alpha);
+	for(int Group = 0; Group < 2; Group++)
+	{
+		if(!aDrawGroup[Group])
+			continue;
+
+		// the opaque tiles come first in the buffer
+		const int *pStarts = pBuffer->m_lChunkStarts.base_ptr() + (Group ? 0 : NumChunks);
+		for(int cy = ChunkY0; cy <= ChunkY1; cy++)
+		{
+			int Start = pStarts[cy*pBuffer->m_NumChunksX+ChunkX0];
+			int End = pStarts[cy*pBuffer->m_NumChunksX+ChunkX1+1];
+			if(Start == End)
+				continue;
+
+			aOffsets[NumRanges] = Start;
+			aCounts[NumRanges] = End-Start;
+			if(++NumRanges == MAX_RANGES)
+			{
+				Graphics()->RenderBuffer(pBuffer->m_Buffer, aOffsets, aCounts, NumRanges, &DrawColor);
+				NumRanges = 0;
+			}
+		}
+	}
+	Graphics()->RenderBuffer(pBuffer->m_Buffer, aOffsets, aCounts, NumRanges, &DrawColor);
+}
+
+bool CRenderTools::CreateQuadsBuffer(CQuadsBuffer *pBuffer, CQuad *pQuads, int NumQuads)
+{
+	pBuffer->m_lRuns.clear();
+	for(int i = 0; i < NumQuads; i++)
+	{
+		if(pQuads[i].m_PosEnv >= 0 || pQuads[i].m_ColorEnv >= 0)
+			return false;
+	}
+
+	// the wrap mode is part of the state, so quads are drawn in runs that share one
+	for(int i = 0; i < NumQuads; i++)
+	{
+		int WrapU, WrapV;
+		GetQuadWrapMode(&pQuads[i], &WrapU, &WrapV);
+		if(pBuffer->m_lRuns.size() && pBuffer->m_lRuns[pBuffer->m_lRuns.size()-1].m_WrapU == WrapU &&
+			pBuffer->m_lRuns[pBuffer->m_lRuns.size()-1].m_WrapV == WrapV)
+		{
+			pBuffer->m_lRuns[pBuffer->m_lRuns.size()-1].m_Count++;
+			continue;
+		}
+
+		CQuadsBuffer::CRun Run;
+		Run.m_Start = i;
+		Run.m_Count = 1;
+		Run.m_WrapU = WrapU;
+		Run.m_WrapV = WrapV;
+		pBuffer->m_lRuns.add(Run);
+	}
+
+	Graphics()->BufferBegin();
+	RenderQuads(pQuads, NumQuads, LAYERRENDERFLAG_TRANSPARENT, 0, 0);
+	pBuffer->m_Buffer = Graphics()->BufferEnd();
+	return true;
+}
+
+void CRenderTools::RenderQuadsBuffer(const CQuadsBuffer *pBuffer)
+{
+	for(int i = 0; i < pBuffer->m_lRuns.size(); i++)
+	{
+		const CQuadsBuffer::CRun *pRun = &pBuffer->m_lRuns[i];
+		Graphics()->WrapMode(pRun->m_WrapU, pRun->m_WrapV);
+		Graphics()->RenderBuffer(pBuffer->m_Buffer, &pRun->m_Start, &pRun->m_Count, 1, 0);
+	}
+	Graphics()->WrapNormal();
+}
@@ -131,6 +131,29 @@ void CCollision::MovePoint(vec2 *pInoutPos, vec2 *pInoutVel, float Elasticity, i
 	}
 }
 
+// moves the points that don't hit anything, the indices of the others are
+// returned in pHits for MovePoint. does the tile lookup of CheckPoint inline.
+int CCollision::MovePoints(float *pPosX, float *pPosY, const float *pVelX, const float *pVelY, int Num, int *pHits) const
+{
+	int NumHits = 0;
+	for(int i = 0; i < Num; i++)
+	{
+		float x = pPosX[i] + pVelX[i];
+		float y = pPosY[i] + pVelY[i];
+		int Nx = clamp(round_to_int(x)/32, 0, m_Width-1);
+		int Ny = clamp(round_to_int(y)/32, 0, m_Height-1);
+		int Index = m_pTiles[Ny*m_Width+Nx].m_Index;
+		if(Index <= 128 && (Index&COLFLAG_SOLID))
+			pHits[NumHits++] = i;
+		else
+		{
+			pPosX[i] = x;
+			pPosY[i] = y;
+		}
+	}
+	return NumHits;
+}
+
 bool CCollision::TestBox(vec2 Pos, vec2 Size, int Flag) const
 {
 	Size *= 0.5f;
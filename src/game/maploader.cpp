@@ -0,0 +1,95 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/tl/threading.h>
+
+#include <engine/engine.h>
+
+#include "collision.h"
+#include "layers.h"
+#include "maploader.h"
+
+CMapLoader::CMapLoader()
+{
+	m_pEngine = 0;
+	m_pMap = 0;
+	m_pLayers = 0;
+	m_pCollision = 0;
+	m_Running = false;
+	m_Steps = 0;
+	m_NumSteps = 0;
+}
+
+void CMapLoader::Init(IEngine *pEngine, CLayers *pLayers, CCollision *pCollision)
+{
+	m_pEngine = pEngine;
+	m_pLayers = pLayers;
+	m_pCollision = pCollision;
+}
+
+void CMapLoader::Start(IMap *pMap, bool Synchronous)
+{
+	Abort();
+
+	int Start, Num;
+	pMap->GetType(MAPITEMTYPE_IMAGE, &Start, &Num);
+	m_pMap = pMap;
+	m_Steps = 0;
+	m_NumSteps = 2+Num;
+
+	if(Synchronous)
+		Load();
+	else
+	{
+		m_Running = true;
+		m_pEngine->AddJob(&m_Job, LoadJob, this);
+	}
+}
+
+void CMapLoader::Load()
+{
+	m_pLayers->Init(0, m_pMap);
+	m_Steps++;
+	m_pCollision->Init(m_pLayers);
+	m_Steps++;
+
+	// decompress the embedded images, their textures are created on the main thread
+	int Start, Num;
+	m_pMap->GetType(MAPITEMTYPE_IMAGE, &Start, &Num);
+	for(int i = 0; i < Num; i++)
+	{
+		CMapItemImage *pImg = (CMapItemImage *)m_pMap->GetItem(Start+i, 0, 0);
+		if(!pImg->m_External)
+			m_pMap->GetData(pImg->m_ImageData);
+		m_Steps++;
+	}
+}
+
+int CMapLoader::LoadJob(void *pUser)
+{
+	((CMapLoader *)pUser)->Load();
+	return 0;
+}
+
+bool CMapLoader::Done()
+{
+	if(m_Running)
+	{
+		if(m_Job.Status() != CJob::STATE_DONE)
+			return false;
+		sync_barrier();
+		m_Running = false;
+	}
+	return true;
+}
+
+void CMapLoader::Abort()
+{
+	if(m_Running)
+		m_pEngine->WaitJob(&m_Job);
+	m_Running = false;
+}
+
+float CMapLoader::Progress() const
+{
+	return m_NumSteps ? m_Steps/(float)m_NumSteps : 0.0f;
+}
@@ -0,0 +1,40 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_MAPLOADER_H
+#define GAME_MAPLOADER_H
+
+#include <engine/shared/jobs.h>
+
+/*
+	Prepares the layers, the collision and the embedded images of a map.
+	A connecting client does that on a job, demos need the map right
+	away and load it synchronously.
+*/
+class CMapLoader
+{
+	class IEngine *m_pEngine;
+	class IMap *m_pMap;
+	class CLayers *m_pLayers;
+	class CCollision *m_pCollision;
+
+	CJob m_Job;
+	bool m_Running;
+	volatile int m_Steps;
+	int m_NumSteps;
+
+	static int LoadJob(void *pUser);
+	void Load();
+
+public:
+	CMapLoader();
+
+	void Init(class IEngine *pEngine, class CLayers *pLayers, class CCollision *pCollision);
+	// waits for a running job before it starts over
+	void Start(class IMap *pMap, bool Synchronous);
+	// the map must not be touched before this returns true
+	bool Done();
+	void Abort();
+	float Progress() const;
+};
+
+#endif
@@ -939,6 +939,8 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 					KickID, Server()->ClientName(KickID), pReason, aCmd, pMsg->m_Force
 				);
 				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+				if(Config()->m_SvVoteKickReplay)
+					Server()->DemoRecorder_SaveReplay("votekick");
 				if(pMsg->m_Force)
 				{
 					Server()->SetRconCID(ClientID);
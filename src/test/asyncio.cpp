@@ -0,0 +1,130 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <base/math.h>
+
+#include <engine/asyncio.h>
+#include <engine/kernel.h>
+#include <engine/storage.h>
+
+struct CRequestResult
+{
+	bool m_Done;
+	int m_Result;
+	char m_aData[64];
+};
+
+static void RequestCallback(int RequestID, int Result, const void *pData, unsigned DataSize, void *pUser)
+{
+	CRequestResult *pResult = static_cast<CRequestResult *>(pUser);
+	pResult->m_Done = true;
+	pResult->m_Result = Result;
+	pResult->m_aData[0] = 0;
+	if(pData)
+		str_copy(pResult->m_aData, (const char *)pData, min((int)DataSize+1, (int)sizeof(pResult->m_aData)));
+}
+
+static bool WaitForRequest(IAsyncIO *pAsyncIO, CRequestResult *pResult)
+{
+	for(int i = 0; i < 1000 && !pResult->m_Done; i++)
+	{
+		pAsyncIO->Update();
+		if(!pResult->m_Done)
+			thread_sleep(5);
+	}
+	return pResult->m_Done;
+}
+
+class AsyncIO : public ::testing::Test
+{
+protected:
+	IKernel *m_pKernel;
+	IStorage *m_pStorage;
+	IEngineAsyncIO *m_pAsyncIO;
+	CTestInfo m_Info;
+
+	AsyncIO()
+	{
+		m_pKernel = IKernel::Create();
+		m_pStorage = CreateTestStorage();
+		m_pAsyncIO = CreateEngineAsyncIO();
+		m_pKernel->RegisterInterface(m_pStorage);
+		m_pKernel->RegisterInterface(m_pAsyncIO);
+		m_pAsyncIO->Init();
+	}
+
+	~AsyncIO()
+	{
+		delete m_pAsyncIO;
+		m_pStorage->RemoveFile(m_Info.m_aFilename, IStorage::TYPE_SAVE);
+		delete m_pStorage;
+		delete m_pKernel;
+	}
+};
+
+TEST_F(AsyncIO, WriteRead)
+{
+	CRequestResult Write = {false, -1, ""};
+	m_pAsyncIO->WriteFile(m_Info.m_aFilename, IStorage::TYPE_SAVE, "test", 4, IAsyncIO::PRIORITY_NORMAL, RequestCallback, &Write);
+	ASSERT_TRUE(WaitForRequest(m_pAsyncIO, &Write));
+	EXPECT_EQ(Write.m_Result, 0);
+
+	CRequestResult Read = {false, -1, ""};
+	m_pAsyncIO->ReadFile(m_Info.m_aFilename, IStorage::TYPE_SAVE, IAsyncIO::PRIORITY_HIGH, RequestCallback, &Read);
+	ASSERT_TRUE(WaitForRequest(m_pAsyncIO, &Read));
+	EXPECT_EQ(Read.m_Result, 0);
+	EXPECT_STREQ(Read.m_aData, "test");
+	EXPECT_EQ(m_pAsyncIO->NumPending(), 0);
+}
+
+TEST_F(AsyncIO, ReadMissing)
+{
+	CRequestResult Read = {false, 0, ""};
+	m_pAsyncIO->ReadFile(m_Info.m_aFilename, IStorage::TYPE_SAVE, IAsyncIO::PRIORITY_LOW, RequestCallback, &Read);
+	ASSERT_TRUE(WaitForRequest(m_pAsyncIO, &Read));
+	EXPECT_EQ(Read.m_Result, -1);
+}
+
+TEST_F(AsyncIO, Reader)
+{
+	// span a few read-ahead blocks
+	const int NumValues = 100000;
+	IOHANDLE File = m_pStorage->OpenFile(m_Info.m_aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	for(int i = 0; i < NumValues; i++)
+		io_write(File, &i, sizeof(i));
+	io_close(File);
+
+	File = m_pStorage->OpenFile(m_Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	IAsyncFileReader *pReader = m_pAsyncIO->OpenReader(File, IAsyncIO::PRIORITY_HIGH);
+	ASSERT_TRUE(pReader);
+	EXPECT_EQ(pReader->Length(), (long)(NumValues*sizeof(int)));
+
+	bool Sequential = true;
+	for(int i = 0; i < NumValues && Sequential; i++)
+	{
+		int Value;
+		Sequential = pReader->Read(&Value, sizeof(Value)) == sizeof(Value) && Value == i;
+	}
+	EXPECT_TRUE(Sequential);
+
+	int Value;
+	EXPECT_EQ(pReader->Read(&Value, sizeof(Value)), 0u);
+
+	EXPECT_EQ(pReader->Seek(1234*sizeof(int), IOSEEK_START), 0);
+	EXPECT_EQ(pReader->Read(&Value, sizeof(Value)), sizeof(Value));
+	EXPECT_EQ(Value, 1234);
+
+	pReader->Skip(10*sizeof(int));
+	EXPECT_EQ(pReader->Tell(), (long)(1245*sizeof(int)));
+	EXPECT_EQ(pReader->Read(&Value, sizeof(Value)), sizeof(Value));
+	EXPECT_EQ(Value, 1245);
+
+	EXPECT_EQ(pReader->Seek(-(long)sizeof(int), IOSEEK_END), 0);
+	EXPECT_EQ(pReader->Read(&Value, sizeof(Value)), sizeof(Value));
+	EXPECT_EQ(Value, NumValues-1);
+
+	m_pAsyncIO->CloseReader(pReader);
+}
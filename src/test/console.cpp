@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/console.h>
+#include <engine/shared/config.h>
+
+struct CCallData
+{
+	IConsole *m_pConsole;
+	int m_NumCalls;
+	int m_NumArgs;
+	char m_aArgs[4][64];
+};
+
+static void ConRecordCall(IConsole::IResult *pResult, void *pUserData)
+{
+	CCallData *pData = (CCallData *)pUserData;
+	pData->m_NumCalls++;
+	pData->m_NumArgs = pResult->NumArguments();
+	for(int i = 0; i < pResult->NumArguments() && i < 4; i++)
+		str_copy(pData->m_aArgs[i], pResult->GetString(i), sizeof(pData->m_aArgs[i]));
+}
+
+static void ConRegisterLate(IConsole::IResult *pResult, void *pUserData)
+{
+	CCallData *pData = (CCallData *)pUserData;
+	pData->m_pConsole->Register("late", "i", CFGFLAG_SERVER, ConRecordCall, pData, "");
+}
+
+TEST(Console, ExecuteLine)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	CCallData Data;
+	mem_zero(&Data, sizeof(Data));
+	pConsole->Register("Test_Cmd", "s i ?r", CFGFLAG_SERVER, ConRecordCall, &Data, "");
+
+	// repeated lines run from the cache and behave the same
+	for(int i = 0; i < 3; i++)
+	{
+		pConsole->ExecuteLine("test_cmd \"a \\\"b\\\"\" 5 the rest ; TEST_CMD x 1 # comment ; test_cmd y 2");
+		EXPECT_EQ(Data.m_NumCalls, 2*(i+1));
+		EXPECT_EQ(Data.m_NumArgs, 2);
+		EXPECT_STREQ(Data.m_aArgs[0], "x");
+	}
+
+	pConsole->ExecuteLine("test_cmd \"a \\\"b\\\"\" 5 the rest");
+	EXPECT_EQ(Data.m_NumArgs, 3);
+	EXPECT_STREQ(Data.m_aArgs[0], "a \"b\"");
+	EXPECT_STREQ(Data.m_aArgs[1], "5");
+	EXPECT_STREQ(Data.m_aArgs[2], "the rest");
+
+	// invalid arguments and unknown commands don't stop the line
+	Data.m_NumCalls = 0;
+	pConsole->ExecuteLine("test_cmd; unknown 1; test_cmd z 3");
+	EXPECT_EQ(Data.m_NumCalls, 1);
+	EXPECT_STREQ(Data.m_aArgs[0], "z");
+
+	// commands of other flags aren't found
+	pConsole->ExecuteLineFlag("test_cmd w 4", CFGFLAG_CLIENT);
+	EXPECT_EQ(Data.m_NumCalls, 1);
+
+	// changed parameters are picked up
+	pConsole->Register("test_cmd", "r", CFGFLAG_SERVER, ConRecordCall, &Data, "");
+	pConsole->ExecuteLine("test_cmd z 3");
+	EXPECT_EQ(Data.m_NumArgs, 1);
+	EXPECT_STREQ(Data.m_aArgs[0], "z 3");
+
+	// a command can register one used later in the same line
+	Data.m_pConsole = pConsole;
+	pConsole->Register("register_late", "", CFGFLAG_SERVER, ConRegisterLate, &Data, "");
+	Data.m_NumCalls = 0;
+	pConsole->ExecuteLine("register_late; late 7");
+	EXPECT_EQ(Data.m_NumCalls, 1);
+	EXPECT_STREQ(Data.m_aArgs[0], "7");
+
+	delete pConsole;
+}
+
+TEST(Console, Stroke)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_CLIENT);
+	CCallData Data;
+	mem_zero(&Data, sizeof(Data));
+	pConsole->Register("+hold", "s", CFGFLAG_CLIENT, ConRecordCall, &Data, "");
+	pConsole->Register("press", "", CFGFLAG_CLIENT, ConRecordCall, &Data, "");
+
+	for(int i = 0; i < 2; i++)
+	{
+		pConsole->ExecuteLineStroked(1, "+hold a; press");
+		EXPECT_EQ(Data.m_NumArgs, 0);
+		pConsole->ExecuteLineStroked(0, "+hold a; press");
+		EXPECT_EQ(Data.m_NumArgs, 2);
+		EXPECT_STREQ(Data.m_aArgs[0], "0");
+		EXPECT_STREQ(Data.m_aArgs[1], "a");
+	}
+	EXPECT_EQ(Data.m_NumCalls, 6);
+
+	delete pConsole;
+}
+
+TEST(Console, TempCommands)
+{
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	pConsole->RegisterTemp("temp_b", "", CFGFLAG_SERVER, "");
+	pConsole->RegisterTemp("temp_a", "", CFGFLAG_SERVER, "");
+	EXPECT_TRUE(pConsole->GetCommandInfo("TEMP_A", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_a", CFGFLAG_SERVER, false));
+	EXPECT_TRUE(pConsole->GetCommandInfo("echo", CFGFLAG_SERVER, false));
+
+	pConsole->DeregisterTemp("temp_a");
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_a", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(pConsole->GetCommandInfo("temp_b", CFGFLAG_SERVER, true));
+
+	// recycled entries are found under their new name
+	pConsole->RegisterTemp("temp_c", "", CFGFLAG_SERVER, "");
+	EXPECT_TRUE(pConsole->GetCommandInfo("temp_c", CFGFLAG_SERVER, true));
+
+	pConsole->DeregisterTempAll();
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_b", CFGFLAG_SERVER, true));
+	EXPECT_FALSE(pConsole->GetCommandInfo("temp_c", CFGFLAG_SERVER, true));
+	EXPECT_TRUE(pConsole->GetCommandInfo("echo", CFGFLAG_SERVER, false));
+	EXPECT_TRUE(pConsole->GetCommandInfo("mod_status", CFGFLAG_SERVER, false));
+
+	delete pConsole;
+}
@@ -0,0 +1,272 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/snapshot.h>
+
+static const char s_aNetVersion[] = "0.7 test";
+
+class Demo : public ::testing::Test
+{
+protected:
+	enum
+	{
+		NUM_TICKS=600,
+	};
+
+	CTestInfo m_Info;
+	IStorage *m_pStorage;
+	IConsole *m_pConsole;
+	CSnapshotDelta m_SnapshotDelta;
+	char m_aMapName[64];
+	char m_aMapFilename[128];
+	SHA256_DIGEST m_MapSha256;
+
+	Demo()
+	{
+		m_pStorage = CreateTestStorage();
+		m_pConsole = CreateConsole(CFGFLAG_SERVER);
+		m_Info.Filename(m_aMapName, sizeof(m_aMapName), "");
+		str_format(m_aMapFilename, sizeof(m_aMapFilename), "maps/%s.map", m_aMapName);
+	}
+
+	~Demo()
+	{
+		m_pStorage->RemoveFile(m_Info.m_aFilename, IStorage::TYPE_SAVE);
+		m_pStorage->RemoveFile(m_aMapFilename, IStorage::TYPE_SAVE);
+		delete m_pConsole;
+		delete m_pStorage;
+	}
+
+	// the recorder embeds the map, so provide one
+	void SetUp()
+	{
+		m_pStorage->CreateFolder("maps", IStorage::TYPE_SAVE);
+		IOHANDLE File = m_pStorage->OpenFile(m_aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+		ASSERT_TRUE(File);
+		io_write(File, "map data", 8);
+		io_close(File);
+		m_MapSha256 = sha256("map data", 8);
+	}
+
+	// records a snapshot with one item of Tick/TicksPerValue and its double for every tick
+	void RecordTicks(CDemoRecorder *pRecorder, int TicksPerValue, int MessageInterval)
+	{
+		for(int Tick = 1; Tick <= NUM_TICKS; Tick++)
+		{
+			CSnapshotBuilder Builder;
+			Builder.Init();
+			int *pData = (int *)Builder.NewItem(1, 0, 2*sizeof(int));
+			pData[0] = Tick/TicksPerValue;
+			pData[1] = pData[0]*2;
+			char aSnap[CSnapshot::MAX_SIZE];
+			pRecorder->RecordSnapshot(Tick, aSnap, Builder.Finish(aSnap));
+			if(Tick%MessageInterval == 0)
+				pRecorder->RecordMessage("msg", 4);
+		}
+	}
+
+	// steps through until the end of the file pauses playback
+	static void PlayToEnd(CDemoPlayer *pPlayer)
+	{
+		pPlayer->Play();
+		while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+			pPlayer->NextFrame();
+	}
+};
+
+class CTestDemoListener : public CDemoPlayer::IListener
+{
+public:
+	int m_NumSnapshots;
+	int m_NumMessages;
+	int m_LastValue;
+	bool m_Valid;
+
+	CTestDemoListener() : m_NumSnapshots(0), m_NumMessages(0), m_LastValue(0), m_Valid(true) {}
+
+	void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		const CSnapshot *pSnap = (const CSnapshot *)pData;
+		if(pSnap->NumItems() != 1)
+		{
+			m_Valid = false;
+			return;
+		}
+		const int *pItemData = pSnap->GetItem(0)->Data();
+		if(pItemData[1] != pItemData[0]*2 || pItemData[0] < m_LastValue)
+			m_Valid = false;
+		if(pItemData[0] != m_LastValue)
+			m_NumSnapshots++;
+		m_LastValue = pItemData[0];
+	}
+
+	void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		if(Size >= 4 && mem_comp(pData, "msg", 4) == 0)
+			m_NumMessages++;
+	}
+};
+
+TEST_F(Demo, RecordPlayback)
+{
+	CDemoRecorder *pRecorder = new CDemoRecorder(&m_SnapshotDelta);
+	pRecorder->SetWaitForWriter(true);
+	ASSERT_EQ(pRecorder->Start(m_pStorage, m_pConsole, m_Info.m_aFilename, s_aNetVersion, m_aMapName, m_MapSha256, 0, "server"), 0);
+	EXPECT_TRUE(pRecorder->IsRecording());
+	RecordTicks(pRecorder, 1, 50);
+	EXPECT_EQ(pRecorder->Length(), (NUM_TICKS-1)/SERVER_TICK_SPEED);
+
+	// returns once the writer wrote everything
+	EXPECT_EQ(pRecorder->Stop(), 0);
+	EXPECT_FALSE(pRecorder->IsRecording());
+	delete pRecorder;
+
+	CTestDemoListener Listener;
+	CDemoPlayer *pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+	pPlayer->SetListener(&Listener);
+	ASSERT_FALSE(pPlayer->Load(m_pStorage, m_pConsole, m_Info.m_aFilename, IStorage::TYPE_SAVE, s_aNetVersion));
+	EXPECT_EQ(pPlayer->BaseInfo()->m_FirstTick, 1);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_LastTick, (int)NUM_TICKS);
+	EXPECT_EQ(pPlayer->Info()->m_SeekablePoints, 3);
+
+	PlayToEnd(pPlayer);
+	EXPECT_TRUE(pPlayer->BaseInfo()->m_Paused);
+	pPlayer->Stop();
+	delete pPlayer;
+
+	EXPECT_TRUE(Listener.m_Valid);
+	EXPECT_EQ(Listener.m_NumSnapshots, (int)NUM_TICKS);
+	EXPECT_EQ(Listener.m_NumMessages, NUM_TICKS/50);
+
+	// seeking lands right before the wanted tick
+	pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+	ASSERT_FALSE(pPlayer->Load(m_pStorage, m_pConsole, m_Info.m_aFilename, IStorage::TYPE_SAVE, s_aNetVersion));
+	EXPECT_EQ(pPlayer->SetPos(0.5f), 0);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_CurrentTick, 1+(NUM_TICKS-1)/2-5+1);
+	pPlayer->Stop();
+	delete pPlayer;
+
+	// without a valid seek index the player falls back to scanning the file
+	char aCopyFilename[64];
+	m_Info.Filename(aCopyFilename, sizeof(aCopyFilename), "-noindex.tmp");
+	void *pDemoData;
+	unsigned DemoSize;
+	IOHANDLE File = m_pStorage->OpenFile(m_Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_read_all(File, &pDemoData, &DemoSize);
+	io_close(File);
+	((char *)pDemoData)[DemoSize-1] = 0;
+	File = m_pStorage->OpenFile(aCopyFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, pDemoData, DemoSize);
+	io_close(File);
+	mem_free(pDemoData);
+
+	pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+	ASSERT_FALSE(pPlayer->Load(m_pStorage, m_pConsole, aCopyFilename, IStorage::TYPE_SAVE, s_aNetVersion));
+	EXPECT_EQ(pPlayer->BaseInfo()->m_FirstTick, 1);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_LastTick, (int)NUM_TICKS);
+	EXPECT_EQ(pPlayer->Info()->m_SeekablePoints, 3);
+	pPlayer->Stop();
+	delete pPlayer;
+
+	m_pStorage->RemoveFile(aCopyFilename, IStorage::TYPE_SAVE);
+}
+
+class CLastSnapshotListener : public CDemoPlayer::IListener
+{
+public:
+	int m_LastValue;
+	int m_NumBadMessages;
+
+	CLastSnapshotListener() : m_LastValue(-1), m_NumBadMessages(0) {}
+
+	void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		const CSnapshot *pSnap = (const CSnapshot *)pData;
+		m_LastValue = pSnap->NumItems() == 1 ? pSnap->GetItem(0)->Data()[0] : -1;
+	}
+
+	void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		if(Size != 4 || mem_comp(pData, "msg", 4) != 0)
+			m_NumBadMessages++;
+	}
+};
+
+TEST_F(Demo, KeyFrameDeltas)
+{
+	// the snapshot only changes every third tick, so some ticks repeat the previous one
+	CDemoRecorder *pRecorder = new CDemoRecorder(&m_SnapshotDelta);
+	pRecorder->SetKeyFrameMode(SERVER_TICK_SPEED, true);
+	ASSERT_EQ(pRecorder->Start(m_pStorage, m_pConsole, m_Info.m_aFilename, s_aNetVersion, m_aMapName, m_MapSha256, 0, "server"), 0);
+	RecordTicks(pRecorder, 3, 1);
+	EXPECT_EQ(pRecorder->Stop(), 0);
+	delete pRecorder;
+
+	CLastSnapshotListener Listener;
+	CDemoPlayer *pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+	pPlayer->SetListener(&Listener);
+	ASSERT_FALSE(pPlayer->Load(m_pStorage, m_pConsole, m_Info.m_aFilename, IStorage::TYPE_SAVE, s_aNetVersion));
+	EXPECT_TRUE(pPlayer->DeltaAgainstKeyFrame());
+	EXPECT_EQ(pPlayer->Info()->m_SeekablePoints, NUM_TICKS/SERVER_TICK_SPEED);
+
+	// every tick decodes to the recorded snapshot, whether played through or seeked to
+	pPlayer->Play();
+	bool Valid = true;
+	while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused && Valid)
+	{
+		Valid = Listener.m_LastValue == pPlayer->BaseInfo()->m_CurrentTick/3;
+		pPlayer->NextFrame();
+	}
+	EXPECT_TRUE(Valid);
+
+	for(int i = 0; i <= 10; i++)
+	{
+		ASSERT_EQ(pPlayer->SetPos(i/10.0f), 0);
+		EXPECT_EQ(Listener.m_LastValue, pPlayer->BaseInfo()->m_CurrentTick/3);
+	}
+	EXPECT_EQ(Listener.m_NumBadMessages, 0);
+	pPlayer->Stop();
+	delete pPlayer;
+}
+
+TEST_F(Demo, Replay)
+{
+	// the buffer only holds a few keyframe intervals
+	CDemoRecorder *pRecorder = new CDemoRecorder(&m_SnapshotDelta);
+	pRecorder->SetKeyFrameMode(SERVER_TICK_SPEED, false);
+	pRecorder->SetWaitForWriter(true);
+	EXPECT_EQ(pRecorder->SaveReplay(m_pStorage, m_Info.m_aFilename), -1);
+	ASSERT_EQ(pRecorder->StartReplay(m_pStorage, m_pConsole, s_aNetVersion, m_aMapName, m_MapSha256, 0, "server", 4096), 0);
+	EXPECT_TRUE(pRecorder->IsRecording());
+	RecordTicks(pRecorder, 1, 50);
+	EXPECT_EQ(pRecorder->SaveReplay(m_pStorage, m_Info.m_aFilename), 0);
+
+	// the replay is complete once the writer got to it
+	EXPECT_EQ(pRecorder->Stop(), 0);
+	EXPECT_FALSE(pRecorder->IsRecording());
+	delete pRecorder;
+
+	CTestDemoListener Listener;
+	CDemoPlayer *pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+	pPlayer->SetListener(&Listener);
+	ASSERT_FALSE(pPlayer->Load(m_pStorage, m_pConsole, m_Info.m_aFilename, IStorage::TYPE_SAVE, s_aNetVersion));
+	int FirstTick = pPlayer->BaseInfo()->m_FirstTick;
+	EXPECT_GT(FirstTick, 1);
+	EXPECT_EQ((FirstTick-1)%SERVER_TICK_SPEED, 0);
+	EXPECT_EQ(pPlayer->BaseInfo()->m_LastTick, (int)NUM_TICKS);
+	EXPECT_EQ(pPlayer->Info()->m_SeekablePoints, (NUM_TICKS-FirstTick)/SERVER_TICK_SPEED+1);
+
+	PlayToEnd(pPlayer);
+	pPlayer->Stop();
+	delete pPlayer;
+
+	EXPECT_TRUE(Listener.m_Valid);
+	EXPECT_EQ(Listener.m_NumSnapshots, NUM_TICKS-FirstTick+1);
+}
@@ -0,0 +1,126 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <engine/storage.h>
+#include <engine/shared/demoinfocache.h>
+
+TEST(DemoInfoCache, GetSet)
+{
+	CDemoInfoCache Cache;
+	CDemoHeader Header;
+	mem_zero(&Header, sizeof(Header));
+	str_copy(Header.m_aMapName, "dm1", sizeof(Header.m_aMapName));
+	Header.m_Version = 5;
+
+	CDemoHeader Result;
+	bool Valid;
+	EXPECT_FALSE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+
+	Cache.Set("demos/a.demo", IStorage::TYPE_SAVE, 100, &Header, true);
+	Cache.Set("demos/b.demo", IStorage::TYPE_SAVE, 100, 0, false);
+	EXPECT_TRUE(Cache.Changed());
+	EXPECT_EQ(Cache.Num(), 2);
+
+	ASSERT_TRUE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+	EXPECT_TRUE(Valid);
+	EXPECT_STREQ(Result.m_aMapName, "dm1");
+	EXPECT_EQ(Result.m_Version, 5);
+	ASSERT_TRUE(Cache.Get("demos/b.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+	EXPECT_FALSE(Valid);
+
+	// a changed file or another storage doesn't hit
+	EXPECT_FALSE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE, 101, &Result, &Valid));
+	EXPECT_FALSE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE+1, 100, &Result, &Valid));
+
+	// updating an entry doesn't add another one
+	Cache.Set("demos/a.demo", IStorage::TYPE_SAVE, 101, &Header, true);
+	EXPECT_EQ(Cache.Num(), 2);
+	EXPECT_TRUE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE, 101, &Result, &Valid));
+}
+
+TEST(DemoInfoCache, Scan)
+{
+	CDemoInfoCache Cache;
+	CDemoHeader Header;
+	mem_zero(&Header, sizeof(Header));
+	Cache.Set("demos/a.demo", IStorage::TYPE_SAVE, 100, &Header, true);
+	Cache.Set("demos/b.demo", IStorage::TYPE_SAVE, 100, &Header, true);
+	Cache.Set("demos/sub/c.demo", IStorage::TYPE_SAVE, 100, &Header, true);
+
+	// b.demo was removed, the subfolder wasn't part of the scan
+	CDemoHeader Result;
+	bool Valid;
+	Cache.BeginScan();
+	EXPECT_TRUE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+	Cache.EndScan("demos");
+	EXPECT_EQ(Cache.Num(), 2);
+	EXPECT_TRUE(Cache.Get("demos/a.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+	EXPECT_FALSE(Cache.Get("demos/b.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+	EXPECT_TRUE(Cache.Get("demos/sub/c.demo", IStorage::TYPE_SAVE, 100, &Result, &Valid));
+	EXPECT_TRUE(Cache.Changed());
+}
+
+TEST(DemoInfoCache, SaveLoad)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+
+	CDemoInfoCache Cache;
+	CDemoHeader Header;
+	mem_zero(&Header, sizeof(Header));
+	for(int i = 0; i < 100; i++)
+	{
+		char aPath[64];
+		str_format(aPath, sizeof(aPath), "demos/%d.demo", i);
+		str_format(Header.m_aMapName, sizeof(Header.m_aMapName), "map%d", i);
+		Cache.Set(aPath, IStorage::TYPE_SAVE, (time_t)i<<20, &Header, i%10 != 0);
+	}
+	ASSERT_TRUE(Cache.Save(pStorage, Info.m_aFilename));
+	EXPECT_FALSE(Cache.Changed());
+
+	// a failed save isn't retried until the next change
+	char aMissingFolder[128];
+	str_format(aMissingFolder, sizeof(aMissingFolder), "%s/cache.dat", Info.m_aFilename);
+	Cache.Set("demos/0.demo", IStorage::TYPE_SAVE, 0, &Header, false);
+	EXPECT_FALSE(Cache.Save(pStorage, aMissingFolder));
+	EXPECT_FALSE(Cache.Changed());
+
+	CDemoInfoCache Loaded;
+	ASSERT_TRUE(Loaded.Load(pStorage, Info.m_aFilename));
+	EXPECT_EQ(Loaded.Num(), 100);
+	EXPECT_FALSE(Loaded.Changed());
+	for(int i = 0; i < 100; i++)
+	{
+		char aPath[64];
+		str_format(aPath, sizeof(aPath), "demos/%d.demo", i);
+		CDemoHeader Result;
+		bool Valid;
+		ASSERT_TRUE(Loaded.Get(aPath, IStorage::TYPE_SAVE, (time_t)i<<20, &Result, &Valid));
+		EXPECT_EQ(Valid, i%10 != 0);
+		if(Valid)
+		{
+			char aMapName[64];
+			str_format(aMapName, sizeof(aMapName), "map%d", i);
+			EXPECT_STREQ(Result.m_aMapName, aMapName);
+		}
+	}
+
+	// a truncated cache is dropped as a whole
+	IOHANDLE File = pStorage->OpenFile(Info.m_aFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	void *pData;
+	unsigned Size;
+	io_read_all(File, &pData, &Size);
+	io_close(File);
+	File = pStorage->OpenFile(Info.m_aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	io_write(File, pData, Size-1);
+	io_close(File);
+	mem_free(pData);
+	EXPECT_FALSE(Loaded.Load(pStorage, Info.m_aFilename));
+	EXPECT_EQ(Loaded.Num(), 0);
+
+	pStorage->RemoveFile(Info.m_aFilename, IStorage::TYPE_SAVE);
+	delete pStorage;
+}
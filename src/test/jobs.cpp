@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/jobs.h>
+
+static int SlowJob(void *pUser)
+{
+	thread_sleep(20);
+	*(int *)pUser = 1;
+	return 2;
+}
+
+TEST(Jobs, Wait)
+{
+	CJobPool Pool;
+	Pool.Init(2);
+
+	// waiting for a job that never ran returns right away
+	CJob Job;
+	Pool.Wait(&Job);
+	EXPECT_EQ(Job.Status(), CJob::STATE_DONE);
+
+	int aValues[4] = {0};
+	CJob aJobs[4];
+	for(int i = 0; i < 4; i++)
+		Pool.Add(&aJobs[i], SlowJob, &aValues[i]);
+	for(int i = 0; i < 4; i++)
+	{
+		Pool.Wait(&aJobs[i]);
+		EXPECT_EQ(aJobs[i].Status(), CJob::STATE_DONE);
+		EXPECT_EQ(aJobs[i].Result(), 2);
+		EXPECT_EQ(aValues[i], 1);
+	}
+
+	// jobs can be reused once they are done
+	aValues[0] = 0;
+	Pool.Add(&aJobs[0], SlowJob, &aValues[0]);
+	Pool.Wait(&aJobs[0]);
+	EXPECT_EQ(aValues[0], 1);
+}
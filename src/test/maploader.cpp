@@ -0,0 +1,142 @@
+#include "test.h"
+
+#include <gtest/gtest.h>
+
+#include <engine/engine.h>
+#include <engine/map.h>
+#include <engine/storage.h>
+#include <engine/shared/datafile.h>
+#include <game/collision.h>
+#include <game/layers.h>
+#include <game/maploader.h>
+
+static bool CreateTestMap(IStorage *pStorage, const char *pFilename)
+{
+	CDataFileWriter Writer;
+	if(!Writer.Open(pStorage, pFilename))
+		return false;
+
+	CMapItemVersion Version;
+	Version.m_Version = CMapItemVersion::CURRENT_VERSION;
+	Writer.AddItem(MAPITEMTYPE_VERSION, 0, sizeof(Version), &Version);
+
+	// an embedded image
+	unsigned char aPixels[2*2*4] = {0};
+	CMapItemImage Image;
+	mem_zero(&Image, sizeof(Image));
+	Image.m_Version = CMapItemImage::CURRENT_VERSION;
+	Image.m_Width = 2;
+	Image.m_Height = 2;
+	Image.m_External = 0;
+	Image.m_ImageName = -1;
+	Image.m_ImageData = Writer.AddData(sizeof(aPixels), aPixels);
+	Writer.AddItem(MAPITEMTYPE_IMAGE, 0, sizeof(Image), &Image);
+
+	// a game layer with a single solid tile
+	CTile aTiles[4*3];
+	mem_zero(aTiles, sizeof(aTiles));
+	aTiles[1*4+2].m_Index = TILE_SOLID;
+	CMapItemLayerTilemap Tilemap;
+	mem_zero(&Tilemap, sizeof(Tilemap));
+	Tilemap.m_Layer.m_Type = LAYERTYPE_TILES;
+	Tilemap.m_Version = 3;
+	Tilemap.m_Width = 4;
+	Tilemap.m_Height = 3;
+	Tilemap.m_Flags = TILESLAYERFLAG_GAME;
+	Tilemap.m_Image = -1;
+	Tilemap.m_ColorEnv = -1;
+	Tilemap.m_Data = Writer.AddData(sizeof(aTiles), aTiles);
+	Writer.AddItem(MAPITEMTYPE_LAYER, 0, sizeof(Tilemap), &Tilemap);
+
+	CMapItemGroup Group;
+	mem_zero(&Group, sizeof(Group));
+	Group.m_Version = CMapItemGroup::CURRENT_VERSION;
+	Group.m_ParallaxX = 100;
+	Group.m_ParallaxY = 100;
+	Group.m_StartLayer = 0;
+	Group.m_NumLayers = 1;
+	Writer.AddItem(MAPITEMTYPE_GROUP, 0, sizeof(Group), &Group);
+
+	return Writer.Finish() != 0;
+}
+
+class CTestEngine : public IEngine
+{
+public:
+	CTestEngine() { m_JobPool.Init(1); }
+
+	void Init() {}
+	void InitLogfile() {}
+	void QueryNetLogHandles(IOHANDLE *pHDLSend, IOHANDLE *pHDLRecv) { *pHDLSend = 0; *pHDLRecv = 0; }
+	void HostLookup(CHostLookup *pLookup, const char *pHostname, int Nettype) {}
+	void AddJob(CJob *pJob, JOBFUNC pfnFunc, void *pData) { m_JobPool.Add(pJob, pfnFunc, pData); }
+	void WaitJob(CJob *pJob) { m_JobPool.Wait(pJob); }
+};
+
+class MapLoader : public ::testing::Test
+{
+protected:
+	IStorage *m_pStorage;
+	IEngine *m_pEngine;
+	IEngineMap *m_pMap;
+	CTestInfo m_Info;
+	CLayers m_Layers;
+	CCollision m_Collision;
+	CMapLoader m_Loader;
+
+	MapLoader()
+	{
+		m_pStorage = CreateTestStorage();
+		m_pEngine = new CTestEngine();
+		m_pMap = CreateEngineMap();
+		m_Loader.Init(m_pEngine, &m_Layers, &m_Collision);
+	}
+
+	~MapLoader()
+	{
+		m_Loader.Abort();
+		m_pMap->Unload();
+		m_pStorage->RemoveFile(m_Info.m_aFilename, IStorage::TYPE_SAVE);
+		delete m_pMap;
+		delete m_pEngine;
+		delete m_pStorage;
+	}
+
+	void ExpectLoaded()
+	{
+		ASSERT_TRUE(m_Layers.GameLayer() != 0);
+		EXPECT_EQ(m_Collision.GetWidth(), 4);
+		EXPECT_EQ(m_Collision.GetHeight(), 3);
+		EXPECT_TRUE(m_Collision.CheckPoint(2*32+16, 1*32+16));
+		EXPECT_FALSE(m_Collision.CheckPoint(1*32+16, 1*32+16));
+		EXPECT_EQ(m_Loader.Progress(), 1.0f);
+	}
+};
+
+TEST_F(MapLoader, Synchronous)
+{
+	ASSERT_TRUE(CreateTestMap(m_pStorage, m_Info.m_aFilename));
+	ASSERT_TRUE(m_pMap->Load(m_Info.m_aFilename, m_pStorage));
+
+	// demos play right after the map was loaded, nothing may be left to a job
+	m_Loader.Start(m_pMap, true);
+	EXPECT_TRUE(m_Loader.Done());
+	ExpectLoaded();
+}
+
+TEST_F(MapLoader, Job)
+{
+	ASSERT_TRUE(CreateTestMap(m_pStorage, m_Info.m_aFilename));
+	ASSERT_TRUE(m_pMap->Load(m_Info.m_aFilename, m_pStorage));
+
+	m_Loader.Start(m_pMap, false);
+	while(!m_Loader.Done())
+		thread_sleep(1);
+	ExpectLoaded();
+
+	// a new load waits for the running job
+	m_Loader.Start(m_pMap, false);
+	m_Loader.Start(m_pMap, true);
+	EXPECT_TRUE(m_Loader.Done());
+	ExpectLoaded();
+}
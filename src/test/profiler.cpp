@@ -0,0 +1,101 @@
+#include "test.h"
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/profiler.h>
+
+TEST(Profiler, History)
+{
+	CProfiler Profiler;
+	int Render = Profiler.AddScope("render", "component");
+	int Message = Profiler.AddScope("message", "component");
+	int Counter = Profiler.AddCounter("vertices");
+
+	// nothing is measured while disabled
+	Profiler.AddTime(Render, 0, 5);
+	Profiler.NextFrame();
+	EXPECT_EQ(Profiler.NumFrames(), 0);
+
+	Profiler.SetEnabled(true);
+	Profiler.NextFrame();
+	for(int i = 1; i <= 3; i++)
+	{
+		Profiler.AddTime(Render, 0, i*10);
+		Profiler.AddTime(Render, 100, 101);
+		Profiler.SetCounter(Counter, i);
+		Profiler.NextFrame();
+	}
+
+	EXPECT_EQ(Profiler.NumFrames(), 3);
+	EXPECT_EQ(Profiler.ScopeTime(Render, 0), 31);
+	EXPECT_EQ(Profiler.ScopeTime(Render, 2), 11);
+	EXPECT_EQ(Profiler.ScopeTime(Message, 0), 0);
+	EXPECT_EQ(Profiler.CounterValue(Counter, 1), 2);
+	EXPECT_EQ(Profiler.ScopeAverage(Render), 21);
+	EXPECT_EQ(Profiler.ScopeMax(Render), 31);
+
+	for(int i = 0; i < CProfiler::HISTORY_SIZE+5; i++)
+		Profiler.NextFrame();
+	EXPECT_EQ(Profiler.NumFrames(), (int)CProfiler::HISTORY_SIZE);
+	EXPECT_EQ(Profiler.ScopeMax(Render), 0);
+}
+
+TEST(Profiler, Totals)
+{
+	CProfiler Profiler;
+	int Scope = Profiler.AddScope("players", "render");
+	int Counter = Profiler.AddCounter("draw calls");
+	Profiler.SetEnabled(true);
+	Profiler.NextFrame();
+	for(int i = 0; i < CProfiler::HISTORY_SIZE+2; i++)
+	{
+		Profiler.AddTime(Scope, 0, i%10 == 0 ? 50 : 2);
+		Profiler.SetCounter(Counter, 3);
+		Profiler.NextFrame();
+	}
+
+	// the totals are not limited by the history
+	const int Frames = CProfiler::HISTORY_SIZE+2;
+	EXPECT_EQ(Profiler.TotalFrames(), Frames);
+	EXPECT_EQ(Profiler.ScopeTotal(Scope), 50*13+2*(Frames-13));
+	EXPECT_EQ(Profiler.ScopeTotalMax(Scope), 50);
+	EXPECT_EQ(Profiler.CounterTotal(Counter), 3*Frames);
+	EXPECT_GE(Profiler.TotalFrameTime(), 0);
+
+	Profiler.ResetTotals();
+	EXPECT_EQ(Profiler.TotalFrames(), 0);
+	EXPECT_EQ(Profiler.ScopeTotal(Scope), 0);
+	EXPECT_EQ(Profiler.CounterTotal(Counter), 0);
+}
+
+TEST(Profiler, Trace)
+{
+	CTestInfo Info;
+	char aFilename[64];
+	Info.Filename(aFilename, sizeof(aFilename), ".json");
+
+	CProfiler Profiler;
+	int Scope = Profiler.AddScope("players", "render");
+	Profiler.AddCounter("draw calls");
+	IOHANDLE File = io_open(aFilename, IOFLAG_WRITE);
+	ASSERT_TRUE(File);
+	Profiler.StartTrace(File, 2);
+	EXPECT_TRUE(Profiler.Tracing());
+
+	for(int i = 0; i < 3; i++)
+	{
+		CProfiler::CScopeTimer Timer(&Profiler, Scope);
+		Profiler.NextFrame();
+	}
+	EXPECT_FALSE(Profiler.Tracing());
+
+	char *pTrace = fs_read_str(aFilename);
+	ASSERT_TRUE(pTrace);
+	EXPECT_TRUE(str_find(pTrace, "\"traceEvents\""));
+	EXPECT_TRUE(str_find(pTrace, "\"players\""));
+	EXPECT_TRUE(str_find(pTrace, "\"frame\""));
+	EXPECT_TRUE(str_find(pTrace, "\"draw calls\""));
+	EXPECT_EQ(pTrace[str_length(pTrace)-2], '}');
+	mem_free(pTrace);
+	fs_remove(aFilename);
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include <base/system.h>
+#include <engine/shared/soundmix.h>
+
+static const int NUM_VOICES = 64;
+static const unsigned NUM_FRAMES = 512;
+
+static void FillNoise(short *pData, int Num, unsigned Seed)
+{
+	for(int i = 0; i < Num; i++)
+	{
+		Seed = Seed*1103515245+12345;
+		pData[i] = (short)(Seed>>16);
+	}
+	// the extremes have to survive the multiplication as well
+	pData[0] = -0x8000;
+	pData[Num-1] = 0x7fff;
+}
+
+TEST(SoundMix, MatchesScalar)
+{
+	short aIn[NUM_FRAMES*2];
+	FillNoise(aIn, NUM_FRAMES*2, 1);
+
+	// odd frame counts exercise the scalar tails
+	const unsigned aFrames[] = {0, 1, 3, 7, 8, 13, NUM_FRAMES};
+	for(unsigned f = 0; f < sizeof(aFrames)/sizeof(aFrames[0]); f++)
+	{
+		for(int Channels = 1; Channels <= 2; Channels++)
+		{
+			int aMix[NUM_FRAMES*2] = {0};
+			int aRef[NUM_FRAMES*2] = {0};
+			for(int v = 0; v < NUM_VOICES; v++)
+			{
+				SoundMixVoice(aMix, aIn+v, Channels, aFrames[f], v*4, 255-v*4);
+				SoundMixVoiceScalar(aRef, aIn+v, Channels, aFrames[f], v*4, 255-v*4);
+			}
+			EXPECT_EQ(mem_comp(aMix, aRef, sizeof(aMix)), 0);
+
+			short aOut[NUM_FRAMES*2] = {0};
+			short aOutRef[NUM_FRAMES*2] = {0};
+			SoundMixOutput(aOut, aMix, aFrames[f], 100);
+			SoundMixOutputScalar(aOutRef, aRef, aFrames[f], 100);
+			EXPECT_EQ(mem_comp(aOut, aOutRef, sizeof(aOut)), 0);
+		}
+	}
+}
+
+TEST(SoundMix, Output)
+{
+	int aMix[8] = {0, 256*101, -256*101, 0x7fffffff, -0x7fffffff, 256*101*0x7fff, 256*101*-0x7fff, 256*101*3};
+	short aOut[8];
+	SoundMixOutput(aOut, aMix, 4, 100);
+	EXPECT_EQ(aOut[0], 0);
+	// the same as the integer scaling, give or take rounding
+	EXPECT_NEAR(aOut[1], 100, 1);
+	EXPECT_NEAR(aOut[2], -100, 1);
+	EXPECT_EQ(aOut[3], 0x7fff);
+	EXPECT_EQ(aOut[4], -0x7fff);
+	EXPECT_EQ(aOut[5], 0x7fff);
+	EXPECT_EQ(aOut[6], -0x7fff);
+	EXPECT_NEAR(aOut[7], 300, 1);
+}
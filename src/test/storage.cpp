@@ -39,3 +39,45 @@ TEST(Storage, FindFile)
 	EXPECT_FALSE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound), &WrongSha256, 0x3bb935c6, 5));
 	EXPECT_FALSE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound), &SHA256_ZEROED, 0x3bb935c6, 5));
 }
+
+static int FindFileCallback(const char *pName, int IsDir, int Type, void *pUser)
+{
+	const char **ppFilename = static_cast<const char **>(pUser);
+	if(!IsDir && !str_comp(pName, *ppFilename))
+	{
+		*ppFilename = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static bool ListContains(IStorage *pStorage, const char *pFilename)
+{
+	const char *pSearch = pFilename;
+	pStorage->ListDirectory(IStorage::TYPE_ALL, ".", FindFileCallback, &pSearch);
+	return pSearch == 0;
+}
+
+TEST(Storage, ListDirectoryCache)
+{
+	CTestInfo Info;
+	IStorage *pStorage = CreateTestStorage();
+	char aFound[128];
+
+	// fill the cache before the file exists
+	EXPECT_FALSE(ListContains(pStorage, Info.m_aFilename));
+	EXPECT_FALSE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound)));
+
+	IOHANDLE File = pStorage->OpenFile(Info.m_aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	ASSERT_TRUE(File);
+	EXPECT_FALSE(io_close(File));
+
+	EXPECT_TRUE(ListContains(pStorage, Info.m_aFilename));
+	EXPECT_TRUE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound)));
+
+	EXPECT_TRUE(pStorage->RemoveFile(Info.m_aFilename, IStorage::TYPE_SAVE));
+	EXPECT_FALSE(ListContains(pStorage, Info.m_aFilename));
+	EXPECT_FALSE(pStorage->FindFile(Info.m_aFilename, ".", IStorage::TYPE_ALL, aFound, sizeof(aFound)));
+
+	delete pStorage;
+}
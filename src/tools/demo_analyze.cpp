@@ -0,0 +1,453 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/array.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/jsonwriter.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include <game/version.h>
+#include <generated/protocol.h>
+
+#include "demo_delta.h"
+
+/*
+	Plays back server and client demos without a client as fast as the
+	files can be decoded and writes the character positions of every
+	tick, the kills and the flag events of each demo into a json file.
+	Demos are spread over several worker threads, each with its own
+	player, snapshot delta and storage.
+*/
+
+enum
+{
+	DEFAULT_NUM_THREADS=4,
+	MAX_THREADS=64,
+};
+
+static const char *s_apFlagEventNames[] = {"grab", "drop", "capture", "return"};
+
+class CDemoAnalyzer : public CDemoPlayer::IListener
+{
+	enum
+	{
+		FLAGEVENT_GRAB=0,
+		FLAGEVENT_DROP,
+		FLAGEVENT_CAPTURE,
+		FLAGEVENT_RETURN,
+	};
+
+	struct CKill
+	{
+		int m_Tick;
+		int m_Killer;
+		int m_Victim;
+		int m_Weapon;
+	};
+
+	struct CFlagEvent
+	{
+		int m_Tick;
+		int m_Team;
+		int m_Type;
+		int m_Player;
+	};
+
+	struct CPlayer
+	{
+		bool m_Active;
+		int m_Team;
+		char m_aName[MAX_NAME_LENGTH];
+	};
+
+	CSnapshotDelta m_SnapshotDelta;
+	CDemoPlayer *m_pPlayer;
+	CNetObjHandler m_NetObjHandler;
+	CJsonWriter *m_pWriter;
+
+	int m_LastSnapshotTick;
+	int m_NumTicks;
+	int m_aFlagCarrier[2];
+	CPlayer m_aPlayers[MAX_CLIENTS];
+	array<CKill> m_lKills;
+	array<CFlagEvent> m_lFlagEvents;
+
+	void OnFlagCarrier(int Team, int Carrier)
+	{
+		int Previous = m_aFlagCarrier[Team];
+		m_aFlagCarrier[Team] = Carrier;
+		if(Carrier == Previous || Previous == FLAG_MISSING)
+			return;
+
+		CFlagEvent Event;
+		Event.m_Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+		Event.m_Team = Team;
+		if(Carrier >= 0)
+		{
+			Event.m_Type = FLAGEVENT_GRAB;
+			Event.m_Player = Carrier;
+		}
+		else if(Carrier == FLAG_TAKEN && Previous >= 0)
+		{
+			Event.m_Type = FLAGEVENT_DROP;
+			Event.m_Player = Previous;
+		}
+		else if(Carrier == FLAG_ATSTAND && Previous >= 0)
+		{
+			Event.m_Type = FLAGEVENT_CAPTURE;
+			Event.m_Player = Previous;
+		}
+		else if(Carrier == FLAG_ATSTAND && Previous == FLAG_TAKEN)
+		{
+			Event.m_Type = FLAGEVENT_RETURN;
+			Event.m_Player = -1;
+		}
+		else
+			return;
+		m_lFlagEvents.add(Event);
+	}
+
+	void WriteCharacter(int ClientID, const CNetObj_Character *pCharacter)
+	{
+		m_pWriter->BeginObject();
+		m_pWriter->WriteAttribute("id");
+		m_pWriter->WriteIntValue(ClientID);
+		m_pWriter->WriteAttribute("x");
+		m_pWriter->WriteIntValue(pCharacter->m_X);
+		m_pWriter->WriteAttribute("y");
+		m_pWriter->WriteIntValue(pCharacter->m_Y);
+		m_pWriter->WriteAttribute("weapon");
+		m_pWriter->WriteIntValue(pCharacter->m_Weapon);
+		m_pWriter->WriteAttribute("health");
+		m_pWriter->WriteIntValue(pCharacter->m_Health);
+		m_pWriter->WriteAttribute("armor");
+		m_pWriter->WriteIntValue(pCharacter->m_Armor);
+		m_pWriter->EndObject();
+	}
+
+	void WriteSummary()
+	{
+		m_pWriter->WriteAttribute("num_ticks");
+		m_pWriter->WriteIntValue(m_NumTicks);
+
+		m_pWriter->WriteAttribute("players");
+		m_pWriter->BeginArray();
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			if(!m_aPlayers[i].m_Active)
+				continue;
+			m_pWriter->BeginObject();
+			m_pWriter->WriteAttribute("id");
+			m_pWriter->WriteIntValue(i);
+			m_pWriter->WriteAttribute("name");
+			m_pWriter->WriteStrValue(m_aPlayers[i].m_aName);
+			m_pWriter->WriteAttribute("team");
+			m_pWriter->WriteIntValue(m_aPlayers[i].m_Team);
+			m_pWriter->EndObject();
+		}
+		m_pWriter->EndArray();
+
+		m_pWriter->WriteAttribute("kills");
+		m_pWriter->BeginArray();
+		for(int i = 0; i < m_lKills.size(); i++)
+		{
+			m_pWriter->BeginObject();
+			m_pWriter->WriteAttribute("tick");
+			m_pWriter->WriteIntValue(m_lKills[i].m_Tick);
+			m_pWriter->WriteAttribute("killer");
+			m_pWriter->WriteIntValue(m_lKills[i].m_Killer);
+			m_pWriter->WriteAttribute("victim");
+			m_pWriter->WriteIntValue(m_lKills[i].m_Victim);
+			m_pWriter->WriteAttribute("weapon");
+			m_pWriter->WriteIntValue(m_lKills[i].m_Weapon);
+			m_pWriter->EndObject();
+		}
+		m_pWriter->EndArray();
+
+		m_pWriter->WriteAttribute("flags");
+		m_pWriter->BeginArray();
+		for(int i = 0; i < m_lFlagEvents.size(); i++)
+		{
+			m_pWriter->BeginObject();
+			m_pWriter->WriteAttribute("tick");
+			m_pWriter->WriteIntValue(m_lFlagEvents[i].m_Tick);
+			m_pWriter->WriteAttribute("team");
+			m_pWriter->WriteStrValue(m_lFlagEvents[i].m_Team == TEAM_RED ? "red" : "blue");
+			m_pWriter->WriteAttribute("event");
+			m_pWriter->WriteStrValue(s_apFlagEventNames[m_lFlagEvents[i].m_Type]);
+			m_pWriter->WriteAttribute("player");
+			m_pWriter->WriteIntValue(m_lFlagEvents[i].m_Player);
+			m_pWriter->EndObject();
+		}
+		m_pWriter->EndArray();
+	}
+
+public:
+	CDemoAnalyzer()
+	{
+		m_pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+		m_pPlayer->SetListener(this);
+		m_pWriter = 0;
+		SetDemoStaticSizes(&m_SnapshotDelta);
+	}
+
+	~CDemoAnalyzer()
+	{
+		delete m_pPlayer;
+	}
+
+	bool Analyze(IStorage *pStorage, IConsole *pConsole, const char *pFilename, const char *pOutputDir)
+	{
+		const char *pError = m_pPlayer->Load(pStorage, pConsole, pFilename, IStorage::TYPE_ALL, GAME_NETVERSION);
+		if(pError)
+		{
+			dbg_msg("demo_analyze", "failed to load '%s': %s", pFilename, pError);
+			return false;
+		}
+
+		char aName[128];
+		char aOutputFilename[IO_MAX_PATH_LENGTH];
+		m_pPlayer->GetDemoName(aName, sizeof(aName));
+		str_format(aOutputFilename, sizeof(aOutputFilename), "%s/%s.json", pOutputDir, aName);
+		IOHANDLE File = io_open(aOutputFilename, IOFLAG_WRITE);
+		if(!File)
+		{
+			dbg_msg("demo_analyze", "failed to open '%s' for writing", aOutputFilename);
+			m_pPlayer->Stop();
+			return false;
+		}
+
+		m_LastSnapshotTick = -1;
+		m_NumTicks = 0;
+		m_aFlagCarrier[TEAM_RED] = FLAG_MISSING;
+		m_aFlagCarrier[TEAM_BLUE] = FLAG_MISSING;
+		mem_zero(m_aPlayers, sizeof(m_aPlayers));
+		m_lKills.clear();
+		m_lFlagEvents.clear();
+
+		const CDemoHeader *pHeader = &m_pPlayer->Info()->m_Header;
+		m_pWriter = new CJsonWriter(File);
+		m_pWriter->BeginObject();
+		m_pWriter->WriteAttribute("demo");
+		m_pWriter->WriteStrValue(pFilename);
+		m_pWriter->WriteAttribute("map");
+		m_pWriter->WriteStrValue(pHeader->m_aMapName);
+		m_pWriter->WriteAttribute("type");
+		m_pWriter->WriteStrValue(pHeader->m_aType);
+		m_pWriter->WriteAttribute("first_tick");
+		m_pWriter->WriteIntValue(m_pPlayer->BaseInfo()->m_FirstTick);
+		m_pWriter->WriteAttribute("last_tick");
+		m_pWriter->WriteIntValue(m_pPlayer->BaseInfo()->m_LastTick);
+
+		// ticks are streamed out while decoding, everything else is collected
+		m_pWriter->WriteAttribute("ticks");
+		m_pWriter->BeginArray();
+		m_pPlayer->Play();
+		while(m_pPlayer->IsPlaying() && !m_pPlayer->BaseInfo()->m_Paused)
+			m_pPlayer->NextFrame();
+		m_pPlayer->Stop();
+		m_pWriter->EndArray();
+
+		WriteSummary();
+		m_pWriter->EndObject();
+		delete m_pWriter;
+		m_pWriter = 0;
+		return true;
+	}
+
+	void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		// a tick without a new snapshot repeats the previous one
+		int Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+		if(Tick == m_LastSnapshotTick)
+			return;
+		m_LastSnapshotTick = Tick;
+		m_NumTicks++;
+
+		m_pWriter->BeginObject();
+		m_pWriter->WriteAttribute("tick");
+		m_pWriter->WriteIntValue(Tick);
+		m_pWriter->WriteAttribute("characters");
+		m_pWriter->BeginArray();
+
+		const CSnapshot *pSnap = (const CSnapshot *)pData;
+		for(int i = 0; i < pSnap->NumItems(); i++)
+		{
+			const CSnapshotItem *pItem = pSnap->GetItem(i);
+			int ItemSize = pSnap->GetItemSize(i);
+			if(m_NetObjHandler.ValidateObj(pItem->Type(), pItem->Data(), ItemSize) != 0)
+				continue;
+
+			if(pItem->Type() == NETOBJTYPE_CHARACTER && pItem->ID() >= 0 && pItem->ID() < MAX_CLIENTS)
+				WriteCharacter(pItem->ID(), (const CNetObj_Character *)pItem->Data());
+			else if(pItem->Type() == NETOBJTYPE_GAMEDATAFLAG)
+			{
+				const CNetObj_GameDataFlag *pFlags = (const CNetObj_GameDataFlag *)pItem->Data();
+				OnFlagCarrier(TEAM_RED, pFlags->m_FlagCarrierRed);
+				OnFlagCarrier(TEAM_BLUE, pFlags->m_FlagCarrierBlue);
+			}
+		}
+
+		m_pWriter->EndArray();
+		m_pWriter->EndObject();
+	}
+
+	void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		CUnpacker Unpacker;
+		Unpacker.Reset(pData, Size);
+
+		// unpack msgid and system flag
+		int Msg = Unpacker.GetInt();
+		int Sys = Msg&1;
+		Msg >>= 1;
+		if(Unpacker.Error() || Sys)
+			return;
+
+		void *pRawMsg = m_NetObjHandler.SecureUnpackMsg(Msg, &Unpacker);
+		if(!pRawMsg)
+			return;
+
+		if(Msg == NETMSGTYPE_SV_KILLMSG)
+		{
+			const CNetMsg_Sv_KillMsg *pMsg = (const CNetMsg_Sv_KillMsg *)pRawMsg;
+			CKill Kill;
+			Kill.m_Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+			Kill.m_Killer = pMsg->m_Killer;
+			Kill.m_Victim = pMsg->m_Victim;
+			Kill.m_Weapon = pMsg->m_Weapon;
+			m_lKills.add(Kill);
+		}
+		else if(Msg == NETMSGTYPE_SV_CLIENTINFO)
+		{
+			const CNetMsg_Sv_ClientInfo *pMsg = (const CNetMsg_Sv_ClientInfo *)pRawMsg;
+			if(pMsg->m_ClientID < 0 || pMsg->m_ClientID >= MAX_CLIENTS)
+				return;
+			CPlayer *pPlayer = &m_aPlayers[pMsg->m_ClientID];
+			pPlayer->m_Active = true;
+			pPlayer->m_Team = pMsg->m_Team;
+			str_copy(pPlayer->m_aName, pMsg->m_pName, sizeof(pPlayer->m_aName));
+		}
+		else if(Msg == NETMSGTYPE_SV_CLIENTDROP)
+		{
+			const CNetMsg_Sv_ClientDrop *pMsg = (const CNetMsg_Sv_ClientDrop *)pRawMsg;
+			if(pMsg->m_ClientID >= 0 && pMsg->m_ClientID < MAX_CLIENTS)
+				m_aPlayers[pMsg->m_ClientID].m_Active = false;
+		}
+	}
+};
+
+struct CJobs
+{
+	LOCK m_Lock;
+	const char **m_ppFilenames;
+	int m_NumFiles;
+	int m_NextFile;
+	int m_NumAnalyzed;
+	const char *m_pOutputDir;
+};
+
+struct CWorker
+{
+	CJobs *m_pJobs;
+	IStorage *m_pStorage;
+	IConsole *m_pConsole;
+	void *m_pThread;
+};
+
+static void WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+	CJobs *pJobs = pWorker->m_pJobs;
+	CDemoAnalyzer *pAnalyzer = new CDemoAnalyzer();
+
+	while(1)
+	{
+		lock_wait(pJobs->m_Lock);
+		int File = pJobs->m_NextFile++;
+		lock_unlock(pJobs->m_Lock);
+		if(File >= pJobs->m_NumFiles)
+			break;
+
+		if(pAnalyzer->Analyze(pWorker->m_pStorage, pWorker->m_pConsole, pJobs->m_ppFilenames[File], pJobs->m_pOutputDir))
+		{
+			lock_wait(pJobs->m_Lock);
+			pJobs->m_NumAnalyzed++;
+			lock_unlock(pJobs->m_Lock);
+		}
+	}
+
+	delete pAnalyzer;
+}
+
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+
+	int NumThreads = DEFAULT_NUM_THREADS;
+	const char *pOutputDir = ".";
+	int FirstFile = 1;
+	while(FirstFile < argc && argv[FirstFile][0] == '-')
+	{
+		if(!str_comp(argv[FirstFile], "-j") && FirstFile+1 < argc)
+			NumThreads = clamp(str_toint(argv[FirstFile+1]), 1, (int)MAX_THREADS);
+		else if(!str_comp(argv[FirstFile], "-o") && FirstFile+1 < argc)
+			pOutputDir = argv[FirstFile+1];
+		else
+			break;
+		FirstFile += 2;
+	}
+
+	if(FirstFile >= argc)
+	{
+		dbg_msg("usage", "%s [-j threads] [-o outdir] <demos...>", argv[0]);
+		dbg_msg("usage", "demo paths are relative to the storage directories");
+		return -1;
+	}
+
+	CJobs Jobs;
+	Jobs.m_Lock = lock_create();
+	Jobs.m_ppFilenames = &argv[FirstFile];
+	Jobs.m_NumFiles = argc-FirstFile;
+	Jobs.m_NextFile = 0;
+	Jobs.m_NumAnalyzed = 0;
+	Jobs.m_pOutputDir = pOutputDir;
+	NumThreads = min(NumThreads, Jobs.m_NumFiles);
+
+	// storages and consoles keep caches, so don't share them between threads
+	CWorker aWorkers[MAX_THREADS];
+	for(int i = 0; i < NumThreads; i++)
+	{
+		aWorkers[i].m_pJobs = &Jobs;
+		aWorkers[i].m_pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
+		aWorkers[i].m_pConsole = CreateConsole(CFGFLAG_SERVER);
+		if(!aWorkers[i].m_pStorage)
+		{
+			dbg_msg("demo_analyze", "failed to initialize storage");
+			return -1;
+		}
+	}
+
+	int64 StartTime = time_get();
+	for(int i = 0; i < NumThreads; i++)
+		aWorkers[i].m_pThread = thread_init(WorkerThread, &aWorkers[i]);
+	for(int i = 0; i < NumThreads; i++)
+	{
+		thread_wait(aWorkers[i].m_pThread);
+		thread_destroy(aWorkers[i].m_pThread);
+		delete aWorkers[i].m_pConsole;
+		delete aWorkers[i].m_pStorage;
+	}
+	float Duration = (time_get()-StartTime)/(float)time_freq();
+	lock_destroy(Jobs.m_Lock);
+
+	dbg_msg("demo_analyze", "analyzed %d of %d demos in %.2fs (%.1f demos/s, %d threads)", Jobs.m_NumAnalyzed, Jobs.m_NumFiles,
+		Duration, Jobs.m_NumAnalyzed/max(Duration, 0.001f), NumThreads);
+	return Jobs.m_NumAnalyzed == Jobs.m_NumFiles ? 0 : 1;
+}
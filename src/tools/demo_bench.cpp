@@ -0,0 +1,204 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include "demo_delta.h"
+
+/*
+	Re-encodes demos with different keyframe settings and reports the
+	resulting file size next to the time it takes to seek in them, to
+	pick a good demo_keyframe_interval and demo_keyframe_deltas.
+*/
+
+enum
+{
+	NUM_SEEKS=20,
+};
+
+static const int s_aKeyFrameIntervals[] = {SERVER_TICK_SPEED/2, SERVER_TICK_SPEED, SERVER_TICK_SPEED*2, SERVER_TICK_SPEED*5, SERVER_TICK_SPEED*10};
+static const char s_aTmpFilename[] = "demo_bench.tmp";
+
+class CRecoder : public CDemoPlayer::IListener
+{
+	CDemoPlayer *m_pPlayer;
+	CDemoRecorder *m_pRecorder;
+	int m_LastTick;
+
+public:
+	CRecoder(CDemoPlayer *pPlayer, CDemoRecorder *pRecorder) : m_pPlayer(pPlayer), m_pRecorder(pRecorder), m_LastTick(-1) {}
+
+	void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		int Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+		if(Tick == m_LastTick)
+			return;
+		m_LastTick = Tick;
+		m_pRecorder->RecordSnapshot(Tick, pData, Size);
+	}
+
+	void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		m_pRecorder->RecordMessage(pData, Size);
+	}
+};
+
+static long FileLength(IStorage *pStorage, const char *pFilename, int StorageType)
+{
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
+	if(!File)
+		return 0;
+	long Length = io_length(File);
+	io_close(File);
+	return Length;
+}
+
+static bool MapSha256(IStorage *pStorage, const CDemoHeader *pHeader, SHA256_DIGEST *pSha256)
+{
+	// loading the demo extracted the map
+	char aMapFilename[128];
+	str_format(aMapFilename, sizeof(aMapFilename), "downloadedmaps/%s_%08x.map", pHeader->m_aMapName, bytes_be_to_uint(pHeader->m_aMapCrc));
+	IOHANDLE File = pStorage->OpenFile(aMapFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+		return false;
+	void *pData;
+	unsigned Size;
+	io_read_all(File, &pData, &Size);
+	io_close(File);
+	*pSha256 = sha256(pData, Size);
+	mem_free(pData);
+	return true;
+}
+
+static CSnapshotDelta *CreateSnapshotDelta()
+{
+	CSnapshotDelta *pSnapshotDelta = new CSnapshotDelta();
+	SetDemoStaticSizes(pSnapshotDelta);
+	return pSnapshotDelta;
+}
+
+// plays the whole demo into the recorder, returns the time it took in ms
+static float Recode(IStorage *pStorage, IConsole *pConsole, CSnapshotDelta *pSnapshotDelta, CSnapshotDelta *pRecorderDelta, const char *pFilename,
+	const CDemoHeader *pHeader, SHA256_DIGEST MapSha256, int Interval, bool DeltaAgainstKeyFrame)
+{
+	// the recorder compresses on its own thread, so it gets its own delta
+	CDemoRecorder *pRecorder = new CDemoRecorder(pRecorderDelta);
+	CDemoPlayer *pPlayer = new CDemoPlayer(pSnapshotDelta);
+	CRecoder Recoder(pPlayer, pRecorder);
+	pPlayer->SetListener(&Recoder);
+	pRecorder->SetKeyFrameMode(Interval, DeltaAgainstKeyFrame);
+	pRecorder->SetWaitForWriter(true);
+
+	float Duration = -1.0f;
+	if(!pPlayer->Load(pStorage, pConsole, pFilename, IStorage::TYPE_ALL, pHeader->m_aNetversion) &&
+		pRecorder->Start(pStorage, pConsole, s_aTmpFilename, pHeader->m_aNetversion, pHeader->m_aMapName, MapSha256,
+			bytes_be_to_uint(pHeader->m_aMapCrc), pHeader->m_aType) == 0)
+	{
+		int64 StartTime = time_get();
+		pPlayer->Play();
+		while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+			pPlayer->NextFrame();
+		pRecorder->Stop();
+		Duration = (time_get()-StartTime)*1000.0f/time_freq();
+	}
+
+	pPlayer->Stop();
+	delete pPlayer;
+	delete pRecorder;
+	return Duration;
+}
+
+// seeks to evenly spread positions, returns the average and worst seek time in ms
+static bool MeasureSeeks(IStorage *pStorage, IConsole *pConsole, CSnapshotDelta *pSnapshotDelta, const char *pNetversion, float *pAverage, float *pWorst)
+{
+	CDemoPlayer *pPlayer = new CDemoPlayer(pSnapshotDelta);
+	bool Loaded = !pPlayer->Load(pStorage, pConsole, s_aTmpFilename, IStorage::TYPE_SAVE, pNetversion);
+	*pAverage = 0.0f;
+	*pWorst = 0.0f;
+	for(int i = 0; Loaded && i < NUM_SEEKS; i++)
+	{
+		// jump back and forth so every seek starts elsewhere
+		float Percent = (i%2 ? i : NUM_SEEKS-i)/(float)NUM_SEEKS;
+		int64 StartTime = time_get();
+		pPlayer->SetPos(Percent);
+		float Duration = (time_get()-StartTime)*1000.0f/time_freq();
+		*pAverage += Duration/NUM_SEEKS;
+		*pWorst = max(*pWorst, Duration);
+	}
+	pPlayer->Stop();
+	delete pPlayer;
+	return Loaded;
+}
+
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+	if(argc < 2)
+	{
+		dbg_msg("usage", "%s <demos...>", argv[0]);
+		dbg_msg("usage", "demo paths are relative to the storage directories");
+		return -1;
+	}
+
+	IStorage *pStorage = CreateStorage("Teeworlds", IStorage::STORAGETYPE_BASIC, argc, argv);
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	if(!pStorage)
+		return -1;
+	pStorage->CreateFolder("downloadedmaps", IStorage::TYPE_SAVE);
+
+	CSnapshotDelta *pSnapshotDelta = CreateSnapshotDelta();
+	CSnapshotDelta *pRecorderDelta = CreateSnapshotDelta();
+	CDemoPlayer *pInfoPlayer = new CDemoPlayer(pSnapshotDelta);
+	for(int d = 1; d < argc; d++)
+	{
+		const char *pFilename = argv[d];
+		CDemoHeader Header;
+		if(!pInfoPlayer->GetDemoInfo(pStorage, pFilename, IStorage::TYPE_ALL, &Header) ||
+			pInfoPlayer->Load(pStorage, pConsole, pFilename, IStorage::TYPE_ALL, Header.m_aNetversion))
+		{
+			dbg_msg("demo_bench", "failed to load '%s'", pFilename);
+			continue;
+		}
+		pInfoPlayer->Stop();
+
+		SHA256_DIGEST Sha256;
+		if(!MapSha256(pStorage, &Header, &Sha256))
+		{
+			dbg_msg("demo_bench", "failed to find the map of '%s'", pFilename);
+			continue;
+		}
+
+		dbg_msg("demo_bench", "%s: %ld bytes, map %s", pFilename, FileLength(pStorage, pFilename, IStorage::TYPE_ALL), Header.m_aMapName);
+		dbg_msg("demo_bench", "%8s %10s %12s %10s %12s %12s", "interval", "deltas", "size", "recode ms", "avg seek ms", "max seek ms");
+		for(unsigned i = 0; i < sizeof(s_aKeyFrameIntervals)/sizeof(s_aKeyFrameIntervals[0]); i++)
+		{
+			for(int Mode = 0; Mode < 2; Mode++)
+			{
+				float RecodeTime = Recode(pStorage, pConsole, pSnapshotDelta, pRecorderDelta, pFilename, &Header, Sha256, s_aKeyFrameIntervals[i], Mode == 1);
+				float AverageSeek, WorstSeek;
+				if(RecodeTime < 0.0f || !MeasureSeeks(pStorage, pConsole, pSnapshotDelta, Header.m_aNetversion, &AverageSeek, &WorstSeek))
+				{
+					dbg_msg("demo_bench", "failed to recode '%s'", pFilename);
+					continue;
+				}
+				dbg_msg("demo_bench", "%8d %10s %12ld %10.1f %12.2f %12.2f", s_aKeyFrameIntervals[i], Mode == 1 ? "keyframe" : "previous",
+					FileLength(pStorage, s_aTmpFilename, IStorage::TYPE_SAVE), RecodeTime, AverageSeek, WorstSeek);
+			}
+		}
+	}
+
+	pStorage->RemoveFile(s_aTmpFilename, IStorage::TYPE_SAVE);
+	delete pInfoPlayer;
+	delete pRecorderDelta;
+	delete pSnapshotDelta;
+	delete pConsole;
+	delete pStorage;
+	return 0;
+}
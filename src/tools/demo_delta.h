@@ -0,0 +1,19 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef TOOLS_DEMO_DELTA_H
+#define TOOLS_DEMO_DELTA_H
+
+#include <engine/shared/snapshot.h>
+
+#include <generated/protocol.h>
+
+// the snapshot delta layout of demos is fixed to the item sizes of the old protocol, like the client and server set it
+inline void SetDemoStaticSizes(CSnapshotDelta *pSnapshotDelta)
+{
+	static const int OLD_NUM_NETOBJTYPES = 23;
+	CNetObjHandler NetObjHandler;
+	for(int i = 0; i < OLD_NUM_NETOBJTYPES; i++)
+		pSnapshotDelta->SetStaticsize(i, NetObjHandler.GetObjSize(i));
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/shared/soundmix.h>
+
+/*
+	Compares the vectorized sound mixing kernels with the scalar ones,
+	with every voice playing and half of them mono.
+*/
+
+enum
+{
+	NUM_VOICES=64,
+	NUM_FRAMES=512,
+	NUM_BUFFERS=2000,
+};
+
+static void FillNoise(short *pData, int Num)
+{
+	unsigned Seed = 2;
+	for(int i = 0; i < Num; i++)
+	{
+		Seed = Seed*1103515245+12345;
+		pData[i] = (short)(Seed>>16);
+	}
+}
+
+// mixes NUM_BUFFERS buffers, returns the time per buffer in microseconds
+static float MixBuffers(const short *pIn, bool Scalar)
+{
+	static int s_aMix[NUM_FRAMES*2];
+	static short s_aOut[NUM_FRAMES*2];
+	int64 Start = time_get();
+	for(int b = 0; b < NUM_BUFFERS; b++)
+	{
+		mem_zero(s_aMix, sizeof(s_aMix));
+		for(int v = 0; v < NUM_VOICES; v++)
+		{
+			const short *pVoice = pIn+v*NUM_FRAMES*2;
+			if(Scalar)
+				SoundMixVoiceScalar(s_aMix, pVoice, 1+v%2, NUM_FRAMES, 128, 200);
+			else
+				SoundMixVoice(s_aMix, pVoice, 1+v%2, NUM_FRAMES, 128, 200);
+		}
+		if(Scalar)
+			SoundMixOutputScalar(s_aOut, s_aMix, NUM_FRAMES, 100);
+		else
+			SoundMixOutput(s_aOut, s_aMix, NUM_FRAMES, 100);
+	}
+	return (time_get()-Start)*1000000.0f/time_freq()/NUM_BUFFERS;
+}
+
+int main(int argc, const char **argv)
+{
+	dbg_logger_stdout();
+
+	short *pIn = (short *)mem_alloc(NUM_VOICES*NUM_FRAMES*2*sizeof(short), 1);
+	FillNoise(pIn, NUM_VOICES*NUM_FRAMES*2);
+
+	// warm up the caches before measuring
+	MixBuffers(pIn, false);
+	float Time = MixBuffers(pIn, false);
+	float ScalarTime = MixBuffers(pIn, true);
+	mem_free(pIn);
+
+	dbg_msg("soundmix_bench", "%d voices, %d frames: %s %.2fus per buffer, scalar %.2fus per buffer",
+		NUM_VOICES, NUM_FRAMES, SoundMixKernelName(), Time, ScalarTime);
+	return 0;
+}